@@ -1,7 +1,322 @@
-﻿#include <iostream>
+﻿#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "src/BatchExecutor.h"
+#include "src/actions/JsonUnserializer.h"
+#include "src/actions/Decompress/DecompressionLimits.h"
+#if defined(HAVE_ZSTD)
+#include "src/actions/Decompress/ZstdDecoder.h"
+#endif
+#include "src/actions/Load/BundleArchive.h"
+#include "src/actions/Load/FileChunkStream.h"
+#include "src/actions/Load/FileReader.h"
+#include "src/net/HttpCache.h"
+#include "src/net/HttpClient.h"
+#include "src/net/RangedDownload.h"
 
-int main()
+namespace {
+
+    // Parses the whole of `text` as a non-negative number into `value`, returns false if it is not one or does
+    // not fit.
+    template <typename T>
+    bool parseNumber(const char* text, T& value)
+    {
+        const char* end = text + std::strlen(text);
+        T parsed{};
+        const auto [last, error] = std::from_chars(text, end, parsed);
+        if (error != std::errc() || last != end || !(parsed >= 0))
+        {
+            return false;
+        }
+        value = parsed;
+        return true;
+    }
+
+    void printUsage(const char* program)
+    {
+        std::cerr << "usage: " << program << " [--input FILE] [--jobs N] [--output DIR] [--mmap-threshold BYTES]\n"
+                  << "       [--io-batch N] [--stream-threshold BYTES] [--http-async] [--max-in-flight N]\n"
+                  << "       [--range-chunk BYTES] [--range-parallelism N] [--max-body-bytes BYTES]\n"
+                  << "       [--http-cache DIR] [--http-cache-size BYTES]\n"
+                  << "       [--hedge] [--hedge-budget FRACTION] [--retries N] [--bundle FILE]...\n"
+                  << "       [--prefetch N] [--prefetch-bytes BYTES] [--manifest-pointer POINTER]...\n"
+                  << "       [--max-decoded-bytes BYTES] [--max-ratio RATIO] [--zstd-dictionary FILE]...\n"
+                  << "  --input FILE  read URIs from FILE, one per line (default: stdin)\n"
+                  << "  --jobs N      number of URIs processed in parallel (default: hardware threads)\n"
+                  << "  --output DIR  write every result payload into DIR\n"
+                  << "  --mmap-threshold BYTES  memory map local files from this size on (default: "
+                  << FileReader::DefaultMmapThreshold << ")\n"
+                  << "  --io-batch N  load local files N at a time with one batched submission (default: 1)\n"
+                  << "  --stream-threshold BYTES  stream local files in chunks from this size on (default: "
+                  << FileChunkStream::DefaultStreamingThreshold << ")\n"
+                  << "  --http-async  download http(s) URIs on a non-blocking event loop\n"
+                  << "  --max-in-flight N  maximum concurrent asynchronous downloads, also caps hedged requests (default: 1024)\n"
+                  << "  --range-chunk BYTES  download large bodies in ranges of BYTES (default: "
+                  << RangedDownload::Options{}.chunkSize << ")\n"
+                  << "  --range-parallelism N  concurrent ranges per download, 1 disables ranges (default: "
+                  << RangedDownload::Options{}.parallelism << ")\n"
+                  << "  --max-body-bytes BYTES  maximum size of a downloaded body, 0 for none (default: "
+                  << HttpRequest::defaultMaxBodySize() << ")\n"
+                  << "  --http-cache DIR  cache http(s) responses in DIR and revalidate them when stale\n"
+                  << "  --http-cache-size BYTES  maximum size of the cached bodies (default: "
+                  << HttpCache::Options{}.maxBytes << ")\n"
+                  << "  --hedge  duplicate requests slower than the host's p95 and adapt timeouts per host\n"
+                  << "  --hedge-budget FRACTION  maximum share of hedged requests (default: "
+                  << HttpClient::Options{}.hedgeBudget << ")\n"
+                  << "  --retries N  retries of hedged requests that time out or fail (default: "
+                  << HttpClient::Options{}.retries << ")\n"
+                  << "  --bundle FILE  mount a bundle, bundle:// URIs are resolved in mount order\n"
+                  << "  --prefetch N  load up to N items ahead of their processing on dedicated threads (default: 0, off)\n"
+                  << "  --prefetch-bytes BYTES  maximum loaded bytes waiting for processing (default: "
+                  << BatchExecutor::Options{}.prefetchBytes << ")\n"
+                  << "  --manifest-pointer POINTER  JSON pointer of the URIs a JSON document references, '*' matching\n"
+                  << "                     any member or element; the referenced URIs are executed concurrently\n"
+                  << "  --max-decoded-bytes BYTES  maximum decoded size of a compressed payload, 0 for none (default: "
+                  << DecompressionLimits{}.maxOutputBytes << ")\n"
+                  << "  --max-ratio RATIO  maximum ratio of decoded to compressed bytes, 0 for none (default: "
+                  << DecompressionLimits{}.maxRatio << ")\n"
+                  << "  --zstd-dictionary FILE  load a zstd dictionary, zstd payloads naming its ID are decoded with it"
+                  << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
 {
-    ActionResult result = ComputePipeline::execute("uri");
-}
\ No newline at end of file
+    std::string inputPath;
+    BatchExecutor::Options options;
+    HttpCache::Options cacheOptions;
+    std::vector<std::string> bundles;
+    std::vector<std::string> dictionaries;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        bool valid = true;
+        if (argument == "--input" && hasValue)
+        {
+            inputPath = argv[++i];
+        }
+        else if (argument == "--jobs" && hasValue)
+        {
+            valid = parseNumber(argv[++i], options.parallelism);
+        }
+        else if (argument == "--output" && hasValue)
+        {
+            options.outputDirectory = argv[++i];
+        }
+        else if (argument == "--io-batch" && hasValue)
+        {
+            valid = parseNumber(argv[++i], options.ioBatch);
+        }
+        else if (argument == "--http-async")
+        {
+            options.asyncHttp = true;
+        }
+        else if (argument == "--max-in-flight" && hasValue)
+        {
+            valid = parseNumber(argv[++i], options.maxInFlight);
+        }
+        else if (argument == "--range-chunk" && hasValue)
+        {
+            RangedDownload::Options ranges = RangedDownload::defaults();
+            valid = parseNumber(argv[++i], ranges.chunkSize);
+            if (valid)
+            {
+                RangedDownload::setDefaults(ranges);
+            }
+        }
+        else if (argument == "--range-parallelism" && hasValue)
+        {
+            RangedDownload::Options ranges = RangedDownload::defaults();
+            valid = parseNumber(argv[++i], ranges.parallelism);
+            if (valid)
+            {
+                RangedDownload::setDefaults(ranges);
+            }
+        }
+        else if (argument == "--max-body-bytes" && hasValue)
+        {
+            std::size_t bytes = 0;
+            valid = parseNumber(argv[++i], bytes);
+            if (valid)
+            {
+                HttpRequest::setDefaultMaxBodySize(bytes);
+            }
+        }
+        else if (argument == "--http-cache" && hasValue)
+        {
+            cacheOptions.directory = argv[++i];
+        }
+        else if (argument == "--http-cache-size" && hasValue)
+        {
+            valid = parseNumber(argv[++i], cacheOptions.maxBytes);
+        }
+        else if (argument == "--hedge")
+        {
+            HttpClient::sharedOptions().hedge = true;
+        }
+        else if (argument == "--hedge-budget" && hasValue)
+        {
+            valid = parseNumber(argv[++i], HttpClient::sharedOptions().hedgeBudget);
+        }
+        else if (argument == "--retries" && hasValue)
+        {
+            valid = parseNumber(argv[++i], HttpClient::sharedOptions().retries);
+        }
+        else if (argument == "--prefetch" && hasValue)
+        {
+            valid = parseNumber(argv[++i], options.prefetchItems);
+        }
+        else if (argument == "--prefetch-bytes" && hasValue)
+        {
+            valid = parseNumber(argv[++i], options.prefetchBytes);
+        }
+        else if (argument == "--manifest-pointer" && hasValue)
+        {
+            try
+            {
+                JsonUnserializer::manifestPointers().push_back(JsonPointer::parse(argv[++i]));
+            }
+            catch (const std::invalid_argument& e)
+            {
+                std::cerr << e.what() << std::endl;
+                return 2;
+            }
+        }
+        else if (argument == "--bundle" && hasValue)
+        {
+            bundles.emplace_back(argv[++i]);
+        }
+        else if (argument == "--zstd-dictionary" && hasValue)
+        {
+            dictionaries.emplace_back(argv[++i]);
+        }
+        else if (argument == "--max-decoded-bytes" && hasValue)
+        {
+            valid = parseNumber(argv[++i], DecompressionLimits::shared().maxOutputBytes);
+        }
+        else if (argument == "--max-ratio" && hasValue)
+        {
+            valid = parseNumber(argv[++i], DecompressionLimits::shared().maxRatio);
+        }
+        else if (argument == "--stream-threshold" && hasValue)
+        {
+            std::size_t bytes = 0;
+            valid = parseNumber(argv[++i], bytes);
+            if (valid)
+            {
+                FileChunkStream::setStreamingThreshold(bytes);
+            }
+        }
+        else if (argument == "--mmap-threshold" && hasValue)
+        {
+            std::size_t bytes = 0;
+            valid = parseNumber(argv[++i], bytes);
+            if (valid)
+            {
+                FileReader::setMmapThreshold(bytes);
+            }
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 2;
+        }
+
+        if (!valid)
+        {
+            std::cerr << "invalid value for " << argument << ": " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    // Blocking requests come from the workers and their range lanes, capped by --max-in-flight.
+    const std::size_t jobs = options.parallelism != 0 ? options.parallelism
+                                                      : std::max(1u, std::thread::hardware_concurrency());
+    HttpClient::sharedOptions().concurrentRequests = std::max<std::size_t>(
+        1, std::min(options.maxInFlight, jobs * std::max<std::size_t>(1, RangedDownload::defaults().parallelism)));
+
+    if (!cacheOptions.directory.empty())
+    {
+        try
+        {
+            HttpCache::shared().configure(cacheOptions);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to open http cache: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    for (const std::string& dictionary : dictionaries)
+    {
+#if defined(HAVE_ZSTD)
+        try
+        {
+            ZstdDecoder::loadDictionary(dictionary);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to load zstd dictionary: " << e.what() << std::endl;
+            return 1;
+        }
+#else
+        std::cerr << "Unable to load zstd dictionary " << dictionary << ": zstd support is not compiled in" << std::endl;
+        return 1;
+#endif
+    }
+
+    for (const std::string& bundle : bundles)
+    {
+        try
+        {
+            BundleArchive::mount(bundle);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to mount bundle: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::ifstream file;
+    if (!inputPath.empty())
+    {
+        file.open(inputPath);
+        if (!file)
+        {
+            std::cerr << "Unable to open input file: " << inputPath << std::endl;
+            return 1;
+        }
+    }
+    std::istream& input = inputPath.empty() ? std::cin : file;
+
+    const BatchExecutor executor(options);
+    const BatchExecutor::Report report = executor.run(BatchExecutor::expandGlobs([&input](std::string& uri) {
+        while (std::getline(input, uri))
+        {
+            if (!uri.empty() && uri.back() == '\r')
+            {
+                uri.pop_back();
+            }
+            if (!uri.empty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }));
+
+    report.print(std::cout);
+    return report.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,724 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "BatchExecutor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "ComputePipeline.h"
+#include "actions/Manifest.h"
+#include "actions/Load/FileBatchReader.h"
+#include "actions/Load/FileGlob.h"
+#include "actions/Load/FileLoad.h"
+#include "actions/Load/LoadFactory.h"
+#include "actions/Load/UrlLoad.h"
+#include "net/HttpEventLoop.h"
+#include "utils/BufferSlice.h"
+#include "utils/ChunkStream.h"
+#include "utils/EncodedPayload.h"
+#include "utils/JsonDocument.h"
+#include "utils/ThreadPool.h"
+#include "utils/Uri.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    double percentile(const std::vector<double>& sorted, double rank)
+    {
+        if (sorted.empty())
+        {
+            return 0.0;
+        }
+        const auto index = static_cast<std::size_t>(rank * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    std::string outputName(std::size_t index, const std::string& uri)
+    {
+        std::string name = uri.substr(uri.find_last_of('/') + 1);
+        std::replace_if(name.begin(), name.end(), [](char c) {
+            return c == '?' || c == '#' || c == ':' || c == '\\';
+        }, '_');
+        return std::to_string(index) + "_" + (name.empty() ? "result" : name);
+    }
+
+    void writeOutput(const std::filesystem::path& directory, std::size_t index, const std::string& uri,
+                     const char* bytes, std::size_t size)
+    {
+        std::ofstream out(directory / outputName(index, uri), std::ios::binary | std::ios::trunc);
+        out.write(bytes, static_cast<std::streamsize>(size));
+    }
+
+    // Consumes a streamed result chunk by chunk, so each chunk is released before the next is read.
+    std::size_t drainStream(ChunkStream& stream, const std::filesystem::path* directory, std::size_t index,
+                            const std::string& uri)
+    {
+        std::ofstream out;
+        if (directory != nullptr)
+        {
+            out.open(*directory / outputName(index, uri), std::ios::binary | std::ios::trunc);
+        }
+        std::size_t total = 0;
+        BufferSlice chunk;
+        while (stream.next(chunk))
+        {
+            if (out.is_open())
+            {
+                out.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+            }
+            total += chunk.size();
+            chunk = {};
+        }
+        return total;
+    }
+
+    /**
+     * Accumulates, over wall time, how long loads, processing, or both were running.
+     */
+    class StageClock {
+    public:
+        enum Stage { Io = 0, Cpu = 1 };
+
+        void enter(Stage stage) {
+            std::lock_guard lock(mutex);
+            advance();
+            ++active[stage];
+        }
+
+        void leave(Stage stage) {
+            std::lock_guard lock(mutex);
+            advance();
+            --active[stage];
+        }
+
+        // Seconds during which `stage` was running, alone or not.
+        double busy(Stage stage) const {
+            return seconds[1u << stage] + seconds[3];
+        }
+
+        double overlap() const {
+            return seconds[3];
+        }
+
+    private:
+        // Credits the time since the last transition to the current combination of running stages.
+        void advance() {
+            const auto now = Clock::now();
+            const unsigned running = (active[Io] > 0 ? 1u : 0u) | (active[Cpu] > 0 ? 2u : 0u);
+            seconds[running] += std::chrono::duration<double>(now - last).count();
+            last = now;
+        }
+
+        std::mutex mutex;
+        std::size_t active[2] = {};
+        double seconds[4] = {};
+        Clock::time_point last = Clock::now();
+    };
+
+    struct Prefetched {
+        std::size_t index = 0;
+        std::string uri;
+        Clock::time_point start;
+        ActionResult loaded;
+        std::exception_ptr error;
+        std::size_t bytes = 0;
+    };
+
+    /**
+     * Items loaded ahead of their processing. Loaders reserve their place before loading, so the
+     * window bounds the items loading as well as the loaded ones.
+     */
+    class PrefetchWindow {
+    public:
+        PrefetchWindow(std::size_t maxItems, std::size_t maxBytes) : maxItems(maxItems), maxBytes(maxBytes) {}
+
+        // Blocks until `count` more items fit. An empty window accepts anything, so no item is too large.
+        void reserve(std::size_t count) {
+            std::unique_lock lock(mutex);
+            roomAvailable.wait(lock, [&]() {
+                return reserved == 0 || (reserved + count <= maxItems && bytes < maxBytes);
+            });
+            reserved += count;
+        }
+
+        void push(Prefetched&& item) {
+            {
+                std::lock_guard lock(mutex);
+                bytes += item.bytes;
+                ready.push_back(std::move(item));
+            }
+            itemAvailable.notify_one();
+        }
+
+        // Takes the oldest loaded item, returns false once the loaders finished and every item was taken.
+        bool pop(Prefetched& item) {
+            {
+                std::unique_lock lock(mutex);
+                itemAvailable.wait(lock, [&]() { return !ready.empty() || loadersDone; });
+                if (ready.empty())
+                {
+                    return false;
+                }
+                item = std::move(ready.front());
+                ready.pop_front();
+                --reserved;
+                bytes -= item.bytes;
+            }
+            roomAvailable.notify_all();
+            return true;
+        }
+
+        void finishLoading() {
+            {
+                std::lock_guard lock(mutex);
+                loadersDone = true;
+            }
+            itemAvailable.notify_all();
+        }
+
+    private:
+        const std::size_t maxItems;
+        const std::size_t maxBytes;
+        std::mutex mutex;
+        std::condition_variable roomAvailable;
+        std::condition_variable itemAvailable;
+        std::deque<Prefetched> ready;
+        std::size_t reserved = 0;
+        std::size_t bytes = 0;
+        bool loadersDone = false;
+    };
+
+    // Bytes held by a loaded item, counted against the prefetch window. Streams are read later.
+    std::size_t loadedBytes(const ActionResult& loaded)
+    {
+        const char* payload = nullptr;
+        std::size_t size = 0;
+        if (BatchExecutor::payloadBytes(loaded, payload, size))
+        {
+            return size;
+        }
+        if (const EncodedPayload* encoded = EncodedPayload::fromAny(loaded.data))
+        {
+            return encoded->encoded.size();
+        }
+        return 0;
+    }
+}
+
+BatchExecutor::BatchExecutor(Options options) : options(std::move(options)) {
+    if (this->options.parallelism == 0)
+    {
+        this->options.parallelism = std::max(1u, std::thread::hardware_concurrency());
+    }
+    this->options.ioBatch = std::max<std::size_t>(1, this->options.ioBatch);
+    this->options.maxInFlight = std::max<std::size_t>(1, this->options.maxInFlight);
+}
+
+bool BatchExecutor::payloadBytes(const ActionResult& result, const char*& bytes, std::size_t& size) {
+    if (const BufferSlice* slice = BufferSlice::fromAny(result.data))
+    {
+        bytes = reinterpret_cast<const char*>(slice->data());
+        size = slice->size();
+        return true;
+    }
+    if (const auto* text = std::any_cast<std::string>(&result.data))
+    {
+        bytes = text->data();
+        size = text->size();
+        return true;
+    }
+    if (const auto* buffer = std::any_cast<std::vector<unsigned char>>(&result.data))
+    {
+        bytes = reinterpret_cast<const char*>(buffer->data());
+        size = buffer->size();
+        return true;
+    }
+    if (const JsonDocument* document = JsonDocument::fromAny(result.data))
+    {
+        bytes = reinterpret_cast<const char*>(document->text().data());
+        size = document->text().size();
+        return true;
+    }
+    return false;
+}
+
+BatchExecutor::UriSource BatchExecutor::expandGlobs(UriSource source) {
+    std::shared_ptr<FileGlob> expansion;
+    std::string pattern;
+    bool matched = false;
+    return [source = std::move(source), expansion, pattern, matched](std::string& uri) mutable {
+        for (;;)
+        {
+            if (expansion)
+            {
+                if (expansion->next(uri))
+                {
+                    matched = true;
+                    return true;
+                }
+                expansion.reset();
+                if (!matched)
+                {
+                    // A pattern matching nothing is still an item, which then fails to load.
+                    uri = std::move(pattern);
+                    return true;
+                }
+            }
+            if (!source(uri))
+            {
+                return false;
+            }
+            if (!FileGlob::isExpandable(uri))
+            {
+                return true;
+            }
+            expansion = std::make_shared<FileGlob>(uri);
+            pattern = uri;
+            matched = false;
+        }
+    };
+}
+
+BatchExecutor::Report BatchExecutor::run(const UriSource& source) const {
+
+    const bool writeResults = !options.outputDirectory.empty();
+    if (writeResults)
+    {
+        std::filesystem::create_directories(options.outputDirectory);
+    }
+
+    std::mutex sourceMutex;
+    std::size_t nextIndex = 0;
+    bool exhausted = false;
+
+    std::mutex latencyMutex;
+    std::vector<double> latencies;
+    std::atomic<std::size_t> failures{0};
+    std::atomic<std::size_t> bytes{0};
+
+    // Runs the remaining pipeline of one item and records its outcome.
+    auto complete = [&](std::size_t index, const std::string& uri, Clock::time_point start,
+                        const std::function<ActionResult()>& execute, std::vector<double>& local) {
+        bool succeeded = false;
+        try
+        {
+            ActionResult result = execute();
+            const char* payload = nullptr;
+            std::size_t size = 0;
+            if (payloadBytes(result, payload, size))
+            {
+                succeeded = true;
+                bytes.fetch_add(size, std::memory_order_relaxed);
+                if (writeResults)
+                {
+                    writeOutput(options.outputDirectory, index, uri, payload, size);
+                }
+            }
+            else if (const auto stream = ChunkStream::fromAny(result.data))
+            {
+                const std::filesystem::path directory = options.outputDirectory;
+                bytes.fetch_add(drainStream(*stream, writeResults ? &directory : nullptr, index, uri),
+                                std::memory_order_relaxed);
+                succeeded = true;
+            }
+            else if (const Manifest* manifest = Manifest::fromAny(result.data))
+            {
+                // The manifest succeeded once its document is loaded, failed children are only reported.
+                succeeded = true;
+                std::size_t total = manifest->document.size();
+                for (const Manifest::Child& child : manifest->children)
+                {
+                    if (child.result == nullptr)
+                    {
+                        std::cerr << "Failed to execute uri: " << child.uri << " referenced by " << uri << " ("
+                                  << child.error << ")" << std::endl;
+                    }
+                    else if (payloadBytes(*child.result, payload, size))
+                    {
+                        total += size;
+                    }
+                }
+                bytes.fetch_add(total, std::memory_order_relaxed);
+                if (writeResults)
+                {
+                    writeOutput(options.outputDirectory, index, uri,
+                                reinterpret_cast<const char*>(manifest->document.data()), manifest->document.size());
+                }
+            }
+            else
+            {
+                succeeded = result.data.has_value();
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Failed to execute uri: " << uri << " (" << e.what() << ")" << std::endl;
+        }
+        local.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        if (!succeeded)
+        {
+            failures.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    std::counting_semaphore<> downloadSlots(static_cast<std::ptrdiff_t>(options.maxInFlight));
+    std::mutex downloadMutex;
+    std::condition_variable downloadsFinished;
+    std::size_t downloads = 0;
+
+    // Queues the download of one item on the event loop, its response is processed on the thread pool.
+    auto download = [&](std::size_t index, const std::string& uri) {
+        downloadSlots.acquire();
+        {
+            std::lock_guard lock(downloadMutex);
+            ++downloads;
+        }
+        const auto start = Clock::now();
+        HttpEventLoop::Completion finished = [&, index, uri, start](HttpResponse&& response,
+                                                                     std::exception_ptr error) {
+            auto received = std::make_shared<HttpResponse>(std::move(response));
+            ThreadPool::shared().submit([&, index, uri, start, received, error]() {
+                std::vector<double> local;
+                complete(index, uri, start, [&]() {
+                    if (error)
+                    {
+                        std::rethrow_exception(error);
+                    }
+                    ActionResult loaded;
+                    UrlLoad::assign(std::move(*received), uri, loaded);
+                    return ComputePipeline::resume(std::move(loaded));
+                }, local);
+                {
+                    std::lock_guard lock(latencyMutex);
+                    latencies.insert(latencies.end(), local.begin(), local.end());
+                }
+                downloadSlots.release();
+                std::lock_guard lock(downloadMutex);
+                if (--downloads == 0)
+                {
+                    downloadsFinished.notify_all();
+                }
+            });
+        };
+
+        Url url;
+        try
+        {
+            url = Url::parse(uri);
+        }
+        catch (...)
+        {
+            finished({}, std::current_exception());
+            return;
+        }
+        HttpEventLoop::shared().fetch(url, HttpRequest{}, std::move(finished));
+    };
+
+    // Reads the local files of a batch together. If the batch read itself fails, it is reported once and false
+    // is returned, the files are then loaded one by one.
+    auto readBatch = [](const std::vector<std::string>& paths, std::vector<FileBatchReader::Entry>& entries) {
+        try
+        {
+            entries = FileBatchReader::read(paths);
+            return true;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Failed to read a batch of " << paths.size() << " files (" << e.what()
+                      << "), loading them one by one" << std::endl;
+            return false;
+        }
+    };
+
+    // Takes the next `ioBatch` URIs from the source and returns the index of the first one.
+    auto take = [&](std::vector<std::string>& uris) {
+        uris.clear();
+        std::lock_guard lock(sourceMutex);
+        std::string uri;
+        while (!exhausted && uris.size() < options.ioBatch)
+        {
+            if (!source(uri))
+            {
+                exhausted = true;
+                break;
+            }
+            uris.push_back(std::move(uri));
+        }
+        const std::size_t firstIndex = nextIndex;
+        nextIndex += uris.size();
+        return firstIndex;
+    };
+
+    auto worker = [&]() {
+        std::vector<double> local;
+        std::vector<std::string> uris;
+        std::vector<std::size_t> fileItems;
+        std::vector<std::string> paths;
+        for (;;)
+        {
+            const std::size_t firstIndex = take(uris);
+            if (uris.empty())
+            {
+                break;
+            }
+
+            // Local files of the batch are loaded together, downloads may go to the event loop, everything
+            // else runs one by one.
+            const auto start = Clock::now();
+            fileItems.clear();
+            paths.clear();
+            for (std::size_t i = 0; i < uris.size(); ++i)
+            {
+                const UriScheme scheme = Uri::schemeOf(uris[i]);
+                if (uris.size() > 1 && scheme == UriScheme::File)
+                {
+                    fileItems.push_back(i);
+                    paths.push_back(FileLoad::pathOf(uris[i]));
+                    continue;
+                }
+                if (options.asyncHttp && (scheme == UriScheme::Http || scheme == UriScheme::Https))
+                {
+                    download(firstIndex + i, uris[i]);
+                    continue;
+                }
+                complete(firstIndex + i, uris[i], Clock::now(), [&]() {
+                    return ComputePipeline::execute(uris[i]);
+                }, local);
+            }
+            if (paths.empty())
+            {
+                continue;
+            }
+
+            std::vector<FileBatchReader::Entry> entries;
+            if (!readBatch(paths, entries))
+            {
+                for (const std::size_t i : fileItems)
+                {
+                    complete(firstIndex + i, uris[i], start, [&]() {
+                        return ComputePipeline::execute(uris[i]);
+                    }, local);
+                }
+                continue;
+            }
+            for (std::size_t k = 0; k < entries.size(); ++k)
+            {
+                const std::size_t i = fileItems[k];
+                complete(firstIndex + i, uris[i], start, [&]() {
+                    if (entries[k].error)
+                    {
+                        throw std::system_error(entries[k].error, "unable to read file: " + paths[k]);
+                    }
+                    ActionResult loaded;
+                    FileLoad::assign(std::move(entries[k].content), loaded);
+                    return ComputePipeline::resume(std::move(loaded));
+                }, local);
+            }
+        }
+
+        std::lock_guard lock(latencyMutex);
+        latencies.insert(latencies.end(), local.begin(), local.end());
+    };
+
+    // With prefetching, loaders run the I/O stage ahead of the processors, through the window.
+    StageClock stages;
+    PrefetchWindow window(options.prefetchItems, options.prefetchBytes);
+
+    // Runs the I/O stage of one item on its own.
+    auto loadItem = [&](Prefetched& item, std::string&& uri) {
+        stages.enter(StageClock::Io);
+        try
+        {
+            LoadFactory::load(std::move(uri), item.loaded);
+            item.bytes = loadedBytes(item.loaded);
+        }
+        catch (...)
+        {
+            item.error = std::current_exception();
+        }
+        stages.leave(StageClock::Io);
+    };
+
+    auto loader = [&]() {
+        std::vector<std::string> uris;
+        std::vector<std::size_t> fileItems;
+        std::vector<std::string> paths;
+        for (;;)
+        {
+            const std::size_t firstIndex = take(uris);
+            if (uris.empty())
+            {
+                break;
+            }
+
+            fileItems.clear();
+            paths.clear();
+            for (std::size_t i = 0; i < uris.size(); ++i)
+            {
+                const UriScheme scheme = Uri::schemeOf(uris[i]);
+                if (uris.size() > 1 && scheme == UriScheme::File)
+                {
+                    fileItems.push_back(i);
+                    paths.push_back(FileLoad::pathOf(uris[i]));
+                    continue;
+                }
+                if (options.asyncHttp && (scheme == UriScheme::Http || scheme == UriScheme::Https))
+                {
+                    download(firstIndex + i, uris[i]);
+                    continue;
+                }
+                window.reserve(1);
+                Prefetched item{firstIndex + i, uris[i], Clock::now(), {}, {}, 0};
+                loadItem(item, std::move(uris[i]));
+                window.push(std::move(item));
+            }
+            if (paths.empty())
+            {
+                continue;
+            }
+
+            window.reserve(paths.size());
+            const auto start = Clock::now();
+            stages.enter(StageClock::Io);
+            std::vector<FileBatchReader::Entry> entries;
+            const bool batched = readBatch(paths, entries);
+            stages.leave(StageClock::Io);
+            if (!batched)
+            {
+                for (const std::size_t i : fileItems)
+                {
+                    Prefetched item{firstIndex + i, uris[i], start, {}, {}, 0};
+                    loadItem(item, std::move(uris[i]));
+                    window.push(std::move(item));
+                }
+                continue;
+            }
+            for (std::size_t k = 0; k < entries.size(); ++k)
+            {
+                const std::size_t i = fileItems[k];
+                Prefetched item{firstIndex + i, std::move(uris[i]), start, {}, {}, 0};
+                if (entries[k].error)
+                {
+                    item.error = std::make_exception_ptr(
+                        std::system_error(entries[k].error, "unable to read file: " + paths[k]));
+                }
+                else
+                {
+                    FileLoad::assign(std::move(entries[k].content), item.loaded);
+                    item.bytes = loadedBytes(item.loaded);
+                }
+                window.push(std::move(item));
+            }
+        }
+    };
+
+    auto processor = [&]() {
+        std::vector<double> local;
+        Prefetched item;
+        while (window.pop(item))
+        {
+            stages.enter(StageClock::Cpu);
+            complete(item.index, item.uri, item.start, [&]() {
+                if (item.error)
+                {
+                    std::rethrow_exception(item.error);
+                }
+                return ComputePipeline::resume(std::move(item.loaded));
+            }, local);
+            stages.leave(StageClock::Cpu);
+        }
+
+        std::lock_guard lock(latencyMutex);
+        latencies.insert(latencies.end(), local.begin(), local.end());
+    };
+
+    const bool prefetch = options.prefetchItems > 0;
+    const auto start = Clock::now();
+    std::vector<std::thread> workers;
+    std::vector<std::thread> processors;
+    workers.reserve(options.parallelism);
+    for (std::size_t i = 0; i < options.parallelism; ++i)
+    {
+        if (prefetch)
+        {
+            workers.emplace_back(loader);
+            processors.emplace_back(processor);
+        }
+        else
+        {
+            workers.emplace_back(worker);
+        }
+    }
+    for (auto& thread : workers)
+    {
+        thread.join();
+    }
+    window.finishLoading();
+    for (auto& thread : processors)
+    {
+        thread.join();
+    }
+    {
+        std::unique_lock lock(downloadMutex);
+        downloadsFinished.wait(lock, [&]() { return downloads == 0; });
+    }
+    const double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+
+    Report report;
+    report.items = latencies.size();
+    report.failures = failures.load();
+    report.bytes = bytes.load();
+    report.wallSeconds = wallSeconds;
+    if (wallSeconds > 0.0)
+    {
+        report.itemsPerSecond = static_cast<double>(report.items) / wallSeconds;
+        report.megabytesPerSecond = static_cast<double>(report.bytes) / (1024.0 * 1024.0) / wallSeconds;
+    }
+    report.latencyP50 = percentile(latencies, 0.50);
+    report.latencyP90 = percentile(latencies, 0.90);
+    report.latencyP99 = percentile(latencies, 0.99);
+    report.latencyMax = latencies.empty() ? 0.0 : latencies.back();
+    if (prefetch)
+    {
+        report.ioBusySeconds = stages.busy(StageClock::Io);
+        report.cpuBusySeconds = stages.busy(StageClock::Cpu);
+        report.overlapSeconds = stages.overlap();
+        const double shorter = std::min(report.ioBusySeconds, report.cpuBusySeconds);
+        report.overlapRatio = shorter > 0.0 ? report.overlapSeconds / shorter : 0.0;
+    }
+    return report;
+}
+
+void BatchExecutor::Report::print(std::ostream& out) const {
+    out << std::fixed << std::setprecision(2)
+        << "items:      " << items << " (" << failures << " failed)\n"
+        << "bytes:      " << bytes << "\n"
+        << "wall time:  " << wallSeconds << " s\n"
+        << "throughput: " << itemsPerSecond << " items/s, " << megabytesPerSecond << " MB/s\n"
+        << "latency:    p50 " << latencyP50 << " ms, p90 " << latencyP90 << " ms, p99 "
+        << latencyP99 << " ms, max " << latencyMax << " ms" << std::endl;
+    if (ioBusySeconds > 0.0 || cpuBusySeconds > 0.0)
+    {
+        out << "stages:     io busy " << ioBusySeconds << " s, cpu busy " << cpuBusySeconds << " s, overlapped "
+            << overlapSeconds << " s (overlap ratio " << overlapRatio << ")" << std::endl;
+    }
+}
@@ -0,0 +1,156 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef BATCHEXECUTOR_H
+#define BATCHEXECUTOR_H
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+
+#include "actions/ActionResult.h"
+
+
+/**
+ * @class BatchExecutor
+ * @brief Runs many URIs through the ComputePipeline concurrently and measures the run.
+ *
+ * URIs are pulled one at a time from a `UriSource`, so the producer (a file, stdin or any
+ * other generator) can keep producing while the workers are already executing. Every item
+ * is timed individually, which allows the final `Report` to expose both throughput and
+ * latency percentiles.
+ */
+class BatchExecutor {
+public:
+
+    /**
+     * @brief Produces the next URI to process.
+     *
+     * The source is invoked from the worker threads under a lock, it does not need to be
+     * thread safe by itself.
+     *
+     * @param uri Output parameter receiving the next URI.
+     * @return true if a URI was produced, false once the source is exhausted.
+     */
+    using UriSource = std::function<bool(std::string& uri)>;
+
+    /**
+     * @struct Options
+     * @brief Tunables of a batch run.
+     *
+     * @var Options::parallelism
+     * Number of worker threads executing the pipeline. Zero selects the hardware concurrency.
+     *
+     * @var Options::outputDirectory
+     * When not empty, the byte payload of every successful result is written into this directory.
+     *
+     * @var Options::ioBatch
+     * Number of URIs a worker takes from the source at once. When greater than one, the `file://`
+     * URIs among them are loaded together through `FileBatchReader` before being processed.
+     *
+     * @var Options::asyncHttp
+     * When true, `http://` and `https://` URIs are downloaded by `HttpEventLoop` instead of blocking a
+     * worker each. Workers only queue the downloads, the responses are processed on `ThreadPool::shared()`.
+     *
+     * @var Options::maxInFlight
+     * Upper bound of asynchronous downloads queued or running at once, which bounds the memory held by
+     * responses waiting for a CPU worker.
+     *
+     * @var Options::prefetchItems
+     * When not zero, the load action of the items (the I/O stage) runs on dedicated loader threads, ahead
+     * of the actions processing them, with at most this many items loaded or loading and not yet
+     * processed.
+     *
+     * @var Options::prefetchBytes
+     * Upper bound of the loaded bytes waiting to be processed when prefetching.
+     */
+    struct Options {
+        std::size_t parallelism = 0;
+        std::string outputDirectory;
+        std::size_t ioBatch = 1;
+        bool asyncHttp = false;
+        std::size_t maxInFlight = 1024;
+        std::size_t prefetchItems = 0;
+        std::size_t prefetchBytes = std::size_t{256} << 20;
+    };
+
+    /**
+     * @struct Report
+     * @brief Aggregated measurements of a finished batch run.
+     *
+     * Latencies are expressed in milliseconds and measured per item, from the moment a worker
+     * picks the URI up until the pipeline returns.
+     *
+     * When prefetching, the busy times give the wall time during which at least one load
+     * (`ioBusySeconds`) or one processing (`cpuBusySeconds`) was running, and `overlapSeconds` the
+     * time both were. `overlapRatio` is the share of the shorter stage hidden behind the other:
+     * 1 means loads and processing never waited for each other.
+     */
+    struct Report {
+        std::size_t items = 0;
+        std::size_t failures = 0;
+        std::size_t bytes = 0;
+        double wallSeconds = 0.0;
+        double itemsPerSecond = 0.0;
+        double megabytesPerSecond = 0.0;
+        double latencyP50 = 0.0;
+        double latencyP90 = 0.0;
+        double latencyP99 = 0.0;
+        double latencyMax = 0.0;
+        double ioBusySeconds = 0.0;
+        double cpuBusySeconds = 0.0;
+        double overlapSeconds = 0.0;
+        double overlapRatio = 0.0;
+
+        /**
+         * @brief Writes a human readable summary of the report.
+         *
+         * @param out The stream receiving the summary.
+         */
+        void print(std::ostream& out) const;
+    };
+
+    explicit BatchExecutor(Options options);
+
+    /**
+     * @brief Executes every URI produced by `source` and blocks until all of them completed.
+     *
+     * A failing item (either a false return or an exception thrown by an action) is counted in
+     * `Report::failures` and does not stop the batch.
+     *
+     * @param source The producer of URIs.
+     * @return Report The measurements of the run.
+     */
+    Report run(const UriSource& source) const;
+
+    /**
+     * @brief Exposes the raw bytes held by an action result, if any.
+     *
+     * @param result The result to inspect.
+     * @param bytes Output parameter receiving a pointer to the payload.
+     * @param size Output parameter receiving the payload size in bytes.
+     * @return true if the result data holds a byte payload or a parsed JSON document (its text),
+     *         false otherwise.
+     */
+    static bool payloadBytes(const ActionResult& result, const char*& bytes, std::size_t& size);
+
+    /**
+     * @brief Wraps `source` so that `file://` glob and directory URIs are replaced by the files they match.
+     *
+     * Matches are produced while the tree is still being walked (see `FileGlob`), the executor starts
+     * loading the first files before the listing is complete. A pattern matching no file is passed on
+     * as it is, so that it is reported as a failed item.
+     *
+     * @param source The producer of URIs, possibly containing globs.
+     * @return UriSource A producer of plain URIs.
+     */
+    static UriSource expandGlobs(UriSource source);
+
+private:
+    Options options;
+};
+
+
+
+#endif //BATCHEXECUTOR_H
@@ -4,21 +4,154 @@
 
 #include "ComputePipeline.h"
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
 
+#include "actions/DataDecompressor.h"
+#include "actions/ImageDecoding.h"
+#include "actions/JsonUnserializer.h"
 #include "actions/Load/LoadFactory.h"
+#include "actions/Manifest.h"
+#include "utils/ThreadPool.h"
 
-ActionResult ComputePipeline::execute(const std::string& uri){
+namespace {
+
+    // Runs the action selected by the metadata type of a loaded item. Decompressed content is
+    // processed in turn by the action selected by its own type.
+    ActionResult process(ActionResult&& loaded) {
+        ActionResult result;
+        bool executed;
+        if (loaded.metadata == "json")
+        {
+            executed = JsonUnserializer::execute(std::move(loaded), result);
+        }
+        else if (loaded.metadata == "decompress")
+        {
+            executed = DataDecompressor::execute(std::move(loaded), result);
+            if (executed && (result.metadata == "json" || result.metadata == "image"))
+            {
+                return process(std::move(result));
+            }
+        }
+        else if (loaded.metadata == "image")
+        {
+            executed = ImageDecoding::execute(std::move(loaded), result);
+        }
+        else
+        {
+            throw std::invalid_argument("invalid metadata type: " + loaded.metadata);
+        }
+
+        if (!executed)
+        {
+            std::cout << "Failed to execute action on loaded data" << std::endl;
+        }
+        return result;
+    }
+
+    // Runs the actions of `uri`, without executing the children of a manifest.
+    ActionResult run(const std::string& uri) {
+        ActionResult loaded;
+        LoadFactory::load(uri, loaded);
+        return process(std::move(loaded));
+    }
+
+    // The outcome of a child request, shared by the manifests referencing its URI.
+    struct SharedChild {
+        std::once_flag executed;
+        ActionResult result;
+        std::string error;
+    };
+
+    // Child requests of the manifests still held somewhere. Entries only hold weak references: a
+    // URI is executed again once no manifest holds its result anymore.
+    class ChildRegistry {
+    public:
+        static ChildRegistry& shared() {
+            static ChildRegistry registry;
+            return registry;
+        }
+
+        std::shared_ptr<SharedChild> acquire(const std::string& uri) {
+            std::lock_guard lock(mutex);
+            // Dropping expired entries whenever the map doubles keeps the cleanup amortized.
+            if (children.size() >= pruneThreshold)
+            {
+                std::erase_if(children, [](const auto& entry) { return entry.second.expired(); });
+                pruneThreshold = std::max<std::size_t>(64, children.size() * 2);
+            }
+            std::weak_ptr<SharedChild>& slot = children[uri];
+            std::shared_ptr<SharedChild> child = slot.lock();
+            if (!child)
+            {
+                child = std::make_shared<SharedChild>();
+                slot = child;
+            }
+            return child;
+        }
 
-    ActionResult result;
-    ActionResult previous{
-        uri,
-        "file"
+    private:
+        std::mutex mutex;
+        std::unordered_map<std::string, std::weak_ptr<SharedChild>> children;
+        std::size_t pruneThreshold = 64;
     };
-    if (!LoadFactory::execute(std::move(previous), result))
-    {
-        std::cout << "Failed to execute action data from uri: " << uri << std::endl;
+
+    ThreadPool& childPool() {
+        static ThreadPool pool(ComputePipeline::ChildParallelism);
+        return pool;
+    }
+
+    // Executes the children of `result` when it is a manifest.
+    void fanOut(ActionResult& result) {
+        Manifest* manifest = result.metadata == "manifest" ? Manifest::fromAny(result.data) : nullptr;
+        if (manifest == nullptr)
+        {
+            return;
+        }
+        childPool().parallelFor(manifest->children.size(), [manifest](std::size_t i) {
+            Manifest::Child& child = manifest->children[i];
+            const std::shared_ptr<SharedChild> shared = ChildRegistry::shared().acquire(child.uri);
+            // Concurrent requests for the same URI wait for the first one instead of executing it again.
+            std::call_once(shared->executed, [&]() {
+                try
+                {
+                    shared->result = run(child.uri);
+                    if (!shared->result.data.has_value())
+                    {
+                        shared->error = "no result";
+                    }
+                }
+                catch (const std::exception& e)
+                {
+                    shared->error = e.what();
+                }
+            });
+            if (shared->error.empty())
+            {
+                child.result = std::shared_ptr<const ActionResult>(shared, &shared->result);
+            }
+            else
+            {
+                child.error = shared->error;
+            }
+        });
     }
+}
+
+ActionResult ComputePipeline::execute(const std::string& uri){
+
+    ActionResult result = run(uri);
+    fanOut(result);
+    return result;
+}
+
+ActionResult ComputePipeline::resume(ActionResult&& loaded){
 
+    ActionResult result = process(std::move(loaded));
+    fanOut(result);
     return result;
 }
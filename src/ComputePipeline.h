@@ -4,6 +4,7 @@
 
 #ifndef COMPUTEPIPELINE_H
 #define COMPUTEPIPELINE_H
+#include <cstddef>
 #include <string>
 
 #include "actions/ActionResult.h"
@@ -14,10 +15,23 @@
  * @brief Represents a compute pipeline that executes operations based on a given URI.
  *
  * This class provides a static method to execute a compute operation using a specified URI.
+ *
+ * When the result is a `Manifest` (a JSON document referencing further URIs, see
+ * `JsonUnserializer::manifestPointers`), the referenced URIs are executed concurrently as child
+ * requests and their results aggregated in the manifest. A URI referenced by several manifests is
+ * executed once while any of them holds its result. The references of a child that is itself a
+ * manifest are collected but not executed, so reference cycles cannot recurse.
  */
 class ComputePipeline {
 public:
 
+    /**
+     * @brief Number of threads executing the child requests of manifests, shared by all manifests.
+     *
+     * The thread waiting for the children of a manifest executes some of them as well.
+     */
+    static constexpr std::size_t ChildParallelism = 16;
+
     /**
      * @brief Executes a specific action based on the provided URI.
      * 
@@ -25,9 +39,24 @@ public:
      * action. The result of the execution is returned as an ActionResult.
      * 
      * @param uri The URI string that specifies the action to be executed.
-     * @return ActionResult The result of the executed action.
+     * @return ActionResult The result of the executed action, with the results of its children when
+     *         it is a manifest.
      */
     static ActionResult execute(const std::string& uri);
+
+    /**
+     * @brief Continues the pipeline from an already loaded item.
+     *
+     * Batch loaders perform the load action of many items at once, this function runs the
+     * remaining actions of one of those items.
+     *
+     * @param loaded The output of a load action, its metadata selects the next action.
+     * @return ActionResult The result of the executed actions, with the results of its children when
+     *         it is a manifest.
+     *
+     * @throws std::invalid_argument If the metadata type of `loaded` is unsupported.
+     */
+    static ActionResult resume(ActionResult&& loaded);
 };
 
 
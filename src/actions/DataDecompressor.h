@@ -5,35 +5,43 @@
 #ifndef DATADECOMPRESSOR_H
 #define DATADECOMPRESSOR_H
 
+#include <any>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #include "ActionResult.h"
-#include "JsonUnserializer.h"
-#include "ImageDecoding.h"
-#include "Load/LoadFactory.h"
+#include "Decompress/DecompressStream.h"
+#include "Decompress/ParallelInflate.h"
+#include "Decompress/StreamDecoder.h"
+#include "../utils/BufferSlice.h"
+#include "../utils/ChunkStream.h"
+#include "../utils/ContentType.h"
+#include "../utils/EncodedPayload.h"
 
 /**
  * @class DataDecompressor
- * @brief A utility class responsible for decompressing data and delegating 
- *        further processing based on metadata type.
+ * @brief A utility class responsible for decompressing data.
  *
  * This class provides a static method `execute` that takes in a previous 
- * ActionResult and processes it based on the metadata type. The decompressed 
- * data and metadata are then assigned to the result object.
- *
- * Supported metadata types:
- * - "json": Delegates processing to JsonUnserializer.
- * - "load": Delegates processing to LoadFactory.
- * - "image": Delegates processing to ImageDecoding.
+ * ActionResult and decompresses its data. The decompressed data and the
+ * metadata type of its content are then assigned to the result object.
  *
- * @note If the metadata type is invalid, an exception is thrown.
+ * The codec of a payload is the one its source recorded (`EncodedPayload`) or is recognized from its
+ * magic bytes: gzip, zlib, zstd, lz4, xz, and brotli when recorded. Each has its `StreamDecoder`.
+ * Complete payloads are decoded at once into a pooled buffer, streamed payloads lazily, one pooled
+ * chunk at a time, through a `DecompressStream`. Large gzip payloads made of several members are
+ * decoded in parallel by `ParallelInflate`, as are large zstd payloads made of several frames.
  */
 class DataDecompressor  {
 public:
     /**
-     * @brief Executes the data decompression logic based on the metadata type.
+     * @brief Executes the data decompression logic.
      * 
      * This function processes the input `previous` ActionResult object, checks if it contains
-     * valid data, and decompresses it based on the metadata type. The decompressed data and
-     * metadata are assigned to the `result` ActionResult object.
+     * valid data, and decompresses it. The decompressed data and the metadata type of its
+     * content are assigned to the `result` ActionResult object, see `decompress`.
      * 
      * @param previous The input ActionResult object containing the data and metadata to be processed.
      *                 This parameter is passed as an rvalue reference.
@@ -41,12 +49,9 @@ public:
      * @return true If the decompression was successful.
      * @return false If the input `previous` object does not contain valid data.
      * 
-     * @throws std::invalid_argument If the metadata type in `previous` is invalid or unsupported.
-     * 
-     * @note The function delegates the decompression logic to specific handlers based on the metadata type:
-     *       - "json": Uses `JsonUnserializer::execute`.
-     *       - "load": Uses `LoadFactory::execute`.
-     *       - "image": Uses `ImageDecoding::execute`.
+     * @throws std::invalid_argument If the payload is not in a supported compression format.
+     * @throws std::runtime_error If the payload is corrupt or truncated.
+     * @throws std::system_error With a `DecompressionError` code if the payload decodes past the limits.
      */
     static bool execute(ActionResult&& previous, ActionResult& result) {
         if (!previous.data.has_value())
@@ -54,20 +59,111 @@ public:
             return false;
         }
 
-        // Implement the data decompressing logic here
-        // process will be assigned to the result object data and metadata
+        decompress(previous.data, result);
+        return true;
+    }
 
-        ActionResult resultCopy = result;
-        switch (previous.metadata)
+    /**
+     * @brief Decodes a compressed payload into `result`, tagged with the metadata type of its content.
+     *
+     * - An `EncodedPayload` is decoded according to its codec, into a buffer of its decoded size.
+     * - A `ChunkStream` is decoded as a `DecompressStream`, only its first chunk is decoded here.
+     * - Bytes (`BufferSlice`, `std::string`, `std::vector<unsigned char>`) are decoded at once, into a
+     *   buffer sized from the decoded size the stream records (gzip trailer, zstd and lz4 frame
+     *   headers) when there is one. The members of large gzip payloads and the frames of large zstd
+     *   payloads are decoded concurrently on `ThreadPool::shared()`.
+     *
+     * Every payload is held to `DecompressionLimits::shared()`.
+     *
+     * @param data The compressed payload.
+     * @param result The result receiving the decoded content.
+     *
+     * @throws std::invalid_argument If the format of the payload is not recognized, or its support
+     *         was not compiled in.
+     * @throws std::runtime_error If the payload is corrupt or truncated.
+     * @throws std::system_error With a `DecompressionError` code if the payload decodes past the limits.
+     */
+    static void decompress(const std::any& data, ActionResult& result) {
+        BufferSlice decoded;
+        if (const EncodedPayload* payload = EncodedPayload::fromAny(data))
         {
-        case "json":
-            return JsonUnserializer::execute(std::move(resultCopy), result);
-        case "load":
-            return LoadFactory::execute(std::move(resultCopy), result);
-        case "image":
-            return ImageDecoding::execute(std::move(resultCopy), result);
+            decoded = payload->codec == Codec::Raw
+                          ? payload->encoded
+                          : StreamDecoder::decodeAll(payload->encoded.data(), payload->encoded.size(),
+                                                     formatOf(payload->codec), payload->decodedSize);
+        }
+        else if (const std::shared_ptr<ChunkStream> stream = ChunkStream::fromAny(data))
+        {
+            const std::shared_ptr<DecompressStream> decoding = DecompressStream::open(stream);
+            if (decoding == nullptr)
+            {
+                throw std::invalid_argument("unsupported compression format");
+            }
+            const BufferSlice head = decoding->head();
+            result.metadata = sniffContentType(head.data(), head.size());
+            result.data = std::shared_ptr<ChunkStream>(decoding);
+            return;
+        }
+        else
+        {
+            const unsigned char* bytes = nullptr;
+            std::size_t size = 0;
+            StreamDecoder::Format format;
+            if (!bytesOf(data, bytes, size) || !StreamDecoder::detect(bytes, size, format))
+            {
+                throw std::invalid_argument("unsupported compression format");
+            }
+            const bool parallel = format == StreamDecoder::Format::Gzip
+                                      ? ParallelInflate::decode(bytes, size, decoded)
+                                      : format == StreamDecoder::Format::Zstd &&
+                                            ParallelInflate::decodeZstd(bytes, size, decoded);
+            if (!parallel)
+            {
+                decoded = StreamDecoder::decodeAll(bytes, size, format, StreamDecoder::contentSize(bytes, size, format));
+            }
+        }
+
+        result.metadata = sniffContentType(decoded.data(), decoded.size());
+        result.data = std::move(decoded);
+    }
+
+private:
+    static StreamDecoder::Format formatOf(Codec codec) {
+        switch (codec)
+        {
+        case Codec::Deflate:
+            return StreamDecoder::Format::Zlib;
+        case Codec::Brotli:
+            return StreamDecoder::Format::Brotli;
+        case Codec::Lzma:
+            return StreamDecoder::Format::Xz;
+        case Codec::Zstd:
+            return StreamDecoder::Format::Zstd;
+        case Codec::Lz4:
+            return StreamDecoder::Format::Lz4;
         default:
-            throw std::invalid_argument("invalid metadata type: " + previous.metadata);
+            throw std::invalid_argument("unsupported codec: " + std::to_string(static_cast<int>(codec)));
+        }
+    }
+
+    static bool bytesOf(const std::any& data, const unsigned char*& bytes, std::size_t& size) {
+        if (const BufferSlice* slice = BufferSlice::fromAny(data))
+        {
+            bytes = slice->data();
+            size = slice->size();
+            return true;
+        }
+        if (const auto* text = std::any_cast<std::string>(&data))
+        {
+            bytes = reinterpret_cast<const unsigned char*>(text->data());
+            size = text->size();
+            return true;
+        }
+        if (const auto* buffer = std::any_cast<std::vector<unsigned char>>(&data))
+        {
+            bytes = buffer->data();
+            size = buffer->size();
+            return true;
         }
         return false;
     }
@@ -0,0 +1,58 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "BrotliDecoder.h"
+
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <brotli/decode.h>
+
+/**
+ * A brotli decoder state.
+ */
+struct BrotliDecoder::Context {
+    BrotliDecoderState* state = ::BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+
+    Context() {
+        if (state == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    ~Context() {
+        ::BrotliDecoderDestroyInstance(state);
+    }
+};
+
+BrotliDecoder::BrotliDecoder() : context(std::make_unique<Context>()) {}
+
+BrotliDecoder::~BrotliDecoder() = default;
+
+bool BrotliDecoder::decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                           std::size_t& outputSize) {
+    if (ended)
+    {
+        // A brotli stream is a single unit, whatever follows it is ignored.
+        return true;
+    }
+    const BrotliDecoderResult status =
+        ::BrotliDecoderDecompressStream(context->state, &inputSize, &input, &outputSize, &output, nullptr);
+    if (status == BROTLI_DECODER_RESULT_ERROR)
+    {
+        throw std::runtime_error(std::string("corrupt brotli stream: ") +
+                                 ::BrotliDecoderErrorString(::BrotliDecoderGetErrorCode(context->state)));
+    }
+    ended = status == BROTLI_DECODER_RESULT_SUCCESS;
+    return ended;
+}
+
+bool BrotliDecoder::complete() const {
+    return ended;
+}
@@ -0,0 +1,40 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef BROTLIDECODER_H
+#define BROTLIDECODER_H
+#include <cstddef>
+#include <memory>
+
+#include "StreamDecoder.h"
+
+/**
+ * @class BrotliDecoder
+ * @brief Incremental decoder of brotli streams (RFC 7932).
+ *
+ * brotli streams carry no magic bytes, they are only decoded when their source records the codec.
+ */
+class BrotliDecoder : public StreamDecoder {
+public:
+    BrotliDecoder();
+    ~BrotliDecoder() override;
+
+    BrotliDecoder(const BrotliDecoder&) = delete;
+    BrotliDecoder& operator=(const BrotliDecoder&) = delete;
+
+    bool decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                std::size_t& outputSize) override;
+
+    bool complete() const override;
+
+private:
+    struct Context;
+
+    std::unique_ptr<Context> context;
+    bool ended = false;
+};
+
+
+
+#endif //BROTLIDECODER_H
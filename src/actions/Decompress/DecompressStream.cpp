@@ -0,0 +1,102 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "DecompressStream.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../../utils/BufferPool.h"
+
+DecompressStream::DecompressStream(std::shared_ptr<ChunkStream> source, std::unique_ptr<StreamDecoder> decoder,
+                                   BufferSlice input, std::size_t chunkSize, const DecompressionLimits& limits)
+    : source(std::move(source)), decoder(std::move(decoder)), chunkSize(std::max<std::size_t>(chunkSize, 1)),
+      limits(limits), input(std::move(input)) {}
+
+std::shared_ptr<DecompressStream> DecompressStream::open(std::shared_ptr<ChunkStream> source, std::size_t chunkSize,
+                                                         const DecompressionLimits& limits) {
+    BufferSlice first;
+    StreamDecoder::Format format;
+    if (!source->next(first) || !StreamDecoder::detect(first.data(), first.size(), format))
+    {
+        return nullptr;
+    }
+    return std::shared_ptr<DecompressStream>(
+        new DecompressStream(std::move(source), StreamDecoder::create(format), std::move(first), chunkSize, limits));
+}
+
+bool DecompressStream::next(BufferSlice& chunk) {
+    if (hasPeeked)
+    {
+        hasPeeked = false;
+        chunk = std::move(peeked);
+        peeked = BufferSlice();
+        return chunk.size() != 0;
+    }
+    return fill(chunk);
+}
+
+BufferSlice DecompressStream::head() {
+    if (!hasPeeked)
+    {
+        fill(peeked);
+        hasPeeked = true;
+    }
+    return peeked;
+}
+
+bool DecompressStream::fill(BufferSlice& chunk) {
+    const std::shared_ptr<BufferPool::Buffer> buffer = BufferPool::shared().acquire(chunkSize);
+    unsigned char* output = buffer->data();
+    std::size_t outputSize = buffer->size();
+    while (outputSize != 0)
+    {
+        if (input.size() == 0)
+        {
+            if (sourceDone || !source->next(input))
+            {
+                sourceDone = true;
+                // Some decoders hold back decoded bytes until there is room for them.
+                const unsigned char* bytes = nullptr;
+                std::size_t size = 0;
+                unsigned char* const start = output;
+                decoder->decode(bytes, size, output, outputSize);
+                if (output != start)
+                {
+                    continue;
+                }
+                if (!decoder->complete())
+                {
+                    throw std::runtime_error("truncated compressed stream");
+                }
+                break;
+            }
+            continue;
+        }
+
+        const unsigned char* bytes = input.data();
+        std::size_t size = input.size();
+        const bool ended = decoder->decode(bytes, size, output, outputSize);
+        consumed += input.size() - size;
+        input = input.subslice(input.size() - size);
+        if (ended && input.size() != 0)
+        {
+            // Whatever follows the payload is ignored, the source is not read any further.
+            input = BufferSlice();
+            sourceDone = true;
+            break;
+        }
+    }
+
+    const std::size_t produced = output - buffer->data();
+    if (produced == 0)
+    {
+        return false;
+    }
+    // Checked once per chunk, so a bomb is stopped after decoding at most one chunk past the limit.
+    decoded += produced;
+    limits.check(std::max(source->sizeHint(), consumed), decoded);
+    chunk = BufferSlice(buffer, buffer->data(), produced);
+    return true;
+}
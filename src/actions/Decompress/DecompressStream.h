@@ -0,0 +1,80 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef DECOMPRESSSTREAM_H
+#define DECOMPRESSSTREAM_H
+#include <cstddef>
+#include <memory>
+
+#include "StreamDecoder.h"
+#include "../../utils/ChunkStream.h"
+
+/**
+ * @class DecompressStream
+ * @brief Decodes a streamed compressed payload chunk by chunk, with the `StreamDecoder` of its format.
+ *
+ * Each `next` pulls compressed chunks from the source until one output chunk is full, so at most
+ * one compressed and one decoded chunk are held at a time, whatever the payload size. Output
+ * chunks come from the `BufferPool` and go back to it once released by the consumer.
+ */
+class DecompressStream : public ChunkStream {
+public:
+
+    /**
+     * @brief Default size of the decoded chunks.
+     */
+    static constexpr std::size_t DefaultChunkSize = std::size_t{1} << 20;
+
+    /**
+     * @brief Opens a stream decoding `source`, whose format is recognized from its first chunk.
+     *
+     * @param source The compressed payload.
+     * @param chunkSize Size of the decoded chunks.
+     * @param limits Caps on the decoded size, against the size hint of `source` when it has one,
+     *        else against the compressed bytes read so far.
+     * @return The stream, or nullptr if the format of `source` is not recognized.
+     *
+     * @throws std::invalid_argument If support for the format was not compiled in.
+     */
+    static std::shared_ptr<DecompressStream> open(std::shared_ptr<ChunkStream> source,
+                                                  std::size_t chunkSize = DefaultChunkSize,
+                                                  const DecompressionLimits& limits = DecompressionLimits::shared());
+
+    /**
+     * @copydoc ChunkStream::next
+     *
+     * @throws std::runtime_error If the payload is corrupt or truncated.
+     * @throws std::system_error With a `DecompressionError` code if the output exceeds the limits.
+     */
+    bool next(BufferSlice& chunk) override;
+
+    /**
+     * @brief Returns the first decoded chunk without consuming it, empty if the payload is empty.
+     *
+     * @throws std::runtime_error If the payload is corrupt or truncated.
+     * @throws std::system_error With a `DecompressionError` code if the output exceeds the limits.
+     */
+    BufferSlice head();
+
+private:
+    DecompressStream(std::shared_ptr<ChunkStream> source, std::unique_ptr<StreamDecoder> decoder, BufferSlice input,
+                     std::size_t chunkSize, const DecompressionLimits& limits);
+
+    bool fill(BufferSlice& chunk);
+
+    std::shared_ptr<ChunkStream> source;
+    std::unique_ptr<StreamDecoder> decoder;
+    std::size_t chunkSize;
+    DecompressionLimits limits;
+    std::size_t consumed = 0;
+    std::size_t decoded = 0;
+    BufferSlice input;
+    bool sourceDone = false;
+    BufferSlice peeked;
+    bool hasPeeked = false;
+};
+
+
+
+#endif //DECOMPRESSSTREAM_H
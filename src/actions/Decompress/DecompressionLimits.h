@@ -0,0 +1,126 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef DECOMPRESSIONLIMITS_H
+#define DECOMPRESSIONLIMITS_H
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+/**
+ * @brief Why a payload was rejected by `DecompressionLimits`, the code of the `std::system_error` thrown.
+ */
+enum class DecompressionError {
+    OutputTooLarge = 1,
+    RatioTooHigh = 2
+};
+
+template <>
+struct std::is_error_code_enum<DecompressionError> : std::true_type {};
+
+/**
+ * @brief The category of `DecompressionError` codes.
+ */
+inline const std::error_category& decompressionCategory() {
+    class Category : public std::error_category {
+    public:
+        const char* name() const noexcept override {
+            return "decompression";
+        }
+
+        std::string message(int code) const override {
+            switch (static_cast<DecompressionError>(code))
+            {
+            case DecompressionError::OutputTooLarge:
+                return "decoded output exceeds the size limit";
+            case DecompressionError::RatioTooHigh:
+                return "compression ratio exceeds the limit";
+            default:
+                return "unknown decompression error";
+            }
+        }
+    };
+    static const Category category;
+    return category;
+}
+
+inline std::error_code make_error_code(DecompressionError error) {
+    return {static_cast<int>(error), decompressionCategory()};
+}
+
+/**
+ * @struct DecompressionLimits
+ * @brief Caps on the output of a single decoded payload, against decompression bombs.
+ *
+ * A few compressed bytes can claim or produce gigabytes. Decoders compare their output with the
+ * caps while they decode, and a size announced up front (gzip trailer, zstd and lz4 frame headers,
+ * bundle entries) before any buffer is allocated. An output outgrowing its first buffer moves to an
+ * anonymous mapping whose pages are only committed as they are decoded and which grows by remapping,
+ * so memory tracks the decoded bytes. Hostile input therefore fails after decoding at most the
+ * allowance, plus the first buffer, or one chunk for streamed payloads.
+ *
+ * @var DecompressionLimits::maxOutputBytes
+ * Maximum decoded size of a payload, zero for no limit. The 4 GiB default leaves room for the
+ * multi-gigabyte archives `ParallelInflate` decodes.
+ *
+ * @var DecompressionLimits::maxRatio
+ * Maximum ratio of decoded to compressed bytes, zero for no limit. Outputs up to `RatioFloor` are
+ * always allowed, tiny payloads of zeros reach high ratios legitimately.
+ */
+struct DecompressionLimits {
+    static constexpr std::size_t RatioFloor = std::size_t{1} << 20;
+
+    std::size_t maxOutputBytes = std::size_t{4} << 30;
+    double maxRatio = 1000;
+
+    /**
+     * @brief Returns the limits `DataDecompressor` applies to every payload.
+     */
+    static DecompressionLimits& shared() {
+        static DecompressionLimits limits;
+        return limits;
+    }
+
+    /**
+     * @brief Largest output allowed for `input` compressed bytes.
+     */
+    std::size_t allowance(std::size_t input) const {
+        std::size_t allowed = maxOutputBytes != 0 ? maxOutputBytes : std::numeric_limits<std::size_t>::max();
+        if (maxRatio > 0)
+        {
+            const double byRatio = maxRatio * static_cast<double>(input);
+            if (byRatio < static_cast<double>(allowed))
+            {
+                allowed = std::max(static_cast<std::size_t>(byRatio), std::min(RatioFloor, allowed));
+            }
+        }
+        return allowed;
+    }
+
+    /**
+     * @brief Checks that `output` bytes decoded out of `input` compressed bytes are within the limits.
+     *
+     * @throws std::system_error With `DecompressionError::OutputTooLarge` or
+     *         `DecompressionError::RatioTooHigh`, according to the cap exceeded.
+     */
+    void check(std::size_t input, std::size_t output) const {
+        if (output <= allowance(input))
+        {
+            return;
+        }
+        if (maxOutputBytes != 0 && output > maxOutputBytes)
+        {
+            throw std::system_error(DecompressionError::OutputTooLarge,
+                                    "payload decodes to more than " + std::to_string(maxOutputBytes) + " bytes");
+        }
+        throw std::system_error(DecompressionError::RatioTooHigh,
+                                "payload of " + std::to_string(input) + " bytes decodes to more than " +
+                                    std::to_string(allowance(input)) + " bytes");
+    }
+};
+
+#endif //DECOMPRESSIONLIMITS_H
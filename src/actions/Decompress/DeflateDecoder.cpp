@@ -0,0 +1,296 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "DeflateDecoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <zlib.h>
+
+#include "../../utils/Checksum.h"
+
+namespace {
+
+    // zlib counts bytes in 32 bits, larger inputs and outputs are handed over in steps.
+    constexpr std::size_t MaxStep = std::size_t{1} << 30;
+
+    // Bound of a gzip header (the optional name, comment and extra field are unbounded by the format).
+    constexpr std::size_t MaxPending = std::size_t{64} << 10;
+
+    std::uint32_t readLittleEndian(const unsigned char* bytes)
+    {
+        return static_cast<std::uint32_t>(bytes[0]) | static_cast<std::uint32_t>(bytes[1]) << 8 |
+               static_cast<std::uint32_t>(bytes[2]) << 16 | static_cast<std::uint32_t>(bytes[3]) << 24;
+    }
+
+    std::uint32_t readBigEndian(const unsigned char* bytes)
+    {
+        return static_cast<std::uint32_t>(bytes[0]) << 24 | static_cast<std::uint32_t>(bytes[1]) << 16 |
+               static_cast<std::uint32_t>(bytes[2]) << 8 | static_cast<std::uint32_t>(bytes[3]);
+    }
+
+    bool isZlibHeader(const unsigned char* bytes)
+    {
+        return (bytes[0] & 0x0f) == 8 && (bytes[0] >> 4) <= 7 && ((bytes[0] << 8) | bytes[1]) % 31 == 0;
+    }
+
+    std::size_t zlibHeaderSize(const unsigned char* bytes, std::size_t size)
+    {
+        if (size < 2)
+        {
+            return 0;
+        }
+        if (!isZlibHeader(bytes))
+        {
+            throw std::runtime_error("invalid zlib header");
+        }
+        if ((bytes[1] & 0x20) != 0)
+        {
+            throw std::runtime_error("zlib streams with a preset dictionary are not supported");
+        }
+        return 2;
+    }
+}
+
+/**
+ * A raw inflater, reset between members instead of being initialized again.
+ */
+struct DeflateDecoder::Inflater {
+    z_stream stream{};
+
+    Inflater() {
+        if (::inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+
+    ~Inflater() {
+        ::inflateEnd(&stream);
+    }
+};
+
+std::unique_ptr<DeflateDecoder::Inflater>& DeflateDecoder::idleInflater() {
+    thread_local std::unique_ptr<Inflater> idle;
+    return idle;
+}
+
+DeflateDecoder::DeflateDecoder(Format format) : format(format), inflater(std::move(idleInflater())) {
+    if (inflater == nullptr)
+    {
+        inflater = std::make_unique<Inflater>();
+    }
+}
+
+DeflateDecoder::~DeflateDecoder() {
+    if (std::unique_ptr<Inflater>& idle = idleInflater(); idle == nullptr)
+    {
+        idle = std::move(inflater);
+    }
+}
+
+template <typename Parse>
+bool DeflateDecoder::take(const unsigned char*& input, std::size_t& inputSize, Parse parse) {
+    if (pending.empty())
+    {
+        if (const std::size_t size = parse(input, inputSize); size != 0)
+        {
+            input += size;
+            inputSize -= size;
+            return true;
+        }
+    }
+    const std::size_t buffered = pending.size();
+    const std::size_t taken = std::min(inputSize, MaxPending - buffered);
+    pending.insert(pending.end(), input, input + taken);
+    const std::size_t size = parse(pending.data(), pending.size());
+    if (size == 0)
+    {
+        if (pending.size() == MaxPending)
+        {
+            throw std::runtime_error("gzip header too long");
+        }
+        input += taken;
+        inputSize -= taken;
+        return false;
+    }
+    input += size - buffered;
+    inputSize -= size - buffered;
+    pending.clear();
+    return true;
+}
+
+void DeflateDecoder::checkTrailer(const unsigned char* trailer) {
+    if (format == Format::Gzip)
+    {
+        if (readLittleEndian(trailer) != checksum || readLittleEndian(trailer + 4) != memberSize)
+        {
+            throw std::runtime_error("gzip member checksum mismatch");
+        }
+    }
+    else if (readBigEndian(trailer) != checksum)
+    {
+        throw std::runtime_error("zlib stream checksum mismatch");
+    }
+}
+
+bool DeflateDecoder::decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                            std::size_t& outputSize) {
+    for (;;)
+    {
+        switch (stage)
+        {
+        case Stage::Header:
+            if (!take(input, inputSize, format == Format::Gzip ? gzipHeaderSize : zlibHeaderSize))
+            {
+                return false;
+            }
+            ::inflateReset(&inflater->stream);
+            checksum = format == Format::Gzip ? Checksum::Crc32Initial : Checksum::Adler32Initial;
+            memberSize = 0;
+            stage = Stage::Body;
+            break;
+
+        case Stage::Body:
+        {
+            z_stream& stream = inflater->stream;
+            stream.next_in = const_cast<Bytef*>(input);
+            stream.avail_in = static_cast<uInt>(std::min(inputSize, MaxStep));
+            stream.next_out = output;
+            stream.avail_out = static_cast<uInt>(std::min(outputSize, MaxStep));
+            const int status = ::inflate(&stream, Z_NO_FLUSH);
+
+            const std::size_t consumed = stream.next_in - input;
+            const std::size_t produced = stream.next_out - output;
+            checksum = format == Format::Gzip ? Checksum::crc32(checksum, output, produced)
+                                              : Checksum::adler32(checksum, output, produced);
+            memberSize += static_cast<std::uint32_t>(produced);
+            input += consumed;
+            inputSize -= consumed;
+            output += produced;
+            outputSize -= produced;
+
+            if (status == Z_STREAM_END)
+            {
+                stage = Stage::Trailer;
+            }
+            else if (status != Z_OK && status != Z_BUF_ERROR)
+            {
+                throw std::runtime_error(std::string("corrupt deflate stream: ") +
+                                         (stream.msg != nullptr ? stream.msg : "inflate failed"));
+            }
+            else if (inputSize == 0 || outputSize == 0)
+            {
+                return false;
+            }
+            break;
+        }
+
+        case Stage::Trailer:
+        {
+            const std::size_t trailerSize = format == Format::Gzip ? 8 : 4;
+            const bool read = take(input, inputSize, [this, trailerSize](const unsigned char* bytes, std::size_t size) {
+                if (size < trailerSize)
+                {
+                    return std::size_t{0};
+                }
+                checkTrailer(bytes);
+                return trailerSize;
+            });
+            if (!read)
+            {
+                return false;
+            }
+            stage = format == Format::Gzip ? Stage::Boundary : Stage::Done;
+            break;
+        }
+
+        case Stage::Boundary:
+            if (inputSize == 0)
+            {
+                return true;
+            }
+            // Anything else than another member is trailing data, which gzip ignores as well.
+            stage = input[0] == 0x1f ? Stage::Header : Stage::Done;
+            break;
+
+        case Stage::Done:
+            return true;
+        }
+    }
+}
+
+bool DeflateDecoder::complete() const {
+    return stage == Stage::Boundary || stage == Stage::Done;
+}
+
+std::size_t DeflateDecoder::gzipHeaderSize(const unsigned char* bytes, std::size_t size) {
+    if (size < 10)
+    {
+        return 0;
+    }
+    if (bytes[0] != 0x1f || bytes[1] != 0x8b || bytes[2] != 8 || (bytes[3] & 0xe0) != 0)
+    {
+        throw std::runtime_error("invalid gzip header");
+    }
+    const unsigned char flags = bytes[3];
+    std::size_t header = 10;
+    if ((flags & 0x04) != 0)
+    {
+        if (size < header + 2)
+        {
+            return 0;
+        }
+        header += 2 + (bytes[header] | bytes[header + 1] << 8);
+    }
+    // The name and the comment are zero terminated.
+    for (const unsigned char field : {0x08, 0x10})
+    {
+        if ((flags & field) == 0)
+        {
+            continue;
+        }
+        const void* end = header < size ? std::memchr(bytes + header, 0, size - header) : nullptr;
+        if (end == nullptr)
+        {
+            return 0;
+        }
+        header = static_cast<const unsigned char*>(end) - bytes + 1;
+    }
+    if ((flags & 0x02) != 0)
+    {
+        header += 2;
+    }
+    return header <= size ? header : 0;
+}
+
+bool DeflateDecoder::detect(const unsigned char* bytes, std::size_t size, Format& format) {
+    if (size >= 3 && bytes[0] == 0x1f && bytes[1] == 0x8b && bytes[2] == 8)
+    {
+        format = Format::Gzip;
+        return true;
+    }
+    if (size >= 2 && isZlibHeader(bytes))
+    {
+        format = Format::Zlib;
+        return true;
+    }
+    return false;
+}
+
+std::size_t DeflateDecoder::gzipSizeHint(const unsigned char* bytes, std::size_t size) {
+    Format format;
+    if (size < 18 || !detect(bytes, size, format) || format != Format::Gzip)
+    {
+        return 0;
+    }
+    return readLittleEndian(bytes + size - 4);
+}
@@ -0,0 +1,114 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef DEFLATEDECODER_H
+#define DEFLATEDECODER_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "StreamDecoder.h"
+
+/**
+ * @class DeflateDecoder
+ * @brief Incremental decoder of gzip (RFC 1952) and zlib (RFC 1950) streams.
+ *
+ * The compressed bytes are fed in pieces of any size and the decoded bytes are written into
+ * buffers supplied by the caller, so neither side ever has to be held at once. The DEFLATE blocks
+ * are inflated by zlib in raw mode while the wrappers are handled here: headers and trailers may
+ * straddle pieces, checksums are verified (with the vectorized kernels of `Checksum`) and
+ * concatenated gzip members are decoded in sequence.
+ *
+ * Inflater states (about 40 KiB with their window) are recycled: every thread keeps the state of
+ * its last decoder, which the next decoder created on that thread takes over.
+ */
+class DeflateDecoder : public StreamDecoder {
+public:
+
+    /**
+     * @brief The wrapper around the DEFLATE blocks.
+     */
+    enum class Format {
+        Gzip,
+        Zlib
+    };
+
+    /**
+     * @brief Upper bound of the DEFLATE compression ratio, reached by runs of a single byte.
+     */
+    static constexpr std::size_t MaxExpansion = 1032;
+
+    explicit DeflateDecoder(Format format);
+    ~DeflateDecoder() override;
+
+    DeflateDecoder(const DeflateDecoder&) = delete;
+    DeflateDecoder& operator=(const DeflateDecoder&) = delete;
+
+    /**
+     * @copydoc StreamDecoder::decode
+     *
+     * A gzip stream ends after a member when the input ends there or continues with something else
+     * than a member, which is ignored.
+     */
+    bool decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                std::size_t& outputSize) override;
+
+    bool complete() const override;
+
+    /**
+     * @brief Recognizes the wrapper of a stream from its first bytes.
+     *
+     * @return true if `bytes` starts a gzip member or a zlib stream, `format` then receives it.
+     */
+    static bool detect(const unsigned char* bytes, std::size_t size, Format& format);
+
+    /**
+     * @brief Size of the gzip member header starting `bytes`.
+     *
+     * @return The header size, zero if `bytes` ends before the header does.
+     *
+     * @throws std::runtime_error If `bytes` does not start a gzip member.
+     */
+    static std::size_t gzipHeaderSize(const unsigned char* bytes, std::size_t size);
+
+    /**
+     * @brief The decoded size recorded in the trailer of a complete gzip stream, zero if there is none.
+     *
+     * It is exact for a single member smaller than 4 GiB: ISIZE only counts the last member, modulo 2^32.
+     */
+    static std::size_t gzipSizeHint(const unsigned char* bytes, std::size_t size);
+
+private:
+    struct Inflater;
+
+    enum class Stage {
+        Header,
+        Body,
+        Trailer,
+        Boundary,
+        Done
+    };
+
+    // Moves a header or trailer out of the input, `parse` returning its size once it is complete and
+    // zero before. Partial ones are buffered in `pending`.
+    template <typename Parse>
+    bool take(const unsigned char*& input, std::size_t& inputSize, Parse parse);
+
+    void checkTrailer(const unsigned char* trailer);
+
+    // The inflater the last decoder destroyed on the calling thread left for the next one.
+    static std::unique_ptr<Inflater>& idleInflater();
+
+    Format format;
+    Stage stage = Stage::Header;
+    std::unique_ptr<Inflater> inflater;
+    std::vector<unsigned char> pending;
+    std::uint32_t checksum = 0;
+    std::uint32_t memberSize = 0;
+};
+
+
+
+#endif //DEFLATEDECODER_H
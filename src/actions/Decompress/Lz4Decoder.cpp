@@ -0,0 +1,84 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "Lz4Decoder.h"
+
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <lz4frame.h>
+
+/**
+ * An lz4 frame decompression context.
+ */
+struct Lz4Decoder::Context {
+    LZ4F_dctx* context = nullptr;
+
+    Context() {
+        if (LZ4F_isError(::LZ4F_createDecompressionContext(&context, LZ4F_VERSION)))
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    ~Context() {
+        ::LZ4F_freeDecompressionContext(context);
+    }
+};
+
+Lz4Decoder::Lz4Decoder() : context(std::make_unique<Context>()) {}
+
+Lz4Decoder::~Lz4Decoder() = default;
+
+bool Lz4Decoder::decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                        std::size_t& outputSize) {
+    if (frameEnded && inputSize == 0)
+    {
+        return true;
+    }
+    for (;;)
+    {
+        std::size_t consumed = inputSize;
+        std::size_t produced = outputSize;
+        const std::size_t status = ::LZ4F_decompress(context->context, output, &produced, input, &consumed, nullptr);
+        if (LZ4F_isError(status))
+        {
+            throw std::runtime_error(std::string("corrupt lz4 stream: ") + ::LZ4F_getErrorName(status));
+        }
+        input += consumed;
+        inputSize -= consumed;
+        output += produced;
+        outputSize -= produced;
+        // Zero once a frame is decoded and flushed, the next call starts the following frame.
+        frameEnded = status == 0;
+        if (inputSize == 0 || outputSize == 0 || (consumed == 0 && produced == 0))
+        {
+            break;
+        }
+    }
+    return frameEnded && inputSize == 0;
+}
+
+bool Lz4Decoder::complete() const {
+    return frameEnded;
+}
+
+std::size_t Lz4Decoder::contentSize(const unsigned char* bytes, std::size_t size) {
+    // Magic number, FLG (version 01, content size flag in bit 3), BD, then the 64 bits content size.
+    if (size < 14 || bytes[0] != 0x04 || bytes[1] != 0x22 || bytes[2] != 0x4d || bytes[3] != 0x18 ||
+        (bytes[4] & 0xc0) != 0x40 || (bytes[4] & 0x08) == 0)
+    {
+        return 0;
+    }
+    std::size_t decodedSize = 0;
+    for (int i = 7; i >= 0; --i)
+    {
+        decodedSize = decodedSize << 8 | bytes[6 + i];
+    }
+    return decodedSize;
+}
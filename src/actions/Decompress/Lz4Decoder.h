@@ -0,0 +1,48 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef LZ4DECODER_H
+#define LZ4DECODER_H
+#include <cstddef>
+#include <memory>
+
+#include "StreamDecoder.h"
+
+/**
+ * @class Lz4Decoder
+ * @brief Incremental decoder of lz4 frames, concatenated and skippable frames included.
+ *
+ * Blocks are decoded straight into the caller's buffer whenever it has room for a whole block,
+ * so a buffer of the decoded size lets the whole frame decode without intermediate copies.
+ *
+ * Only compiled when liblz4 is found at build time.
+ */
+class Lz4Decoder : public StreamDecoder {
+public:
+    Lz4Decoder();
+    ~Lz4Decoder() override;
+
+    Lz4Decoder(const Lz4Decoder&) = delete;
+    Lz4Decoder& operator=(const Lz4Decoder&) = delete;
+
+    bool decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                std::size_t& outputSize) override;
+
+    bool complete() const override;
+
+    /**
+     * @brief The decoded size recorded in the descriptor of the first frame, zero if it is not.
+     */
+    static std::size_t contentSize(const unsigned char* bytes, std::size_t size);
+
+private:
+    struct Context;
+
+    std::unique_ptr<Context> context;
+    bool frameEnded = false;
+};
+
+
+
+#endif //LZ4DECODER_H
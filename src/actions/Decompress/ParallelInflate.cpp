@@ -0,0 +1,270 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "ParallelInflate.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+
+#include "DeflateDecoder.h"
+#include "../../utils/BufferPool.h"
+
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+
+#include "ZstdDecoder.h"
+#endif
+
+namespace {
+
+    // A 10 bytes header, an empty DEFLATE block and the 8 bytes trailer.
+    constexpr std::size_t MinMemberSize = 20;
+
+    std::size_t readLittleEndian32(const unsigned char* bytes)
+    {
+        return static_cast<std::uint32_t>(bytes[0]) | static_cast<std::uint32_t>(bytes[1]) << 8 |
+               static_cast<std::uint32_t>(bytes[2]) << 16 | static_cast<std::uint32_t>(bytes[3]) << 24;
+    }
+
+    // Whether a gzip member header plausibly starts at `bytes`: deflate method, no reserved flag,
+    // extra flags and operating system among the values compressors write.
+    bool looksLikeMember(const unsigned char* bytes)
+    {
+        return bytes[0] == 0x1f && bytes[1] == 0x8b && bytes[2] == 8 && (bytes[3] & 0xe0) == 0 &&
+               (bytes[8] == 0 || bytes[8] == 2 || bytes[8] == 4) && (bytes[9] <= 13 || bytes[9] == 255);
+    }
+
+    struct Task {
+        std::size_t inputBegin;
+        std::size_t inputEnd;
+        std::size_t outputBegin;
+        std::size_t outputEnd;
+    };
+
+#if defined(HAVE_ZSTD)
+    struct Frame {
+        std::size_t offset;
+        std::size_t size;
+        std::size_t outputBegin;
+        std::size_t decodedSize;
+    };
+
+    // Locates the frames of a zstd payload and their place in the output, false if one is corrupt or
+    // does not record its decoded size.
+    bool splitFrames(const unsigned char* bytes, std::size_t size, std::vector<Frame>& frames, std::size_t& total)
+    {
+        total = 0;
+        for (std::size_t offset = 0; offset < size;)
+        {
+            const std::size_t frameSize = ::ZSTD_findFrameCompressedSize(bytes + offset, size - offset);
+            if (::ZSTD_isError(frameSize) || frameSize == 0)
+            {
+                return false;
+            }
+            const std::uint32_t magic = static_cast<std::uint32_t>(readLittleEndian32(bytes + offset));
+            if ((magic & ZSTD_MAGIC_SKIPPABLE_MASK) != ZSTD_MAGIC_SKIPPABLE_START)
+            {
+                const unsigned long long decodedSize = ::ZSTD_getFrameContentSize(bytes + offset, size - offset);
+                if (decodedSize == ZSTD_CONTENTSIZE_UNKNOWN || decodedSize == ZSTD_CONTENTSIZE_ERROR ||
+                    decodedSize > std::numeric_limits<std::size_t>::max() - total)
+                {
+                    return false;
+                }
+                frames.push_back({offset, frameSize, total, static_cast<std::size_t>(decodedSize)});
+                total += static_cast<std::size_t>(decodedSize);
+            }
+            offset += frameSize;
+        }
+        return true;
+    }
+#endif
+}
+
+bool ParallelInflate::splitBgzf(const unsigned char* bytes, std::size_t size, std::vector<Member>& members) {
+    for (std::size_t offset = 0; offset < size;)
+    {
+        const unsigned char* member = bytes + offset;
+        const std::size_t left = size - offset;
+        if (left < MinMemberSize + 6 || !looksLikeMember(member) || (member[3] & 0x04) == 0)
+        {
+            return false;
+        }
+        // The "BC" subfield of the extra field holds the member size minus one.
+        const std::size_t extraEnd = 12 + (member[10] | member[11] << 8);
+        std::size_t memberSize = 0;
+        for (std::size_t field = 12; field + 4 <= extraEnd && extraEnd <= left;)
+        {
+            const std::size_t fieldSize = member[field + 2] | member[field + 3] << 8;
+            if (member[field] == 'B' && member[field + 1] == 'C' && fieldSize == 2 && field + 6 <= extraEnd)
+            {
+                memberSize = (member[field + 4] | member[field + 5] << 8) + std::size_t{1};
+                break;
+            }
+            field += 4 + fieldSize;
+        }
+        if (memberSize < extraEnd + 10 || memberSize > left)
+        {
+            return false;
+        }
+        members.push_back({offset, readLittleEndian32(member + memberSize - 4)});
+        offset += memberSize;
+    }
+    return true;
+}
+
+bool ParallelInflate::split(const unsigned char* bytes, std::size_t size, std::vector<Member>& members) {
+    if (size < MinMemberSize || !looksLikeMember(bytes))
+    {
+        return false;
+    }
+    if (splitBgzf(bytes, size, members))
+    {
+        return true;
+    }
+
+    members.assign(1, Member{0, 0});
+    std::size_t at = MinMemberSize;
+    while (at + MinMemberSize <= size)
+    {
+        const void* found = std::memchr(bytes + at, 0x1f, size - MinMemberSize + 1 - at);
+        if (found == nullptr)
+        {
+            break;
+        }
+        const std::size_t candidate = static_cast<const unsigned char*>(found) - bytes;
+        if (!looksLikeMember(bytes + candidate))
+        {
+            at = candidate + 1;
+            continue;
+        }
+        // The trailer ending the previous member records its decoded size.
+        members.back().decodedSize = readLittleEndian32(bytes + candidate - 4);
+        members.push_back({candidate, 0});
+        at = candidate + MinMemberSize;
+    }
+    members.back().decodedSize = readLittleEndian32(bytes + size - 4);
+    return true;
+}
+
+bool ParallelInflate::decode(const unsigned char* bytes, std::size_t size, BufferSlice& decoded,
+                             const DecompressionLimits& limits, ThreadPool& pool) {
+    std::vector<Member> members;
+    if (size < MinInputSize || pool.size() < 2 || !split(bytes, size, members) || members.size() < 2)
+    {
+        return false;
+    }
+
+    std::vector<Task> tasks;
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < members.size(); ++i)
+    {
+        const std::size_t end = i + 1 < members.size() ? members[i + 1].offset : size;
+        if (tasks.empty() || tasks.back().inputEnd - tasks.back().inputBegin >= TaskInputSize)
+        {
+            tasks.push_back({members[i].offset, end, total, total});
+        }
+        total += members[i].decodedSize;
+        tasks.back().inputEnd = end;
+        tasks.back().outputEnd = total;
+    }
+    if (tasks.size() < 2 || total > size * DeflateDecoder::MaxExpansion || total > limits.allowance(size))
+    {
+        return false;
+    }
+
+    const std::shared_ptr<BufferPool::Buffer> buffer = BufferPool::shared().acquire(total);
+    std::atomic<bool> failed{false};
+    pool.parallelFor(tasks.size(), [&](std::size_t i) {
+        if (failed.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        const Task& task = tasks[i];
+        const unsigned char* input = bytes + task.inputBegin;
+        std::size_t inputSize = task.inputEnd - task.inputBegin;
+        unsigned char* output = buffer->data() + task.outputBegin;
+        std::size_t outputSize = task.outputEnd - task.outputBegin;
+        try
+        {
+            DeflateDecoder decoder(DeflateDecoder::Format::Gzip);
+            // Members split in the wrong place end elsewhere or decode to another size.
+            if (!decoder.decode(input, inputSize, output, outputSize) || inputSize != 0 || outputSize != 0)
+            {
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+        catch (const std::exception&)
+        {
+            failed.store(true, std::memory_order_relaxed);
+        }
+    });
+    if (failed.load())
+    {
+        return false;
+    }
+    decoded = BufferSlice(buffer, buffer->data(), total);
+    return true;
+}
+
+bool ParallelInflate::decodeZstd([[maybe_unused]] const unsigned char* bytes, [[maybe_unused]] std::size_t size,
+                                 [[maybe_unused]] BufferSlice& decoded,
+                                 [[maybe_unused]] const DecompressionLimits& limits,
+                                 [[maybe_unused]] ThreadPool& pool) {
+#if defined(HAVE_ZSTD)
+    std::vector<Frame> frames;
+    std::size_t total = 0;
+    if (size < MinInputSize || pool.size() < 2 || !splitFrames(bytes, size, frames, total) || frames.size() < 2 ||
+        total > limits.allowance(size))
+    {
+        return false;
+    }
+
+    // Each task decodes consecutive frames, the first frame of every task is listed.
+    std::vector<std::size_t> tasks;
+    std::size_t taskInput = 0;
+    for (std::size_t i = 0; i < frames.size(); ++i)
+    {
+        if (tasks.empty() || taskInput >= TaskInputSize)
+        {
+            tasks.push_back(i);
+            taskInput = 0;
+        }
+        taskInput += frames[i].size;
+    }
+    if (tasks.size() < 2)
+    {
+        return false;
+    }
+
+    const std::shared_ptr<BufferPool::Buffer> buffer = BufferPool::shared().acquire(total);
+    std::atomic<bool> failed{false};
+    pool.parallelFor(tasks.size(), [&](std::size_t i) {
+        const std::size_t end = i + 1 < tasks.size() ? tasks[i + 1] : frames.size();
+        for (std::size_t k = tasks[i]; k < end && !failed.load(std::memory_order_relaxed); ++k)
+        {
+            const Frame& frame = frames[k];
+            try
+            {
+                ZstdDecoder::decodeFrame(bytes + frame.offset, frame.size, buffer->data() + frame.outputBegin,
+                                         frame.decodedSize);
+            }
+            catch (const std::exception&)
+            {
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    });
+    if (failed.load())
+    {
+        return false;
+    }
+    decoded = BufferSlice(buffer, buffer->data(), total);
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,90 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef PARALLELINFLATE_H
+#define PARALLELINFLATE_H
+#include <cstddef>
+#include <vector>
+
+#include "DecompressionLimits.h"
+#include "../../utils/BufferSlice.h"
+#include "../../utils/ThreadPool.h"
+
+/**
+ * @class ParallelInflate
+ * @brief Decodes the members of a large gzip payload concurrently.
+ *
+ * gzip members are independent: a payload made of several of them (bgzip output, concatenated
+ * files, pigz runs appended to each other) can be decoded member by member on different threads.
+ * The members are located without decoding anything. bgzip records the size of each member in its
+ * header, other payloads are scanned for member headers. The trailer right before each member
+ * gives the decoded size of the previous one, so the whole output is allocated once and every task
+ * decodes its members into its own range of it.
+ *
+ * A header found inside compressed data would split the payload in the wrong place. Each task
+ * checks that its members end exactly at the boundary and produce exactly the expected size,
+ * with verified checksums. When one does not, the payload is left to the sequential decoder.
+ *
+ * zstd payloads made of several frames (`pzstd` output, the seekable format, concatenated
+ * files) are decoded the same way when libzstd is compiled in: frame boundaries are exact, read
+ * with `ZSTD_findFrameCompressedSize`, and every frame records its decoded size in its header.
+ */
+class ParallelInflate {
+public:
+
+    /**
+     * @brief Payloads smaller than this are not worth splitting.
+     */
+    static constexpr std::size_t MinInputSize = std::size_t{4} << 20;
+
+    /**
+     * @brief Compressed bytes decoded by a task at least. Smaller members are grouped.
+     */
+    static constexpr std::size_t TaskInputSize = std::size_t{1} << 20;
+
+    /**
+     * @brief Decodes a complete gzip payload on `pool` when it consists of several members.
+     *
+     * @param bytes The gzip payload.
+     * @param size Number of compressed bytes.
+     * @param decoded Receives the decoded bytes, in a single pooled buffer.
+     * @param limits Caps on the decoded size. Payloads whose members add up past them are left to
+     *        the sequential decoder, which reports them.
+     * @param pool The threads decoding the members, the calling thread takes part.
+     * @return false if the payload is too small, made of a single member, or could not be split
+     *         reliably. Nothing is decoded then.
+     */
+    static bool decode(const unsigned char* bytes, std::size_t size, BufferSlice& decoded,
+                       const DecompressionLimits& limits = DecompressionLimits::shared(),
+                       ThreadPool& pool = ThreadPool::shared());
+
+    /**
+     * @brief Decodes a complete zstd payload on `pool` when it consists of several frames.
+     *
+     * Skippable frames are skipped. The parameters are those of `decode`.
+     *
+     * @return false if the payload is too small, made of a single frame, has a frame that does not
+     *         record its decoded size or could not be decoded, or libzstd is not compiled in.
+     *         Nothing is decoded then.
+     */
+    static bool decodeZstd(const unsigned char* bytes, std::size_t size, BufferSlice& decoded,
+                           const DecompressionLimits& limits = DecompressionLimits::shared(),
+                           ThreadPool& pool = ThreadPool::shared());
+
+private:
+    struct Member {
+        std::size_t offset;
+        std::size_t decodedSize;
+    };
+
+    // Locates the members of `bytes`, false if it does not start with a gzip member.
+    static bool split(const unsigned char* bytes, std::size_t size, std::vector<Member>& members);
+
+    // Follows the member sizes recorded by bgzip, false if a member does not record it.
+    static bool splitBgzf(const unsigned char* bytes, std::size_t size, std::vector<Member>& members);
+};
+
+
+
+#endif //PARALLELINFLATE_H
@@ -0,0 +1,258 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "StreamDecoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "BrotliDecoder.h"
+#include "DeflateDecoder.h"
+#include "XzDecoder.h"
+#include "DecompressionLimits.h"
+#include "../../utils/BufferPool.h"
+#if defined(HAVE_ZSTD)
+#include "ZstdDecoder.h"
+#endif
+#if defined(HAVE_LZ4)
+#include "Lz4Decoder.h"
+#endif
+
+namespace {
+
+    // Upper bound of the decoded size of `size` compressed bytes, past which the stream must be corrupt.
+    std::size_t maxDecodedSize(StreamDecoder::Format format, std::size_t size)
+    {
+        if (format == StreamDecoder::Format::Gzip || format == StreamDecoder::Format::Zlib)
+        {
+            return size * DeflateDecoder::MaxExpansion + 64;
+        }
+        return std::numeric_limits<std::size_t>::max();
+    }
+
+    /**
+     * Anonymous mapping receiving an output that outgrew its pooled buffer. Pages are only committed once
+     * written, and growing remaps them instead of copying, so the output is never held twice.
+     */
+    class OutputMapping {
+    public:
+        OutputMapping() = default;
+        OutputMapping(const OutputMapping&) = delete;
+        OutputMapping& operator=(const OutputMapping&) = delete;
+
+        ~OutputMapping() {
+            if (data != nullptr)
+            {
+                ::munmap(data, size);
+            }
+        }
+
+        unsigned char* begin() const {
+            return data;
+        }
+
+        void resize(std::size_t newSize) {
+            void* address = data == nullptr
+                ? ::mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)
+                : ::mremap(data, size, newSize, MREMAP_MAYMOVE);
+            if (address == MAP_FAILED)
+            {
+                throw std::bad_alloc();
+            }
+            data = static_cast<unsigned char*>(address);
+            size = newSize;
+        }
+
+        // Hands the first `used` bytes over to a slice, the pages past them are returned first.
+        BufferSlice release(std::size_t used) {
+            const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            const std::size_t kept = std::max(page, (used + page - 1) / page * page);
+            if (kept < size)
+            {
+                resize(kept);
+            }
+            unsigned char* bytes = std::exchange(data, nullptr);
+            std::shared_ptr<const void> owner(bytes, [length = size](const void* mapped) {
+                ::munmap(const_cast<void*>(mapped), length);
+            });
+            return {std::move(owner), bytes, used};
+        }
+
+    private:
+        unsigned char* data = nullptr;
+        std::size_t size = 0;
+    };
+}
+
+std::unique_ptr<StreamDecoder> StreamDecoder::create(Format format) {
+    switch (format)
+    {
+    case Format::Gzip:
+        return std::make_unique<DeflateDecoder>(DeflateDecoder::Format::Gzip);
+    case Format::Zlib:
+        return std::make_unique<DeflateDecoder>(DeflateDecoder::Format::Zlib);
+    case Format::Xz:
+        return std::make_unique<XzDecoder>();
+    case Format::Brotli:
+        return std::make_unique<BrotliDecoder>();
+#if defined(HAVE_ZSTD)
+    case Format::Zstd:
+        return std::make_unique<ZstdDecoder>();
+#endif
+#if defined(HAVE_LZ4)
+    case Format::Lz4:
+        return std::make_unique<Lz4Decoder>();
+#endif
+    default:
+        throw std::invalid_argument(std::string("unsupported compression format: ") + name(format) +
+                                    " support is not compiled in");
+    }
+}
+
+bool StreamDecoder::detect(const unsigned char* bytes, std::size_t size, Format& format) {
+    auto startsWith = [&](const char* magic, std::size_t length) {
+        return size >= length && std::memcmp(bytes, magic, length) == 0;
+    };
+
+    if (DeflateDecoder::Format deflate; DeflateDecoder::detect(bytes, size, deflate))
+    {
+        format = deflate == DeflateDecoder::Format::Gzip ? Format::Gzip : Format::Zlib;
+        return true;
+    }
+    if (startsWith("\x28\xb5\x2f\xfd", 4))
+    {
+        format = Format::Zstd;
+        return true;
+    }
+    if (startsWith("\x04\x22\x4d\x18", 4))
+    {
+        format = Format::Lz4;
+        return true;
+    }
+    if (startsWith("\xfd\x37\x7a\x58\x5a\x00", 6))
+    {
+        format = Format::Xz;
+        return true;
+    }
+    return false;
+}
+
+std::size_t StreamDecoder::contentSize(const unsigned char* bytes, std::size_t size, Format format) {
+    switch (format)
+    {
+    case Format::Gzip:
+        return DeflateDecoder::gzipSizeHint(bytes, size);
+#if defined(HAVE_ZSTD)
+    case Format::Zstd:
+        return ZstdDecoder::contentSize(bytes, size);
+#endif
+#if defined(HAVE_LZ4)
+    case Format::Lz4:
+        return Lz4Decoder::contentSize(bytes, size);
+#endif
+    default:
+        return 0;
+    }
+}
+
+BufferSlice StreamDecoder::decodeAll(const unsigned char* bytes, std::size_t size, Format format, std::size_t sizeHint,
+                                     const DecompressionLimits& limits) {
+    // A payload announcing more than it may produce is rejected before anything is allocated.
+    const std::size_t inputSize = size;
+    limits.check(inputSize, std::max(sizeHint, contentSize(bytes, size, format)));
+#if defined(HAVE_ZSTD)
+    if (BufferSlice decoded; format == Format::Zstd && ZstdDecoder::decodeFrame(bytes, size, decoded))
+    {
+        return decoded;
+    }
+#endif
+    const std::unique_ptr<StreamDecoder> decoder = create(format);
+    // One byte past the allowance tells an output exceeding it from one filling it exactly.
+    const std::size_t allowance = limits.allowance(inputSize);
+    const std::size_t maxSize = std::min(maxDecodedSize(format, size),
+                                         allowance == std::numeric_limits<std::size_t>::max() ? allowance : allowance + 1);
+    std::size_t capacity = sizeHint != 0 ? std::min(sizeHint, maxSize)
+                                         : std::clamp<std::size_t>(size * 4, std::size_t{64} << 10, maxSize);
+    std::shared_ptr<BufferPool::Buffer> buffer = BufferPool::shared().acquire(capacity);
+    OutputMapping mapping;
+    unsigned char* data = buffer->data();
+    std::size_t available = buffer->size();
+
+    std::size_t produced = 0;
+    for (;;)
+    {
+        unsigned char* output = data + produced;
+        std::size_t outputSize = available - produced;
+        const bool ended = decoder->decode(bytes, size, output, outputSize);
+        produced = output - data;
+        if (ended)
+        {
+            break;
+        }
+        if (outputSize != 0)
+        {
+            // Decoders may hold back decoded bytes, the input only ran short if there was room left.
+            if (size == 0)
+            {
+                throw std::runtime_error(std::string("truncated ") + name(format) + " stream");
+            }
+            continue;
+        }
+
+        // The hint was too small: use the spare capacity of the size class first, then move the output
+        // once to a mapping twice as large, which keeps doubling without copying.
+        if (buffer && std::min(buffer->capacity(), maxSize) > buffer->size())
+        {
+            buffer->resize(std::min(buffer->capacity(), maxSize));
+            available = buffer->size();
+            continue;
+        }
+        if (produced >= maxSize)
+        {
+            limits.check(inputSize, produced);
+            throw std::runtime_error(std::string("corrupt ") + name(format) +
+                                     " stream: output exceeds the maximum expansion");
+        }
+        available = std::min(available * 2, maxSize);
+        mapping.resize(available);
+        if (buffer)
+        {
+            std::memcpy(mapping.begin(), buffer->data(), produced);
+            buffer.reset();
+        }
+        data = mapping.begin();
+    }
+    if (!buffer)
+    {
+        return mapping.release(produced);
+    }
+    return {buffer, data, produced};
+}
+
+const char* StreamDecoder::name(Format format) {
+    switch (format)
+    {
+    case Format::Gzip:
+        return "gzip";
+    case Format::Zlib:
+        return "zlib";
+    case Format::Zstd:
+        return "zstd";
+    case Format::Lz4:
+        return "lz4";
+    case Format::Xz:
+        return "xz";
+    case Format::Brotli:
+        return "brotli";
+    }
+    return "unknown";
+}
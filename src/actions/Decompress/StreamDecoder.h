@@ -0,0 +1,113 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef STREAMDECODER_H
+#define STREAMDECODER_H
+#include <cstddef>
+#include <memory>
+
+#include "DecompressionLimits.h"
+#include "../../utils/BufferSlice.h"
+
+/**
+ * @class StreamDecoder
+ * @brief Incremental decoder of a compressed stream, whatever its codec.
+ *
+ * The compressed bytes are fed in pieces of any size and the decoded bytes are written into
+ * buffers supplied by the caller. Every codec implements the same contract, so `DecompressStream`
+ * and `decodeAll` drive them alike.
+ *
+ * gzip, zlib, xz and brotli are always available. zstd and lz4 are compiled in when their
+ * libraries are found at build time (`HAVE_ZSTD`, `HAVE_LZ4`).
+ */
+class StreamDecoder {
+public:
+
+    /**
+     * @brief The compression formats a decoder exists for.
+     */
+    enum class Format {
+        Gzip,
+        Zlib,
+        Zstd,
+        Lz4,
+        Xz,
+        Brotli
+    };
+
+    virtual ~StreamDecoder() = default;
+
+    /**
+     * @brief Decodes `input` into `output` until either is exhausted or the stream ends.
+     *
+     * Pointers and sizes are advanced past the consumed and produced bytes.
+     *
+     * @return true once the stream ended. Formats made of concatenated members or frames end after
+     *         one of them when the input ends there; calling again with more input decodes the
+     *         following ones.
+     *
+     * @throws std::runtime_error If the data is corrupt or a checksum does not match.
+     */
+    virtual bool decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                        std::size_t& outputSize) = 0;
+
+    /**
+     * @brief Whether the input may end here, between two members or frames or after the stream.
+     */
+    virtual bool complete() const = 0;
+
+    /**
+     * @brief Creates a decoder of `format`.
+     *
+     * @throws std::invalid_argument If support for `format` was not compiled in.
+     */
+    static std::unique_ptr<StreamDecoder> create(Format format);
+
+    /**
+     * @brief Recognizes the format of a stream from its magic bytes.
+     *
+     * brotli streams have none: they are only decoded when their source records the codec.
+     *
+     * @return true if `bytes` starts a gzip, zlib, zstd, lz4 or xz stream, `format` then receives it.
+     */
+    static bool detect(const unsigned char* bytes, std::size_t size, Format& format);
+
+    /**
+     * @brief The decoded size a complete stream records about itself, zero if it records none.
+     *
+     * gzip trailers, zstd frame headers and lz4 frame descriptors may carry it.
+     */
+    static std::size_t contentSize(const unsigned char* bytes, std::size_t size, Format format);
+
+    /**
+     * @brief Decodes a complete stream into a single pooled buffer.
+     *
+     * A single zstd frame of known size is decoded in one shot; other streams are decoded
+     * incrementally, into a buffer grown as needed when `sizeHint` falls short, but never past
+     * what `limits` allow.
+     *
+     * @param bytes The compressed stream.
+     * @param size Number of compressed bytes.
+     * @param format Format of the stream.
+     * @param sizeHint Expected decoded size, the buffer is allocated once when exact. Zero if unknown.
+     * @param limits Caps on the decoded size, checked against `sizeHint` and the size the stream
+     *        records before decoding, then against the output while decoding.
+     * @return BufferSlice The decoded bytes.
+     *
+     * @throws std::invalid_argument If support for `format` was not compiled in.
+     * @throws std::runtime_error If the stream is corrupt or truncated.
+     * @throws std::system_error With a `DecompressionError` code if the output exceeds `limits`.
+     */
+    static BufferSlice decodeAll(const unsigned char* bytes, std::size_t size, Format format, std::size_t sizeHint,
+                                 const DecompressionLimits& limits = DecompressionLimits::shared());
+
+    /**
+     * @brief Name of `format`, for messages.
+     */
+    static const char* name(Format format);
+};
+
+
+
+#endif //STREAMDECODER_H
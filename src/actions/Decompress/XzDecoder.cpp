@@ -0,0 +1,124 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "XzDecoder.h"
+
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <lzma.h>
+
+namespace {
+
+    void start(lzma_stream& stream)
+    {
+        if (::lzma_stream_decoder(&stream, UINT64_MAX, 0) != LZMA_OK)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    const char* describe(lzma_ret status)
+    {
+        switch (status)
+        {
+        case LZMA_MEM_ERROR:
+            throw std::bad_alloc();
+        case LZMA_FORMAT_ERROR:
+            return "not an xz stream";
+        case LZMA_OPTIONS_ERROR:
+            return "unsupported options";
+        case LZMA_DATA_ERROR:
+            return "corrupt data";
+        default:
+            return "decoding failed";
+        }
+    }
+}
+
+/**
+ * A stream decoder, initialized again for every concatenated stream (liblzma reuses its memory).
+ */
+struct XzDecoder::Context {
+    lzma_stream stream = LZMA_STREAM_INIT;
+
+    Context() {
+        start(stream);
+    }
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    ~Context() {
+        ::lzma_end(&stream);
+    }
+};
+
+XzDecoder::XzDecoder() : context(std::make_unique<Context>()) {}
+
+XzDecoder::~XzDecoder() = default;
+
+bool XzDecoder::decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                       std::size_t& outputSize) {
+    for (;;)
+    {
+        switch (stage)
+        {
+        case Stage::Stream:
+        {
+            lzma_stream& stream = context->stream;
+            stream.next_in = input;
+            stream.avail_in = inputSize;
+            stream.next_out = output;
+            stream.avail_out = outputSize;
+            const lzma_ret status = ::lzma_code(&stream, LZMA_RUN);
+
+            const std::size_t consumed = stream.next_in - input;
+            const std::size_t produced = stream.next_out - output;
+            input += consumed;
+            inputSize -= consumed;
+            output += produced;
+            outputSize -= produced;
+
+            if (status == LZMA_STREAM_END)
+            {
+                stage = Stage::Boundary;
+            }
+            else if (status != LZMA_OK && status != LZMA_BUF_ERROR)
+            {
+                throw std::runtime_error(std::string("corrupt xz stream: ") + describe(status));
+            }
+            else if (inputSize == 0 || outputSize == 0)
+            {
+                return false;
+            }
+            break;
+        }
+
+        case Stage::Boundary:
+            if (inputSize == 0)
+            {
+                return true;
+            }
+            // Anything else than another stream is trailing data, ignored as gzip does.
+            if (input[0] != 0xfd)
+            {
+                stage = Stage::Done;
+                break;
+            }
+            start(context->stream);
+            stage = Stage::Stream;
+            break;
+
+        case Stage::Done:
+            return true;
+        }
+    }
+}
+
+bool XzDecoder::complete() const {
+    return stage != Stage::Stream;
+}
@@ -0,0 +1,47 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef XZDECODER_H
+#define XZDECODER_H
+#include <cstddef>
+#include <memory>
+
+#include "StreamDecoder.h"
+
+/**
+ * @class XzDecoder
+ * @brief Incremental decoder of xz streams, concatenated streams included.
+ *
+ * Like gzip members, a stream followed by something else than another stream ends the payload and
+ * whatever follows is ignored. Block checks are verified by liblzma.
+ */
+class XzDecoder : public StreamDecoder {
+public:
+    XzDecoder();
+    ~XzDecoder() override;
+
+    XzDecoder(const XzDecoder&) = delete;
+    XzDecoder& operator=(const XzDecoder&) = delete;
+
+    bool decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                std::size_t& outputSize) override;
+
+    bool complete() const override;
+
+private:
+    struct Context;
+
+    enum class Stage {
+        Stream,
+        Boundary,
+        Done
+    };
+
+    std::unique_ptr<Context> context;
+    Stage stage = Stage::Stream;
+};
+
+
+
+#endif //XZDECODER_H
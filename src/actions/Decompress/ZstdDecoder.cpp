@@ -0,0 +1,335 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "ZstdDecoder.h"
+
+#include <array>
+#include <cerrno>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// For ZSTD_createDDict_byReference, which digests a dictionary without copying its content.
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+#include "../../utils/BufferPool.h"
+
+namespace {
+
+    void check(std::size_t status)
+    {
+        if (ZSTD_isError(status))
+        {
+            throw std::runtime_error(std::string("corrupt zstd stream: ") + ZSTD_getErrorName(status));
+        }
+    }
+
+    [[noreturn]] void throwErrno(const std::string& what, const std::string& path)
+    {
+        throw std::system_error(errno, std::generic_category(), what + ": " + path);
+    }
+
+    /**
+     * A loaded dictionary: its file stays mapped, the digested form references the content in place.
+     */
+    struct Dictionary {
+        void* address;
+        std::size_t length;
+        ZSTD_DDict* digested = nullptr;
+
+        Dictionary(void* address, std::size_t length) : address(address), length(length) {}
+        Dictionary(const Dictionary&) = delete;
+        Dictionary& operator=(const Dictionary&) = delete;
+
+        ~Dictionary() {
+            ::ZSTD_freeDDict(digested);
+            ::munmap(address, length);
+        }
+    };
+
+    /**
+     * The loaded dictionaries by ID. Never unloaded, so the digested dictionaries outlive every
+     * context referencing them.
+     */
+    struct Dictionaries {
+        std::shared_mutex mutex;
+        std::unordered_map<std::uint32_t, std::unique_ptr<Dictionary>> byId;
+
+        static Dictionaries& shared() {
+            static Dictionaries dictionaries;
+            return dictionaries;
+        }
+
+        const ZSTD_DDict* find(std::uint32_t id) {
+            std::shared_lock lock(mutex);
+            const auto found = byId.find(id);
+            return found != byId.end() ? found->second->digested : nullptr;
+        }
+    };
+
+    // Longest prefix of a frame header needed to reach its dictionary ID (RFC 8878, section 3.1.1.1).
+    constexpr std::size_t DictionaryIdPrefix = 10;
+
+    /**
+     * Reads the dictionary ID of the frame starting at `bytes`, zero if it names none or is not a
+     * zstd frame (skippable frames, corrupt data left to zstd).
+     *
+     * @return false if the header is cut before the ID.
+     */
+    bool frameDictionaryId(const unsigned char* bytes, std::size_t size, std::uint32_t& id)
+    {
+        if (size < 4)
+        {
+            return false;
+        }
+        id = 0;
+        const std::uint32_t magic = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<std::uint32_t>(bytes[3]) << 24;
+        if (magic != ZSTD_MAGICNUMBER)
+        {
+            return true;
+        }
+        if (size < 5)
+        {
+            return false;
+        }
+        static constexpr std::size_t IdSizes[] = {0, 1, 2, 4};
+        const unsigned char descriptor = bytes[4];
+        const std::size_t idSize = IdSizes[descriptor & 3];
+        // A window descriptor precedes the ID unless the frame is a single segment.
+        const std::size_t at = (descriptor & 0x20) != 0 ? 5 : 6;
+        if (size < at + idSize)
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < idSize; ++i)
+        {
+            id |= static_cast<std::uint32_t>(bytes[at + i]) << (8 * i);
+        }
+        return true;
+    }
+}
+
+/**
+ * A decompression context, reset between decoders instead of being created again. The dictionary
+ * it references is kept across resets, consecutive payloads sharing a dictionary reference it once.
+ */
+struct ZstdDecoder::Context {
+    ZSTD_DCtx* context = ::ZSTD_createDCtx();
+    std::uint32_t dictionaryId = 0;
+
+    // First bytes of a frame header cut by the end of an input, until its dictionary ID is known.
+    std::array<unsigned char, DictionaryIdPrefix> header{};
+    std::size_t headerSize = 0;
+
+    Context() {
+        if (context == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    ~Context() {
+        ::ZSTD_freeDCtx(context);
+    }
+
+    /**
+     * References the dictionary `id` (none for zero) for the frames that follow.
+     */
+    void useDictionary(std::uint32_t id) {
+        if (id == dictionaryId)
+        {
+            return;
+        }
+        const ZSTD_DDict* dictionary = nullptr;
+        if (id != 0 && (dictionary = Dictionaries::shared().find(id)) == nullptr)
+        {
+            throw std::runtime_error("zstd frame needs dictionary " + std::to_string(id) + ", which is not loaded");
+        }
+        check(::ZSTD_DCtx_refDDict(context, dictionary));
+        dictionaryId = id;
+    }
+
+    /**
+     * Selects the dictionary of the frame starting at `in`, whose header may be split across inputs.
+     *
+     * @return false if `in` ends before the dictionary ID, its bytes are kept for the next input.
+     */
+    bool startFrame(ZSTD_inBuffer& in) {
+        const auto* bytes = static_cast<const unsigned char*>(in.src);
+        std::uint32_t id = 0;
+        if (headerSize == 0 && frameDictionaryId(bytes + in.pos, in.size - in.pos, id))
+        {
+            useDictionary(id);
+            return true;
+        }
+        while (!frameDictionaryId(header.data(), headerSize, id))
+        {
+            if (in.pos == in.size)
+            {
+                return false;
+            }
+            header[headerSize++] = bytes[in.pos++];
+        }
+        useDictionary(id);
+        // Only header bytes were kept, zstd buffers them without producing anything.
+        ZSTD_inBuffer kept{header.data(), headerSize, 0};
+        ZSTD_outBuffer none{nullptr, 0, 0};
+        check(::ZSTD_decompressStream(context, &none, &kept));
+        headerSize = 0;
+        return true;
+    }
+};
+
+std::unique_ptr<ZstdDecoder::Context>& ZstdDecoder::idleContext() {
+    thread_local std::unique_ptr<Context> idle;
+    return idle;
+}
+
+ZstdDecoder::ZstdDecoder() : context(std::move(idleContext())) {
+    if (context == nullptr)
+    {
+        context = std::make_unique<Context>();
+    }
+    ::ZSTD_DCtx_reset(context->context, ZSTD_reset_session_only);
+    context->headerSize = 0;
+}
+
+ZstdDecoder::~ZstdDecoder() {
+    if (std::unique_ptr<Context>& idle = idleContext(); idle == nullptr)
+    {
+        idle = std::move(context);
+    }
+}
+
+bool ZstdDecoder::decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                         std::size_t& outputSize) {
+    if (frameEnded && inputSize == 0)
+    {
+        return true;
+    }
+    ZSTD_inBuffer in{input, inputSize, 0};
+    ZSTD_outBuffer out{output, outputSize, 0};
+    for (;;)
+    {
+        // Each frame names its dictionary, which must be referenced before the frame is decoded.
+        if (frameStart && !context->startFrame(in))
+        {
+            break;
+        }
+        frameStart = false;
+        const std::size_t consumed = in.pos;
+        const std::size_t produced = out.pos;
+        const std::size_t status = ::ZSTD_decompressStream(context->context, &out, &in);
+        check(status);
+        // Zero once a frame is decoded and flushed, the next call starts the following frame.
+        frameEnded = status == 0;
+        frameStart = frameEnded;
+        if (in.pos == in.size || out.pos == out.size || (in.pos == consumed && out.pos == produced))
+        {
+            break;
+        }
+    }
+    input += in.pos;
+    inputSize -= in.pos;
+    output += out.pos;
+    outputSize -= out.pos;
+    return frameEnded && inputSize == 0;
+}
+
+bool ZstdDecoder::complete() const {
+    return frameEnded;
+}
+
+std::size_t ZstdDecoder::contentSize(const unsigned char* bytes, std::size_t size) {
+    const unsigned long long decodedSize = ::ZSTD_getFrameContentSize(bytes, size);
+    return decodedSize == ZSTD_CONTENTSIZE_UNKNOWN || decodedSize == ZSTD_CONTENTSIZE_ERROR
+               ? 0
+               : static_cast<std::size_t>(decodedSize);
+}
+
+bool ZstdDecoder::decodeFrame(const unsigned char* bytes, std::size_t size, BufferSlice& output) {
+    const unsigned long long decodedSize = ::ZSTD_getFrameContentSize(bytes, size);
+    if (decodedSize == ZSTD_CONTENTSIZE_UNKNOWN || decodedSize == ZSTD_CONTENTSIZE_ERROR ||
+        ::ZSTD_findFrameCompressedSize(bytes, size) != size)
+    {
+        return false;
+    }
+    const std::shared_ptr<BufferPool::Buffer> buffer = BufferPool::shared().acquire(decodedSize);
+    decodeFrame(bytes, size, buffer->data(), buffer->size());
+    output = BufferSlice(buffer, buffer->data(), buffer->size());
+    return true;
+}
+
+void ZstdDecoder::decodeFrame(const unsigned char* bytes, std::size_t size, unsigned char* output,
+                              std::size_t outputSize) {
+    ZstdDecoder decoder;
+    std::uint32_t dictionaryId = 0;
+    frameDictionaryId(bytes, size, dictionaryId);
+    decoder.context->useDictionary(dictionaryId);
+    const std::size_t decoded = ::ZSTD_decompressDCtx(decoder.context->context, output, outputSize, bytes, size);
+    check(decoded);
+    if (decoded != outputSize)
+    {
+        throw std::runtime_error("corrupt zstd stream: frame size mismatch");
+    }
+}
+
+std::uint32_t ZstdDecoder::loadDictionary(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throwErrno("unable to open zstd dictionary", path);
+    }
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        const int error = info.st_size == 0 ? EINVAL : errno;
+        ::close(fd);
+        errno = error;
+        throwErrno("unable to inspect zstd dictionary", path);
+    }
+    const auto length = static_cast<std::size_t>(info.st_size);
+    void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int mapError = errno;
+    ::close(fd);
+    if (address == MAP_FAILED)
+    {
+        errno = mapError;
+        throwErrno("unable to map zstd dictionary", path);
+    }
+    auto dictionary = std::make_unique<Dictionary>(address, length);
+
+    // Raw content dictionaries have no ID, frames could not name them.
+    const std::uint32_t id = ::ZSTD_getDictID_fromDict(address, length);
+    if (id == 0)
+    {
+        throw std::runtime_error("invalid zstd dictionary " + path + ": no dictionary ID");
+    }
+    dictionary->digested = ::ZSTD_createDDict_byReference(address, length);
+    if (dictionary->digested == nullptr)
+    {
+        throw std::runtime_error("invalid zstd dictionary " + path);
+    }
+
+    Dictionaries& dictionaries = Dictionaries::shared();
+    std::unique_lock lock(dictionaries.mutex);
+    if (!dictionaries.byId.emplace(id, std::move(dictionary)).second)
+    {
+        throw std::runtime_error("zstd dictionary " + std::to_string(id) + " is already loaded: " + path);
+    }
+    return id;
+}
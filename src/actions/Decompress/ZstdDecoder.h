@@ -0,0 +1,91 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef ZSTDDECODER_H
+#define ZSTDDECODER_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "StreamDecoder.h"
+
+/**
+ * @class ZstdDecoder
+ * @brief Incremental decoder of zstd streams (RFC 8878), concatenated and skippable frames included.
+ *
+ * Decompression contexts (their window included) are recycled like the inflaters of
+ * `DeflateDecoder`: every thread keeps the context of its last decoder for the next one.
+ *
+ * Frames compressed with a dictionary record its ID, the dictionary is looked up among those
+ * loaded with `loadDictionary`. A recycled context keeps the dictionary it references, so small
+ * payloads sharing one decode without any setup beyond a context reset.
+ *
+ * Only compiled when libzstd is found at build time.
+ */
+class ZstdDecoder : public StreamDecoder {
+public:
+    ZstdDecoder();
+    ~ZstdDecoder() override;
+
+    ZstdDecoder(const ZstdDecoder&) = delete;
+    ZstdDecoder& operator=(const ZstdDecoder&) = delete;
+
+    bool decode(const unsigned char*& input, std::size_t& inputSize, unsigned char*& output,
+                std::size_t& outputSize) override;
+
+    bool complete() const override;
+
+    /**
+     * @brief The decoded size recorded in the header of the first frame, zero if it is not.
+     */
+    static std::size_t contentSize(const unsigned char* bytes, std::size_t size);
+
+    /**
+     * @brief Decodes `bytes` in one shot when it is a single frame recording its decoded size.
+     *
+     * @param output Receives the decoded bytes, in a pooled buffer of the exact size.
+     * @return false if `bytes` is not such a frame. Nothing is decoded then.
+     *
+     * @throws std::runtime_error If the frame is corrupt or needs a dictionary that is not loaded.
+     */
+    static bool decodeFrame(const unsigned char* bytes, std::size_t size, BufferSlice& output);
+
+    /**
+     * @brief Decodes the single frame `bytes` into the `outputSize` bytes at `output`.
+     *
+     * @throws std::runtime_error If the frame is corrupt, needs a dictionary that is not loaded, or
+     *         does not decode to exactly `outputSize` bytes.
+     */
+    static void decodeFrame(const unsigned char* bytes, std::size_t size, unsigned char* output,
+                            std::size_t outputSize);
+
+    /**
+     * @brief Loads the dictionary file at `path` (as written by `zstd --train` or `zstd_train`).
+     *
+     * The file is memory mapped and digested once, then stays loaded for the life of the process:
+     * every frame recording its ID is decoded with it, on any thread.
+     *
+     * @return The dictionary ID.
+     *
+     * @throws std::system_error If the file cannot be opened or mapped.
+     * @throws std::runtime_error If the file is not a zstd dictionary, or one with the same ID is
+     *         already loaded.
+     */
+    static std::uint32_t loadDictionary(const std::string& path);
+
+private:
+    struct Context;
+
+    // The context the last decoder destroyed on the calling thread left for the next one.
+    static std::unique_ptr<Context>& idleContext();
+
+    std::unique_ptr<Context> context;
+    bool frameStart = true;
+    bool frameEnded = false;
+};
+
+
+
+#endif //ZSTDDECODER_H
@@ -4,8 +4,18 @@
 
 #ifndef JSONUNSERIALIZER_H
 #define JSONUNSERIALIZER_H
+#include <any>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
 #include "ActionResult.h"
-#include "ImageDecoding.h"
+#include "Manifest.h"
+#include "../utils/BufferSlice.h"
+#include "../utils/JsonDocument.h"
+#include "../utils/JsonPointer.h"
 
 
 /**
@@ -13,29 +23,30 @@
  * @brief A utility class for handling the deserialization of JSON data into actionable results.
  *
  * This class provides a static method to process and transform JSON data encapsulated
- * in an ActionResult object. Based on the metadata type, it delegates the processing
- * to specific handlers such as ImageDecoding, LoadFactory, or FileLoad.
+ * in an ActionResult object.
+ *
+ * Loaded documents are parsed into a `JsonDocument`, see `JsonIndex` for the vectorized first stage.
+ * Documents in which the `manifestPointers` designate URIs are manifests: they are returned as a
+ * `Manifest` listing the referenced URIs, which `ComputePipeline` executes as child requests.
  */
 class JsonUnserializer {
 
 public:
     /**
-     * @brief Executes the unserialization process based on the metadata type of the previous action result.
+     * @brief Executes the unserialization process on the data of the previous action result.
      * 
-     * This function processes the given `previous` action result and performs a specific operation
-     * based on its metadata type. The result of the operation is stored in the `result` parameter.
+     * This function parses the document held by the given `previous` action result, see
+     * `unserialize`. The result of the operation is stored in the `result` parameter.
      * 
-     * @param previous The previous action result containing data and metadata to be processed.
+     * @param previous The previous action result containing the document to be processed.
      *                 Must have a valid `data` value; otherwise, the function returns false.
      * @param result   The action result object where the output of the operation will be stored.
      * 
      * @return `true` if the operation is successful, `false` if the `previous` data is invalid.
      * 
-     * @throws std::invalid_argument If the metadata type in `previous` is invalid or unsupported.
+     * @throws std::invalid_argument If the document is malformed.
      * 
-     * @note The function delegates the processing to specific handlers (`ImageDecoding`, `LoadFactory`,
-     *       or `FileLoad`) based on the metadata type. The metadata type must match one of the supported
-     *       cases ("image", "load", "decompress").
+     * @note Streamed documents (`ChunkStream`) are not parsed, they are passed through unchanged.
      */
     static bool execute(ActionResult&& previous, ActionResult& result) {
         if (!previous.data.has_value())
@@ -43,22 +54,94 @@ public:
             return false;
         }
 
-        // Implement the unserialize logic here
-        // process will be assigned to the result object data and metadata
+        if (!unserialize(previous.data, result))
+        {
+            result = std::move(previous);
+        }
+        return true;
+    }
+
+    /**
+     * @brief The JSON pointers designating URI strings in manifests, none by default.
+     *
+     * Configure them before the first execution. A `*` token matches every member or element, see
+     * `JsonPointer`.
+     */
+    static std::vector<JsonPointer>& manifestPointers() {
+        static std::vector<JsonPointer> pointers;
+        return pointers;
+    }
+
+    /**
+     * @brief Parses a loaded JSON document.
+     *
+     * @param data The loaded document: a `BufferSlice`, a `std::string` (moved from) or a
+     *             `std::vector<unsigned char>` (moved from).
+     * @param result Receives a `Manifest` with the metadata type "manifest" when the
+     *               `manifestPointers` designate URIs in the document, the `JsonDocument` with the
+     *               metadata type "document" otherwise.
+     * @return false if `data` holds no document bytes, streamed payloads among others.
+     *
+     * @throws std::invalid_argument If the document is malformed.
+     */
+    static bool unserialize(std::any& data, ActionResult& result) {
+        BufferSlice text;
+        if (const BufferSlice* slice = BufferSlice::fromAny(data))
+        {
+            text = *slice;
+        }
+        else if (auto* string = std::any_cast<std::string>(&data))
+        {
+            const auto owner = std::make_shared<const std::string>(std::move(*string));
+            text = BufferSlice(owner, owner->data(), owner->size());
+        }
+        else if (auto* bytes = std::any_cast<std::vector<unsigned char>>(&data))
+        {
+            const auto owner = std::make_shared<const std::vector<unsigned char>>(std::move(*bytes));
+            text = BufferSlice(owner, owner->data(), owner->size());
+        }
+        else
+        {
+            return false;
+        }
+
+        JsonDocument document = JsonDocument::parse(std::move(text));
+        if (Manifest manifest; !manifestPointers().empty() && extractManifest(document, manifest))
+        {
+            result.data = std::move(manifest);
+            result.metadata = "manifest";
+            return true;
+        }
+        result.data = std::move(document);
+        result.metadata = "document";
+        return true;
+    }
+
+    /**
+     * @brief Collects the URIs the `manifestPointers` designate in a parsed JSON document.
+     *
+     * @param document The parsed document.
+     * @param manifest Receives the document text and one child per distinct URI, in document order.
+     * @return true if the document references at least one URI.
+     */
+    static bool extractManifest(const JsonDocument& document, Manifest& manifest) {
+        manifest.document = document.text();
 
-        ActionResult resultCopy = result;
-        switch (previous.metadata)
+        std::vector<std::string> uris;
+        JsonPointer::collect(document, manifestPointers(), uris);
+        std::unordered_set<std::string_view> seen;
+        manifest.children.reserve(uris.size());
+        for (std::string& uri : uris)
         {
-        case "image":
-            return ImageDecoding::execute(std::move(resultCopy), result);
-        case "load":
-            return LoadFactory::execute(std::move(resultCopy), result);
-        case "decompress":
-            return FileLoad::execute(std::move(resultCopy), result);
-        default:
-            throw std::invalid_argument("invalid metadata type: " + previous.metadata);
+            if (uri.empty() || seen.contains(uri))
+            {
+                continue;
+            }
+            // No reallocation happens after the reserve, the views stay valid.
+            manifest.children.push_back({std::move(uri), nullptr, {}});
+            seen.insert(manifest.children.back().uri);
         }
-        return false;
+        return !manifest.children.empty();
     }
 };
 
@@ -0,0 +1,317 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "BundleArchive.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    /**
+     * A mounted bundle, opened once by whichever of the warm-up thread and `resolve` comes first.
+     */
+    struct Mounted {
+        std::string path;
+        std::once_flag opened;
+        std::shared_ptr<const BundleArchive> archive;
+        std::exception_ptr error;
+        std::atomic<bool> reported{false};
+
+        // Returns nullptr if the bundle could not be opened, `error` then holds the reason.
+        const BundleArchive* get() {
+            std::call_once(opened, [this]() {
+                try
+                {
+                    archive = BundleArchive::open(path);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            });
+            return archive.get();
+        }
+    };
+
+    std::shared_mutex mountedMutex;
+    std::vector<std::shared_ptr<Mounted>> mounted;
+
+    [[noreturn]] void throwErrno(const std::string& what, const std::string& path)
+    {
+        throw std::system_error(errno, std::generic_category(), what + ": " + path);
+    }
+
+    [[noreturn]] void invalid(const std::string& what, const std::string& path)
+    {
+        throw std::runtime_error("invalid bundle " + path + ": " + what);
+    }
+
+    /**
+     * Owner of the bundle mapping, unmaps once the archive and every slice are gone.
+     */
+    struct Mapping {
+        void* address;
+        std::size_t length;
+        Mapping(void* address, std::size_t length) : address(address), length(length) {}
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+        ~Mapping() {
+            ::munmap(address, length);
+        }
+    };
+
+    // Starts reading `size` bytes at `address` into the page cache, without waiting for them.
+    void willNeed(const void* address, std::size_t size)
+    {
+        static const auto pageSize = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+        const auto start = reinterpret_cast<std::uintptr_t>(address) / pageSize * pageSize;
+        const auto end = reinterpret_cast<std::uintptr_t>(address) + size;
+        if (size > 0)
+        {
+            ::madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED);
+        }
+    }
+
+    // Whether `count` items of `size` bytes at `offset` lie within `length`, suitably aligned.
+    bool fits(std::uint64_t offset, std::uint64_t count, std::size_t size, std::size_t length)
+    {
+        return offset % std::min(size, alignof(std::uint64_t)) == 0 && offset <= length &&
+               count <= (length - offset) / size;
+    }
+
+    // Validates the header of a bundle of `length` bytes, whose tables must lie within the file.
+    void checkHeader(const BundleFormat::Header& header, std::size_t length, const std::string& path)
+    {
+        if (std::memcmp(header.magic, BundleFormat::Magic, sizeof(BundleFormat::Magic)) != 0)
+        {
+            invalid("bad magic", path);
+        }
+        if (header.version != BundleFormat::Version)
+        {
+            invalid("unsupported version " + std::to_string(header.version), path);
+        }
+        if (header.entryCount > 0 && (header.bucketCount == 0 || header.slotCount < header.entryCount))
+        {
+            invalid("inconsistent table sizes", path);
+        }
+        if (!fits(header.bucketsOffset, header.bucketCount, sizeof(std::uint32_t), length) ||
+            !fits(header.slotsOffset, header.slotCount, sizeof(std::uint32_t), length) ||
+            !fits(header.entriesOffset, header.entryCount, sizeof(BundleFormat::Entry), length) ||
+            !fits(header.namesOffset, header.namesSize, 1, length))
+        {
+            invalid("table out of bounds", path);
+        }
+    }
+}
+
+BundleArchive::BundleArchive(std::shared_ptr<const void> mapping, const unsigned char* base, std::size_t length)
+    : mapping(std::move(mapping)), base(base), length(length) {
+    header = reinterpret_cast<const BundleFormat::Header*>(base);
+    seeds = reinterpret_cast<const std::uint32_t*>(base + header->bucketsOffset);
+    slots = reinterpret_cast<const std::uint32_t*>(base + header->slotsOffset);
+    entries = reinterpret_cast<const BundleFormat::Entry*>(base + header->entriesOffset);
+    names = reinterpret_cast<const char*>(base + header->namesOffset);
+}
+
+std::shared_ptr<const BundleArchive> BundleArchive::open(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throwErrno("unable to open bundle", path);
+    }
+    struct stat info{};
+    if (::fstat(fd, &info) != 0)
+    {
+        const int error = errno;
+        ::close(fd);
+        errno = error;
+        throwErrno("unable to inspect bundle", path);
+    }
+    const auto length = static_cast<std::size_t>(info.st_size);
+    if (length < sizeof(BundleFormat::Header))
+    {
+        ::close(fd);
+        invalid("truncated header", path);
+    }
+    void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int mapError = errno;
+    ::close(fd);
+    if (address == MAP_FAILED)
+    {
+        errno = mapError;
+        throwErrno("unable to map bundle", path);
+    }
+    auto mapping = std::make_shared<const Mapping>(address, length);
+
+    // Assets are looked up in any order, readahead around each one would only pollute the cache.
+    ::madvise(address, length, MADV_RANDOM);
+
+    checkHeader(*static_cast<const BundleFormat::Header*>(address), length, path);
+
+    const auto* base = static_cast<const unsigned char*>(address);
+    return std::shared_ptr<const BundleArchive>(new BundleArchive(std::move(mapping), base, length));
+}
+
+bool BundleArchive::find(std::string_view name, Entry& entry) const {
+    if (header->entryCount == 0)
+    {
+        return false;
+    }
+
+    const std::uint64_t hash = BundleFormat::hashName(name);
+    const std::uint32_t seed = seeds[BundleFormat::bucketOf(hash, header->bucketCount)];
+    const std::uint32_t index = slots[BundleFormat::slotOf(hash, seed, header->slotCount)];
+    if (index >= header->entryCount)
+    {
+        return false;
+    }
+
+    // The slot is only a candidate, names absent from the bundle hash to occupied slots too.
+    const BundleFormat::Entry& record = entries[index];
+    if (std::uint64_t{record.nameOffset} + record.nameLength > header->namesSize)
+    {
+        throw std::runtime_error("corrupt bundle entry name");
+    }
+    if (std::string_view(names + record.nameOffset, record.nameLength) != name)
+    {
+        return false;
+    }
+    if (record.offset > length || record.storedSize > length - record.offset ||
+        record.codec > static_cast<std::uint8_t>(BundleFormat::Codec::Lz4))
+    {
+        throw std::runtime_error("corrupt bundle entry: " + std::string(name));
+    }
+
+    entry.stored = {mapping, base + record.offset, static_cast<std::size_t>(record.storedSize)};
+    entry.originalSize = static_cast<std::size_t>(record.originalSize);
+    entry.codec = static_cast<BundleFormat::Codec>(record.codec);
+    return true;
+}
+
+void BundleArchive::warmUp() const {
+    // The seeds are the only table every lookup reads from wherever the name hashes.
+    willNeed(seeds, std::size_t{header->bucketCount} * sizeof(std::uint32_t));
+
+    // The packer stores the hot entries first, their records, names and contents are contiguous.
+    std::uint32_t hot = 0;
+    while (hot < header->entryCount && (entries[hot].flags & BundleFormat::HotEntry) != 0)
+    {
+        ++hot;
+    }
+    if (hot == 0)
+    {
+        return;
+    }
+    willNeed(entries, std::size_t{hot} * sizeof(BundleFormat::Entry));
+
+    std::uint64_t namesEnd = 0;
+    std::uint64_t contentsStart = length;
+    std::uint64_t contentsEnd = 0;
+    for (std::uint32_t i = 0; i < hot; ++i)
+    {
+        const BundleFormat::Entry& record = entries[i];
+        if (std::uint64_t{record.nameOffset} + record.nameLength > header->namesSize ||
+            record.offset > length || record.storedSize > length - record.offset)
+        {
+            return;
+        }
+        namesEnd = std::max<std::uint64_t>(namesEnd, std::uint64_t{record.nameOffset} + record.nameLength);
+        contentsStart = std::min(contentsStart, record.offset);
+        contentsEnd = std::max(contentsEnd, record.offset + record.storedSize);
+    }
+    willNeed(names, static_cast<std::size_t>(namesEnd));
+    willNeed(base + contentsStart, static_cast<std::size_t>(contentsEnd - contentsStart));
+
+    // Slots are spread over the whole table, touching them faults in just the pages of hot names.
+    std::uint32_t touched = 0;
+    for (std::uint32_t i = 0; i < hot; ++i)
+    {
+        const BundleFormat::Entry& record = entries[i];
+        const std::uint64_t hash = BundleFormat::hashName(std::string_view(names + record.nameOffset, record.nameLength));
+        const std::uint32_t seed = seeds[BundleFormat::bucketOf(hash, header->bucketCount)];
+        touched ^= *static_cast<const volatile std::uint32_t*>(&slots[BundleFormat::slotOf(hash, seed, header->slotCount)]);
+    }
+    static_cast<void>(touched);
+}
+
+void BundleArchive::mount(const std::string& path) {
+    // Only the 64 byte header is read here, a corrupt bundle is rejected before it can be searched.
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throwErrno("unable to read bundle", path);
+    }
+    struct stat info{};
+    BundleFormat::Header header{};
+    const ssize_t read = ::fstat(fd, &info) == 0 ? ::pread(fd, &header, sizeof(header), 0) : -1;
+    const int error = errno;
+    ::close(fd);
+    if (read < 0)
+    {
+        errno = error;
+        throwErrno("unable to read bundle", path);
+    }
+    if (static_cast<std::size_t>(read) < sizeof(header))
+    {
+        invalid("truncated header", path);
+    }
+    checkHeader(header, static_cast<std::size_t>(info.st_size), path);
+
+    auto bundle = std::make_shared<Mounted>();
+    bundle->path = path;
+    {
+        std::unique_lock lock(mountedMutex);
+        mounted.push_back(bundle);
+    }
+
+    std::thread([bundle = std::move(bundle)]() {
+        // Opening errors are reported by `resolve`.
+        if (const BundleArchive* archive = bundle->get())
+        {
+            archive->warmUp();
+        }
+    }).detach();
+}
+
+bool BundleArchive::resolve(std::string_view name, Entry& entry) {
+    std::shared_lock lock(mountedMutex);
+    Mounted* failed = nullptr;
+    for (const auto& bundle : mounted)
+    {
+        const BundleArchive* archive = bundle->get();
+        if (archive == nullptr)
+        {
+            if (failed == nullptr && !bundle->reported.load(std::memory_order_relaxed))
+            {
+                failed = bundle.get();
+            }
+            continue;
+        }
+        if (archive->find(name, entry))
+        {
+            return true;
+        }
+    }
+    // A bundle that failed to open is skipped, its error is only raised by the first lookup it may have served.
+    if (failed != nullptr && !failed->reported.exchange(true))
+    {
+        std::rethrow_exception(failed->error);
+    }
+    return false;
+}
@@ -0,0 +1,124 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef BUNDLEARCHIVE_H
+#define BUNDLEARCHIVE_H
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "BundleFormat.h"
+#include "../../utils/BufferSlice.h"
+
+/**
+ * @class BundleArchive
+ * @brief A memory mapped bundle, see `BundleFormat.h` for the layout.
+ *
+ * The file is mapped once when opened. Looking a name up hashes it, reads one seed and one slot
+ * and compares the name of the single candidate entry, then returns a slice pointing into the
+ * mapping: no file is opened and no byte is copied per asset.
+ *
+ * Bundles are mounted process wide, `bundle://name` URIs are resolved against the mounted bundles
+ * in mount order. Mounting does not wait for the bundle: it is opened by a background thread that
+ * then warms the top level of the index and the hot entries, and the first lookup only waits for
+ * the opening if it is still running. Nothing is ever read in proportion to the bundle size.
+ */
+class BundleArchive {
+public:
+
+    /**
+     * @struct Entry
+     * @brief A bundle entry found by `find`.
+     *
+     * @var Entry::stored
+     * The stored bytes, pointing into the mapping.
+     *
+     * @var Entry::originalSize
+     * Size of the content once decoded.
+     *
+     * @var Entry::codec
+     * Encoding of `stored`.
+     */
+    struct Entry {
+        BufferSlice stored;
+        std::size_t originalSize = 0;
+        BundleFormat::Codec codec = BundleFormat::Codec::Raw;
+    };
+
+    /**
+     * @brief Maps the bundle located at `path` and validates its header and tables.
+     *
+     * @throws std::system_error If the file cannot be opened or mapped.
+     * @throws std::runtime_error If the file is not a valid bundle.
+     */
+    static std::shared_ptr<const BundleArchive> open(const std::string& path);
+
+    /**
+     * @brief Looks `name` up.
+     *
+     * @param name Name of the entry, its path relative to the packed directory.
+     * @param entry Output parameter receiving the entry.
+     * @return true if the bundle contains `name`.
+     *
+     * @throws std::runtime_error If the entry record points outside of the bundle or names an unknown codec.
+     */
+    bool find(std::string_view name, Entry& entry) const;
+
+    /**
+     * @brief Number of entries.
+     */
+    std::size_t size() const {
+        return header->entryCount;
+    }
+
+    /**
+     * @brief Pages in the seeds, then the records, names, slots and contents of the hot entries.
+     *
+     * Blocks on disk reads, it is meant for a background thread.
+     */
+    void warmUp() const;
+
+    /**
+     * @brief Adds the bundle located at `path` to the bundles searched by `resolve`.
+     *
+     * Only the header is read and validated here. The bundle is then opened and warmed in the
+     * background, errors opening it are reported by `resolve`.
+     *
+     * @throws std::system_error If the file cannot be read.
+     * @throws std::runtime_error If the header is not a valid bundle header.
+     */
+    static void mount(const std::string& path);
+
+    /**
+     * @brief Looks `name` up in the mounted bundles.
+     *
+     * Bundles that cannot be opened are skipped. The error of each one is raised once, by the first
+     * lookup that none of the other bundles could serve.
+     *
+     * @return true if a mounted bundle contains `name`.
+     *
+     * @throws std::system_error If a bundle skipped could not be opened or mapped, once per bundle.
+     * @throws std::runtime_error If a bundle skipped is not a valid bundle, once per bundle.
+     * @throws std::runtime_error If the entry record found is corrupt.
+     */
+    static bool resolve(std::string_view name, Entry& entry);
+
+private:
+    BundleArchive(std::shared_ptr<const void> mapping, const unsigned char* base, std::size_t length);
+
+    std::shared_ptr<const void> mapping;
+    const unsigned char* base;
+    std::size_t length;
+
+    const BundleFormat::Header* header;
+    const std::uint32_t* seeds;
+    const std::uint32_t* slots;
+    const BundleFormat::Entry* entries;
+    const char* names;
+};
+
+
+
+#endif //BUNDLEARCHIVE_H
@@ -0,0 +1,120 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef BUNDLEFORMAT_H
+#define BUNDLEFORMAT_H
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "../../utils/EncodedPayload.h"
+
+/**
+ * @file BundleFormat.h
+ * @brief On-disk layout of bundle archives, shared by `BundleArchive` and the bundle packer.
+ *
+ * A bundle is a single file meant to be memory mapped once:
+ *
+ * - a 64 bytes `Header` at offset 0,
+ * - the displacement seeds, one `uint32_t` per bucket,
+ * - the slot table, one `uint32_t` entry index per slot (`EmptySlot` when unused),
+ * - the `Entry` table,
+ * - the entry names, concatenated without separators,
+ * - the entry contents, each starting on a `PageSize` boundary.
+ *
+ * Names are indexed with a hash-and-displace perfect hash: the name hash selects a bucket, the
+ * bucket seed selects the slot, and the packer chose the seeds so that no two names share a slot.
+ * A lookup is therefore a single probe whatever the size of the bundle. The seeds form the small
+ * top level of the index (one byte per entry), the slots, entries and names are only paged in
+ * for the entries looked up.
+ *
+ * Entries flagged `HotEntry` are the ones an application reads first. The packer stores them at
+ * the front of the entry table, of the names and of the contents, so they can be warmed with a
+ * few sequential reads. All integers are little endian.
+ */
+namespace BundleFormat {
+
+    static_assert(std::endian::native == std::endian::little, "bundles are mapped in place on little endian hosts");
+
+    inline constexpr char Magic[8] = {'I', 'M', 'G', 'L', 'Y', 'B', 'D', 'L'};
+    inline constexpr std::uint32_t Version = 1;
+    inline constexpr std::size_t PageSize = 4096;
+    inline constexpr std::uint32_t EmptySlot = 0xffffffffu;
+
+    /**
+     * @brief `Entry::flags` bit of the entries warmed when the bundle is mounted.
+     */
+    inline constexpr std::uint8_t HotEntry = 1;
+
+    /**
+     * @brief Encoding of a stored entry.
+     */
+    using Codec = ::Codec;
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t entryCount;
+        std::uint32_t bucketCount;
+        std::uint32_t slotCount;
+        std::uint64_t bucketsOffset;
+        std::uint64_t slotsOffset;
+        std::uint64_t entriesOffset;
+        std::uint64_t namesOffset;
+        std::uint64_t namesSize;
+    };
+    static_assert(sizeof(Header) == 64);
+
+    /**
+     * @brief Table of contents record of one entry.
+     *
+     * `storedSize` bytes are stored at `offset`, `originalSize` is the size once decoded with
+     * `codec` (equal to `storedSize` for raw entries).
+     */
+    struct Entry {
+        std::uint64_t offset;
+        std::uint64_t storedSize;
+        std::uint64_t originalSize;
+        std::uint32_t nameOffset;
+        std::uint16_t nameLength;
+        std::uint8_t codec;
+        std::uint8_t flags;
+    };
+    static_assert(sizeof(Entry) == 32);
+
+    /**
+     * @brief Hashes an entry name, once per lookup.
+     */
+    inline std::uint64_t hashName(std::string_view name) {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (const char c : name)
+        {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    /**
+     * @brief Final avalanche of MurmurHash3, derives independent values from one name hash.
+     */
+    inline std::uint64_t mix(std::uint64_t value) {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdull;
+        value ^= value >> 33;
+        value *= 0xc4ceb9fe1a85ec53ull;
+        value ^= value >> 33;
+        return value;
+    }
+
+    inline std::uint32_t bucketOf(std::uint64_t hash, std::uint32_t bucketCount) {
+        return static_cast<std::uint32_t>(mix(hash) % bucketCount);
+    }
+
+    inline std::uint32_t slotOf(std::uint64_t hash, std::uint32_t seed, std::uint32_t slotCount) {
+        return static_cast<std::uint32_t>(mix(hash + (seed + 1ull) * 0x9e3779b97f4a7c15ull) % slotCount);
+    }
+}
+
+#endif //BUNDLEFORMAT_H
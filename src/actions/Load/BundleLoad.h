@@ -5,65 +5,119 @@
 #ifndef BUNDLELOAD_H
 #define BUNDLELOAD_H
 
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "BundleArchive.h"
 #include "../ActionResult.h"
-#include "../JsonUnserializer.h"
-#include "../DataDecompressor.h"
-#include "../ImageDecoding.h"
+#include "../../utils/ContentType.h"
+#include "../../utils/EncodedPayload.h"
+#include "../../utils/Uri.h"
 
 /**
  * @class BundleLoad
- * @brief Handles the execution of bundle loading actions based on metadata.
+ * @brief Handles the execution of bundle loading actions.
  *
- * The `BundleLoad` class provides a static method to execute specific actions
- * based on the metadata provided in the `previous` ActionResult object. It
- * processes the data and metadata and assigns the result to the provided
- * `result` ActionResult object.
+ * The `BundleLoad` class provides a static method to load the bundle entry
+ * designated by the URI in the `previous` ActionResult object. It assigns the
+ * entry and its metadata type to the provided `result` ActionResult object.
  *
- * @note This class relies on external components such as `JsonUnserializer`,
- *       `DataDecompressor`, and `ImageDecoding` to handle specific types of
- *       metadata.
+ * Entries come from the mounted bundles (see `BundleArchive`): a `bundle://name` lookup is a
+ * single hash probe and the content is a slice of the bundle mapping, nothing is copied.
  */
 class BundleLoad {
 public:
     /**
-     * @brief Executes the bundle loading logic based on the metadata type of the previous action result.
+     * @brief Executes the bundle load action of the URI held by the previous action result.
      * 
-     * This function processes the `previous` action result and performs specific operations
-     * (e.g., JSON unserialization, data decompression, or image decoding) based on the metadata type.
-     * The processed data and metadata are assigned to the `result` object.
+     * The entry is assigned to the `result` object, tagged with the metadata type of the action
+     * that processes it next (see `ComputePipeline`).
      * 
-     * @param previous The result of the previous action, containing data and metadata.
+     * @param previous The result of the previous action, containing the URI as data.
      *                 Must have a valid `data` value; otherwise, the function returns false.
-     * @param result   The result object where the processed data and metadata will be stored.
+     * @param result   The result object where the loaded data and metadata will be stored.
      * 
      * @return `true` if the operation is successful, `false` if the `previous` data is invalid.
      * 
-     * @throws std::invalid_argument If the metadata type in `previous` is invalid or unsupported.
+     * @throws std::runtime_error If no mounted bundle contains the entry.
      */
     static bool execute(ActionResult&& previous, ActionResult& result) {
         if (!previous.data.has_value())
         {
             return false;
         }
+        load(std::any_cast<const std::string&>(previous.data), result);
+        return true;
+    }
 
+    /**
+     * @brief Loads the bundle entry designated by `uri` into `result`, without running the next action.
+     *
+     * @param uri The `bundle://` URI.
+     * @param result The result receiving the entry and the metadata type of the next action.
+     *
+     * @throws std::runtime_error If no mounted bundle contains the entry.
+     */
+    static void load(const std::string& uri, ActionResult& result) {
+        BundleArchive::Entry entry;
+        std::string decoded;
+        if (!BundleArchive::resolve(nameOf(uri, decoded), entry))
+        {
+            throw std::runtime_error("no mounted bundle contains: " + uri);
+        }
+        assign(std::move(entry), result);
+    }
 
+    /**
+     * @brief Returns the entry name designated by a `bundle://` URI.
+     *
+     * The name spans the authority and the path, `bundle://dir/file` names `dir/file`. The query and
+     * the fragment are not part of it, and escapes are decoded.
+     *
+     * @param uri A `bundle://` URI, the scheme compared case-insensitively, or a bare name returned as it is.
+     * @param decoded Storage of the name when it has to be decoded.
+     * @return The name, a view into `uri` or into `decoded`.
+     */
+    static std::string_view nameOf(std::string_view uri, std::string& decoded) {
+        const Uri parsed = Uri::parse(uri);
+        if (parsed.schemeId != UriScheme::Bundle)
+        {
+            return uri;
+        }
+        std::string_view name = parsed.path;
+        if (parsed.hasAuthority)
+        {
+            const char* end = parsed.path.empty() ? parsed.authority.data() + parsed.authority.size()
+                                                  : parsed.path.data() + parsed.path.size();
+            name = {parsed.authority.data(), static_cast<std::size_t>(end - parsed.authority.data())};
+        }
+        if (!Uri::needsDecoding(name))
+        {
+            return name;
+        }
+        Uri::decode(name, decoded);
+        return decoded;
+    }
 
-        // Implement the bundle loading logic here
-        // process will be assigned to the result object data and metadata
-
-        ActionResult resultCopy = result;
-        switch (previous.metadata)
+    /**
+     * @brief Stores a bundle entry into `result`, ready for the next action.
+     *
+     * Raw entries are typed from their content. Compressed ones go to the decompressor as an
+     * `EncodedPayload` carrying the codec and decoded size recorded by the packer.
+     *
+     * @param entry The entry found in a bundle.
+     * @param result The result receiving the entry and the metadata type of the next action.
+     */
+    static void assign(BundleArchive::Entry&& entry, ActionResult& result) {
+        if (entry.codec == Codec::Raw)
         {
-            case "json":
-                return JsonUnserializer::execute(std::move(resultCopy), result);
-            case "decompress":
-                return DataDecompressor::execute(std::move(resultCopy), result);
-            case "image":
-                return ImageDecoding::execute(std::move(resultCopy), result);
-            default:
-                throw std::invalid_argument("invalid metadata type: " + previous.metadata);
+            result.metadata = sniffContentType(entry.stored.data(), entry.stored.size());
+            result.data = std::move(entry.stored);
+            return;
         }
-        return false;
+        result.metadata = "decompress";
+        result.data = EncodedPayload{std::move(entry.stored), entry.codec, entry.originalSize};
     }
 };
 
@@ -0,0 +1,192 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "BundleWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <unordered_set>
+
+namespace {
+
+    // Slots are kept 15% emptier than entries, single-name buckets then find a free slot quickly.
+    constexpr std::uint64_t LoadPercent = 85;
+
+    constexpr std::uint64_t NamesPerBucket = 4;
+
+    // Only reachable with colliding name hashes, which no seed can separate.
+    constexpr std::uint32_t MaxSeed = 1u << 24;
+
+    constexpr std::uint64_t alignUp(std::uint64_t value, std::uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+BundleWriter::BundleWriter(const std::string& path, std::vector<std::string> names)
+    : path(path), names(std::move(names)) {
+    const std::size_t count = this->names.size();
+    std::unordered_set<std::string_view> unique;
+    std::uint64_t namesSize = 0;
+    entries.resize(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const std::string& name = this->names[i];
+        if (name.size() > 0xffff)
+        {
+            throw std::invalid_argument("bundle entry name too long: " + name.substr(0, 64) + "...");
+        }
+        if (!unique.insert(name).second)
+        {
+            throw std::invalid_argument("duplicated bundle entry name: " + name);
+        }
+        entries[i].nameOffset = static_cast<std::uint32_t>(namesSize);
+        entries[i].nameLength = static_cast<std::uint16_t>(name.size());
+        namesSize += name.size();
+        if (namesSize > 0xffffffffu)
+        {
+            throw std::invalid_argument("bundle entry names exceed 4 GiB");
+        }
+    }
+    added.assign(count, false);
+
+    std::memcpy(header.magic, BundleFormat::Magic, sizeof(header.magic));
+    header.version = BundleFormat::Version;
+    header.entryCount = static_cast<std::uint32_t>(count);
+    header.bucketCount = static_cast<std::uint32_t>(std::max<std::uint64_t>(1, (count + NamesPerBucket - 1) / NamesPerBucket));
+    header.slotCount = static_cast<std::uint32_t>(std::max<std::uint64_t>(1, count * 100 / LoadPercent + 1));
+    header.bucketsOffset = sizeof(BundleFormat::Header);
+    header.slotsOffset = header.bucketsOffset + std::uint64_t{header.bucketCount} * sizeof(std::uint32_t);
+    header.entriesOffset = alignUp(header.slotsOffset + std::uint64_t{header.slotCount} * sizeof(std::uint32_t),
+                                   alignof(BundleFormat::Entry));
+    header.namesOffset = header.entriesOffset + count * sizeof(BundleFormat::Entry);
+    header.namesSize = namesSize;
+
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw std::system_error(errno, std::generic_category(), "unable to create bundle: " + path);
+    }
+    // The tables are written by `finish`, until then their space is zero filled.
+    pad(alignUp(header.namesOffset + header.namesSize, BundleFormat::PageSize));
+    check();
+}
+
+void BundleWriter::add(std::size_t index, const void* data, std::size_t storedSize, std::size_t originalSize,
+                       BundleFormat::Codec codec, std::uint8_t flags) {
+    if (index >= entries.size() || added[index])
+    {
+        throw std::logic_error("bundle entry added twice or unknown: " + std::to_string(index));
+    }
+    pad(alignUp(position, BundleFormat::PageSize));
+
+    BundleFormat::Entry& entry = entries[index];
+    entry.offset = position;
+    entry.storedSize = storedSize;
+    entry.originalSize = originalSize;
+    entry.codec = static_cast<std::uint8_t>(codec);
+    entry.flags = flags;
+    out.write(static_cast<const char*>(data), static_cast<std::streamsize>(storedSize));
+    position += storedSize;
+    added[index] = true;
+    check();
+}
+
+void BundleWriter::finish() {
+    if (const auto missing = std::find(added.begin(), added.end(), false); missing != added.end())
+    {
+        throw std::logic_error("bundle entry never added: " + names[static_cast<std::size_t>(missing - added.begin())]);
+    }
+
+    std::vector<std::uint64_t> hashes(names.size());
+    std::vector<std::vector<std::uint32_t>> buckets(header.bucketCount);
+    for (std::size_t i = 0; i < names.size(); ++i)
+    {
+        hashes[i] = BundleFormat::hashName(names[i]);
+        buckets[BundleFormat::bucketOf(hashes[i], header.bucketCount)].push_back(static_cast<std::uint32_t>(i));
+    }
+
+    // The largest buckets are placed first, while most slots are still free.
+    std::vector<std::uint32_t> order(header.bucketCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&buckets](std::uint32_t left, std::uint32_t right) {
+        return buckets[left].size() > buckets[right].size();
+    });
+
+    std::vector<std::uint32_t> seeds(header.bucketCount, 0);
+    std::vector<std::uint32_t> slots(header.slotCount, BundleFormat::EmptySlot);
+    std::vector<std::uint32_t> candidate;
+    for (const std::uint32_t bucket : order)
+    {
+        if (buckets[bucket].empty())
+        {
+            break;
+        }
+        for (std::uint32_t seed = 0;; ++seed)
+        {
+            if (seed == MaxSeed)
+            {
+                throw std::runtime_error("unable to index bundle, entry names have colliding hashes");
+            }
+            candidate.clear();
+            for (const std::uint32_t index : buckets[bucket])
+            {
+                const std::uint32_t slot = BundleFormat::slotOf(hashes[index], seed, header.slotCount);
+                if (slots[slot] != BundleFormat::EmptySlot ||
+                    std::find(candidate.begin(), candidate.end(), slot) != candidate.end())
+                {
+                    break;
+                }
+                candidate.push_back(slot);
+            }
+            if (candidate.size() == buckets[bucket].size())
+            {
+                for (std::size_t k = 0; k < candidate.size(); ++k)
+                {
+                    slots[candidate[k]] = buckets[bucket][k];
+                }
+                seeds[bucket] = seed;
+                break;
+            }
+        }
+    }
+
+    auto writeAt = [this](std::uint64_t offset, const void* data, std::size_t size) {
+        out.seekp(static_cast<std::streamoff>(offset));
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    };
+    writeAt(0, &header, sizeof(header));
+    writeAt(header.bucketsOffset, seeds.data(), seeds.size() * sizeof(std::uint32_t));
+    writeAt(header.slotsOffset, slots.data(), slots.size() * sizeof(std::uint32_t));
+    writeAt(header.entriesOffset, entries.data(), entries.size() * sizeof(BundleFormat::Entry));
+    out.seekp(static_cast<std::streamoff>(header.namesOffset));
+    for (const std::string& name : names)
+    {
+        out.write(name.data(), static_cast<std::streamsize>(name.size()));
+    }
+    out.close();
+    check();
+}
+
+void BundleWriter::pad(std::uint64_t to) {
+    static constexpr char Zeros[BundleFormat::PageSize] = {};
+    while (position < to)
+    {
+        const std::uint64_t count = std::min<std::uint64_t>(to - position, sizeof(Zeros));
+        out.write(Zeros, static_cast<std::streamsize>(count));
+        position += count;
+    }
+}
+
+void BundleWriter::check() const {
+    if (out.fail())
+    {
+        throw std::system_error(errno, std::generic_category(), "unable to write bundle: " + path);
+    }
+}
@@ -0,0 +1,76 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef BUNDLEWRITER_H
+#define BUNDLEWRITER_H
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "BundleFormat.h"
+
+/**
+ * @class BundleWriter
+ * @brief Writes a bundle, see `BundleFormat.h` for the layout.
+ *
+ * All names are given up front, which fixes the size of the tables: the contents are then
+ * streamed to the file in the order `add` is called, each one on its own page, and `finish`
+ * builds the perfect hash and writes the header and tables in front of them. The order of the
+ * `add` calls is therefore the on-disk order of the contents.
+ */
+class BundleWriter {
+public:
+
+    /**
+     * @brief Creates the bundle file.
+     *
+     * @param path Destination of the bundle, truncated if it exists.
+     * @param names Names of all the entries, unique, each shorter than 64 KiB.
+     *
+     * @throws std::invalid_argument If a name is duplicated or too long.
+     * @throws std::system_error If the file cannot be created.
+     */
+    BundleWriter(const std::string& path, std::vector<std::string> names);
+
+    /**
+     * @brief Appends the content of the entry `index`.
+     *
+     * @param index Position of the entry name in the names given to the constructor.
+     * @param data Stored bytes.
+     * @param storedSize Number of stored bytes.
+     * @param originalSize Size of the content once decoded.
+     * @param codec Encoding of the stored bytes.
+     * @param flags `Entry::flags` of the entry, `BundleFormat::HotEntry` for instance.
+     *
+     * @throws std::system_error If writing fails.
+     */
+    void add(std::size_t index, const void* data, std::size_t storedSize, std::size_t originalSize,
+             BundleFormat::Codec codec, std::uint8_t flags = 0);
+
+    /**
+     * @brief Writes the index and closes the bundle.
+     *
+     * @throws std::logic_error If an entry was never added.
+     * @throws std::system_error If writing fails.
+     */
+    void finish();
+
+private:
+    void pad(std::uint64_t to);
+    void check() const;
+
+    std::string path;
+    std::ofstream out;
+    std::vector<std::string> names;
+    std::vector<BundleFormat::Entry> entries;
+    std::vector<bool> added;
+    BundleFormat::Header header{};
+    std::uint64_t position = 0;
+};
+
+
+
+#endif //BUNDLEWRITER_H
@@ -0,0 +1,129 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef DATAURILOAD_H
+#define DATAURILOAD_H
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "../ActionResult.h"
+#include "../../utils/Base64.h"
+#include "../../utils/BufferPool.h"
+#include "../../utils/BufferSlice.h"
+#include "../../utils/ContentType.h"
+#include "../../utils/Uri.h"
+
+/**
+ * @class DataUriLoad
+ * @brief Handles the execution of `data:` URI loading logic (RFC 2397) based on metadata.
+ *
+ * The content is carried by the URI itself, nothing is read from storage or the network. Base64
+ * payloads are decoded by `Base64::decode` into a pooled buffer. Other payloads are handed over
+ * as slices of the URI string, which the loaded item takes ownership of: percent escapes, if
+ * any, are decoded in place and nothing is copied.
+ */
+class DataUriLoad {
+public:
+    /**
+     * @brief Executes the `data:` URI load action of the URI held by the previous action result.
+     *
+     * @param previous The result of the previous action, containing the URI as data.
+     *                 The data must have a value; otherwise, the function returns false.
+     * @param result   The result object where the decoded data and metadata will be stored.
+     *
+     * @return true if the operation is successful, false otherwise.
+     *
+     * @throws std::invalid_argument if the URI is malformed.
+     */
+    static bool execute(ActionResult&& previous, ActionResult& result) {
+        if (!previous.data.has_value())
+        {
+            return false;
+        }
+
+        assign(std::any_cast<std::string&&>(std::move(previous.data)), result);
+        return true;
+    }
+
+    /**
+     * @brief Stores the content of a `data:` URI into `result`, tagged with its content type.
+     *
+     * The type is guessed from the content, the declared media type is only used when the content
+     * is not recognized.
+     *
+     * @param uri The `data:[<media type>][;base64],<payload>` URI, owned by the slice of a
+     *            payload that is not base64 encoded.
+     * @param result The result receiving the content.
+     *
+     * @throws std::invalid_argument if the URI has no payload or its base64 payload is invalid.
+     */
+    static void assign(std::string&& uri, ActionResult& result) {
+        const std::size_t comma = uri.find(',');
+        if (Uri::schemeOf(uri) != UriScheme::Data || comma == std::string::npos)
+        {
+            throw std::invalid_argument("malformed data uri: " + uri.substr(0, 64));
+        }
+        const std::string_view mediaType = std::string_view(uri).substr(5, comma - 5);
+        const bool base64 = mediaType.ends_with(";base64");
+        const std::string fallbackType = typeOf(mediaType);
+
+        const auto owner = std::make_shared<std::string>(std::move(uri));
+        char* payload = owner->data() + comma + 1;
+        std::size_t payloadSize = owner->size() - comma - 1;
+        if (Uri::needsDecoding({payload, payloadSize}))
+        {
+            payloadSize = Uri::decode({payload, payloadSize}, payload);
+        }
+
+        BufferSlice content;
+        if (base64)
+        {
+            auto buffer = BufferPool::shared().acquire(Base64::decodedCapacity(payloadSize));
+            std::size_t written = 0;
+            if (!Base64::decode({payload, payloadSize}, buffer->data(), written))
+            {
+                throw std::invalid_argument("invalid base64 payload in data uri: " + owner->substr(0, 64));
+            }
+            buffer->resize(written);
+            content = BufferSlice(buffer, buffer->data(), written);
+        }
+        else
+        {
+            content = BufferSlice(owner, payload, payloadSize);
+        }
+
+        result.metadata = sniffContentType(content.data(), content.size());
+        if (result.metadata.empty())
+        {
+            result.metadata = fallbackType;
+        }
+        result.data = std::move(content);
+    }
+
+private:
+    // Metadata type of the action able to process a declared media type, empty when unknown.
+    static std::string typeOf(std::string_view mediaType) {
+        mediaType = mediaType.substr(0, mediaType.find(';'));
+        if (mediaType.starts_with("image/"))
+        {
+            return "image";
+        }
+        if (mediaType == "application/json" || mediaType.ends_with("+json"))
+        {
+            return "json";
+        }
+        if (mediaType == "application/gzip" || mediaType == "application/zlib" || mediaType == "application/x-xz")
+        {
+            return "decompress";
+        }
+        return "";
+    }
+};
+
+
+
+#endif //DATAURILOAD_H
@@ -0,0 +1,592 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "FileBatchReader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "FileReader.h"
+#include "../../utils/BufferPool.h"
+#include "../../utils/ThreadPool.h"
+
+namespace {
+
+    // Every file in flight owns at most two submission entries, the ring is sized accordingly.
+    constexpr unsigned RingEntries = 256;
+    constexpr std::size_t MaxFilesInFlight = RingEntries / 2;
+
+    // Files up to SlotSize bytes are read into one of the registered slots.
+    constexpr std::size_t SlotSize = 64 * 1024;
+    constexpr unsigned SlotCount = 32;
+
+    // Longer reads are split, the length of a submission entry is 32 bits wide.
+    constexpr std::size_t MaxReadLength = std::size_t{1} << 30;
+
+    enum Operation : std::uint64_t {
+        Open = 0,
+        Stat = 1,
+        Read = 2,
+        Close = 3
+    };
+
+    std::uint64_t tag(std::size_t index, Operation operation)
+    {
+        return (static_cast<std::uint64_t>(index) << 2) | operation;
+    }
+
+    /**
+     * Page aligned memory registered with a ring, split in fixed size slots. Slices handed out
+     * from a slot keep the arena alive and give the slot back when released.
+     */
+    class SlotArena {
+    public:
+        SlotArena() {
+            memory = static_cast<unsigned char*>(::mmap(nullptr, SlotSize * SlotCount, PROT_READ | PROT_WRITE,
+                                                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (memory == MAP_FAILED)
+            {
+                memory = nullptr;
+                return;
+            }
+            for (unsigned slot = 0; slot < SlotCount; ++slot)
+            {
+                free.push_back(SlotCount - 1 - slot);
+            }
+        }
+
+        ~SlotArena() {
+            if (memory != nullptr)
+            {
+                ::munmap(memory, SlotSize * SlotCount);
+            }
+        }
+
+        bool valid() const {
+            return memory != nullptr;
+        }
+
+        unsigned char* slot(unsigned index) const {
+            return memory + static_cast<std::size_t>(index) * SlotSize;
+        }
+
+        bool acquire(unsigned& index) {
+            std::lock_guard lock(mutex);
+            if (free.empty())
+            {
+                return false;
+            }
+            index = free.back();
+            free.pop_back();
+            return true;
+        }
+
+        void release(unsigned index) {
+            std::lock_guard lock(mutex);
+            free.push_back(index);
+        }
+
+    private:
+        unsigned char* memory = nullptr;
+        std::mutex mutex;
+        std::vector<unsigned> free;
+    };
+
+    /**
+     * Minimal io_uring wrapper over the raw system calls.
+     */
+    class Ring {
+    public:
+        ~Ring() {
+            if (sqes != nullptr)
+            {
+                ::munmap(sqes, sqesLength);
+            }
+            if (cqRing != nullptr && cqRing != sqRing)
+            {
+                ::munmap(cqRing, cqLength);
+            }
+            if (sqRing != nullptr)
+            {
+                ::munmap(sqRing, sqLength);
+            }
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+
+        bool init() {
+            io_uring_params params{};
+            fd = static_cast<int>(::syscall(__NR_io_uring_setup, RingEntries, &params));
+            if (fd < 0)
+            {
+                return false;
+            }
+
+            sqLength = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqLength = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (singleMap)
+            {
+                sqLength = cqLength = std::max(sqLength, cqLength);
+            }
+
+            sqRing = map(sqLength, IORING_OFF_SQ_RING);
+            cqRing = singleMap ? sqRing : map(cqLength, IORING_OFF_CQ_RING);
+            sqesLength = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(map(sqesLength, IORING_OFF_SQES));
+            if (sqRing == nullptr || cqRing == nullptr || sqes == nullptr)
+            {
+                return false;
+            }
+
+            auto* sq = static_cast<unsigned char*>(sqRing);
+            sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sqEntries = params.sq_entries;
+            sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+            auto* cq = static_cast<unsigned char*>(cqRing);
+            cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            localTail = *sqTail;
+            return supportsOperations() && registerArena();
+        }
+
+        bool hasFixedBuffers() const {
+            return arena != nullptr;
+        }
+
+        const std::shared_ptr<SlotArena>& slots() const {
+            return arena;
+        }
+
+        io_uring_sqe* next() {
+            const unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            if (localTail - head >= sqEntries)
+            {
+                return nullptr;
+            }
+            const unsigned index = localTail & sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqArray[index] = index;
+            ++localTail;
+            return sqe;
+        }
+
+        /**
+         * Publishes the queued entries and waits for at least one completion.
+         */
+        int submitAndWait() {
+            return enter(1, IORING_ENTER_GETEVENTS);
+        }
+
+        /**
+         * Publishes the queued entries without waiting, which frees their submission slots.
+         */
+        int submit() {
+            return enter(0, 0);
+        }
+
+        template <typename Handler>
+        void drain(Handler&& handler) {
+            unsigned head = *cqHead;
+            const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head)
+            {
+                const io_uring_cqe& cqe = cqes[head & cqMask];
+                handler(cqe.user_data, cqe.res);
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+
+    private:
+        int enter(unsigned minComplete, unsigned flags) {
+            const unsigned toSubmit = localTail - *sqTail;
+            __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+            for (;;)
+            {
+                const long submitted = ::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+                if (submitted >= 0 || errno != EINTR)
+                {
+                    return submitted < 0 ? -errno : 0;
+                }
+            }
+        }
+
+        void* map(std::size_t length, off_t offset) const {
+            void* address = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+            return address == MAP_FAILED ? nullptr : address;
+        }
+
+        bool supportsOperations() const {
+            constexpr unsigned OperationCount = 64;
+            const std::size_t length = sizeof(io_uring_probe) + OperationCount * sizeof(io_uring_probe_op);
+            auto storage = std::make_unique<unsigned char[]>(length);
+            std::memset(storage.get(), 0, length);
+            auto* probe = reinterpret_cast<io_uring_probe*>(storage.get());
+            if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, OperationCount) < 0)
+            {
+                return false;
+            }
+            for (const unsigned operation : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_READ_FIXED,
+                                             IORING_OP_CLOSE})
+            {
+                if (operation > probe->last_op || (probe->ops[operation].flags & IO_URING_OP_SUPPORTED) == 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Registration may fail under a low RLIMIT_MEMLOCK, reads then simply use pooled buffers.
+        bool registerArena() {
+            auto candidate = std::make_shared<SlotArena>();
+            if (!candidate->valid())
+            {
+                return true;
+            }
+            iovec vectors[SlotCount];
+            for (unsigned slot = 0; slot < SlotCount; ++slot)
+            {
+                vectors[slot] = {candidate->slot(slot), SlotSize};
+            }
+            if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, vectors, SlotCount) == 0)
+            {
+                arena = std::move(candidate);
+            }
+            return true;
+        }
+
+        int fd = -1;
+        void* sqRing = nullptr;
+        void* cqRing = nullptr;
+        std::size_t sqLength = 0;
+        std::size_t cqLength = 0;
+        io_uring_sqe* sqes = nullptr;
+        std::size_t sqesLength = 0;
+
+        unsigned* sqHead = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned* sqArray = nullptr;
+        unsigned sqMask = 0;
+        unsigned sqEntries = 0;
+        unsigned localTail = 0;
+
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned cqMask = 0;
+        io_uring_cqe* cqes = nullptr;
+
+        std::shared_ptr<SlotArena> arena;
+    };
+
+    std::atomic<bool> uringUnavailable{false};
+
+    Ring* threadRing()
+    {
+        thread_local std::unique_ptr<Ring> ring;
+        thread_local bool attempted = false;
+        if (!attempted && !uringUnavailable.load(std::memory_order_relaxed))
+        {
+            attempted = true;
+            auto candidate = std::make_unique<Ring>();
+            if (candidate->init())
+            {
+                ring = std::move(candidate);
+            }
+            else
+            {
+                uringUnavailable.store(true, std::memory_order_relaxed);
+            }
+        }
+        return ring.get();
+    }
+
+    /**
+     * Per file progress of a batch submitted on the ring.
+     */
+    struct Pending {
+        struct statx info{};
+        int fd = -1;
+        int pendingOperations = 0;
+        std::error_code error;
+        std::size_t size = 0;
+        std::size_t offset = 0;
+        unsigned char* destination = nullptr;
+        std::shared_ptr<const void> owner;
+        int slot = -1;
+    };
+
+    std::error_code errorOf(int result)
+    {
+        return {-result, std::generic_category()};
+    }
+
+    std::vector<FileBatchReader::Entry> readWithRing(Ring& ring, const std::vector<std::string>& paths)
+    {
+        std::vector<FileBatchReader::Entry> entries(paths.size());
+        std::vector<Pending> pending(paths.size());
+        const std::size_t mmapThreshold = FileReader::mmapThreshold();
+
+        // The submission queue is only full when the kernel left entries unconsumed, publishing them again
+        // frees slots.
+        auto nextEntry = [&]() {
+            io_uring_sqe* sqe = ring.next();
+            if (sqe == nullptr)
+            {
+                if (const int error = ring.submit(); error < 0)
+                {
+                    throw std::system_error(-error, std::generic_category(), "io_uring_enter failed");
+                }
+                sqe = ring.next();
+            }
+            if (sqe == nullptr)
+            {
+                throw std::system_error(EBUSY, std::generic_category(), "io_uring submission queue is full");
+            }
+            return sqe;
+        };
+
+        auto queueRead = [&](std::size_t index) {
+            Pending& file = pending[index];
+            io_uring_sqe* sqe = nextEntry();
+            sqe->fd = file.fd;
+            sqe->addr = reinterpret_cast<std::uint64_t>(file.destination + file.offset);
+            sqe->len = static_cast<std::uint32_t>(std::min<std::size_t>(file.size - file.offset, MaxReadLength));
+            sqe->off = file.offset;
+            sqe->user_data = tag(index, Read);
+            if (file.slot >= 0)
+            {
+                sqe->opcode = IORING_OP_READ_FIXED;
+                sqe->buf_index = static_cast<std::uint16_t>(file.slot);
+            }
+            else
+            {
+                sqe->opcode = IORING_OP_READ;
+            }
+            ++file.pendingOperations;
+        };
+
+        auto queueClose = [&](std::size_t index) {
+            Pending& file = pending[index];
+            io_uring_sqe* sqe = nextEntry();
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = file.fd;
+            sqe->user_data = tag(index, Close);
+            file.fd = -1;
+            ++file.pendingOperations;
+        };
+
+        // Called once the open and the size lookup of a file both completed.
+        auto startRead = [&](std::size_t index) {
+            Pending& file = pending[index];
+            file.size = static_cast<std::size_t>(file.info.stx_size);
+            if (file.error || file.size == 0)
+            {
+                return;
+            }
+
+            if (file.size >= mmapThreshold)
+            {
+                void* address = ::mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+                if (address == MAP_FAILED)
+                {
+                    file.error = {errno, std::generic_category()};
+                    return;
+                }
+                const std::size_t length = file.size;
+                entries[index].content = {std::shared_ptr<const void>(address, [length](const void* mapped) {
+                    ::munmap(const_cast<void*>(mapped), length);
+                }), address, length};
+                return;
+            }
+
+            unsigned slot;
+            if (file.size <= SlotSize && ring.hasFixedBuffers() && ring.slots()->acquire(slot))
+            {
+                const auto& arena = ring.slots();
+                file.slot = static_cast<int>(slot);
+                file.destination = arena->slot(slot);
+                file.owner = std::shared_ptr<const void>(file.destination, [arena, slot](const void*) {
+                    arena->release(slot);
+                });
+            }
+            else
+            {
+                auto buffer = BufferPool::shared().acquire(file.size);
+                file.destination = buffer->data();
+                file.owner = std::move(buffer);
+            }
+            queueRead(index);
+        };
+
+        auto finishIfIdle = [&](std::size_t index) {
+            Pending& file = pending[index];
+            if (file.pendingOperations > 0)
+            {
+                return false;
+            }
+            if (file.fd >= 0)
+            {
+                queueClose(index);
+                return false;
+            }
+            if (file.error)
+            {
+                entries[index].error = file.error;
+            }
+            else if (file.owner)
+            {
+                entries[index].content = {std::move(file.owner), file.destination, file.offset};
+            }
+            file.owner.reset();
+            return true;
+        };
+
+        std::size_t next = 0;
+        std::size_t inFlight = 0;
+        std::size_t finished = 0;
+        while (finished < paths.size())
+        {
+            while (inFlight < MaxFilesInFlight && next < paths.size())
+            {
+                Pending& file = pending[next];
+                io_uring_sqe* open = nextEntry();
+                open->opcode = IORING_OP_OPENAT;
+                open->fd = AT_FDCWD;
+                open->addr = reinterpret_cast<std::uint64_t>(paths[next].c_str());
+                open->open_flags = O_RDONLY | O_CLOEXEC;
+                open->user_data = tag(next, Open);
+
+                io_uring_sqe* stat = nextEntry();
+                stat->opcode = IORING_OP_STATX;
+                stat->fd = AT_FDCWD;
+                stat->addr = reinterpret_cast<std::uint64_t>(paths[next].c_str());
+                stat->len = STATX_SIZE;
+                stat->off = reinterpret_cast<std::uint64_t>(&file.info);
+                stat->user_data = tag(next, Stat);
+
+                file.pendingOperations = 2;
+                ++inFlight;
+                ++next;
+            }
+
+            if (const int error = ring.submitAndWait(); error < 0)
+            {
+                throw std::system_error(-error, std::generic_category(), "io_uring_enter failed");
+            }
+
+            ring.drain([&](std::uint64_t userData, int result) {
+                const std::size_t index = userData >> 2;
+                Pending& file = pending[index];
+                --file.pendingOperations;
+
+                switch (static_cast<Operation>(userData & 3))
+                {
+                case Open:
+                    if (result < 0)
+                    {
+                        file.error = errorOf(result);
+                    }
+                    else
+                    {
+                        file.fd = result;
+                    }
+                    if (file.pendingOperations == 0)
+                    {
+                        startRead(index);
+                    }
+                    break;
+                case Stat:
+                    if (result < 0 && !file.error)
+                    {
+                        file.error = errorOf(result);
+                    }
+                    if (file.pendingOperations == 0)
+                    {
+                        startRead(index);
+                    }
+                    break;
+                case Read:
+                    if (result == -EAGAIN || result == -EINTR)
+                    {
+                        queueRead(index);
+                    }
+                    else if (result < 0)
+                    {
+                        file.error = errorOf(result);
+                    }
+                    else
+                    {
+                        file.offset += static_cast<std::size_t>(result);
+                        // A zero length read means the file shrank since statx, keep what was read.
+                        if (result > 0 && file.offset < file.size)
+                        {
+                            queueRead(index);
+                        }
+                    }
+                    break;
+                case Close:
+                    break;
+                }
+
+                if (finishIfIdle(index))
+                {
+                    --inFlight;
+                    ++finished;
+                }
+            });
+        }
+        return entries;
+    }
+
+    std::vector<FileBatchReader::Entry> readWithThreadPool(const std::vector<std::string>& paths)
+    {
+        std::vector<FileBatchReader::Entry> entries(paths.size());
+        ThreadPool::shared().parallelFor(paths.size(), [&](std::size_t index) {
+            try
+            {
+                entries[index].content = FileReader::read(paths[index]);
+            }
+            catch (const std::system_error& e)
+            {
+                entries[index].error = e.code();
+            }
+        });
+        return entries;
+    }
+}
+
+std::vector<FileBatchReader::Entry> FileBatchReader::read(const std::vector<std::string>& paths) {
+    if (Ring* ring = threadRing())
+    {
+        return readWithRing(*ring, paths);
+    }
+    return readWithThreadPool(paths);
+}
+
+FileBatchReader::Backend FileBatchReader::backend() {
+    return threadRing() != nullptr ? Backend::IoUring : Backend::ThreadPool;
+}
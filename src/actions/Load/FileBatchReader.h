@@ -0,0 +1,73 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef FILEBATCHREADER_H
+#define FILEBATCHREADER_H
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "../../utils/BufferSlice.h"
+
+/**
+ * @class FileBatchReader
+ * @brief Loads many local files at once, amortizing the per-file system calls.
+ *
+ * On Linux kernels exposing io_uring, the opens, size lookups, reads and closes of a whole batch
+ * are queued on a per-thread ring and submitted together, so thousands of small files cost a
+ * handful of `io_uring_enter` calls instead of four blocking calls each. Small files are read
+ * into buffers registered with the ring once per thread. Files at or above the `FileReader` mmap
+ * threshold are still memory mapped.
+ *
+ * When io_uring is not available (old kernel, seccomp policy...), every file goes through
+ * `FileReader::read` on the shared thread pool instead.
+ */
+class FileBatchReader {
+public:
+
+    /**
+     * @enum Backend
+     * @brief The mechanism used to perform the batch reads.
+     */
+    enum class Backend {
+        IoUring,
+        ThreadPool
+    };
+
+    /**
+     * @struct Entry
+     * @brief Outcome of loading one file of the batch.
+     *
+     * @var Entry::content
+     * The whole file content, valid when `error` is not set.
+     *
+     * @var Entry::error
+     * The reason the file could not be loaded.
+     */
+    struct Entry {
+        BufferSlice content;
+        std::error_code error;
+    };
+
+    /**
+     * @brief Reads every file of `paths`.
+     *
+     * Failures are reported per entry, one unreadable file does not affect the others.
+     *
+     * @param paths Local file system paths.
+     * @return std::vector<Entry> One entry per path, in the same order.
+     *
+     * @throws std::system_error If the io_uring batch itself fails, the whole batch is then unread.
+     */
+    static std::vector<Entry> read(const std::vector<std::string>& paths);
+
+    /**
+     * @brief Returns the backend used by `read` on this machine.
+     */
+    static Backend backend();
+};
+
+
+
+#endif //FILEBATCHREADER_H
@@ -0,0 +1,142 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "FileChunkStream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    std::atomic<std::size_t> threshold{FileChunkStream::DefaultStreamingThreshold};
+
+    [[noreturn]] void throwErrno(const std::string& what, const std::string& path)
+    {
+        throw std::system_error(errno, std::generic_category(), what + ": " + path);
+    }
+
+    std::size_t pageSize()
+    {
+        static const auto size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        return size;
+    }
+}
+
+/**
+ * The read-only mapping shared by the stream and every chunk it handed out. The descriptor stays
+ * open for the page cache advice.
+ */
+struct FileChunkStream::Mapping {
+    int fd;
+    unsigned char* address;
+    std::size_t size;
+
+    Mapping(int fd, unsigned char* address, std::size_t size) : fd(fd), address(address), size(size) {}
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    ~Mapping() {
+        if (address != nullptr)
+        {
+            ::munmap(address, size);
+        }
+        ::close(fd);
+    }
+};
+
+FileChunkStream::FileChunkStream(std::shared_ptr<const Mapping> mapping, Options options)
+    : mapping(std::move(mapping)), options(options) {}
+
+std::shared_ptr<FileChunkStream> FileChunkStream::open(const std::string& path, Options options) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throwErrno("unable to open file", path);
+    }
+
+    struct stat info{};
+    if (::fstat(fd, &info) != 0)
+    {
+        const int error = errno;
+        ::close(fd);
+        errno = error;
+        throwErrno("unable to stat file", path);
+    }
+
+    const auto size = static_cast<std::size_t>(info.st_size);
+    unsigned char* address = nullptr;
+    if (size > 0)
+    {
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            const int error = errno;
+            ::close(fd);
+            errno = error;
+            throwErrno("unable to map file", path);
+        }
+        address = static_cast<unsigned char*>(mapped);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        ::madvise(address, size, MADV_SEQUENTIAL);
+    }
+
+    const std::size_t page = pageSize();
+    options.chunkSize = std::max(page, (options.chunkSize + page - 1) / page * page);
+
+    auto mapping = std::make_shared<const Mapping>(fd, address, size);
+    return std::shared_ptr<FileChunkStream>(new FileChunkStream(std::move(mapping), options));
+}
+
+bool FileChunkStream::next(BufferSlice& chunk) {
+    if (offset >= mapping->size)
+    {
+        return false;
+    }
+
+    const std::size_t start = offset;
+    const std::size_t length = std::min(options.chunkSize, mapping->size - start);
+    offset += length;
+
+    const std::size_t ahead = std::min(options.readaheadChunks * options.chunkSize, mapping->size - offset);
+    if (ahead > 0)
+    {
+        ::madvise(mapping->address + offset, ahead, MADV_WILLNEED);
+    }
+
+    if (!options.releaseConsumed)
+    {
+        chunk = {mapping, mapping->address + start, length};
+        return true;
+    }
+
+    std::shared_ptr<const void> owner(mapping->address + start, [mapping = mapping, start, length](const void*) {
+        ::madvise(mapping->address + start, length, MADV_DONTNEED);
+        ::posix_fadvise(mapping->fd, static_cast<off_t>(start), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+    });
+    chunk = {std::move(owner), mapping->address + start, length};
+    return true;
+}
+
+std::size_t FileChunkStream::sizeHint() const {
+    return mapping->size;
+}
+
+BufferSlice FileChunkStream::head(std::size_t size) const {
+    return {mapping, mapping->address, std::min(size, mapping->size)};
+}
+
+void FileChunkStream::setStreamingThreshold(std::size_t bytes) {
+    threshold.store(bytes, std::memory_order_relaxed);
+}
+
+std::size_t FileChunkStream::streamingThreshold() {
+    return threshold.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,100 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef FILECHUNKSTREAM_H
+#define FILECHUNKSTREAM_H
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "../../utils/ChunkStream.h"
+
+/**
+ * @class FileChunkStream
+ * @brief Streams a large local file sequentially while keeping the page cache and RSS bounded.
+ *
+ * The file is mapped read-only and advertised to the kernel as sequentially accessed
+ * (`posix_fadvise`/`madvise` SEQUENTIAL). Every time a chunk is handed out, the next
+ * `readaheadChunks` chunks are requested with WILLNEED so the disk stays busy while the consumer
+ * works. When the last slice of a chunk is released, its pages are dropped with DONTNEED, both from
+ * the process mapping and from the page cache.
+ */
+class FileChunkStream : public ChunkStream {
+public:
+
+    /**
+     * @struct Options
+     * @brief Tunables of a chunked file stream.
+     *
+     * @var Options::chunkSize
+     * Size of every chunk but the last, rounded up to the page size.
+     *
+     * @var Options::readaheadChunks
+     * Number of chunks requested ahead of the one being consumed.
+     *
+     * @var Options::releaseConsumed
+     * Whether released chunks are dropped from the page cache.
+     */
+    struct Options {
+        std::size_t chunkSize = 8u << 20;
+        std::size_t readaheadChunks = 2;
+        bool releaseConsumed = true;
+    };
+
+    /**
+     * @brief Default size from which `FileLoad` streams a file instead of loading it at once.
+     */
+    static constexpr std::size_t DefaultStreamingThreshold = std::size_t{256} << 20;
+
+    /**
+     * @brief Opens `path` for chunked streaming.
+     *
+     * @param path Local file system path.
+     * @param options Stream tunables.
+     * @return The stream, positioned on the first chunk.
+     *
+     * @throws std::system_error If the file cannot be opened or mapped.
+     */
+    static std::shared_ptr<FileChunkStream> open(const std::string& path, Options options);
+
+    static std::shared_ptr<FileChunkStream> open(const std::string& path) {
+        return open(path, Options{});
+    }
+
+    bool next(BufferSlice& chunk) override;
+
+    std::size_t sizeHint() const override;
+
+    /**
+     * @brief Returns the first bytes of the file without consuming them.
+     *
+     * @param size Maximum number of bytes.
+     */
+    BufferSlice head(std::size_t size) const;
+
+    /**
+     * @brief Changes the size from which `FileLoad` streams files.
+     *
+     * @param bytes New threshold in bytes.
+     */
+    static void setStreamingThreshold(std::size_t bytes);
+
+    /**
+     * @brief Returns the size from which `FileLoad` streams files.
+     */
+    static std::size_t streamingThreshold();
+
+private:
+    struct Mapping;
+
+    FileChunkStream(std::shared_ptr<const Mapping> mapping, Options options);
+
+    std::shared_ptr<const Mapping> mapping;
+    Options options;
+    std::size_t offset = 0;
+};
+
+
+
+#endif //FILECHUNKSTREAM_H
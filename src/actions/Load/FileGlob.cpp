@@ -0,0 +1,366 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "FileGlob.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "FileLoad.h"
+#include "../../utils/Uri.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+    constexpr std::string_view Scheme = "file://";
+    constexpr std::string_view AnyDepth = "**";
+
+    // Bounds the matches found ahead of the consumer.
+    constexpr std::size_t MaxQueuedMatches = 4096;
+
+    constexpr std::size_t DirentBufferSize = 64 * 1024;
+
+    /**
+     * Layout of the records returned by getdents64, not exposed by the C library.
+     */
+    struct LinuxDirent64 {
+        std::uint64_t inode;
+        std::int64_t offset;
+        unsigned short length;
+        unsigned char type;
+        char name[1];
+    };
+
+    // `?` delimits the query of a URI, so it is not a wildcard here.
+    bool hasWildcard(std::string_view segment)
+    {
+        return segment.find_first_of("*[") != std::string_view::npos;
+    }
+
+    // Turns an encoded URI segment into an fnmatch pattern, in which escaped octets only match themselves.
+    std::string patternOf(std::string_view segment)
+    {
+        std::string pattern;
+        pattern.reserve(segment.size());
+        for (std::size_t i = 0; i < segment.size(); ++i)
+        {
+            char c = segment[i];
+            char escaped[3];
+            if (c == '%' && segment.size() - i >= 3 && Uri::decode(segment.substr(i, 3), escaped) == 1)
+            {
+                c = escaped[0];
+                i += 2;
+                if (c != '\0' && std::strchr("*?[]\\", c) != nullptr)
+                {
+                    pattern += '\\';
+                }
+            }
+            else if (c == '\\')
+            {
+                pattern += '\\';
+            }
+            pattern += c;
+        }
+        return pattern;
+    }
+
+    std::string join(const std::string& directory, const char* name)
+    {
+        std::string path = directory;
+        if (path.empty() || path.back() != '/')
+        {
+            path += '/';
+        }
+        return path += name;
+    }
+}
+
+bool FileGlob::isExpandable(std::string_view uri) {
+    if (Uri::schemeOf(uri) != UriScheme::File)
+    {
+        return false;
+    }
+    const std::string_view path = Uri::parse(uri).path;
+    if (path.ends_with('/'))
+    {
+        return true;
+    }
+    if (!hasWildcard(path))
+    {
+        return false;
+    }
+    // Names may contain wildcard characters, such as img[1].png: an existing file is designated literally.
+    struct stat info{};
+    return ::stat(FileLoad::pathOf(uri).c_str(), &info) != 0;
+}
+
+FileGlob::FileGlob(std::string_view text, std::size_t walkerCount) {
+    const std::string_view uri = Uri::parse(text).path;
+
+    // The literal leading segments form the directory the walk starts from.
+    std::string base = uri.starts_with('/') ? "/" : "";
+    bool literal = true;
+    for (std::size_t start = 0; start <= uri.size();)
+    {
+        std::size_t end = uri.find('/', start);
+        if (end == std::string_view::npos)
+        {
+            end = uri.size();
+        }
+        const std::string_view segment = uri.substr(start, end - start);
+        start = end + 1;
+        if (segment.empty())
+        {
+            continue;
+        }
+        literal = literal && !hasWildcard(segment);
+        if (literal)
+        {
+            if (!base.empty() && base.back() != '/')
+            {
+                base += '/';
+            }
+            std::string decoded;
+            Uri::decode(segment, decoded);
+            base += decoded;
+        }
+        else
+        {
+            segments.push_back(segment == AnyDepth ? std::string(AnyDepth) : patternOf(segment));
+        }
+    }
+    if (uri.ends_with('/'))
+    {
+        segments.emplace_back(AnyDepth);
+        segments.emplace_back("*");
+    }
+
+    std::vector<std::size_t> states{0};
+    closure(states);
+    directories.push_back({base.empty() ? "." : base, std::move(states)});
+
+    if (walkerCount == 0)
+    {
+        walkerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    walkers.reserve(walkerCount);
+    for (std::size_t i = 0; i < walkerCount; ++i)
+    {
+        walkers.emplace_back([this]() { walk(); });
+    }
+}
+
+FileGlob::~FileGlob() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    directoriesAvailable.notify_all();
+    matchesConsumed.notify_all();
+    for (auto& walker : walkers)
+    {
+        walker.join();
+    }
+}
+
+bool FileGlob::next(std::string& uri) {
+    std::unique_lock lock(mutex);
+    matchesAvailable.wait(lock, [this]() { return finished || !matches.empty(); });
+    if (matches.empty())
+    {
+        return false;
+    }
+    uri = std::move(matches.front());
+    matches.pop_front();
+    lock.unlock();
+    matchesConsumed.notify_one();
+    return true;
+}
+
+void FileGlob::closure(std::vector<std::size_t>& states) const {
+    // `**` also matches zero directories, so its position implies the following one.
+    for (std::size_t i = 0; i < states.size(); ++i)
+    {
+        const std::size_t state = states[i];
+        if (state < segments.size() && segments[state] == AnyDepth &&
+            std::find(states.begin(), states.end(), state + 1) == states.end())
+        {
+            states.push_back(state + 1);
+        }
+    }
+}
+
+void FileGlob::walk() {
+    for (;;)
+    {
+        Directory directory;
+        {
+            std::unique_lock lock(mutex);
+            directoriesAvailable.wait(lock, [this]() {
+                return stopping || finished || !directories.empty();
+            });
+            if (stopping || finished)
+            {
+                return;
+            }
+            directory = std::move(directories.front());
+            directories.pop_front();
+            ++activeWalkers;
+        }
+
+        list(directory);
+
+        std::lock_guard lock(mutex);
+        if (--activeWalkers == 0 && directories.empty())
+        {
+            finished = true;
+            directoriesAvailable.notify_all();
+            matchesAvailable.notify_all();
+        }
+    }
+}
+
+void FileGlob::list(const Directory& directory) {
+    const int fd = ::open(directory.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        // Unreadable directories are skipped, the rest of the tree is still expanded.
+        return;
+    }
+
+    std::vector<Directory> children;
+    std::vector<std::size_t> states;
+    alignas(LinuxDirent64) char buffer[DirentBufferSize];
+    for (;;)
+    {
+        const long read = ::syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (read <= 0)
+        {
+            break;
+        }
+
+        for (long position = 0; position < read;)
+        {
+            const auto* entry = reinterpret_cast<const LinuxDirent64*>(buffer + position);
+            position += entry->length;
+            const char* name = entry->name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+
+            // Symbolic links are followed to files but never descended into, which rules out cycles.
+            bool isDirectory = entry->type == DT_DIR;
+            bool isFile = entry->type == DT_REG;
+            if (entry->type == DT_LNK || entry->type == DT_UNKNOWN)
+            {
+                struct stat info{};
+                bool isLink = entry->type == DT_LNK;
+                if (!isLink && ::fstatat(fd, name, &info, AT_SYMLINK_NOFOLLOW) == 0)
+                {
+                    isLink = S_ISLNK(info.st_mode);
+                    isDirectory = S_ISDIR(info.st_mode);
+                    isFile = S_ISREG(info.st_mode);
+                }
+                if (isLink && ::fstatat(fd, name, &info, 0) == 0)
+                {
+                    isFile = S_ISREG(info.st_mode);
+                }
+            }
+            if (!isDirectory && !isFile)
+            {
+                continue;
+            }
+
+            states.clear();
+            for (const std::size_t state : directory.states)
+            {
+                if (state >= segments.size())
+                {
+                    continue;
+                }
+                const std::string& segment = segments[state];
+                if (segment == AnyDepth)
+                {
+                    if (name[0] == '.')
+                    {
+                        continue;
+                    }
+                    if (isDirectory)
+                    {
+                        states.push_back(state);
+                    }
+                    else if (state + 1 == segments.size())
+                    {
+                        // A trailing `**` matches the files it reaches as well.
+                        states.push_back(state + 1);
+                    }
+                }
+                else if (::fnmatch(segment.c_str(), name, FNM_PERIOD) == 0)
+                {
+                    states.push_back(state + 1);
+                }
+            }
+            closure(states);
+
+            if (isFile && std::find(states.begin(), states.end(), segments.size()) != states.end())
+            {
+                emit(join(directory.path, name));
+            }
+            if (isDirectory && std::any_of(states.begin(), states.end(), [this](std::size_t state) {
+                    return state < segments.size();
+                }))
+            {
+                children.push_back({join(directory.path, name), states});
+            }
+        }
+    }
+    ::close(fd);
+
+    if (children.empty())
+    {
+        return;
+    }
+    {
+        std::lock_guard lock(mutex);
+        for (auto& child : children)
+        {
+            directories.push_back(std::move(child));
+        }
+    }
+    directoriesAvailable.notify_all();
+}
+
+void FileGlob::emit(std::string&& path) {
+    {
+        std::unique_lock lock(mutex);
+        matchesConsumed.wait(lock, [this]() { return stopping || matches.size() < MaxQueuedMatches; });
+        if (stopping)
+        {
+            return;
+        }
+        // Matches are URIs: '%', '?' and '#' in a file name are escaped so that they stay part of the path.
+        std::string uri(Scheme);
+        for (std::size_t start = 0;;)
+        {
+            const std::size_t special = path.find_first_of("%?#", start);
+            uri.append(path, start, special - start);
+            if (special == std::string::npos)
+            {
+                break;
+            }
+            uri += path[special] == '%' ? "%25" : path[special] == '?' ? "%3F" : "%23";
+            start = special + 1;
+        }
+        matches.push_back(std::move(uri));
+    }
+    matchesAvailable.notify_one();
+}
@@ -0,0 +1,94 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef FILEGLOB_H
+#define FILEGLOB_H
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @class FileGlob
+ * @brief Expands a `file://` glob or directory URI into the `file://` URIs of the matching files.
+ *
+ * Supported patterns are made of `/` separated segments, each matched with `fnmatch` (`*`,
+ * `[...]`), plus `**` which matches any number of directories. A URI ending with `/` designates
+ * every regular file below that directory, like a trailing `**` segment would. Hidden entries are
+ * only matched by segments starting with a dot. `?` starts the query of a URI, so it is not a
+ * wildcard, and percent-encoded characters (`%2A`, `%3F`, `%5B`...) only match themselves.
+ *
+ * The tree is walked by several threads reading directories with `getdents64`. Matches are pushed
+ * into a bounded queue as soon as they are found, so the consumer starts loading the first files
+ * while the rest of the tree is still being listed.
+ */
+class FileGlob {
+public:
+
+    /**
+     * @brief Tells whether `uri` designates several files and must be expanded.
+     *
+     * @param uri Any URI.
+     * @return true for `file://` URIs ending with `/`, or whose path contains a wildcard and does not
+     *         designate an existing file as it is.
+     */
+    static bool isExpandable(std::string_view uri);
+
+    /**
+     * @brief Starts walking the tree designated by `uri`.
+     *
+     * @param uri A `file://` glob or directory URI.
+     * @param walkers Number of walking threads, zero selects the hardware concurrency.
+     */
+    explicit FileGlob(std::string_view uri, std::size_t walkers = 0);
+
+    FileGlob(const FileGlob&) = delete;
+    FileGlob& operator=(const FileGlob&) = delete;
+
+    /**
+     * @brief Stops the walk if still running and joins the walking threads.
+     */
+    ~FileGlob();
+
+    /**
+     * @brief Blocks until the next matching file is found.
+     *
+     * @param uri Output parameter receiving the `file://` URI of the match.
+     * @return true if a match was produced, false once the whole tree was walked.
+     */
+    bool next(std::string& uri);
+
+private:
+    struct Directory {
+        std::string path;
+        std::vector<std::size_t> states;
+    };
+
+    void walk();
+    void list(const Directory& directory);
+    void emit(std::string&& path);
+    void closure(std::vector<std::size_t>& states) const;
+
+    std::vector<std::string> segments;
+
+    std::mutex mutex;
+    std::condition_variable directoriesAvailable;
+    std::condition_variable matchesAvailable;
+    std::condition_variable matchesConsumed;
+    std::deque<Directory> directories;
+    std::deque<std::string> matches;
+    std::size_t activeWalkers = 0;
+    bool finished = false;
+    bool stopping = false;
+
+    std::vector<std::thread> walkers;
+};
+
+
+
+#endif //FILEGLOB_H
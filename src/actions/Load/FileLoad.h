@@ -5,38 +5,43 @@
 #ifndef FILELOAD_H
 #define FILELOAD_H
 
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "FileChunkStream.h"
+#include "FileReader.h"
 #include "../ActionResult.h"
-#include "../JsonUnserializer.h"
-#include "../DataDecompressor.h"
-#include "../ImageDecoding.h"
+#include "../../utils/ContentType.h"
+#include "../../utils/Uri.h"
 
 /**
  * @class FileLoad
- * @brief Handles the execution of file loading actions based on metadata.
+ * @brief Handles the execution of file loading actions.
+ *
+ * The FileLoad class provides a static method to load the file designated by a
+ * URI and tag it with the metadata type of the action that processes it next.
  *
- * The FileLoad class provides a static method to process file loading logic
- * by delegating the task to specific handlers based on the metadata type.
- * It ensures that the input data is valid and processes it accordingly.
+ * The file content is exposed as a `BufferSlice`: large files are memory mapped
+ * so the next actions read straight from the page cache, small files are read
+ * into pooled buffers (see `FileReader`). Files above the streaming threshold
+ * are exposed as a `ChunkStream` instead (see `FileChunkStream`), so the next
+ * action can start on the first chunk and consumed pages are released.
  */
 class FileLoad  {
 public:
     /**
-     * @brief Executes the file loading action based on the metadata type of the previous result.
+     * @brief Executes the file load action of the URI held by the previous result.
      * 
-     * This function processes the `previous` ActionResult object and performs a specific action
-     * depending on the metadata type. The result of the operation is stored in the `result` object.
+     * The file content is stored in `result`, tagged with the metadata type of the action that
+     * processes it next (see `ComputePipeline`).
      * 
-     * @param previous The previous ActionResult object, which must contain valid data and metadata.
-     * @param result The ActionResult object where the processed data and metadata will be stored.
+     * @param previous The previous ActionResult object, which must contain the URI as data.
+     * @param result The ActionResult object where the loaded data and metadata will be stored.
      * @return true If the operation is successful.
      * @return false If the `previous` object does not contain valid data.
      * 
-     * @throws std::invalid_argument If the metadata type in `previous` is invalid or unsupported.
-     * 
-     * @note The metadata type in `previous` determines which specific processing function is called:
-     *       - "json": Calls `JsonUnserializer::execute`.
-     *       - "decompress": Calls `DataDecompressor::execute`.
-     *       - "image": Calls `ImageDecoding::execute`.
+     * @throws std::system_error If the file cannot be read.
      */
     static bool execute(ActionResult&& previous, ActionResult& result) {
         if (!previous.data.has_value())
@@ -44,22 +49,84 @@ public:
             return false;
         }
 
-        // Implement the file loading logic here
-        // process will be assigned to the result object data and metadata
+        load(std::any_cast<const std::string&>(previous.data), result);
+        return true;
+    }
 
-        ActionResult resultCopy = result;
-        switch (previous.metadata)
+    /**
+     * @brief Loads the file designated by `uri` into `result`, without running the next action.
+     *
+     * @param uri A `file://` URI or a plain path.
+     * @param result The result receiving the content and the metadata type of the next action.
+     *
+     * @throws std::system_error If the file cannot be read.
+     */
+    static void load(const std::string& uri, ActionResult& result) {
+        const std::string path = pathOf(uri);
+        std::error_code error;
+        const auto size = std::filesystem::file_size(path, error);
+        if (!error && size >= FileChunkStream::streamingThreshold())
+        {
+            assign(FileChunkStream::open(path), result);
+        }
+        else
+        {
+            assign(FileReader::read(path), result);
+        }
+    }
+
+    /**
+     * @brief Returns the local path designated by a `file://` URI.
+     *
+     * The path of a file URI is percent-decoded. File URIs carry no query nor fragment, `?` and
+     * `#` are part of the path.
+     *
+     * @param uri A `file://` URI or a plain path, returned as it is.
+     * @return std::string The path to pass to the file system.
+     */
+    static std::string pathOf(std::string_view uri) {
+        if (Uri::schemeOf(uri) != UriScheme::File)
+        {
+            return std::string(uri);
+        }
+        uri.remove_prefix(5);
+        if (uri.starts_with("//"))
         {
-        case "json":
-            return JsonUnserializer::execute(std::move(resultCopy), result);
-        case "decompress":
-            return DataDecompressor::execute(std::move(resultCopy), result);
-        case "image":
-            return ImageDecoding::execute(std::move(resultCopy), result);
-        default:
-            throw std::invalid_argument("invalid metadata type: " + previous.metadata);
+            uri.remove_prefix(2);
         }
-        return false;
+        if (!Uri::needsDecoding(uri))
+        {
+            return std::string(uri);
+        }
+        std::string path;
+        Uri::decode(uri, path);
+        return path;
+    }
+
+    /**
+     * @brief Stores loaded file content into `result`, ready for the next action.
+     *
+     * Used by `execute` and by batch loaders (see `FileBatchReader`) that read the content
+     * of many files up front.
+     *
+     * @param content The file content.
+     * @param result The result receiving the content and the metadata type of the next action.
+     */
+    static void assign(BufferSlice&& content, ActionResult& result) {
+        result.metadata = sniffContentType(content.data(), content.size());
+        result.data = std::move(content);
+    }
+
+    /**
+     * @brief Stores a chunked file stream into `result`, ready for the next action.
+     *
+     * @param stream The opened stream, the metadata type is guessed from its first bytes.
+     * @param result The result receiving the stream and the metadata type of the next action.
+     */
+    static void assign(std::shared_ptr<FileChunkStream>&& stream, ActionResult& result) {
+        const BufferSlice head = stream->head(64);
+        result.metadata = sniffContentType(head.data(), head.size());
+        result.data = std::shared_ptr<ChunkStream>(std::move(stream));
     }
 };
 
@@ -0,0 +1,123 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "FileReader.h"
+
+#include <atomic>
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../utils/BufferPool.h"
+
+namespace {
+
+    std::atomic<std::size_t> threshold{FileReader::DefaultMmapThreshold};
+
+    [[noreturn]] void throwErrno(const std::string& what, const std::string& path)
+    {
+        throw std::system_error(errno, std::generic_category(), what + ": " + path);
+    }
+
+    /**
+     * Closes the descriptor when leaving the scope, mappings stay valid after close.
+     */
+    struct ScopedFd {
+        int fd;
+        ~ScopedFd() {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+    };
+
+    /**
+     * Owner of a read-only mapping, unmaps once the last slice is gone.
+     */
+    struct Mapping {
+        void* address;
+        std::size_t length;
+        Mapping(void* address, std::size_t length) : address(address), length(length) {}
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+        ~Mapping() {
+            ::munmap(address, length);
+        }
+    };
+
+    BufferSlice mapFile(int fd, std::size_t size, const std::string& path)
+    {
+        void* address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            throwErrno("unable to map file", path);
+        }
+        auto mapping = std::make_shared<const Mapping>(address, size);
+        return {std::move(mapping), address, size};
+    }
+
+    BufferSlice preadFile(int fd, std::size_t size, const std::string& path)
+    {
+        auto buffer = BufferPool::shared().acquire(size);
+        std::size_t offset = 0;
+        while (offset < size)
+        {
+            const ssize_t count = ::pread(fd, buffer->data() + offset, size - offset, static_cast<off_t>(offset));
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throwErrno("unable to read file", path);
+            }
+            if (count == 0)
+            {
+                // The file shrank since fstat, expose what was actually read.
+                break;
+            }
+            offset += static_cast<std::size_t>(count);
+        }
+        const unsigned char* bytes = buffer->data();
+        return {std::move(buffer), bytes, offset};
+    }
+}
+
+BufferSlice FileReader::read(const std::string& path) {
+    const ScopedFd file{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (file.fd < 0)
+    {
+        throwErrno("unable to open file", path);
+    }
+
+    struct stat info{};
+    if (::fstat(file.fd, &info) != 0)
+    {
+        throwErrno("unable to stat file", path);
+    }
+    const auto size = static_cast<std::size_t>(info.st_size);
+    if (size == 0)
+    {
+        return {};
+    }
+
+    if (size >= mmapThreshold())
+    {
+        return mapFile(file.fd, size, path);
+    }
+    return preadFile(file.fd, size, path);
+}
+
+void FileReader::setMmapThreshold(std::size_t bytes) {
+    threshold.store(bytes, std::memory_order_relaxed);
+}
+
+std::size_t FileReader::mmapThreshold() {
+    return threshold.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,52 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef FILEREADER_H
+#define FILEREADER_H
+#include <cstddef>
+#include <string>
+
+#include "../../utils/BufferSlice.h"
+
+/**
+ * @class FileReader
+ * @brief Reads whole files into ref-counted slices with as few copies as possible.
+ *
+ * Files at or above the mmap threshold are mapped read-only, the returned slice points straight
+ * into the page cache and keeps the mapping alive. Smaller files are read with `pread` into a
+ * buffer taken from the `BufferPool`, since mapping costs more than copying a few kilobytes.
+ */
+class FileReader {
+public:
+    /**
+     * @brief Default size from which files are memory mapped instead of read.
+     */
+    static constexpr std::size_t DefaultMmapThreshold = 1u << 20;
+
+    /**
+     * @brief Reads the whole file located at `path`.
+     *
+     * @param path Local file system path.
+     * @return BufferSlice A slice covering the whole file content.
+     *
+     * @throws std::system_error If the file cannot be opened, inspected, mapped or read.
+     */
+    static BufferSlice read(const std::string& path);
+
+    /**
+     * @brief Changes the size from which files are memory mapped.
+     *
+     * @param bytes New threshold in bytes. Zero maps every non-empty file.
+     */
+    static void setMmapThreshold(std::size_t bytes);
+
+    /**
+     * @brief Returns the size from which files are memory mapped.
+     */
+    static std::size_t mmapThreshold();
+};
+
+
+
+#endif //FILEREADER_H
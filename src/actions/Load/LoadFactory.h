@@ -8,30 +8,35 @@
 #include <stdexcept>
 
 #include "BundleLoad.h"
+#include "DataUriLoad.h"
 #include "FileLoad.h"
+#include "MemoryLoad.h"
 #include "UrlLoad.h"
 #include "../ActionResult.h"
+#include "../../utils/Uri.h"
 
 /**
  * @class LoadFactory
  * @brief A factory class responsible for executing different types of load actions based on metadata.
  *
  * The LoadFactory class provides a static method to execute specific load actions
- * depending on the metadata provided in the `previous` ActionResult object. It supports
- * loading from various sources such as files, URLs, and bundles.
+ * depending on the scheme of the URI held by the `previous` ActionResult object. It supports
+ * loading from various sources such as files, URLs, bundles, `data:` URIs and in-process buffers.
+ *
+ * Only the scheme is read to choose the loader, interned into a `UriScheme` without allocating.
  */
 class LoadFactory {
 
   public:
     /**
-     * @brief Executes a specific load action based on the metadata of the previous action result.
+     * @brief Executes a specific load action based on the URI of the previous action result.
      * 
      * This function determines the type of load operation to perform (e.g., file, URL, or bundle)
-     * based on the metadata provided in the `previous` ActionResult. It delegates the execution
-     * to the appropriate handler (e.g., FileLoad, UrlLoad, or BundleLoad). If the metadata does
-     * not match any known type, an exception is thrown.
+     * based on the scheme of the URI held by `previous`. It delegates the execution to the
+     * appropriate handler (e.g., FileLoad, UrlLoad, or BundleLoad), plain paths being loaded as
+     * files. If the scheme does not match any known type, an exception is thrown.
      * 
-     * @param previous The result of the previous action, containing data and metadata.
+     * @param previous The result of the previous action, containing the URI as data.
      *                 The `data` field must have a value; otherwise, the function returns false.
      * @param result   A reference to an ActionResult object where the result of the current
      *                 execution will be stored.
@@ -39,7 +44,7 @@ class LoadFactory {
      * @return true if the execution was successful, false if the `data` field in `previous`
      *         does not have a value.
      * 
-     * @throws std::invalid_argument If the metadata in `previous` does not match any known type.
+     * @throws std::invalid_argument If the scheme of the URI does not match any known type.
      */
     static bool execute(ActionResult&& previous, ActionResult& result) {
         if (!previous.data.has_value())
@@ -47,21 +52,67 @@ class LoadFactory {
             return false;
         }
 
-        switch (previous.metadata)
+        const std::string& uri = std::any_cast<const std::string&>(previous.data);
+        switch (Uri::schemeOf(uri))
         {
-        case "file":
-                return FileLoad::execute(std::move(previous), result);
-            case "http":
-                [[fallthrough]];
-        case "https":
-                return UrlLoad::execute(std::move(previous), result);
-            case "bundle":
-                return BundleLoad::execute(std::move(previous), result);
-            default:
-                throw std::invalid_argument("unable to parse uri: " + previous.metadata);
+        case UriScheme::None:
+            [[fallthrough]];
+        case UriScheme::File:
+            return FileLoad::execute(std::move(previous), result);
+        case UriScheme::Http:
+            [[fallthrough]];
+        case UriScheme::Https:
+            return UrlLoad::execute(std::move(previous), result);
+        case UriScheme::Bundle:
+            return BundleLoad::execute(std::move(previous), result);
+        case UriScheme::Data:
+            return DataUriLoad::execute(std::move(previous), result);
+        case UriScheme::Memory:
+            return MemoryLoad::execute(std::move(previous), result);
+        default:
+            throw std::invalid_argument("unable to parse uri: " + uri);
         }
         return false;
     }
+
+    /**
+     * @brief Runs only the load action of `uri`, the I/O stage of the pipeline.
+     *
+     * The loaded content and its metadata type are stored in `result`, ready for
+     * `ComputePipeline::resume`. Batch runs use it to load items ahead of their processing.
+     *
+     * @param uri The URI to load, moved into the result when the content is a view of it.
+     * @param result The result receiving the content and the metadata type of the next action.
+     *
+     * @throws std::invalid_argument If the scheme of the URI does not match any known type.
+     * @throws std::exception Any error of the loader.
+     */
+    static void load(std::string uri, ActionResult& result) {
+        switch (Uri::schemeOf(uri))
+        {
+        case UriScheme::None:
+            [[fallthrough]];
+        case UriScheme::File:
+            FileLoad::load(uri, result);
+            return;
+        case UriScheme::Http:
+            [[fallthrough]];
+        case UriScheme::Https:
+            UrlLoad::load(uri, result);
+            return;
+        case UriScheme::Bundle:
+            BundleLoad::load(uri, result);
+            return;
+        case UriScheme::Data:
+            DataUriLoad::assign(std::move(uri), result);
+            return;
+        case UriScheme::Memory:
+            MemoryLoad::load(uri, result);
+            return;
+        default:
+            throw std::invalid_argument("unable to parse uri: " + uri);
+        }
+    }
 };
 
 
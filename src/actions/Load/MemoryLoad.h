@@ -0,0 +1,111 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef MEMORYLOAD_H
+#define MEMORYLOAD_H
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "MemoryRegistry.h"
+#include "../ActionResult.h"
+#include "../../utils/ContentType.h"
+#include "../../utils/Uri.h"
+
+/**
+ * @class MemoryLoad
+ * @brief Handles the execution of `memory://` loading actions based on metadata.
+ *
+ * Entries come from the buffers the application published in the `MemoryRegistry`: the loaded
+ * item is a slice sharing the published buffer, which the next actions read in place.
+ */
+class MemoryLoad {
+public:
+    /**
+     * @brief Executes the memory load action of the URI held by the previous action result.
+     *
+     * @param previous The result of the previous action, containing the URI as data.
+     *                 Must have a valid `data` value; otherwise, the function returns false.
+     * @param result   The result object where the loaded data and metadata will be stored.
+     *
+     * @return `true` if the operation is successful, `false` if the `previous` data is invalid.
+     *
+     * @throws std::runtime_error If no buffer is published under the name.
+     */
+    static bool execute(ActionResult&& previous, ActionResult& result) {
+        if (!previous.data.has_value())
+        {
+            return false;
+        }
+        load(std::any_cast<const std::string&>(previous.data), result);
+        return true;
+    }
+
+    /**
+     * @brief Loads the buffer designated by `uri` into `result`, without running the next action.
+     *
+     * @param uri The `memory://` URI.
+     * @param result The result receiving the buffer and the metadata type of the next action.
+     *
+     * @throws std::runtime_error If no buffer is published under the name.
+     */
+    static void load(const std::string& uri, ActionResult& result) {
+        MemoryRegistry::Entry entry;
+        std::string decoded;
+        if (!MemoryRegistry::shared().find(nameOf(uri, decoded), entry))
+        {
+            throw std::runtime_error("no buffer published as: " + uri);
+        }
+        assign(std::move(entry), result);
+    }
+
+    /**
+     * @brief Returns the buffer name designated by a `memory://` URI.
+     *
+     * The name spans the authority and the path, `memory://dir/file` names `dir/file`. The query and
+     * the fragment are not part of it, and escapes are decoded.
+     *
+     * @param uri A `memory://` URI, the scheme compared case-insensitively, or a bare name returned as it is.
+     * @param decoded Storage of the name when it has to be decoded.
+     * @return The name, a view into `uri` or into `decoded`.
+     */
+    static std::string_view nameOf(std::string_view uri, std::string& decoded) {
+        const Uri parsed = Uri::parse(uri);
+        if (parsed.schemeId != UriScheme::Memory)
+        {
+            return uri;
+        }
+        std::string_view name = parsed.path;
+        if (parsed.hasAuthority)
+        {
+            const char* end = parsed.path.empty() ? parsed.authority.data() + parsed.authority.size()
+                                                  : parsed.path.data() + parsed.path.size();
+            name = {parsed.authority.data(), static_cast<std::size_t>(end - parsed.authority.data())};
+        }
+        if (!Uri::needsDecoding(name))
+        {
+            return name;
+        }
+        Uri::decode(name, decoded);
+        return decoded;
+    }
+
+    /**
+     * @brief Stores a published buffer into `result`, ready for the next action.
+     *
+     * @param entry The buffer found in the registry.
+     * @param result The result receiving the buffer and the metadata type of the next action.
+     */
+    static void assign(MemoryRegistry::Entry&& entry, ActionResult& result) {
+        result.metadata = entry.metadata.empty()
+                              ? sniffContentType(entry.content.data(), entry.content.size())
+                              : std::move(entry.metadata);
+        result.data = std::move(entry.content);
+    }
+};
+
+
+
+#endif //MEMORYLOAD_H
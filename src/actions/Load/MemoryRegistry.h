@@ -0,0 +1,134 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef MEMORYREGISTRY_H
+#define MEMORYREGISTRY_H
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "../../utils/BufferSlice.h"
+
+/**
+ * @class MemoryRegistry
+ * @brief Buffers published by the application under a name, loaded through `memory://name` URIs.
+ *
+ * The registry only holds references: publishing a buffer shares its owner, and every item loaded
+ * from it shares the owner again. Nothing is copied, and removing or replacing a buffer never
+ * invalidates the items already loaded from it.
+ */
+class MemoryRegistry {
+public:
+
+    /**
+     * @struct Entry
+     * @brief A published buffer.
+     *
+     * @var Entry::content
+     * The published bytes.
+     *
+     * @var Entry::metadata
+     * Metadata type of the action able to process the bytes, guessed from them when empty.
+     */
+    struct Entry {
+        BufferSlice content;
+        std::string metadata;
+    };
+
+    /**
+     * @brief Returns the registry shared by the whole process.
+     */
+    static MemoryRegistry& shared() {
+        static MemoryRegistry registry;
+        return registry;
+    }
+
+    /**
+     * @brief Publishes `content` as `memory://name`, replacing any buffer published under `name`.
+     *
+     * @param name Name of the buffer, the URI is `memory://` followed by it.
+     * @param content The bytes, kept alive by the registry until removed or replaced.
+     * @param metadata Metadata type of the next action ("json", "image", "decompress"), guessed
+     *                 from the content when empty.
+     */
+    void publish(std::string name, BufferSlice content, std::string metadata = {}) {
+        Entry entry{std::move(content), std::move(metadata)};
+        std::unique_lock lock(mutex);
+        entries.insert_or_assign(std::move(name), std::move(entry));
+    }
+
+    /**
+     * @brief Publishes the whole content of a shared contiguous container (`std::string`,
+     * `std::vector<unsigned char>`...), see `publish(std::string, BufferSlice, std::string)`.
+     */
+    template <typename Container>
+    void publish(std::string name, std::shared_ptr<Container> content, std::string metadata = {}) {
+        const void* bytes = std::data(*content);
+        const std::size_t length = std::size(*content) * sizeof(*std::data(*content));
+        publish(std::move(name), BufferSlice(std::move(content), bytes, length), std::move(metadata));
+    }
+
+    /**
+     * @brief Removes the buffer published under `name`.
+     *
+     * @return true if a buffer was published under `name`.
+     */
+    bool remove(std::string_view name) {
+        std::unique_lock lock(mutex);
+        const auto found = entries.find(name);
+        if (found == entries.end())
+        {
+            return false;
+        }
+        entries.erase(found);
+        return true;
+    }
+
+    /**
+     * @brief Looks `name` up.
+     *
+     * @param name Name of the buffer.
+     * @param entry Output parameter receiving a reference to the buffer.
+     * @return true if a buffer is published under `name`.
+     */
+    bool find(std::string_view name, Entry& entry) const {
+        std::shared_lock lock(mutex);
+        const auto found = entries.find(name);
+        if (found == entries.end())
+        {
+            return false;
+        }
+        entry = found->second;
+        return true;
+    }
+
+    /**
+     * @brief Number of published buffers.
+     */
+    std::size_t size() const {
+        std::shared_lock lock(mutex);
+        return entries.size();
+    }
+
+private:
+    // Lets `find` and `remove` take a `string_view` without building a `std::string` key.
+    struct NameHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view name) const {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, Entry, NameHash, std::equal_to<>> entries;
+};
+
+
+
+#endif //MEMORYREGISTRY_H
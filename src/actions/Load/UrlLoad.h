@@ -5,38 +5,42 @@
 #ifndef URLLOAD_H
 #define URLLOAD_H
 
+#include <stdexcept>
+#include <string>
+
 #include "../ActionResult.h"
-#include "../JsonUnserializer.h"
-#include "../DataDecompressor.h"
-#include "../ImageDecoding.h"
+#include "../../net/HttpCache.h"
+#include "../../net/HttpClient.h"
+#include "../../utils/ContentType.h"
 
 /**
  * @class UrlLoad
- * @brief Handles the execution of URL loading logic and delegates processing based on metadata.
+ * @brief Handles the execution of URL loading logic.
+ *
+ * This class provides a static method to execute URL loading logic. It downloads the URI held
+ * by a previous action result and tags the body with the metadata type of the action that
+ * processes it next.
  *
- * This class provides a static method to execute URL loading logic. It processes the input
- * data and metadata from a previous action result and delegates further processing to
- * appropriate handlers based on the metadata type.
+ * Requests go through the shared `HttpClient`, which keeps connections to each origin
+ * alive between requests so repeated downloads skip the TCP and TLS handshakes. Large bodies
+ * are fetched as concurrent ranges by `RangedDownload`. When the `HttpCache` is enabled, fresh
+ * responses are answered from disk and stale ones are revalidated instead of downloaded again.
  */
 class UrlLoad {
 public:
     /**
-     * @brief Executes the URL loading logic based on the metadata type of the previous action result.
+     * @brief Executes the URL load action of the URI held by the previous action result.
      * 
-     * @param previous The result of the previous action, containing data and metadata.
+     * @param previous The result of the previous action, containing the URI as data.
      *                 The data must have a value; otherwise, the function returns false.
-     * @param result   The result object where the processed data and metadata will be stored.
+     * @param result   The result object where the downloaded data and metadata will be stored.
      * 
      * @return true if the operation is successful, false otherwise.
      * 
-     * @throws std::invalid_argument if the metadata type in the previous result is invalid.
+     * @throws std::runtime_error if the download fails or the server answers with a non 2xx status.
      * 
-     * @details This function processes the input based on the metadata type provided in the
-     *          previous action result. It delegates the processing to specific handlers:
-     *          - "json": Uses JsonUnserializer to process the data.
-     *          - "decompress": Uses DataDecompressor to process the data.
-     *          - "image": Uses ImageDecoding to process the data.
-     *          If the metadata type does not match any of the above, an exception is thrown.
+     * @details The body is tagged with the metadata type of the action that processes it next
+     *          (see `ComputePipeline`).
      */
     static bool execute(ActionResult&& previous, ActionResult& result) {
         if (!previous.data.has_value())
@@ -44,22 +48,42 @@ public:
             return false;
         }
 
-        // Implement the url loading logic here
-        // process will be assigned to the result object data and metadata
+        load(std::any_cast<const std::string&>(previous.data), result);
+        return true;
+    }
+
+    /**
+     * @brief Downloads `uri` into `result`, without running the next action.
+     *
+     * @param uri The `http://` or `https://` URI.
+     * @param result The result receiving the body and the metadata type of the next action.
+     *
+     * @throws std::runtime_error if the download fails or the server answers with a non 2xx status.
+     */
+    static void load(const std::string& uri, ActionResult& result) {
+        assign(HttpCache::shared().get(HttpClient::shared(), Url::parse(uri)), uri, result);
+    }
 
-        ActionResult resultCopy = result;
-        switch (previous.metadata)
+    /**
+     * @brief Stores a downloaded body into `result`, tagged with its detected content type.
+     *
+     * Shared with the asynchronous download path of `BatchExecutor`, which receives responses from
+     * `HttpEventLoop` instead of calling `execute`.
+     *
+     * @param response The response received for `uri`.
+     * @param uri The downloaded URI, used in error messages.
+     * @param result The result receiving the body.
+     *
+     * @throws std::runtime_error if the server answered with a non 2xx status.
+     */
+    static void assign(HttpResponse&& response, const std::string& uri, ActionResult& result) {
+        if (response.status < 200 || response.status >= 300)
         {
-        case "json":
-            return JsonUnserializer::execute(std::move(resultCopy), result);
-        case "decompress":
-            return DataDecompressor::execute(std::move(resultCopy), result);
-        case "image":
-            return ImageDecoding::execute(std::move(resultCopy), result);
-        default:
-            throw std::invalid_argument("invalid metadata type: " + previous.metadata);
+            throw std::runtime_error("http status " + std::to_string(response.status) + " for uri: " + uri);
         }
-        return false;
+
+        result.metadata = sniffContentType(response.body.data(), response.body.size());
+        result.data = std::move(response.body);
     }
 };
 
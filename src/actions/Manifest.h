@@ -0,0 +1,72 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+#include <any>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ActionResult.h"
+#include "../utils/BufferSlice.h"
+
+/**
+ * @struct Manifest
+ * @brief A JSON document referencing further items, with the results of those items.
+ *
+ * `JsonUnserializer` produces it, with the metadata type "manifest", when the configured JSON
+ * pointers designate URIs in the document. `ComputePipeline` then executes the referenced URIs
+ * concurrently and stores their results in the children.
+ *
+ * @var Manifest::document
+ * The JSON document.
+ *
+ * @var Manifest::children
+ * The referenced items in document order, each URI appearing once.
+ */
+struct Manifest {
+
+    /**
+     * @struct Child
+     * @brief An item referenced by the manifest.
+     *
+     * @var Child::uri
+     * The referenced URI.
+     *
+     * @var Child::result
+     * The result of the pipeline for the URI, shared with the other manifests referencing it.
+     * Null until executed or when the execution failed.
+     *
+     * @var Child::error
+     * Why the execution failed, empty otherwise.
+     */
+    struct Child {
+        std::string uri;
+        std::shared_ptr<const ActionResult> result;
+        std::string error;
+    };
+
+    BufferSlice document;
+    std::vector<Child> children;
+
+    /**
+     * @brief Extracts a manifest from an action result payload.
+     *
+     * @param data The `ActionResult::data` of a previous action.
+     * @return A pointer to the manifest, or nullptr when the payload is not a `Manifest`.
+     */
+    static Manifest* fromAny(std::any& data) {
+        return std::any_cast<Manifest>(&data);
+    }
+
+    /**
+     * @copydoc fromAny(std::any&)
+     */
+    static const Manifest* fromAny(const std::any& data) {
+        return std::any_cast<Manifest>(&data);
+    }
+};
+
+#endif //MANIFEST_H
@@ -0,0 +1,484 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "HttpCache.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <openssl/evp.h>
+
+#include "RangedDownload.h"
+#include "../actions/Load/FileReader.h"
+
+namespace {
+
+    namespace fs = std::filesystem;
+
+    constexpr std::string_view EntryFormat = "img_ly_test http cache 1";
+
+    // Headers replayed on answers served from the cache.
+    constexpr std::string_view StoredHeaders[] = {
+        "Content-Type", "Content-Encoding", "Cache-Control", "ETag", "Last-Modified"
+    };
+
+    // Eviction frees a little more than needed, so it does not run again on the next store.
+    constexpr double EvictionTarget = 0.9;
+
+    bool equalsIgnoreCase(std::string_view left, std::string_view right)
+    {
+        return left.size() == right.size() && std::equal(left.begin(), left.end(), right.begin(), [](char a, char b) {
+            return (a | 0x20) == (b | 0x20);
+        });
+    }
+
+    std::string_view trim(std::string_view value)
+    {
+        constexpr std::string_view blanks = " \t";
+        const std::size_t first = value.find_first_not_of(blanks);
+        if (first == std::string_view::npos)
+        {
+            return {};
+        }
+        return value.substr(first, value.find_last_not_of(blanks) - first + 1);
+    }
+
+    struct CacheControl {
+        bool noStore = false;
+        bool noCache = false;
+        long long maxAge = -1;
+    };
+
+    CacheControl parseCacheControl(std::string_view value)
+    {
+        CacheControl control;
+        while (!value.empty())
+        {
+            const std::size_t comma = value.find(',');
+            const std::string_view directive = trim(value.substr(0, comma));
+            const std::size_t equals = directive.find('=');
+            const std::string_view name = trim(directive.substr(0, equals));
+            if (equalsIgnoreCase(name, "no-store"))
+            {
+                control.noStore = true;
+            }
+            else if (equalsIgnoreCase(name, "no-cache"))
+            {
+                control.noCache = true;
+            }
+            else if (equalsIgnoreCase(name, "max-age") && equals != std::string_view::npos)
+            {
+                std::string_view seconds = trim(directive.substr(equals + 1));
+                if (seconds.size() >= 2 && seconds.front() == '"' && seconds.back() == '"')
+                {
+                    seconds = seconds.substr(1, seconds.size() - 2);
+                }
+                long long parsed = 0;
+                if (std::from_chars(seconds.data(), seconds.data() + seconds.size(), parsed).ec == std::errc())
+                {
+                    control.maxAge = parsed;
+                }
+            }
+            if (comma == std::string_view::npos)
+            {
+                break;
+            }
+            value.remove_prefix(comma + 1);
+        }
+        return control;
+    }
+
+    long long now()
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::string sha256(const void* data, std::size_t size)
+    {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        if (EVP_Digest(data, size, digest, &length, EVP_sha256(), nullptr) != 1)
+        {
+            throw std::runtime_error("sha256 digest failed");
+        }
+        static constexpr char Hex[] = "0123456789abcdef";
+        std::string text;
+        text.reserve(length * 2);
+        for (unsigned int i = 0; i < length; ++i)
+        {
+            text.push_back(Hex[digest[i] >> 4]);
+            text.push_back(Hex[digest[i] & 0xf]);
+        }
+        return text;
+    }
+
+    /**
+     * Writes `size` bytes to a temporary file next to `path`, then renames it over `path`, so
+     * concurrent readers never see a partial file.
+     */
+    bool writeAtomically(const fs::path& path, const char* data, std::size_t size)
+    {
+        static std::atomic<std::size_t> counter{0};
+        const fs::path temporary = path.parent_path() /
+            (".tmp-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "-" +
+             std::to_string(counter.fetch_add(1, std::memory_order_relaxed)));
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(data, static_cast<std::streamsize>(size));
+            if (!out)
+            {
+                std::error_code ignored;
+                fs::remove(temporary, ignored);
+                return false;
+            }
+        }
+        std::error_code error;
+        fs::rename(temporary, path, error);
+        if (error)
+        {
+            fs::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+}
+
+struct HttpCache::Entry {
+    std::string object;
+    std::size_t size = 0;
+    long long storedAt = 0;
+    long long maxAge = -1;
+    bool noCache = false;
+    HttpHeaders headers;
+
+    bool fresh() const {
+        return !noCache && maxAge >= 0 && now() - storedAt < maxAge;
+    }
+
+    std::string_view header(std::string_view name) const {
+        for (const auto& [key, value] : headers)
+        {
+            if (equalsIgnoreCase(key, name))
+            {
+                return value;
+            }
+        }
+        return {};
+    }
+
+    std::string serialize() const {
+        std::ostringstream out;
+        out << EntryFormat << "\nobject " << object << "\nsize " << size << "\nstored " << storedAt
+            << "\nmax-age " << maxAge << "\nno-cache " << noCache << "\n";
+        for (const auto& [name, value] : headers)
+        {
+            out << "header " << name << ": " << value << "\n";
+        }
+        return out.str();
+    }
+
+    // Reads the object back, nothing when it was evicted or does not match the entry.
+    std::optional<BufferSlice> body(const fs::path& root) const {
+        const fs::path path = root / "objects" / object;
+        try
+        {
+            BufferSlice content = FileReader::read(path.string());
+            if (content.size() != size)
+            {
+                return std::nullopt;
+            }
+            // The modification time orders objects for eviction.
+            std::error_code ignored;
+            fs::last_write_time(path, fs::file_time_type::clock::now(), ignored);
+            return content;
+        }
+        catch (const std::exception&)
+        {
+            return std::nullopt;
+        }
+    }
+
+    HttpResponse response(BufferSlice&& body) const {
+        HttpResponse answer;
+        answer.status = 200;
+        answer.headers = headers;
+        answer.body = std::move(body);
+        return answer;
+    }
+};
+
+void HttpCache::configure(Options options) {
+    if (!options.directory.empty())
+    {
+        fs::create_directories(options.directory / "objects");
+        fs::create_directories(options.directory / "entries");
+    }
+
+    std::size_t stored = 0;
+    std::error_code error;
+    if (!options.directory.empty())
+    {
+        for (const auto& object : fs::directory_iterator(options.directory / "objects", error))
+        {
+            stored += object.is_regular_file(error) ? object.file_size(error) : 0;
+        }
+    }
+
+    std::lock_guard lock(mutex);
+    this->options = std::move(options);
+    usage = stored;
+}
+
+bool HttpCache::enabled() const {
+    std::lock_guard lock(mutex);
+    return !options.directory.empty();
+}
+
+HttpResponse HttpCache::get(HttpClient& client, const Url& url) {
+    fs::path root;
+    {
+        std::lock_guard lock(mutex);
+        root = options.directory;
+    }
+    if (root.empty())
+    {
+        return RangedDownload::get(client, url);
+    }
+
+    const std::string key = url.origin() + url.target;
+    std::optional<Entry> entry = lookup(root, key);
+    if (entry && entry->fresh())
+    {
+        if (std::optional<BufferSlice> body = entry->body(root))
+        {
+            freshHits.fetch_add(1, std::memory_order_relaxed);
+            return entry->response(std::move(*body));
+        }
+        entry.reset();
+    }
+
+    const std::string_view etag = entry ? entry->header("ETag") : std::string_view();
+    const std::string_view lastModified = entry ? entry->header("Last-Modified") : std::string_view();
+    if (etag.empty() && lastModified.empty())
+    {
+        HttpResponse response = RangedDownload::get(client, url);
+        store(root, key, response);
+        return response;
+    }
+
+    HttpRequest conditional;
+    if (!etag.empty())
+    {
+        conditional.headers.emplace_back("If-None-Match", std::string(etag));
+    }
+    if (!lastModified.empty())
+    {
+        conditional.headers.emplace_back("If-Modified-Since", std::string(lastModified));
+    }
+    HttpResponse response = client.send(url, conditional);
+    if (response.status == 304)
+    {
+        if (std::optional<BufferSlice> body = entry->body(root))
+        {
+            notModified.fetch_add(1, std::memory_order_relaxed);
+            refresh(root, key, *entry, response);
+            return entry->response(std::move(*body));
+        }
+        // The object was evicted since the lookup, only a full transfer can help.
+        response = RangedDownload::get(client, url);
+    }
+    store(root, key, response);
+    return response;
+}
+
+std::optional<HttpCache::Entry> HttpCache::lookup(const fs::path& root, const std::string& key) {
+    std::ifstream in(root / "entries" / sha256(key.data(), key.size()));
+    std::string line;
+    if (!in || !std::getline(in, line) || line != EntryFormat)
+    {
+        return std::nullopt;
+    }
+
+    Entry entry;
+    while (std::getline(in, line))
+    {
+        const std::size_t space = line.find(' ');
+        const std::string_view field = std::string_view(line).substr(0, space);
+        const std::string_view value = space == std::string::npos ? std::string_view() : std::string_view(line).substr(space + 1);
+        if (field == "object")
+        {
+            entry.object = value;
+        }
+        else if (field == "size")
+        {
+            std::from_chars(value.data(), value.data() + value.size(), entry.size);
+        }
+        else if (field == "stored")
+        {
+            std::from_chars(value.data(), value.data() + value.size(), entry.storedAt);
+        }
+        else if (field == "max-age")
+        {
+            std::from_chars(value.data(), value.data() + value.size(), entry.maxAge);
+        }
+        else if (field == "no-cache")
+        {
+            entry.noCache = value == "1";
+        }
+        else if (field == "header")
+        {
+            const std::size_t colon = value.find(':');
+            if (colon != std::string_view::npos)
+            {
+                entry.headers.emplace_back(std::string(value.substr(0, colon)), std::string(trim(value.substr(colon + 1))));
+            }
+        }
+    }
+    if (entry.object.size() != 64 || entry.object.find_first_not_of("0123456789abcdef") != std::string::npos)
+    {
+        return std::nullopt;
+    }
+    return entry;
+}
+
+void HttpCache::store(const fs::path& root, const std::string& key, const HttpResponse& response) {
+    if (response.status != 200 || trim(response.header("Vary")) == "*")
+    {
+        return;
+    }
+    const CacheControl control = parseCacheControl(response.header("Cache-Control"));
+    if (control.noStore)
+    {
+        return;
+    }
+
+    try
+    {
+        Entry entry;
+        entry.object = sha256(response.body.data(), response.body.size());
+        entry.size = response.body.size();
+        entry.storedAt = now();
+        entry.maxAge = control.maxAge;
+        entry.noCache = control.noCache;
+        for (const std::string_view name : StoredHeaders)
+        {
+            if (const std::string_view value = response.header(name); !value.empty())
+            {
+                entry.headers.emplace_back(std::string(name), std::string(value));
+            }
+        }
+
+        // Identical bodies share one object, only the first store writes it.
+        const fs::path object = root / "objects" / entry.object;
+        std::error_code error;
+        if (!fs::exists(object, error))
+        {
+            if (!writeAtomically(object, reinterpret_cast<const char*>(response.body.data()), response.body.size()))
+            {
+                return;
+            }
+            std::lock_guard lock(mutex);
+            usage += entry.size;
+        }
+
+        const std::string text = entry.serialize();
+        writeAtomically(root / "entries" / sha256(key.data(), key.size()), text.data(), text.size());
+
+        bool full;
+        {
+            std::lock_guard lock(mutex);
+            full = usage > options.maxBytes;
+        }
+        if (full)
+        {
+            evict(root);
+        }
+    }
+    catch (const std::exception&)
+    {
+        // A cache that cannot be written only costs the next download.
+    }
+}
+
+void HttpCache::refresh(const fs::path& root, const std::string& key, Entry& entry,
+                        const HttpResponse& notModifiedResponse) {
+    entry.storedAt = now();
+    if (const std::string_view cacheControl = notModifiedResponse.header("Cache-Control"); !cacheControl.empty())
+    {
+        const CacheControl control = parseCacheControl(cacheControl);
+        entry.maxAge = control.maxAge;
+        entry.noCache = control.noCache;
+    }
+    // A 304 carries the current validators, they replace the stored ones.
+    for (const std::string_view name : StoredHeaders)
+    {
+        const std::string_view value = notModifiedResponse.header(name);
+        if (value.empty())
+        {
+            continue;
+        }
+        const auto found = std::find_if(entry.headers.begin(), entry.headers.end(), [name](const auto& header) {
+            return equalsIgnoreCase(header.first, name);
+        });
+        if (found != entry.headers.end())
+        {
+            found->second = value;
+        }
+        else
+        {
+            entry.headers.emplace_back(std::string(name), std::string(value));
+        }
+    }
+    const std::string text = entry.serialize();
+    writeAtomically(root / "entries" / sha256(key.data(), key.size()), text.data(), text.size());
+}
+
+void HttpCache::evict(const fs::path& root) {
+    std::lock_guard lock(mutex);
+
+    struct Object {
+        fs::file_time_type used;
+        fs::path path;
+        std::size_t size;
+    };
+    std::vector<Object> objects;
+    std::size_t stored = 0;
+    std::error_code error;
+    for (const auto& object : fs::directory_iterator(root / "objects", error))
+    {
+        if (!object.is_regular_file(error) || object.path().filename().string().starts_with(".tmp-"))
+        {
+            continue;
+        }
+        const std::size_t size = object.file_size(error);
+        objects.push_back({object.last_write_time(error), object.path(), size});
+        stored += size;
+    }
+
+    // Least recently used first. Entries left pointing to evicted objects are treated as misses.
+    std::sort(objects.begin(), objects.end(), [](const Object& left, const Object& right) {
+        return left.used < right.used;
+    });
+    const auto target = static_cast<std::size_t>(static_cast<double>(options.maxBytes) * EvictionTarget);
+    for (const Object& object : objects)
+    {
+        if (stored <= target)
+        {
+            break;
+        }
+        if (fs::remove(object.path, error))
+        {
+            stored -= object.size;
+        }
+    }
+    usage = stored;
+}
@@ -0,0 +1,119 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef HTTPCACHE_H
+#define HTTPCACHE_H
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "HttpClient.h"
+#include "HttpMessage.h"
+#include "Url.h"
+
+/**
+ * @class HttpCache
+ * @brief Disk backed cache of `GET` responses, revalidated with conditional requests.
+ *
+ * Bodies are stored content-addressed under `objects/`, named after their SHA-256, so identical
+ * payloads served from different URLs are kept once. Each URL has a small entry under `entries/`
+ * recording its object, its freshness lifetime and its validators (`ETag`, `Last-Modified`).
+ *
+ * A fresh entry is answered locally. A stale one is revalidated with `If-None-Match` or
+ * `If-Modified-Since`: a `304 Not Modified` answer costs a header-only round trip, and the body
+ * is read back from disk (memory mapped when large, see `FileReader`).
+ *
+ * `Cache-Control: no-store` responses are never stored, `no-cache` ones are always revalidated.
+ * When the objects exceed `Options::maxBytes`, the least recently used ones are evicted.
+ */
+class HttpCache {
+public:
+
+    /**
+     * @struct Options
+     * @brief Location and size of the cache.
+     *
+     * @var Options::directory
+     * Root directory of the cache. Empty disables caching.
+     *
+     * @var Options::maxBytes
+     * Upper bound of the stored bodies, in bytes.
+     */
+    struct Options {
+        std::filesystem::path directory;
+        std::size_t maxBytes = std::size_t{1} << 30;
+    };
+
+    /**
+     * @brief Returns the cache used by `UrlLoad`, disabled until `configure` is called.
+     */
+    static HttpCache& shared() {
+        static HttpCache cache;
+        return cache;
+    }
+
+    /**
+     * @brief Changes the location and size of the cache.
+     *
+     * @throws std::filesystem::filesystem_error If the directory cannot be created.
+     */
+    void configure(Options options);
+
+    /**
+     * @brief Whether responses are cached.
+     */
+    bool enabled() const;
+
+    /**
+     * @brief Downloads `url`, answering from or revalidating the cache when possible.
+     *
+     * Misses are fetched with `RangedDownload`. Failures of the cache itself (unreadable entry,
+     * full disk...) are not reported, the response is then simply not cached.
+     *
+     * @param client The client used for the requests.
+     * @param url The resource to download.
+     * @return HttpResponse The response. Answers served from the cache have status 200.
+     *
+     * @throws std::system_error If a connection fails or times out.
+     * @throws std::runtime_error If the response is malformed.
+     */
+    HttpResponse get(HttpClient& client, const Url& url);
+
+    /**
+     * @brief Number of requests answered without contacting the origin.
+     */
+    std::size_t hits() const {
+        return freshHits.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Number of requests answered with a `304 Not Modified` revalidation.
+     */
+    std::size_t revalidations() const {
+        return notModified.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry;
+
+    static std::optional<Entry> lookup(const std::filesystem::path& root, const std::string& key);
+    void store(const std::filesystem::path& root, const std::string& key, const HttpResponse& response);
+    static void refresh(const std::filesystem::path& root, const std::string& key, Entry& entry,
+                        const HttpResponse& notModifiedResponse);
+    void evict(const std::filesystem::path& root);
+
+    mutable std::mutex mutex;
+    Options options;
+    std::size_t usage = 0;
+
+    std::atomic<std::size_t> freshHits{0};
+    std::atomic<std::size_t> notModified{0};
+};
+
+
+
+#endif //HTTPCACHE_H
@@ -0,0 +1,358 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "HttpClient.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <exception>
+#include <optional>
+#include <random>
+#include <system_error>
+#include <thread>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    constexpr std::size_t ReadChunkSize = 16 * 1024;
+
+    // Percentiles of fewer head latencies are too noisy to hedge on.
+    constexpr std::size_t MinLatencySamples = 20;
+
+    // Floor of the adaptive timeout, so a very fast origin is not abandoned on scheduling noise.
+    constexpr std::chrono::milliseconds MinAdaptiveTimeout{100};
+
+    /**
+     * Reads from `connection` until `parser` holds a complete response. `received` tells whether
+     * any byte of the response arrived, even when an exception is thrown. `onHead`, when set, is
+     * invoked once the status line and headers were parsed.
+     */
+    void receive(HttpConnection& connection, HttpResponseParser& parser, bool& received,
+                 const std::function<void()>& onHead)
+    {
+        if (!connection.buffer.empty())
+        {
+            const std::size_t used = parser.feed(connection.buffer.data(), connection.buffer.size());
+            connection.buffer.erase(0, used);
+            received = true;
+        }
+
+        bool headSignaled = false;
+        char scratch[ReadChunkSize];
+        while (!parser.complete())
+        {
+            if (!headSignaled && parser.headComplete())
+            {
+                headSignaled = true;
+                if (onHead)
+                {
+                    onHead();
+                }
+            }
+
+            // Bodies of known length are received straight into their final buffer.
+            std::size_t directSize;
+            if (unsigned char* direct = parser.directBuffer(directSize))
+            {
+                const std::size_t count = connection.read(direct, directSize);
+                if (count == 0)
+                {
+                    parser.finish();
+                    break;
+                }
+                received = true;
+                parser.commitDirect(count);
+                continue;
+            }
+
+            const std::size_t count = connection.read(scratch, sizeof(scratch));
+            if (count == 0)
+            {
+                parser.finish();
+                break;
+            }
+            received = true;
+            const std::size_t used = parser.feed(scratch, count);
+            connection.buffer.assign(scratch + used, count - used);
+        }
+        if (!headSignaled && onHead)
+        {
+            onHead();
+        }
+    }
+
+    // Full jitter: a uniform wait below the exponential bound spreads retries of many clients.
+    std::chrono::milliseconds backoff(std::chrono::milliseconds base, std::size_t attempt)
+    {
+        thread_local std::mt19937_64 random{std::random_device{}()};
+        const auto bound = base.count() << std::min<std::size_t>(attempt, 16);
+        return std::chrono::milliseconds(std::uniform_int_distribution<long long>(0, bound)(random));
+    }
+}
+
+/**
+ * Attempts of one hedged request. Shared with the attempt tasks, which may outlive the request.
+ */
+struct HttpClient::Race {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::optional<HttpResponse> response;
+    std::exception_ptr error;
+    std::size_t running = 0;
+    bool headReceived = false;
+    LatencyWindow::Duration headLatency{};
+};
+
+HttpClient::~HttpClient() {
+    // Runs the queued attempts and joins the pool while the connection pool is still alive.
+    attempts.reset();
+}
+
+HttpResponse HttpClient::send(const Url& url, const HttpRequest& request) {
+    if (options.hedge)
+    {
+        return sendHedged(url, request);
+    }
+    return exchange(url, request, nullptr);
+}
+
+HttpResponse HttpClient::sendHedged(const Url& url, HttpRequest request) {
+    // Concurrent attempts cannot share a destination, each one receives into a buffer of its own.
+    request.bodyTarget = {};
+    const std::string origin = url.origin();
+    const std::size_t requestCount = hedgedRequests.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    for (std::size_t attempt = 0;; ++attempt)
+    {
+        std::optional<Clock::duration> hedgeAfter;
+        Clock::duration timeout = options.connectTimeout + options.ioTimeout;
+        {
+            std::lock_guard lock(latencyMutex);
+            if (const auto found = headLatencies.find(origin);
+                found != headLatencies.end() && found->second.window.size() >= MinLatencySamples)
+            {
+                const LatencyWindow& window = found->second.window;
+                hedgeAfter = window.percentile(0.95);
+                timeout = std::clamp<Clock::duration>(window.percentile(0.99) * 4, MinAdaptiveTimeout, timeout);
+            }
+        }
+
+        auto race = std::make_shared<Race>();
+        const auto start = Clock::now();
+        launch(race, url, request);
+
+        std::unique_lock lock(race->mutex);
+        bool hedged = false;
+        std::exception_ptr error;
+        for (;;)
+        {
+            if (race->response)
+            {
+                const LatencyWindow::Duration latency = race->headLatency;
+                HttpResponse response = std::move(*race->response);
+                lock.unlock();
+                recordHeadLatency(origin, latency);
+                return response;
+            }
+            if (race->running == 0)
+            {
+                error = race->error;
+                break;
+            }
+            if (race->headReceived)
+            {
+                // The origin answered, the body transfer is bounded by the connection timeouts.
+                race->changed.wait(lock);
+                continue;
+            }
+
+            const auto now = Clock::now();
+            if (now - start >= timeout)
+            {
+                error = std::make_exception_ptr(std::system_error(
+                    ETIMEDOUT, std::generic_category(), "no http response head from " + origin));
+                break;
+            }
+            if (!hedged && hedgeAfter && now - start >= *hedgeAfter)
+            {
+                hedged = true;
+                if (reserveHedge(requestCount))
+                {
+                    lock.unlock();
+                    launch(race, url, request);
+                    lock.lock();
+                    continue;
+                }
+            }
+            const auto wakeUp = !hedged && hedgeAfter ? start + std::min(*hedgeAfter, timeout) : start + timeout;
+            race->changed.wait_until(lock, wakeUp);
+        }
+        lock.unlock();
+
+        if (attempt >= options.retries)
+        {
+            std::rethrow_exception(error);
+        }
+        std::this_thread::sleep_for(backoff(options.retryBackoff, attempt));
+    }
+}
+
+std::size_t HttpClient::attemptThreads(const Options& options) {
+    const std::size_t requests = options.concurrentRequests != 0
+                                     ? options.concurrentRequests
+                                     : std::max(1u, std::thread::hardware_concurrency());
+    return requests * 2 * (options.retries + 1);
+}
+
+bool HttpClient::reserveHedge(std::size_t requestCount) {
+    // The check and the increment are one step, concurrent requests cannot both take the last hedge.
+    const double budget = options.hedgeBudget * static_cast<double>(requestCount);
+    std::size_t issued = hedges.load(std::memory_order_relaxed);
+    do
+    {
+        if (static_cast<double>(issued + 1) > budget)
+        {
+            return false;
+        }
+    }
+    while (!hedges.compare_exchange_weak(issued, issued + 1, std::memory_order_relaxed));
+    return true;
+}
+
+void HttpClient::recordHeadLatency(const std::string& origin, LatencyWindow::Duration latency) {
+    std::lock_guard lock(latencyMutex);
+    auto found = headLatencies.find(origin);
+    if (found == headLatencies.end())
+    {
+        if (headLatencies.size() >= MaxTrackedOrigins)
+        {
+            // The origin heard from the longest ago makes room, its percentiles are the stalest.
+            headLatencies.erase(std::min_element(headLatencies.begin(), headLatencies.end(),
+                                                 [](const auto& left, const auto& right) {
+                                                     return left.second.updated < right.second.updated;
+                                                 }));
+        }
+        found = headLatencies.try_emplace(origin).first;
+    }
+    found->second.window.add(latency);
+    found->second.updated = Clock::now();
+}
+
+void HttpClient::launch(const std::shared_ptr<Race>& race, const Url& url, const HttpRequest& request) {
+    {
+        std::lock_guard lock(race->mutex);
+        ++race->running;
+    }
+    attempts->submit([this, race, url, request]() {
+        const auto start = Clock::now();
+        auto onHead = [&]() {
+            std::lock_guard lock(race->mutex);
+            if (!race->headReceived)
+            {
+                race->headReceived = true;
+                race->headLatency = std::chrono::duration_cast<LatencyWindow::Duration>(Clock::now() - start);
+                race->changed.notify_all();
+            }
+        };
+        try
+        {
+            HttpResponse response = exchange(url, request, onHead);
+            std::lock_guard lock(race->mutex);
+            if (!race->response)
+            {
+                race->response = std::move(response);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard lock(race->mutex);
+            race->error = std::current_exception();
+        }
+        std::lock_guard lock(race->mutex);
+        --race->running;
+        race->changed.notify_all();
+    });
+}
+
+HttpResponse HttpClient::exchange(const Url& url, const HttpRequest& request, const std::function<void()>& onHead) {
+    const std::string origin = url.origin();
+    const std::string message = request.serialize(url);
+
+    for (bool firstAttempt = true;; firstAttempt = false)
+    {
+        std::unique_ptr<HttpConnection> connection = firstAttempt ? acquire(origin) : nullptr;
+        const bool pooled = connection != nullptr;
+        if (pooled)
+        {
+            reused.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            connection = HttpConnection::open(url.host, url.port, url.tls, options.connectTimeout, options.ioTimeout);
+            opened.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        HttpResponseParser parser(request);
+        bool received = false;
+        try
+        {
+            connection->write(message);
+            receive(*connection, parser, received, onHead);
+        }
+        catch (const std::exception&)
+        {
+            // The server may have closed the idle connection while the request was in flight.
+            if (pooled && !received)
+            {
+                continue;
+            }
+            throw;
+        }
+
+        HttpResponse response = std::move(parser.response());
+        if (parser.keepAlive() && connection->buffer.empty())
+        {
+            release(origin, std::move(connection));
+        }
+        return response;
+    }
+}
+
+std::unique_ptr<HttpConnection> HttpClient::acquire(const std::string& origin) {
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<HttpConnection>> stale;
+    std::unique_ptr<HttpConnection> connection;
+    {
+        std::lock_guard lock(mutex);
+        const auto found = idle.find(origin);
+        if (found == idle.end())
+        {
+            return nullptr;
+        }
+        auto& connections = found->second;
+        while (!connections.empty() && !connection)
+        {
+            std::unique_ptr<HttpConnection> candidate = std::move(connections.back());
+            connections.pop_back();
+            if (now - candidate->idleSince > options.idleTimeout || !candidate->isIdleAndOpen())
+            {
+                stale.push_back(std::move(candidate));
+                continue;
+            }
+            connection = std::move(candidate);
+        }
+    }
+    return connection;
+}
+
+void HttpClient::release(const std::string& origin, std::unique_ptr<HttpConnection> connection) {
+    connection->idleSince = std::chrono::steady_clock::now();
+    std::lock_guard lock(mutex);
+    auto& connections = idle[origin];
+    if (connections.size() < options.maxIdlePerHost)
+    {
+        connections.push_back(std::move(connection));
+    }
+}
@@ -0,0 +1,177 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "HttpConnection.h"
+#include "HttpMessage.h"
+#include "LatencyWindow.h"
+#include "Url.h"
+#include "../utils/ThreadPool.h"
+
+/**
+ * @class HttpClient
+ * @brief Blocking HTTP/1.1 client reusing keep-alive connections.
+ *
+ * Idle connections are pooled per origin (scheme, host and port). A request first takes an idle
+ * connection of its origin, so repeated requests to the same host pay the TCP and TLS handshakes
+ * once. At most `Options::maxIdlePerHost` connections are kept idle per origin, the surplus and the
+ * connections idle for longer than `Options::idleTimeout` are closed.
+ *
+ * A request failing on a reused connection before any response byte arrived is retried once on a
+ * fresh connection, since the server may have closed the idle connection in the meantime.
+ *
+ * With `Options::hedge`, requests also defend against slow origins. The time to the response
+ * head is tracked per origin; a request still waiting for its head after the origin's p95 gets a
+ * duplicate on another connection and the first head wins. Hedges are limited to
+ * `Options::hedgeBudget` of the requests, a hedge is counted before it is sent, so concurrent
+ * requests cannot overdraw the budget. A request without a head after four times the p99 is
+ * abandoned and retried after a jittered exponential backoff, at most `Options::retries` times.
+ * Attempts run on a pool owned by the client, abandoned ones finish there in the background. It is
+ * sized for `Options::concurrentRequests` requests (the hardware threads when zero), each running a
+ * hedged pair per try while the abandoned pairs of its earlier tries finish. Latencies are kept for
+ * the `MaxTrackedOrigins` origins heard from most recently.
+ */
+class HttpClient {
+public:
+
+    /**
+     * @struct Options
+     * @brief Tunables of the client and its connection pool.
+     */
+    struct Options {
+        std::size_t maxIdlePerHost = 8;
+        std::chrono::milliseconds idleTimeout{30000};
+        std::chrono::milliseconds connectTimeout{5000};
+        std::chrono::milliseconds ioTimeout{30000};
+        bool hedge = false;
+        double hedgeBudget = 0.05;
+        std::size_t retries = 2;
+        std::chrono::milliseconds retryBackoff{100};
+        std::size_t concurrentRequests = 0;
+    };
+
+    /**
+     * @brief Number of origins whose head latencies are tracked at once.
+     */
+    static constexpr std::size_t MaxTrackedOrigins = 256;
+
+    explicit HttpClient(Options options)
+        : options(options),
+          attempts(options.hedge ? std::make_unique<ThreadPool>(attemptThreads(options)) : nullptr) {}
+
+    HttpClient() : HttpClient(Options{}) {}
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    /**
+     * @brief Waits for the abandoned hedged attempts still running.
+     */
+    ~HttpClient();
+
+    /**
+     * @brief Returns the options `shared` creates its client with. Changes after its first use have no effect.
+     */
+    static Options& sharedOptions() {
+        static Options options;
+        return options;
+    }
+
+    /**
+     * @brief Returns the client shared by every `UrlLoad`.
+     */
+    static HttpClient& shared() {
+        static HttpClient client(sharedOptions());
+        return client;
+    }
+
+    /**
+     * @brief Sends `request` to `url` and waits for the complete response.
+     *
+     * @return HttpResponse The response, whatever its status code.
+     *
+     * @throws std::system_error If the connection fails or times out.
+     * @throws std::runtime_error If the TLS handshake fails or the response is malformed.
+     */
+    HttpResponse send(const Url& url, const HttpRequest& request);
+
+    /**
+     * @brief Sends a `GET` request to `url`.
+     *
+     * @throws std::invalid_argument If `url` is not a valid http(s) URL.
+     */
+    HttpResponse get(std::string_view url) {
+        return send(Url::parse(url), HttpRequest{});
+    }
+
+    /**
+     * @brief Number of connections opened since the client was created.
+     */
+    std::size_t connectionsOpened() const {
+        return opened.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Number of requests sent over a pooled connection.
+     */
+    std::size_t connectionsReused() const {
+        return reused.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Number of duplicate requests issued by hedging.
+     */
+    std::size_t hedgesIssued() const {
+        return hedges.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Race;
+
+    HttpResponse exchange(const Url& url, const HttpRequest& request, const std::function<void()>& onHead);
+    HttpResponse sendHedged(const Url& url, HttpRequest request);
+    void launch(const std::shared_ptr<Race>& race, const Url& url, const HttpRequest& request);
+    static std::size_t attemptThreads(const Options& options);
+    bool reserveHedge(std::size_t requestCount);
+    void recordHeadLatency(const std::string& origin, LatencyWindow::Duration latency);
+    std::unique_ptr<HttpConnection> acquire(const std::string& origin);
+    void release(const std::string& origin, std::unique_ptr<HttpConnection> connection);
+
+    Options options;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<std::unique_ptr<HttpConnection>>> idle;
+    std::atomic<std::size_t> opened{0};
+    std::atomic<std::size_t> reused{0};
+
+    struct OriginLatencies {
+        LatencyWindow window;
+        std::chrono::steady_clock::time_point updated;
+    };
+
+    std::mutex latencyMutex;
+    std::unordered_map<std::string, OriginLatencies> headLatencies;
+    std::atomic<std::size_t> hedgedRequests{0};
+    std::atomic<std::size_t> hedges{0};
+
+    // Last member, its attempts use the connection pool above until they are drained.
+    std::unique_ptr<ThreadPool> attempts;
+};
+
+
+
+#endif //HTTPCLIENT_H
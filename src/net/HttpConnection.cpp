@@ -0,0 +1,363 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "HttpConnection.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+namespace {
+
+    [[noreturn]] void throwErrno(const std::string& what)
+    {
+        const int error = errno == EAGAIN || errno == EWOULDBLOCK ? ETIMEDOUT : errno;
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+    [[noreturn]] void throwTls(const std::string& what)
+    {
+        char reason[256] = "unknown error";
+        if (const unsigned long error = ERR_get_error(); error != 0)
+        {
+            ERR_error_string_n(error, reason, sizeof(reason));
+        }
+        ERR_clear_error();
+        throw std::runtime_error(what + ": " + reason);
+    }
+
+    int socketOf(BIO* bio)
+    {
+        return static_cast<int>(reinterpret_cast<std::intptr_t>(BIO_get_data(bio)));
+    }
+
+    // The errors after which the operation may succeed later, as the stock socket BIO sees them.
+    bool isTransient(int error)
+    {
+        return error == EAGAIN || error == EWOULDBLOCK || error == EINTR || error == EINPROGRESS ||
+               error == EALREADY || error == ENOTCONN || error == EPROTO;
+    }
+
+    int socketWrite(BIO* bio, const char* data, int size)
+    {
+        BIO_clear_retry_flags(bio);
+        const ssize_t written = ::send(socketOf(bio), data, static_cast<std::size_t>(size), MSG_NOSIGNAL);
+        if (written < 0 && isTransient(errno))
+        {
+            BIO_set_retry_write(bio);
+        }
+        return static_cast<int>(written);
+    }
+
+    int socketRead(BIO* bio, char* data, int size)
+    {
+        BIO_clear_retry_flags(bio);
+        const ssize_t received = ::recv(socketOf(bio), data, static_cast<std::size_t>(size), 0);
+        if (received < 0 && isTransient(errno))
+        {
+            BIO_set_retry_read(bio);
+        }
+#if defined(BIO_FLAGS_IN_EOF)
+        else if (received == 0)
+        {
+            BIO_set_flags(bio, BIO_FLAGS_IN_EOF);
+        }
+#endif
+        return static_cast<int>(received);
+    }
+
+    long socketControl(BIO* bio, int command, long, void* argument)
+    {
+        switch (command)
+        {
+        case BIO_C_GET_FD:
+            if (argument != nullptr)
+            {
+                *static_cast<int*>(argument) = socketOf(bio);
+            }
+            return socketOf(bio);
+        case BIO_CTRL_FLUSH:
+            return 1;
+#if defined(BIO_FLAGS_IN_EOF)
+        case BIO_CTRL_EOF:
+            return BIO_test_flags(bio, BIO_FLAGS_IN_EOF) != 0;
+#endif
+        default:
+            return 0;
+        }
+    }
+
+    /**
+     * Socket BIO of the TLS sessions. The stock one writes with `write`, which raises SIGPIPE on a
+     * broken connection, this one sends with MSG_NOSIGNAL like plain connections do. The socket is
+     * not owned, the connection closes it.
+     */
+    BIO* socketBio(int fd)
+    {
+        static BIO_METHOD* method = []() {
+            BIO_METHOD* created = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK | BIO_TYPE_DESCRIPTOR,
+                                               "socket without SIGPIPE");
+            if (created == nullptr || BIO_meth_set_write(created, socketWrite) != 1 ||
+                BIO_meth_set_read(created, socketRead) != 1 || BIO_meth_set_ctrl(created, socketControl) != 1)
+            {
+                throwTls("unable to create socket bio method");
+            }
+            return created;
+        }();
+        BIO* bio = BIO_new(method);
+        if (bio == nullptr)
+        {
+            throwTls("unable to create socket bio");
+        }
+        BIO_set_data(bio, reinterpret_cast<void*>(static_cast<std::intptr_t>(fd)));
+        BIO_set_init(bio, 1);
+        return bio;
+    }
+
+    /**
+     * Client context shared by every TLS connection.
+     */
+    SSL_CTX* tlsContext()
+    {
+        static SSL_CTX* context = []() {
+            SSL_CTX* created = SSL_CTX_new(TLS_client_method());
+            if (created == nullptr)
+            {
+                throwTls("unable to create tls context");
+            }
+            SSL_CTX_set_min_proto_version(created, TLS1_2_VERSION);
+            SSL_CTX_set_default_verify_paths(created);
+            SSL_CTX_set_verify(created, SSL_VERIFY_PEER, nullptr);
+            return created;
+        }();
+        return context;
+    }
+
+    void setTimeout(int fd, int option, std::chrono::milliseconds timeout)
+    {
+        timeval value{};
+        value.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+        value.tv_usec = static_cast<suseconds_t>((timeout.count() % 1000) * 1000);
+        ::setsockopt(fd, SOL_SOCKET, option, &value, sizeof(value));
+    }
+
+    int connectTo(const addrinfo& address, std::chrono::milliseconds timeout)
+    {
+        const int fd = ::socket(address.ai_family, address.ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                                address.ai_protocol);
+        if (fd < 0)
+        {
+            return -1;
+        }
+
+        if (::connect(fd, address.ai_addr, address.ai_addrlen) != 0)
+        {
+            if (errno != EINPROGRESS)
+            {
+                const int error = errno;
+                ::close(fd);
+                errno = error;
+                return -1;
+            }
+            pollfd waiting{fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (::poll(&waiting, 1, static_cast<int>(timeout.count())) != 1 ||
+                ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0)
+            {
+                ::close(fd);
+                errno = error != 0 ? error : ETIMEDOUT;
+                return -1;
+            }
+        }
+
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        const int enabled = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+        return fd;
+    }
+}
+
+std::unique_ptr<HttpConnection> HttpConnection::open(const std::string& host, std::uint16_t port, bool tls,
+                                                     std::chrono::milliseconds connectTimeout,
+                                                     std::chrono::milliseconds ioTimeout) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    const std::string service = std::to_string(port);
+    if (const int status = ::getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses); status != 0)
+    {
+        throw std::system_error(EHOSTUNREACH, std::generic_category(),
+                                "unable to resolve " + host + ": " + ::gai_strerror(status));
+    }
+
+    int fd = -1;
+    int error = 0;
+    for (const addrinfo* address = addresses; address != nullptr && fd < 0; address = address->ai_next)
+    {
+        fd = connectTo(*address, connectTimeout);
+        error = errno;
+    }
+    ::freeaddrinfo(addresses);
+    if (fd < 0)
+    {
+        errno = error;
+        throwErrno("unable to connect to " + host + ":" + service);
+    }
+    setTimeout(fd, SO_RCVTIMEO, ioTimeout);
+    setTimeout(fd, SO_SNDTIMEO, ioTimeout);
+
+    std::unique_ptr<HttpConnection> connection(new HttpConnection(fd, nullptr));
+    if (!tls)
+    {
+        return connection;
+    }
+
+    connection->ssl = createTlsSession(fd, host);
+    if (SSL_connect(connection->ssl) != 1)
+    {
+        throwTls("tls handshake with " + host + " failed");
+    }
+    return connection;
+}
+
+SSL* HttpConnection::createTlsSession(int fd, const std::string& host) {
+    SSL* ssl = SSL_new(tlsContext());
+    if (ssl == nullptr)
+    {
+        throwTls("unable to create tls session");
+    }
+    BIO* bio;
+    try
+    {
+        bio = socketBio(fd);
+    }
+    catch (...)
+    {
+        SSL_free(ssl);
+        throw;
+    }
+    SSL_set_bio(ssl, bio, bio);
+    SSL_set_tlsext_host_name(ssl, host.c_str());
+    SSL_set1_host(ssl, host.c_str());
+    return ssl;
+}
+
+HttpConnection::~HttpConnection() {
+    if (ssl != nullptr)
+    {
+        SSL_free(ssl);
+    }
+    ::close(fd);
+}
+
+void HttpConnection::write(std::string_view bytes) {
+    while (!bytes.empty())
+    {
+        ssize_t written;
+        if (ssl != nullptr)
+        {
+            written = SSL_write(ssl, bytes.data(), static_cast<int>(bytes.size()));
+            if (written <= 0)
+            {
+                if (SSL_get_error(ssl, static_cast<int>(written)) == SSL_ERROR_SYSCALL)
+                {
+                    throwErrno("unable to send request");
+                }
+                throwTls("unable to send request");
+            }
+        }
+        else
+        {
+            written = ::send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throwErrno("unable to send request");
+            }
+        }
+        bytes.remove_prefix(static_cast<std::size_t>(written));
+    }
+}
+
+std::size_t HttpConnection::read(void* destination, std::size_t size) {
+    for (;;)
+    {
+        if (ssl != nullptr)
+        {
+            const int received = SSL_read(ssl, destination, static_cast<int>(std::min<std::size_t>(size, 1 << 30)));
+            if (received > 0)
+            {
+                return static_cast<std::size_t>(received);
+            }
+            switch (SSL_get_error(ssl, received))
+            {
+            case SSL_ERROR_ZERO_RETURN:
+                return 0;
+            case SSL_ERROR_SYSCALL:
+                if (errno == 0)
+                {
+                    // The peer closed the socket without a close_notify alert.
+                    return 0;
+                }
+                throwErrno("unable to receive response");
+            default:
+                throwTls("unable to receive response");
+            }
+        }
+
+        const ssize_t received = ::recv(fd, destination, size, 0);
+        if (received >= 0)
+        {
+            return static_cast<std::size_t>(received);
+        }
+        if (errno != EINTR)
+        {
+            throwErrno("unable to receive response");
+        }
+    }
+}
+
+bool HttpConnection::isIdleAndOpen() const {
+    pollfd waiting{fd, POLLIN, 0};
+    if (::poll(&waiting, 1, 0) == 0)
+    {
+        return true;
+    }
+    if (ssl == nullptr || (waiting.revents & (POLLERR | POLLHUP)) != 0)
+    {
+        return false;
+    }
+
+    // TLS 1.3 servers send session tickets after the handshake, those records make the socket
+    // readable without carrying any application data.
+    const int flags = ::fcntl(fd, F_GETFL);
+    ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    char byte;
+    const int peeked = SSL_peek(ssl, &byte, 1);
+    const bool open = peeked <= 0 && SSL_get_error(ssl, peeked) == SSL_ERROR_WANT_READ;
+    ::fcntl(fd, F_SETFL, flags);
+    ERR_clear_error();
+    return open;
+}
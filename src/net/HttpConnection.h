@@ -0,0 +1,107 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef HTTPCONNECTION_H
+#define HTTPCONNECTION_H
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+typedef struct ssl_st SSL;
+
+/**
+ * @class HttpConnection
+ * @brief A blocking TCP connection to an HTTP origin, optionally secured with TLS.
+ *
+ * The connection keeps the bytes received past the end of the last parsed message in `buffer`,
+ * so it can be handed back to the pool and reused for the next request to the same origin.
+ */
+class HttpConnection {
+public:
+
+    /**
+     * @brief Resolves `host`, connects to it and performs the TLS handshake when requested.
+     *
+     * @param host Host name or address.
+     * @param port TCP port.
+     * @param tls Whether to secure the connection. The peer certificate is verified against `host`.
+     * @param connectTimeout Maximum time spent connecting to each resolved address.
+     * @param ioTimeout Maximum time a single read or write may block.
+     * @return The connected connection.
+     *
+     * @throws std::system_error If no address could be connected to.
+     * @throws std::runtime_error If the TLS handshake fails.
+     */
+    static std::unique_ptr<HttpConnection> open(const std::string& host, std::uint16_t port, bool tls,
+                                                std::chrono::milliseconds connectTimeout,
+                                                std::chrono::milliseconds ioTimeout);
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+    ~HttpConnection();
+
+    /**
+     * @brief Creates a client TLS session over the connected socket `fd`.
+     *
+     * The session sends `host` as SNI and verifies the peer certificate against it. The handshake
+     * itself is left to the caller, which allows driving it on non-blocking sockets.
+     *
+     * @throws std::runtime_error If the session cannot be created.
+     */
+    static SSL* createTlsSession(int fd, const std::string& host);
+
+    /**
+     * @brief Sends all of `bytes`.
+     *
+     * @throws std::system_error If the connection fails or times out.
+     */
+    void write(std::string_view bytes);
+
+    /**
+     * @brief Receives at most `size` bytes.
+     *
+     * @return The number of bytes received, zero when the peer closed the connection.
+     *
+     * @throws std::system_error If the connection fails or times out.
+     */
+    std::size_t read(void* destination, std::size_t size);
+
+    /**
+     * @brief Tells whether an idle connection can still carry a request.
+     *
+     * An idle keep-alive connection that became readable was either closed by the peer or received
+     * unsolicited bytes, in both cases it must be discarded.
+     */
+    bool isIdleAndOpen() const;
+
+    /**
+     * @brief Returns the underlying socket descriptor.
+     */
+    int descriptor() const {
+        return fd;
+    }
+
+    /**
+     * @brief Bytes received but not consumed by the last message.
+     */
+    std::string buffer;
+
+    /**
+     * @brief Moment the connection was last returned to its pool.
+     */
+    std::chrono::steady_clock::time_point idleSince;
+
+private:
+    HttpConnection(int fd, SSL* ssl) : fd(fd), ssl(ssl) {}
+
+    int fd;
+    SSL* ssl;
+};
+
+
+
+#endif //HTTPCONNECTION_H
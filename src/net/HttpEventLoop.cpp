@@ -0,0 +1,754 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "HttpEventLoop.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "HttpConnection.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int MaxEvents = 256;
+
+    // Granularity of the timeout checks.
+    constexpr int TickMilliseconds = 100;
+
+    constexpr std::size_t ScratchSize = 64 * 1024;
+
+    // Resolved addresses are reused for this long, getaddrinfo does not expose record TTLs.
+    constexpr std::chrono::seconds ResolutionLifetime{60};
+
+    struct Address {
+        sockaddr_storage storage{};
+        socklen_t length = 0;
+        int family = AF_UNSPEC;
+    };
+
+    using Addresses = std::shared_ptr<const std::vector<Address>>;
+
+    /**
+     * Resolves origins on the submitting threads, so the I/O threads never block on DNS.
+     */
+    Addresses resolve(const Url& url)
+    {
+        static std::mutex mutex;
+        static std::unordered_map<std::string, std::pair<Addresses, Clock::time_point>> cache;
+
+        const std::string key = url.host + ":" + std::to_string(url.port);
+        {
+            std::lock_guard lock(mutex);
+            if (const auto found = cache.find(key); found != cache.end() && found->second.second > Clock::now())
+            {
+                return found->second.first;
+            }
+        }
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* results = nullptr;
+        if (const int status = ::getaddrinfo(url.host.c_str(), std::to_string(url.port).c_str(), &hints, &results);
+            status != 0)
+        {
+            throw std::system_error(EHOSTUNREACH, std::generic_category(),
+                                    "unable to resolve " + url.host + ": " + ::gai_strerror(status));
+        }
+        auto addresses = std::make_shared<std::vector<Address>>();
+        for (const addrinfo* result = results; result != nullptr; result = result->ai_next)
+        {
+            Address address;
+            std::memcpy(&address.storage, result->ai_addr, result->ai_addrlen);
+            address.length = result->ai_addrlen;
+            address.family = result->ai_family;
+            addresses->push_back(address);
+        }
+        ::freeaddrinfo(results);
+
+        std::lock_guard lock(mutex);
+        cache[key] = {addresses, Clock::now() + ResolutionLifetime};
+        return addresses;
+    }
+
+    struct Request {
+        Url url;
+        Addresses addresses;
+        std::size_t address = 0;
+        HttpRequest request;
+        std::string message;
+        bool retried = false;
+        Clock::time_point deadline;
+        HttpEventLoop::Completion done;
+    };
+
+    [[noreturn]] void throwErrno(const std::string& what, int error)
+    {
+        throw std::system_error(error, std::generic_category(), what);
+    }
+}
+
+/**
+ * One I/O thread with its epoll instance, its connections and its per-origin pools.
+ */
+class HttpEventLoop::Worker {
+public:
+    Worker(const Options& options, std::atomic<std::size_t>& pending) : options(options), pending(pending) {
+        epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        wake = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (epoll < 0 || wake < 0)
+        {
+            throwErrno("unable to create event loop", errno);
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        ::epoll_ctl(epoll, EPOLL_CTL_ADD, wake, &event);
+        scratch.resize(ScratchSize);
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~Worker() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        signal();
+        thread.join();
+        ::close(wake);
+        ::close(epoll);
+    }
+
+    void submit(std::unique_ptr<Request> request) {
+        {
+            std::lock_guard lock(mutex);
+            submissions.push_back(std::move(request));
+        }
+        signal();
+    }
+
+private:
+    enum class Phase {
+        Connecting,
+        Handshaking,
+        Writing,
+        Reading,
+        Idle
+    };
+
+    struct Connection {
+        int fd = -1;
+        SSL* ssl = nullptr;
+        std::string origin;
+        Phase phase = Phase::Connecting;
+        std::uint32_t events = 0;
+        Clock::time_point deadline;
+        bool closed = false;
+
+        std::unique_ptr<Request> request;
+        std::size_t written = 0;
+        std::unique_ptr<HttpResponseParser> parser;
+        bool reused = false;
+        bool received = false;
+        bool leftover = false;
+    };
+
+    struct Origin {
+        std::size_t open = 0;
+        std::vector<Connection*> idle;
+        std::deque<std::unique_ptr<Request>> waiting;
+    };
+
+    void signal() const {
+        const std::uint64_t one = 1;
+        [[maybe_unused]] const ssize_t written = ::write(wake, &one, sizeof(one));
+    }
+
+    void run() {
+        epoll_event events[MaxEvents];
+        for (;;)
+        {
+            const int count = ::epoll_wait(epoll, events, MaxEvents, TickMilliseconds);
+            for (int i = 0; i < count; ++i)
+            {
+                if (events[i].data.ptr == nullptr)
+                {
+                    std::uint64_t value;
+                    [[maybe_unused]] const ssize_t read = ::read(wake, &value, sizeof(value));
+                    continue;
+                }
+                auto* connection = static_cast<Connection*>(events[i].data.ptr);
+                if (!connection->closed)
+                {
+                    handle(*connection, events[i].events);
+                }
+            }
+
+            expire();
+            // Connections closed during this round may still have had events queued in it.
+            graveyard.clear();
+
+            std::vector<std::unique_ptr<Request>> accepted;
+            {
+                std::lock_guard lock(mutex);
+                if (stopping)
+                {
+                    break;
+                }
+                accepted.swap(submissions);
+            }
+            for (auto& request : accepted)
+            {
+                dispatch(std::move(request), true);
+            }
+        }
+        shutdown();
+    }
+
+    void dispatch(std::unique_ptr<Request> request, bool allowIdle) {
+        const std::string key = request->url.origin();
+        Origin& origin = origins[key];
+        if (allowIdle && !origin.idle.empty())
+        {
+            Connection* connection = origin.idle.back();
+            origin.idle.pop_back();
+            connection->request = std::move(request);
+            connection->reused = true;
+            guarded(*connection, [&]() { startRequest(*connection); });
+            return;
+        }
+        if (origin.open < options.maxConnectionsPerOrigin)
+        {
+            open(origin, key, std::move(request));
+            return;
+        }
+        // Waiting for a connection counts against the I/O timeout, see `expire`.
+        request->deadline = Clock::now() + options.ioTimeout;
+        origin.waiting.push_back(std::move(request));
+    }
+
+    void service(const std::string& key) {
+        Origin& origin = origins[key];
+        while (!origin.waiting.empty() && (!origin.idle.empty() || origin.open < options.maxConnectionsPerOrigin))
+        {
+            std::unique_ptr<Request> request = std::move(origin.waiting.front());
+            origin.waiting.pop_front();
+            dispatch(std::move(request), true);
+        }
+    }
+
+    // Connects to the resolved addresses of the request in turn, from `Request::address` on.
+    void open(Origin& origin, const std::string& key, std::unique_ptr<Request> request) {
+        int fd = -1;
+        for (;;)
+        {
+            const Address& address = (*request->addresses)[request->address];
+            fd = ::socket(address.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd >= 0 && (::connect(fd, reinterpret_cast<const sockaddr*>(&address.storage), address.length) == 0 ||
+                            errno == EINPROGRESS))
+            {
+                break;
+            }
+            const int error = errno;
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            if (++request->address >= request->addresses->size())
+            {
+                complete(std::move(request), {}, std::make_exception_ptr(std::system_error(
+                    error, std::generic_category(), "unable to connect to " + key)));
+                return;
+            }
+        }
+
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        connection->origin = key;
+        connection->request = std::move(request);
+        connection->deadline = Clock::now() + options.connectTimeout;
+        epoll_event event{};
+        event.events = connection->events = EPOLLOUT;
+        event.data.ptr = connection.get();
+        ::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+        ++origin.open;
+        Connection* raw = connection.get();
+        connections.emplace(raw, std::move(connection));
+    }
+
+    void watch(Connection& connection, std::uint32_t events) {
+        if (connection.events == events)
+        {
+            return;
+        }
+        epoll_event event{};
+        event.events = connection.events = events;
+        event.data.ptr = &connection;
+        ::epoll_ctl(epoll, EPOLL_CTL_MOD, connection.fd, &event);
+    }
+
+    // Runs `step`, turning any exception into a failure of the connection's request.
+    template <typename Step>
+    void guarded(Connection& connection, Step&& step) {
+        try
+        {
+            step();
+        }
+        catch (...)
+        {
+            fail(connection, std::current_exception());
+        }
+    }
+
+    void handle(Connection& connection, std::uint32_t events) {
+        guarded(connection, [&]() {
+            switch (connection.phase)
+            {
+            case Phase::Connecting:
+                connected(connection);
+                break;
+            case Phase::Handshaking:
+                handshake(connection);
+                break;
+            case Phase::Writing:
+                write(connection);
+                break;
+            case Phase::Reading:
+                read(connection);
+                break;
+            case Phase::Idle:
+                idleEvent(connection, events);
+                break;
+            }
+        });
+    }
+
+    void connected(Connection& connection) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (::getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0)
+        {
+            throwErrno("unable to connect to " + connection.origin, error != 0 ? error : errno);
+        }
+        const int enabled = 1;
+        ::setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+
+        if (connection.request->url.tls)
+        {
+            connection.ssl = HttpConnection::createTlsSession(connection.fd, connection.request->url.host);
+            connection.phase = Phase::Handshaking;
+            connection.deadline = Clock::now() + options.ioTimeout;
+            handshake(connection);
+            return;
+        }
+        startRequest(connection);
+    }
+
+    // Maps a non-fatal OpenSSL result to the readiness it waits for, throws on fatal errors.
+    void awaitTls(Connection& connection, int result, const char* what) {
+        switch (SSL_get_error(connection.ssl, result))
+        {
+        case SSL_ERROR_WANT_READ:
+            watch(connection, EPOLLIN);
+            return;
+        case SSL_ERROR_WANT_WRITE:
+            watch(connection, EPOLLOUT);
+            return;
+        default:
+            ERR_clear_error();
+            throw std::runtime_error(std::string(what) + " with " + connection.origin + " failed");
+        }
+    }
+
+    void handshake(Connection& connection) {
+        const int result = SSL_connect(connection.ssl);
+        if (result == 1)
+        {
+            startRequest(connection);
+            return;
+        }
+        awaitTls(connection, result, "tls handshake");
+    }
+
+    void startRequest(Connection& connection) {
+        connection.phase = Phase::Writing;
+        connection.written = 0;
+        connection.received = false;
+        connection.parser = std::make_unique<HttpResponseParser>(connection.request->request);
+        connection.deadline = Clock::now() + options.ioTimeout;
+        write(connection);
+    }
+
+    void write(Connection& connection) {
+        const std::string& message = connection.request->message;
+        while (connection.written < message.size())
+        {
+            const char* data = message.data() + connection.written;
+            const std::size_t size = message.size() - connection.written;
+            if (connection.ssl != nullptr)
+            {
+                const int result = SSL_write(connection.ssl, data, static_cast<int>(size));
+                if (result <= 0)
+                {
+                    awaitTls(connection, result, "tls write");
+                    return;
+                }
+                connection.written += static_cast<std::size_t>(result);
+                continue;
+            }
+
+            const ssize_t result = ::send(connection.fd, data, size, MSG_NOSIGNAL);
+            if (result < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    watch(connection, EPOLLOUT);
+                    return;
+                }
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throwErrno("unable to send request to " + connection.origin, errno);
+            }
+            connection.written += static_cast<std::size_t>(result);
+        }
+
+        connection.phase = Phase::Reading;
+        connection.deadline = Clock::now() + options.ioTimeout;
+        watch(connection, EPOLLIN);
+    }
+
+    /**
+     * Receives into `destination`, returns false when the socket would block.
+     */
+    bool receive(Connection& connection, void* destination, std::size_t size, std::size_t& count) {
+        if (connection.ssl != nullptr)
+        {
+            const int result = SSL_read(connection.ssl, destination, static_cast<int>(std::min<std::size_t>(size, 1 << 30)));
+            if (result > 0)
+            {
+                count = static_cast<std::size_t>(result);
+                return true;
+            }
+            const int error = SSL_get_error(connection.ssl, result);
+            if (error == SSL_ERROR_ZERO_RETURN || (error == SSL_ERROR_SYSCALL && errno == 0))
+            {
+                count = 0;
+                return true;
+            }
+            awaitTls(connection, result, "tls read");
+            return false;
+        }
+
+        for (;;)
+        {
+            const ssize_t result = ::recv(connection.fd, destination, size, 0);
+            if (result >= 0)
+            {
+                count = static_cast<std::size_t>(result);
+                return true;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                watch(connection, EPOLLIN);
+                return false;
+            }
+            if (errno != EINTR)
+            {
+                throwErrno("unable to receive response from " + connection.origin, errno);
+            }
+        }
+    }
+
+    void read(Connection& connection) {
+        HttpResponseParser& parser = *connection.parser;
+        while (!parser.complete())
+        {
+            std::size_t directSize;
+            unsigned char* direct = parser.directBuffer(directSize);
+            std::size_t count;
+            if (!receive(connection, direct != nullptr ? static_cast<void*>(direct) : scratch.data(),
+                         direct != nullptr ? directSize : scratch.size(), count))
+            {
+                return;
+            }
+            if (count == 0)
+            {
+                parser.finish();
+                break;
+            }
+
+            connection.received = true;
+            connection.deadline = Clock::now() + options.ioTimeout;
+            if (direct != nullptr)
+            {
+                parser.commitDirect(count);
+            }
+            else
+            {
+                // Bytes past the response were not asked for, the connection cannot be reused.
+                connection.leftover = parser.feed(scratch.data(), count) < count;
+            }
+        }
+        finish(connection);
+    }
+
+    void idleEvent(Connection& connection, std::uint32_t events) {
+        // Idle TLS connections receive session tickets, anything else means the peer is gone.
+        if (connection.ssl != nullptr && (events & (EPOLLERR | EPOLLHUP)) == 0)
+        {
+            const int result = SSL_read(connection.ssl, scratch.data(), 1);
+            if (result <= 0 && SSL_get_error(connection.ssl, result) == SSL_ERROR_WANT_READ)
+            {
+                return;
+            }
+            ERR_clear_error();
+        }
+        close(connection);
+        service(connection.origin);
+    }
+
+    void finish(Connection& connection) {
+        HttpResponse response = std::move(connection.parser->response());
+        const bool reusable = connection.parser->keepAlive() && !connection.leftover;
+        std::unique_ptr<Request> request = std::move(connection.request);
+        connection.parser.reset();
+        const std::string key = connection.origin;
+
+        Origin& origin = origins[key];
+        if (reusable && origin.idle.size() < options.maxIdlePerOrigin)
+        {
+            connection.phase = Phase::Idle;
+            connection.deadline = Clock::now() + options.idleTimeout;
+            watch(connection, EPOLLIN);
+            origin.idle.push_back(&connection);
+        }
+        else
+        {
+            close(connection);
+        }
+
+        complete(std::move(request), std::move(response), nullptr);
+        service(key);
+    }
+
+    void fail(Connection& connection, std::exception_ptr error) {
+        std::unique_ptr<Request> request = std::move(connection.request);
+        const bool retry = request && connection.reused && !connection.received && !request->retried;
+        const bool nextAddress = request && connection.phase == Phase::Connecting &&
+                                 request->address + 1 < request->addresses->size();
+        const std::string key = connection.origin;
+        close(connection);
+
+        if (nextAddress)
+        {
+            // Refused or timed out: the origin may still be reachable at its next address.
+            ++request->address;
+            open(origins[key], key, std::move(request));
+        }
+        else if (request && retry)
+        {
+            // The server may have closed the pooled connection while the request was sent.
+            request->retried = true;
+            dispatch(std::move(request), false);
+        }
+        else if (request)
+        {
+            complete(std::move(request), {}, std::move(error));
+        }
+        service(key);
+    }
+
+    void close(Connection& connection) {
+        if (connection.closed)
+        {
+            return;
+        }
+        connection.closed = true;
+        ::epoll_ctl(epoll, EPOLL_CTL_DEL, connection.fd, nullptr);
+        if (connection.ssl != nullptr)
+        {
+            SSL_free(connection.ssl);
+        }
+        ::close(connection.fd);
+
+        Origin& origin = origins[connection.origin];
+        --origin.open;
+        std::erase(origin.idle, &connection);
+
+        const auto found = connections.find(&connection);
+        graveyard.push_back(std::move(found->second));
+        connections.erase(found);
+    }
+
+    void complete(std::unique_ptr<Request> request, HttpResponse&& response, std::exception_ptr error) {
+        pending.fetch_sub(1, std::memory_order_relaxed);
+        try
+        {
+            request->done(std::move(response), std::move(error));
+        }
+        catch (...)
+        {
+            // Completions must not throw, an escaping exception would take the I/O thread down.
+        }
+    }
+
+    void expire() {
+        const auto now = Clock::now();
+        std::vector<Connection*> expired;
+        for (const auto& [connection, owned] : connections)
+        {
+            if (now > connection->deadline)
+            {
+                expired.push_back(connection);
+            }
+        }
+        for (Connection* connection : expired)
+        {
+            if (connection->phase == Phase::Idle)
+            {
+                close(*connection);
+                continue;
+            }
+            fail(*connection, std::make_exception_ptr(std::system_error(
+                ETIMEDOUT, std::generic_category(), "http request to " + connection->origin + " timed out")));
+        }
+
+        // Requests wait in arrival order, so the expired ones are at the front.
+        for (auto& [key, origin] : origins)
+        {
+            while (!origin.waiting.empty() && now > origin.waiting.front()->deadline)
+            {
+                std::unique_ptr<Request> request = std::move(origin.waiting.front());
+                origin.waiting.pop_front();
+                complete(std::move(request), {}, std::make_exception_ptr(std::system_error(
+                    ETIMEDOUT, std::generic_category(), "http request to " + key + " timed out waiting for a connection")));
+            }
+        }
+    }
+
+    void shutdown() {
+        const auto stopped = std::make_exception_ptr(std::runtime_error("http event loop stopped"));
+        std::vector<std::unique_ptr<Request>> abandoned;
+        {
+            std::lock_guard lock(mutex);
+            abandoned.swap(submissions);
+        }
+        for (auto& [key, origin] : origins)
+        {
+            for (auto& request : origin.waiting)
+            {
+                abandoned.push_back(std::move(request));
+            }
+            origin.waiting.clear();
+        }
+        std::vector<Connection*> open;
+        for (const auto& [connection, owned] : connections)
+        {
+            open.push_back(connection);
+        }
+        for (Connection* connection : open)
+        {
+            if (connection->request)
+            {
+                abandoned.push_back(std::move(connection->request));
+            }
+            close(*connection);
+        }
+        graveyard.clear();
+        for (auto& request : abandoned)
+        {
+            complete(std::move(request), {}, stopped);
+        }
+    }
+
+    Options options;
+    std::atomic<std::size_t>& pending;
+    int epoll = -1;
+    int wake = -1;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Request>> submissions;
+    bool stopping = false;
+
+    std::unordered_map<std::string, Origin> origins;
+    std::unordered_map<Connection*, std::unique_ptr<Connection>> connections;
+    std::vector<std::unique_ptr<Connection>> graveyard;
+    std::vector<char> scratch;
+    std::thread thread;
+};
+
+HttpEventLoop::HttpEventLoop(Options options) {
+    const std::size_t count = std::max<std::size_t>(1, options.ioThreads);
+    workers.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>(options, pending));
+    }
+}
+
+HttpEventLoop::~HttpEventLoop() = default;
+
+HttpEventLoop& HttpEventLoop::shared() {
+    static HttpEventLoop loop;
+    return loop;
+}
+
+void HttpEventLoop::fetch(const Url& url, const HttpRequest& request, Completion done) {
+    auto queued = std::make_unique<Request>();
+    try
+    {
+        queued->addresses = resolve(url);
+    }
+    catch (...)
+    {
+        done({}, std::current_exception());
+        return;
+    }
+    queued->url = url;
+    queued->request = request;
+    queued->message = request.serialize(url);
+    queued->done = std::move(done);
+
+    pending.fetch_add(1, std::memory_order_relaxed);
+    workers[nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size()]->submit(std::move(queued));
+}
+
+std::future<HttpResponse> HttpEventLoop::get(std::string_view url) {
+    auto promise = std::make_shared<std::promise<HttpResponse>>();
+    std::future<HttpResponse> future = promise->get_future();
+    fetch(Url::parse(url), HttpRequest{}, [promise](HttpResponse&& response, std::exception_ptr error) {
+        if (error)
+        {
+            promise->set_exception(error);
+        }
+        else
+        {
+            promise->set_value(std::move(response));
+        }
+    });
+    return future;
+}
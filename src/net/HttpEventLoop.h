@@ -0,0 +1,107 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef HTTPEVENTLOOP_H
+#define HTTPEVENTLOOP_H
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "HttpMessage.h"
+#include "Url.h"
+
+/**
+ * @class HttpEventLoop
+ * @brief Non-blocking HTTP/1.1 engine multiplexing many concurrent requests on a few threads.
+ *
+ * Each I/O thread owns an epoll instance and drives the connections assigned to it through their
+ * connect, TLS handshake, write and read phases without ever blocking, so a single thread keeps
+ * thousands of requests in flight. Requests are spread over the I/O threads round-robin.
+ *
+ * Like `HttpClient`, every I/O thread keeps idle keep-alive connections per origin. When an origin
+ * already has `Options::maxConnectionsPerOrigin` connections, further requests to it wait for one to
+ * become available instead of opening more, and fail once they waited `Options::ioTimeout`. New
+ * connections try the resolved addresses of the origin in turn until one accepts.
+ *
+ * Completions run on the I/O thread: they must be short and are expected to hand the response over
+ * to CPU workers (see `BatchExecutor`) rather than processing it in place.
+ */
+class HttpEventLoop {
+public:
+
+    /**
+     * @brief Receives the outcome of a request: either the response or the error that prevented it.
+     */
+    using Completion = std::function<void(HttpResponse&& response, std::exception_ptr error)>;
+
+    /**
+     * @struct Options
+     * @brief Tunables of the engine.
+     */
+    struct Options {
+        std::size_t ioThreads = 1;
+        std::size_t maxConnectionsPerOrigin = 256;
+        std::size_t maxIdlePerOrigin = 64;
+        std::chrono::milliseconds connectTimeout{5000};
+        std::chrono::milliseconds ioTimeout{30000};
+        std::chrono::milliseconds idleTimeout{30000};
+    };
+
+    explicit HttpEventLoop(Options options);
+
+    HttpEventLoop() : HttpEventLoop(Options{}) {}
+
+    HttpEventLoop(const HttpEventLoop&) = delete;
+    HttpEventLoop& operator=(const HttpEventLoop&) = delete;
+
+    /**
+     * @brief Stops the I/O threads. Requests still in flight are failed.
+     */
+    ~HttpEventLoop();
+
+    /**
+     * @brief Returns the engine shared by the whole process.
+     */
+    static HttpEventLoop& shared();
+
+    /**
+     * @brief Queues `request` for `url` and returns immediately.
+     *
+     * @param url Destination of the request.
+     * @param request The request to send.
+     * @param done Invoked exactly once, on an I/O thread, when the request completed or failed.
+     */
+    void fetch(const Url& url, const HttpRequest& request, Completion done);
+
+    /**
+     * @brief Queues a `GET` request for `url` and returns a future of its response.
+     *
+     * @throws std::invalid_argument If `url` is not a valid http(s) URL.
+     */
+    std::future<HttpResponse> get(std::string_view url);
+
+    /**
+     * @brief Number of requests queued or in flight.
+     */
+    std::size_t inFlight() const {
+        return pending.load(std::memory_order_relaxed);
+    }
+
+private:
+    class Worker;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<std::size_t> nextWorker{0};
+    std::atomic<std::size_t> pending{0};
+};
+
+
+
+#endif //HTTPEVENTLOOP_H
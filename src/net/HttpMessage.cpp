@@ -0,0 +1,360 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "HttpMessage.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+    // Protects against peers streaming endless status lines or headers.
+    constexpr std::size_t MaxHeadSize = 64 * 1024;
+
+    std::atomic<std::size_t> defaultBodyLimit{std::size_t{4} << 30};
+
+    bool equalsIgnoreCase(std::string_view left, std::string_view right)
+    {
+        return left.size() == right.size() && std::equal(left.begin(), left.end(), right.begin(), [](char a, char b) {
+            return (a | 0x20) == (b | 0x20);
+        });
+    }
+
+    std::string_view trim(std::string_view value)
+    {
+        constexpr std::string_view blanks = " \t\r\n";
+        const std::size_t first = value.find_first_not_of(blanks);
+        if (first == std::string_view::npos)
+        {
+            return {};
+        }
+        return value.substr(first, value.find_last_not_of(blanks) - first + 1);
+    }
+
+    bool containsTokenIgnoreCase(std::string_view list, std::string_view token)
+    {
+        while (!list.empty())
+        {
+            const std::size_t comma = list.find(',');
+            if (equalsIgnoreCase(trim(list.substr(0, comma)), token))
+            {
+                return true;
+            }
+            if (comma == std::string_view::npos)
+            {
+                break;
+            }
+            list.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    [[noreturn]] void malformed(const std::string& what)
+    {
+        throw std::runtime_error("malformed http response: " + what);
+    }
+}
+
+std::size_t HttpRequest::defaultMaxBodySize() {
+    return defaultBodyLimit.load(std::memory_order_relaxed);
+}
+
+void HttpRequest::setDefaultMaxBodySize(std::size_t size) {
+    defaultBodyLimit.store(size, std::memory_order_relaxed);
+}
+
+std::string HttpRequest::serialize(const Url& url) const {
+    std::string message;
+    message.reserve(128 + url.target.size());
+    message.append(method).append(" ").append(url.target).append(" HTTP/1.1\r\n");
+    message.append("Host: ").append(url.hostHeader()).append("\r\n");
+    message.append("Connection: keep-alive\r\n");
+    message.append("User-Agent: img_ly_test\r\n");
+    for (const auto& [name, value] : headers)
+    {
+        message.append(name).append(": ").append(value).append("\r\n");
+    }
+    message.append("\r\n");
+    return message;
+}
+
+std::string_view HttpResponse::header(std::string_view name) const {
+    for (const auto& [key, value] : headers)
+    {
+        if (equalsIgnoreCase(key, name))
+        {
+            return value;
+        }
+    }
+    return {};
+}
+
+std::size_t HttpResponseParser::feed(const char* data, std::size_t size) {
+    std::size_t consumed = 0;
+
+    // Accumulates a CRLF terminated line into `pending`, returns true once it is complete.
+    auto takeLine = [&]() {
+        const char* start = data + consumed;
+        const auto* newline = static_cast<const char*>(std::memchr(start, '\n', size - consumed));
+        const std::size_t length = newline == nullptr ? size - consumed : static_cast<std::size_t>(newline - start) + 1;
+        pending.append(start, length);
+        consumed += length;
+        if (pending.size() > MaxHeadSize)
+        {
+            malformed("line too long");
+        }
+        return newline != nullptr;
+    };
+
+    while (consumed < size && state != State::Done)
+    {
+        switch (state)
+        {
+        case State::Head:
+        {
+            const std::size_t previous = pending.size();
+            pending.append(data + consumed, size - consumed);
+            const std::size_t end = pending.find("\r\n\r\n", previous >= 3 ? previous - 3 : 0);
+            if (end == std::string::npos)
+            {
+                if (pending.size() > MaxHeadSize)
+                {
+                    malformed("header section too large");
+                }
+                consumed = size;
+                break;
+            }
+            consumed += end + 4 - previous;
+            const std::string head = pending.substr(0, end + 2);
+            pending.clear();
+            parseHead(head);
+            break;
+        }
+        case State::FixedBody:
+        {
+            const std::size_t count = std::min(remaining, size - consumed);
+            std::memcpy(fixedBody->data() + fixedOffset, data + consumed, count);
+            consumed += count;
+            commitDirect(count);
+            break;
+        }
+        case State::ChunkSize:
+            if (takeLine())
+            {
+                const std::string_view line = trim(std::string_view(pending).substr(0, pending.find_first_of(";\r\n")));
+                std::size_t chunkSize = 0;
+                const auto [end, error] = std::from_chars(line.data(), line.data() + line.size(), chunkSize, 16);
+                if (error != std::errc() || end != line.data() + line.size() || line.empty())
+                {
+                    malformed("invalid chunk size");
+                }
+                pending.clear();
+                checkBodySize(growingBody->size(), chunkSize);
+                remaining = chunkSize;
+                state = chunkSize == 0 ? State::Trailer : State::ChunkData;
+            }
+            break;
+        case State::ChunkData:
+        {
+            const std::size_t count = std::min(remaining, size - consumed);
+            appendBody(data + consumed, count);
+            consumed += count;
+            remaining -= count;
+            if (remaining == 0)
+            {
+                state = State::ChunkDataEnd;
+            }
+            break;
+        }
+        case State::ChunkDataEnd:
+            if (takeLine())
+            {
+                if (!trim(pending).empty())
+                {
+                    malformed("missing chunk terminator");
+                }
+                pending.clear();
+                state = State::ChunkSize;
+            }
+            break;
+        case State::Trailer:
+            if (takeLine())
+            {
+                const bool last = trim(pending).empty();
+                pending.clear();
+                if (last)
+                {
+                    finishBody();
+                }
+            }
+            break;
+        case State::BodyUntilClose:
+            appendBody(data + consumed, size - consumed);
+            consumed = size;
+            break;
+        case State::Done:
+            break;
+        }
+    }
+    return consumed;
+}
+
+void HttpResponseParser::parseHead(std::string_view head) {
+    const std::size_t lineEnd = head.find("\r\n");
+    const std::string_view statusLine = head.substr(0, lineEnd);
+    if (!statusLine.starts_with("HTTP/1.") || statusLine.size() < 12 || statusLine[8] != ' ')
+    {
+        malformed("invalid status line");
+    }
+    const bool http11 = statusLine[7] != '0';
+    int status = 0;
+    const auto [end, error] = std::from_chars(statusLine.data() + 9, statusLine.data() + 12, status);
+    if (error != std::errc() || end != statusLine.data() + 12)
+    {
+        malformed("invalid status code");
+    }
+
+    // Interim responses (100 Continue...) precede the actual one.
+    if (status >= 100 && status < 200)
+    {
+        return;
+    }
+
+    parsed.status = status;
+    parsed.headers.clear();
+    for (std::size_t start = lineEnd + 2; start < head.size();)
+    {
+        std::size_t next = head.find("\r\n", start);
+        if (next == std::string_view::npos)
+        {
+            next = head.size();
+        }
+        const std::string_view line = head.substr(start, next - start);
+        start = next + 2;
+        const std::size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0)
+        {
+            malformed("invalid header line");
+        }
+        parsed.headers.emplace_back(std::string(line.substr(0, colon)), std::string(trim(line.substr(colon + 1))));
+    }
+
+    const std::string_view connection = parsed.header("Connection");
+    reusable = http11 ? !containsTokenIgnoreCase(connection, "close") : containsTokenIgnoreCase(connection, "keep-alive");
+
+    if (headRequest || status == 204 || status == 304)
+    {
+        finishBody();
+        return;
+    }
+    if (containsTokenIgnoreCase(parsed.header("Transfer-Encoding"), "chunked"))
+    {
+        growingBody = std::make_shared<std::vector<unsigned char>>();
+        state = State::ChunkSize;
+        return;
+    }
+    if (const std::string_view length = parsed.header("Content-Length"); !length.empty())
+    {
+        std::size_t contentLength = 0;
+        const auto [lengthEnd, lengthError] = std::from_chars(length.data(), length.data() + length.size(), contentLength);
+        if (lengthError != std::errc() || lengthEnd != length.data() + length.size())
+        {
+            malformed("invalid content length");
+        }
+        checkBodySize(0, contentLength);
+        if (status == 200 && deferBodyAbove != 0 && contentLength > deferBodyAbove &&
+            containsTokenIgnoreCase(parsed.header("Accept-Ranges"), "bytes"))
+        {
+            // The unread body is still on the connection, it cannot carry another request.
+            reusable = false;
+            parsed.bodyDeferred = true;
+            state = State::Done;
+            return;
+        }
+        if (status == 206 && bodyTarget.buffer && contentLength <= bodyTarget.capacity)
+        {
+            fixedBody = std::move(bodyTarget.buffer);
+            fixedStart = bodyTarget.offset;
+        }
+        else
+        {
+            fixedBody = BufferPool::shared().acquire(contentLength);
+            fixedStart = 0;
+        }
+        fixedOffset = fixedStart;
+        remaining = contentLength;
+        state = State::FixedBody;
+        if (contentLength == 0)
+        {
+            finishBody();
+        }
+        return;
+    }
+
+    // Without framing the body ends with the connection, which therefore cannot be reused.
+    reusable = false;
+    growingBody = std::make_shared<std::vector<unsigned char>>();
+    state = State::BodyUntilClose;
+}
+
+void HttpResponseParser::checkBodySize(std::size_t received, std::size_t more) const {
+    if (maxBodySize != 0 && (received > maxBodySize || more > maxBodySize - received))
+    {
+        throw std::runtime_error("http response body exceeds the limit of " + std::to_string(maxBodySize) + " bytes");
+    }
+}
+
+void HttpResponseParser::appendBody(const char* data, std::size_t size) {
+    checkBodySize(growingBody->size(), size);
+    growingBody->insert(growingBody->end(), data, data + size);
+}
+
+void HttpResponseParser::finishBody() {
+    if (fixedBody)
+    {
+        const unsigned char* bytes = fixedBody->data() + fixedStart;
+        parsed.body = {std::move(fixedBody), bytes, fixedOffset - fixedStart};
+    }
+    else if (growingBody)
+    {
+        const unsigned char* bytes = growingBody->data();
+        const std::size_t length = growingBody->size();
+        parsed.body = {std::move(growingBody), bytes, length};
+    }
+    state = State::Done;
+}
+
+void HttpResponseParser::finish() {
+    if (state == State::BodyUntilClose)
+    {
+        finishBody();
+        return;
+    }
+    if (state != State::Done)
+    {
+        throw std::runtime_error("connection closed before the http response was complete");
+    }
+}
+
+unsigned char* HttpResponseParser::directBuffer(std::size_t& size) {
+    if (state != State::FixedBody)
+    {
+        size = 0;
+        return nullptr;
+    }
+    size = remaining;
+    return fixedBody->data() + fixedOffset;
+}
+
+void HttpResponseParser::commitDirect(std::size_t size) {
+    fixedOffset += size;
+    remaining -= size;
+    if (remaining == 0)
+    {
+        finishBody();
+    }
+}
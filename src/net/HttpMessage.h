@@ -0,0 +1,241 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef HTTPMESSAGE_H
+#define HTTPMESSAGE_H
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Url.h"
+#include "../utils/BufferPool.h"
+#include "../utils/BufferSlice.h"
+
+/**
+ * @file HttpMessage.h
+ * @brief HTTP/1.1 request serialization and incremental response parsing.
+ *
+ * The parser does not perform any I/O: it is fed whatever bytes the transport received, which lets
+ * the same code serve blocking connections and event-driven ones.
+ */
+
+using HttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @struct HttpBodyTarget
+ * @brief Caller provided storage receiving a partial content body in place.
+ *
+ * @var HttpBodyTarget::buffer
+ * The destination buffer, shared by the resulting `HttpResponse::body`.
+ *
+ * @var HttpBodyTarget::offset
+ * Position in `buffer` of the first body byte.
+ *
+ * @var HttpBodyTarget::capacity
+ * Bytes available from `offset`. Larger bodies get a buffer of their own.
+ */
+struct HttpBodyTarget {
+    std::shared_ptr<BufferPool::Buffer> buffer;
+    std::size_t offset = 0;
+    std::size_t capacity = 0;
+};
+
+/**
+ * @struct HttpRequest
+ * @brief A request without body, the target comes from the `Url` it is sent to.
+ *
+ * @var HttpRequest::method
+ * The request method, `GET` or `HEAD`.
+ *
+ * @var HttpRequest::headers
+ * Additional headers. `Host`, `Connection` and `User-Agent` are added when sent.
+ *
+ * @var HttpRequest::bodyTarget
+ * When set, a `206 Partial Content` answer is received straight into it (see `RangedDownload`).
+ *
+ * @var HttpRequest::maxBodySize
+ * Largest response body accepted, zero for no limit. A longer `Content-Length` fails before the
+ * body is allocated, chunked and close-delimited bodies fail once they grow past it.
+ *
+ * @var HttpRequest::deferBodyAbove
+ * When not zero, a `200` answer advertising `Accept-Ranges: bytes` and a `Content-Length` above
+ * this size completes after its headers, without body, and is flagged `HttpResponse::bodyDeferred`.
+ * The connection is not reused, the caller fetches the body in ranges (see `RangedDownload`).
+ */
+struct HttpRequest {
+    std::string method = "GET";
+    HttpHeaders headers;
+    HttpBodyTarget bodyTarget;
+    std::size_t maxBodySize = defaultMaxBodySize();
+    std::size_t deferBodyAbove = 0;
+
+    /**
+     * @brief Returns the body size limit requests are created with, 4 GiB unless changed.
+     */
+    static std::size_t defaultMaxBodySize();
+
+    /**
+     * @brief Changes the body size limit requests are created with, zero for no limit.
+     */
+    static void setDefaultMaxBodySize(std::size_t size);
+
+    /**
+     * @brief Serializes the request line and headers for `url`.
+     */
+    std::string serialize(const Url& url) const;
+};
+
+/**
+ * @struct HttpResponse
+ * @brief A complete response.
+ *
+ * @var HttpResponse::status
+ * The status code.
+ *
+ * @var HttpResponse::headers
+ * The response headers, in the order they were received.
+ *
+ * @var HttpResponse::body
+ * The body, decoded from the chunked transfer coding when needed.
+ *
+ * @var HttpResponse::bodyDeferred
+ * Whether the body was left unread because of `HttpRequest::deferBodyAbove`.
+ */
+struct HttpResponse {
+    int status = 0;
+    HttpHeaders headers;
+    BufferSlice body;
+    bool bodyDeferred = false;
+
+    /**
+     * @brief Returns the value of the first header named `name`, compared case-insensitively.
+     *
+     * @return The value, empty when the header is absent.
+     */
+    std::string_view header(std::string_view name) const;
+};
+
+/**
+ * @class HttpResponseParser
+ * @brief Incremental HTTP/1.1 response parser.
+ *
+ * Bytes are pushed with `feed` until `complete` returns true. Bodies with a known length are
+ * written into a single pooled buffer, which callers may fill directly through `directBuffer`
+ * instead of going through an intermediate read buffer.
+ */
+class HttpResponseParser {
+public:
+    /**
+     * @param headRequest Whether the response answers a `HEAD` request, which never has a body.
+     */
+    explicit HttpResponseParser(bool headRequest = false)
+        : headRequest(headRequest), maxBodySize(HttpRequest::defaultMaxBodySize()) {}
+
+    /**
+     * @brief Parses the response to `request`, honouring its method, body target and body size limit.
+     */
+    explicit HttpResponseParser(const HttpRequest& request)
+        : headRequest(request.method == "HEAD"), maxBodySize(request.maxBodySize),
+          deferBodyAbove(request.deferBodyAbove), bodyTarget(request.bodyTarget) {}
+
+    /**
+     * @brief Consumes bytes received from the connection.
+     *
+     * @param data Received bytes.
+     * @param size Number of received bytes.
+     * @return The number of bytes consumed. Bytes past the end of the message are left unconsumed.
+     *
+     * @throws std::runtime_error If the response is malformed or its body exceeds the size limit.
+     */
+    std::size_t feed(const char* data, std::size_t size);
+
+    /**
+     * @brief Signals that the peer closed the connection.
+     *
+     * @throws std::runtime_error If the response was not complete and its end was not delimited by
+     *                            the connection close.
+     */
+    void finish();
+
+    /**
+     * @brief Returns where the next body bytes can be received without copy, if possible.
+     *
+     * @param size Output parameter receiving the writable size, zero when direct reads are not possible.
+     * @return The destination of the next body bytes, to be committed with `commitDirect`.
+     */
+    unsigned char* directBuffer(std::size_t& size);
+
+    /**
+     * @brief Accounts for `size` bytes received into `directBuffer`.
+     */
+    void commitDirect(std::size_t size);
+
+    /**
+     * @brief Whether the response has been received entirely.
+     */
+    bool complete() const {
+        return state == State::Done;
+    }
+
+    /**
+     * @brief Whether the status line and headers have been received.
+     */
+    bool headComplete() const {
+        return state != State::Head;
+    }
+
+    /**
+     * @brief Whether the connection can carry another request once the response is complete.
+     */
+    bool keepAlive() const {
+        return reusable;
+    }
+
+    /**
+     * @brief Returns the parsed response. Only meaningful once `complete` returns true.
+     */
+    HttpResponse& response() {
+        return parsed;
+    }
+
+private:
+    enum class State {
+        Head,
+        FixedBody,
+        ChunkSize,
+        ChunkData,
+        ChunkDataEnd,
+        Trailer,
+        BodyUntilClose,
+        Done
+    };
+
+    void parseHead(std::string_view head);
+    void checkBodySize(std::size_t received, std::size_t more) const;
+    void appendBody(const char* data, std::size_t size);
+    void finishBody();
+
+    bool headRequest;
+    std::size_t maxBodySize;
+    std::size_t deferBodyAbove = 0;
+    State state = State::Head;
+    bool reusable = false;
+    std::string pending;
+    std::size_t remaining = 0;
+
+    HttpBodyTarget bodyTarget;
+    std::shared_ptr<BufferPool::Buffer> fixedBody;
+    std::size_t fixedStart = 0;
+    std::size_t fixedOffset = 0;
+    std::shared_ptr<std::vector<unsigned char>> growingBody;
+
+    HttpResponse parsed;
+};
+
+
+
+#endif //HTTPMESSAGE_H
@@ -0,0 +1,65 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef LATENCYWINDOW_H
+#define LATENCYWINDOW_H
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+/**
+ * @class LatencyWindow
+ * @brief Percentiles over the most recent latencies of one host.
+ *
+ * A fixed ring of samples: old observations fall out as new ones arrive, so the percentiles
+ * follow the current behaviour of the host. Not thread safe.
+ */
+class LatencyWindow {
+public:
+    using Duration = std::chrono::microseconds;
+
+    static constexpr std::size_t Capacity = 128;
+
+    /**
+     * @brief Records one observation, replacing the oldest when the window is full.
+     */
+    void add(Duration latency) {
+        samples[next] = latency;
+        next = (next + 1) % Capacity;
+        count = std::min(count + 1, Capacity);
+    }
+
+    /**
+     * @brief Number of observations in the window.
+     */
+    std::size_t size() const {
+        return count;
+    }
+
+    /**
+     * @brief Returns the latency below which a fraction `rank` of the observations fall.
+     *
+     * @param rank Between 0 and 1.
+     */
+    Duration percentile(double rank) const {
+        if (count == 0)
+        {
+            return Duration::zero();
+        }
+        std::array<Duration, Capacity> sorted;
+        std::copy_n(samples.begin(), count, sorted.begin());
+        const auto index = std::min(count - 1, static_cast<std::size_t>(rank * static_cast<double>(count - 1) + 0.5));
+        std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(index),
+                         sorted.begin() + static_cast<std::ptrdiff_t>(count));
+        return sorted[index];
+    }
+
+private:
+    std::array<Duration, Capacity> samples{};
+    std::size_t next = 0;
+    std::size_t count = 0;
+};
+
+#endif //LATENCYWINDOW_H
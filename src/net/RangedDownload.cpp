@@ -0,0 +1,193 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include "RangedDownload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../utils/BufferPool.h"
+
+namespace {
+
+    // Smaller ranges spend more time in request round trips than in transfers.
+    constexpr std::size_t MinChunkSize = 64 * 1024;
+
+    std::mutex defaultsMutex;
+    RangedDownload::Options defaultOptions;
+
+    struct ContentRange {
+        std::size_t first = 0;
+        std::size_t last = 0;
+        std::size_t complete = 0;
+    };
+
+    bool parseNumber(std::string_view& text, std::size_t& value)
+    {
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc() || end == text.data())
+        {
+            return false;
+        }
+        text.remove_prefix(static_cast<std::size_t>(end - text.data()));
+        return true;
+    }
+
+    /**
+     * Parses `bytes first-last/complete`. An unknown complete length (`*`) is rejected, the body
+     * could not be preallocated.
+     */
+    bool parseContentRange(std::string_view value, ContentRange& range)
+    {
+        if (!value.starts_with("bytes "))
+        {
+            return false;
+        }
+        value.remove_prefix(6);
+        if (!parseNumber(value, range.first) || !value.starts_with('-'))
+        {
+            return false;
+        }
+        value.remove_prefix(1);
+        if (!parseNumber(value, range.last) || !value.starts_with('/'))
+        {
+            return false;
+        }
+        value.remove_prefix(1);
+        return parseNumber(value, range.complete) && value.empty() && range.first <= range.last &&
+               range.last < range.complete;
+    }
+
+    std::string rangeHeader(std::size_t first, std::size_t last)
+    {
+        return "bytes=" + std::to_string(first) + "-" + std::to_string(last);
+    }
+}
+
+HttpResponse RangedDownload::get(HttpClient& client, const Url& url, Options options) {
+    if (options.parallelism <= 1)
+    {
+        return client.send(url, HttpRequest{});
+    }
+    options.chunkSize = std::max(options.chunkSize, MinChunkSize);
+
+    // Small bodies, the common case, arrive with this single request. Only a large body the server
+    // offers in ranges is left unread and fetched again in chunks.
+    HttpRequest plain;
+    plain.deferBodyAbove = options.chunkSize;
+    HttpResponse first = client.send(url, plain);
+    if (!first.bodyDeferred)
+    {
+        return first;
+    }
+
+    std::size_t total = 0;
+    std::string_view length = first.header("Content-Length");
+    if (!parseNumber(length, total) || !length.empty())
+    {
+        throw std::runtime_error("invalid content length from " + url.origin());
+    }
+    std::shared_ptr<BufferPool::Buffer> buffer = BufferPool::shared().acquire(total);
+
+    // Weak validators are not allowed in If-Range, a date is the fallback.
+    std::string validator(first.header("ETag"));
+    if (validator.empty() || validator.starts_with("W/"))
+    {
+        validator = first.header("Last-Modified");
+    }
+
+    const std::size_t count = (total + options.chunkSize - 1) / options.chunkSize;
+    std::atomic<std::size_t> nextChunk{0};
+    std::atomic<bool> failed{false};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    auto fetch = [&](std::size_t chunk) {
+        const std::size_t offset = chunk * options.chunkSize;
+        const std::size_t size = std::min(options.chunkSize, total - offset);
+
+        HttpRequest request;
+        request.headers.emplace_back("Range", rangeHeader(offset, offset + size - 1));
+        if (!validator.empty())
+        {
+            request.headers.emplace_back("If-Range", validator);
+        }
+        request.bodyTarget = {buffer, offset, size};
+        const HttpResponse response = client.send(url, request);
+
+        ContentRange received;
+        if (response.status != 206)
+        {
+            throw std::runtime_error("http status " + std::to_string(response.status) + " for range of " +
+                                     url.origin() + url.target + ", the resource may have changed");
+        }
+        if (!parseContentRange(response.header("Content-Range"), received) || received.first != offset ||
+            received.complete != total || response.body.size() != size)
+        {
+            throw std::runtime_error("inconsistent content range from " + url.origin());
+        }
+        if (response.body.data() != buffer->data() + offset)
+        {
+            std::memcpy(buffer->data() + offset, response.body.data(), size);
+        }
+    };
+
+    auto lane = [&]() {
+        for (std::size_t chunk; !failed.load(std::memory_order_relaxed) && (chunk = nextChunk++) < count;)
+        {
+            try
+            {
+                fetch(chunk);
+            }
+            catch (...)
+            {
+                std::lock_guard lock(errorMutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // Lanes block on the network, they get threads of their own rather than CPU pool workers.
+    std::vector<std::thread> lanes;
+    for (std::size_t i = 1; i < std::min(options.parallelism, count); ++i)
+    {
+        lanes.emplace_back(lane);
+    }
+    lane();
+    for (auto& thread : lanes)
+    {
+        thread.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    const unsigned char* bytes = buffer->data();
+    first.body = {std::move(buffer), bytes, total};
+    first.bodyDeferred = false;
+    return first;
+}
+
+void RangedDownload::setDefaults(Options options) {
+    std::lock_guard lock(defaultsMutex);
+    defaultOptions = options;
+}
+
+RangedDownload::Options RangedDownload::defaults() {
+    std::lock_guard lock(defaultsMutex);
+    return defaultOptions;
+}
@@ -0,0 +1,75 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef RANGEDDOWNLOAD_H
+#define RANGEDDOWNLOAD_H
+#include <cstddef>
+
+#include "HttpClient.h"
+#include "HttpMessage.h"
+#include "Url.h"
+
+/**
+ * @class RangedDownload
+ * @brief Downloads large bodies as several concurrent `Range` requests.
+ *
+ * The first request is a plain `GET`. When its answer advertises `Accept-Ranges: bytes` and a
+ * `Content-Length` larger than one chunk, the body is left unread and requested again as chunks
+ * in parallel over separate pooled connections. Every chunk is received straight into its place
+ * in one preallocated buffer, there is no reassembly copy.
+ *
+ * Small bodies and servers ignoring ranges therefore cost a single request and no extra thread.
+ * Chunks carry `If-Range` with the validator of the first answer, a resource modified during the
+ * download makes it fail instead of mixing two versions.
+ */
+class RangedDownload {
+public:
+
+    /**
+     * @struct Options
+     * @brief Tunables of ranged downloads.
+     *
+     * @var Options::chunkSize
+     * Size of every range request. Bodies not larger than this are downloaded with one request.
+     *
+     * @var Options::parallelism
+     * Number of range requests in flight at once. One disables ranged downloads.
+     */
+    struct Options {
+        std::size_t chunkSize = 8u << 20;
+        std::size_t parallelism = 4;
+    };
+
+    /**
+     * @brief Downloads `url`, splitting the body into ranges when the server supports them.
+     *
+     * @param client The client whose connections are used.
+     * @param url The resource to download.
+     * @param options Chunking tunables.
+     * @return HttpResponse The response of the first request, holding the complete body.
+     *
+     * @throws std::system_error If a connection fails or times out.
+     * @throws std::runtime_error If a range is missing, inconsistent, or the resource changed, or if the
+     *         total length exceeds `HttpRequest::maxBodySize`.
+     */
+    static HttpResponse get(HttpClient& client, const Url& url, Options options);
+
+    static HttpResponse get(HttpClient& client, const Url& url) {
+        return get(client, url, defaults());
+    }
+
+    /**
+     * @brief Changes the options used by `UrlLoad`.
+     */
+    static void setDefaults(Options options);
+
+    /**
+     * @brief Returns the options used by `UrlLoad`.
+     */
+    static Options defaults();
+};
+
+
+
+#endif //RANGEDDOWNLOAD_H
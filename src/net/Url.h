@@ -0,0 +1,132 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef URL_H
+#define URL_H
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "../utils/Uri.h"
+
+/**
+ * @struct Url
+ * @brief The parts of an `http://` or `https://` URL needed to issue a request.
+ *
+ * @var Url::tls
+ * Whether the connection must be secured (`https`).
+ *
+ * @var Url::host
+ * Host name or address, without the brackets of IPv6 literals.
+ *
+ * @var Url::port
+ * Explicit port, or the default port of the scheme.
+ *
+ * @var Url::target
+ * Path and query sent in the request line, `/` when the URL has no path.
+ */
+struct Url {
+    bool tls = false;
+    std::string host;
+    std::uint16_t port = 0;
+    std::string target;
+
+    /**
+     * @brief Returns the `host[:port]` value of the `Host` request header.
+     */
+    std::string hostHeader() const {
+        std::string value = host.find(':') != std::string::npos ? "[" + host + "]" : host;
+        if (port != (tls ? 443 : 80))
+        {
+            value += ":" + std::to_string(port);
+        }
+        return value;
+    }
+
+    /**
+     * @brief Returns the key identifying the origin, used to share connections.
+     */
+    std::string origin() const {
+        return (tls ? "https://" : "http://") + host + ":" + std::to_string(port);
+    }
+
+    /**
+     * @brief Parses an absolute `http://` or `https://` URL.
+     *
+     * @param url The URL to parse. The fragment, if any, is dropped.
+     * @return Url The parsed URL.
+     *
+     * @throws std::invalid_argument If the scheme is not http(s) or the authority is malformed.
+     */
+    static Url parse(std::string_view url) {
+        const Uri uri = Uri::parse(url);
+        if ((uri.schemeId != UriScheme::Http && uri.schemeId != UriScheme::Https) || !uri.hasAuthority)
+        {
+            throw std::invalid_argument("unsupported url scheme: " + std::string(url));
+        }
+        Url result;
+        result.tls = uri.schemeId == UriScheme::Https;
+
+        result.target.reserve(uri.path.size() + uri.query.size() + 2);
+        result.target = uri.path.empty() ? "/" : uri.path;
+        if (uri.hasQuery)
+        {
+            result.target += '?';
+            result.target += uri.query;
+        }
+
+        std::string_view authority = uri.authority;
+
+        if (const std::size_t userInfo = authority.rfind('@'); userInfo != std::string_view::npos)
+        {
+            authority.remove_prefix(userInfo + 1);
+        }
+
+        std::string_view port;
+        if (authority.starts_with('['))
+        {
+            const std::size_t close = authority.find(']');
+            if (close == std::string_view::npos)
+            {
+                throw std::invalid_argument("malformed url authority: " + std::string(authority));
+            }
+            result.host = authority.substr(1, close - 1);
+            if (close + 1 < authority.size() && authority[close + 1] == ':')
+            {
+                port = authority.substr(close + 2);
+            }
+        }
+        else
+        {
+            const std::size_t colon = authority.rfind(':');
+            result.host = authority.substr(0, colon);
+            if (colon != std::string_view::npos)
+            {
+                port = authority.substr(colon + 1);
+            }
+        }
+
+        if (result.host.empty())
+        {
+            throw std::invalid_argument("missing url host: " + std::string(authority));
+        }
+        result.port = result.tls ? 443 : 80;
+        if (!port.empty())
+        {
+            unsigned value = 0;
+            for (const char c : port)
+            {
+                if (c < '0' || c > '9' || (value = value * 10 + static_cast<unsigned>(c - '0')) > 65535)
+                {
+                    throw std::invalid_argument("malformed url port: " + std::string(port));
+                }
+            }
+            result.port = static_cast<std::uint16_t>(value);
+        }
+        return result;
+    }
+};
+
+#endif //URL_H
@@ -0,0 +1,241 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef BASE64_H
+#define BASE64_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BASE64_X86_DISPATCH 1
+#endif
+
+/**
+ * @struct Base64
+ * @brief Decodes standard base64 (RFC 4648 section 4), vectorized when the CPU allows it.
+ *
+ * The vector decoders follow Muła and Lemire ("Faster Base64 Encoding and Decoding Using AVX2
+ * Instructions"): each byte is validated and translated with two nibble-indexed table lookups,
+ * then the 6-bit values are packed with multiply-adds. They consume 32 (AVX2) or 16 (SSSE3)
+ * characters per step while the input is free of padding and invalid characters, the scalar
+ * decoder handles the rest and reports errors. The implementation is chosen once, at run time,
+ * so the build needs no instruction set flags.
+ */
+struct Base64 {
+
+    /**
+     * @brief Size of the output buffer `decode` needs for `encodedSize` characters.
+     *
+     * Includes the slack written past the decoded bytes by the vector stores.
+     */
+    static constexpr std::size_t decodedCapacity(std::size_t encodedSize) {
+        return (encodedSize + 3) / 4 * 3 + 8;
+    }
+
+    /**
+     * @brief Decodes `text` with the fastest implementation supported by the CPU.
+     *
+     * Padding is optional. No whitespace is allowed.
+     *
+     * @param text The base64 characters.
+     * @param out Receives the bytes, at least `decodedCapacity(text.size())` long.
+     * @param written Output parameter receiving the number of decoded bytes.
+     * @return false if `text` is not valid base64.
+     */
+    static bool decode(std::string_view text, unsigned char* out, std::size_t& written) {
+        static const auto implementation = select();
+        return implementation(text, out, written);
+    }
+
+    /**
+     * @brief Decodes `text` one quantum at a time, see `decode`.
+     */
+    static bool decodeScalar(std::string_view text, unsigned char* out, std::size_t& written) {
+        written = 0;
+        return decodeTail(text, out, written);
+    }
+
+#if defined(BASE64_X86_DISPATCH)
+    /**
+     * @brief Decodes `text` 16 characters per step, see `decode`. Requires SSSE3.
+     */
+    __attribute__((target("ssse3")))
+    static bool decodeSsse3(std::string_view text, unsigned char* out, std::size_t& written) {
+        const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+        const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i mask2f = _mm_set1_epi8(0x2f);
+        const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+        const char* in = text.data();
+        std::size_t read = 0;
+        written = 0;
+        while (text.size() - read >= 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + read));
+            const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(block, 4), mask2f);
+            const __m128i loNibbles = _mm_and_si128(block, mask2f);
+            const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+            const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+            if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+            {
+                break;
+            }
+            const __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(block, mask2f), hiNibbles));
+            block = _mm_add_epi8(block, roll);
+
+            const __m128i pairs = _mm_maddubs_epi16(block, _mm_set1_epi32(0x01400140));
+            const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + written), _mm_shuffle_epi8(words, pack));
+            read += 16;
+            written += 12;
+        }
+        return decodeTail(text.substr(read), out, written);
+    }
+
+    /**
+     * @brief Decodes `text` 32 characters per step, see `decode`. Requires AVX2.
+     */
+    __attribute__((target("avx2")))
+    static bool decodeAvx2(std::string_view text, unsigned char* out, std::size_t& written) {
+        const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                               0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                               0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                               0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+        const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                               0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                               0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                               0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i mask2f = _mm256_set1_epi8(0x2f);
+        const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+        const char* in = text.data();
+        std::size_t read = 0;
+        written = 0;
+        while (text.size() - read >= 32)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + read));
+            const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(block, 4), mask2f);
+            const __m256i loNibbles = _mm256_and_si256(block, mask2f);
+            const __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+            const __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+            if (!_mm256_testz_si256(lo, hi))
+            {
+                break;
+            }
+            const __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(block, mask2f), hiNibbles));
+            block = _mm256_add_epi8(block, roll);
+
+            const __m256i pairs = _mm256_maddubs_epi16(block, _mm256_set1_epi32(0x01400140));
+            const __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+            // Each lane holds 12 bytes, moving them next to each other leaves 24 contiguous bytes.
+            const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(words, pack), lanes);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + written), packed);
+            read += 32;
+            written += 24;
+        }
+        return decodeTail(text.substr(read), out, written);
+    }
+#endif
+
+private:
+    using Decoder = bool (*)(std::string_view, unsigned char*, std::size_t&);
+
+    static constexpr std::uint8_t Invalid = 0xff;
+
+    static Decoder select() {
+#if defined(BASE64_X86_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return decodeAvx2;
+        }
+        if (__builtin_cpu_supports("ssse3"))
+        {
+            return decodeSsse3;
+        }
+#endif
+        return decodeScalar;
+    }
+
+    static constexpr std::array<std::uint8_t, 256> makeValues() {
+        std::array<std::uint8_t, 256> values{};
+        values.fill(Invalid);
+        constexpr std::string_view Alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (std::size_t i = 0; i < Alphabet.size(); ++i)
+        {
+            values[static_cast<unsigned char>(Alphabet[i])] = static_cast<std::uint8_t>(i);
+        }
+        return values;
+    }
+
+    // Decodes the end of the input, appending after the `written` bytes already decoded.
+    static bool decodeTail(std::string_view text, unsigned char* out, std::size_t& written) {
+        static constexpr std::array<std::uint8_t, 256> Values = makeValues();
+
+        if (text.ends_with("=="))
+        {
+            text.remove_suffix(2);
+        }
+        else if (text.ends_with('='))
+        {
+            text.remove_suffix(1);
+        }
+        // A single character left over cannot encode a byte.
+        if (text.size() % 4 == 1)
+        {
+            return false;
+        }
+
+        const auto* in = reinterpret_cast<const unsigned char*>(text.data());
+        std::size_t read = 0;
+        for (; text.size() - read >= 4; read += 4)
+        {
+            const std::uint32_t a = Values[in[read]];
+            const std::uint32_t b = Values[in[read + 1]];
+            const std::uint32_t c = Values[in[read + 2]];
+            const std::uint32_t d = Values[in[read + 3]];
+            if (((a | b | c | d) & 0xc0) != 0)
+            {
+                return false;
+            }
+            const std::uint32_t bits = a << 18 | b << 12 | c << 6 | d;
+            out[written++] = static_cast<unsigned char>(bits >> 16);
+            out[written++] = static_cast<unsigned char>(bits >> 8);
+            out[written++] = static_cast<unsigned char>(bits);
+        }
+
+        std::uint32_t bits = 0;
+        const std::size_t left = text.size() - read;
+        for (std::size_t i = 0; i < left; ++i)
+        {
+            const std::uint32_t value = Values[in[read + i]];
+            if (value == Invalid)
+            {
+                return false;
+            }
+            bits |= value << (18 - 6 * i);
+        }
+        if (left >= 2)
+        {
+            out[written++] = static_cast<unsigned char>(bits >> 16);
+        }
+        if (left == 3)
+        {
+            out[written++] = static_cast<unsigned char>(bits >> 8);
+        }
+        return true;
+    }
+};
+
+#endif //BASE64_H
@@ -0,0 +1,133 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @class BufferPool
+ * @brief A process wide pool of heap buffers grouped in power of two size classes.
+ *
+ * Actions producing byte payloads (file reads, decompression output...) acquire their storage
+ * here instead of allocating a fresh vector each time. The returned buffer is handed out through
+ * a `shared_ptr` whose deleter gives the vector back to the pool, so it naturally returns once
+ * the last `BufferSlice` referring to it is destroyed. Buffers are never zero-filled, and the pool
+ * keeps at most `MaxRetainedBytes` of idle buffers, larger releases are freed.
+ */
+class BufferPool {
+public:
+    /**
+     * @brief Allocator default-initializing the elements a vector grows by, which leaves bytes uninitialized.
+     */
+    template <typename T>
+    struct UninitializedAllocator : std::allocator<T> {
+        using value_type = T;
+
+        UninitializedAllocator() = default;
+
+        template <typename U>
+        UninitializedAllocator(const UninitializedAllocator<U>&) noexcept {}
+
+        template <typename U>
+        void construct(U* element) noexcept(std::is_nothrow_default_constructible_v<U>) {
+            ::new (static_cast<void*>(element)) U;
+        }
+
+        template <typename U, typename... Args>
+        void construct(U* element, Args&&... args) {
+            ::new (static_cast<void*>(element)) U(std::forward<Args>(args)...);
+        }
+    };
+
+    using Buffer = std::vector<unsigned char, UninitializedAllocator<unsigned char>>;
+
+    /**
+     * @brief Total capacity of the idle buffers the pool keeps for reuse.
+     */
+    static constexpr std::size_t MaxRetainedBytes = std::size_t{256} << 20;
+
+    /**
+     * @brief Returns the pool shared by the whole process.
+     */
+    static BufferPool& shared() {
+        static BufferPool pool;
+        return pool;
+    }
+
+    /**
+     * @brief Acquires a buffer of exactly `size` bytes.
+     *
+     * The buffer capacity is rounded up to the size class, so it can later be grown up to that
+     * capacity without reallocating. Contents are unspecified.
+     *
+     * @param size Requested size in bytes.
+     * @return A shared buffer that returns to the pool when released.
+     */
+    std::shared_ptr<Buffer> acquire(std::size_t size) {
+        const std::size_t sizeClass = classOf(size);
+        Buffer* buffer = nullptr;
+        if (sizeClass < ClassCount)
+        {
+            std::lock_guard lock(state->mutex);
+            auto& freeList = state->free[sizeClass];
+            if (!freeList.empty())
+            {
+                buffer = freeList.back().release();
+                freeList.pop_back();
+                state->retainedBytes -= buffer->capacity();
+            }
+        }
+        if (buffer == nullptr)
+        {
+            buffer = new Buffer();
+            buffer->reserve(sizeClass < ClassCount ? std::size_t{1} << (sizeClass + MinClassBits) : size);
+        }
+        buffer->resize(size);
+
+        return {buffer, [state = state](Buffer* released) {
+            const std::size_t releasedClass = classOf(released->capacity());
+            std::unique_ptr<Buffer> owned(released);
+            if (releasedClass >= ClassCount || (std::size_t{1} << (releasedClass + MinClassBits)) != owned->capacity())
+            {
+                return;
+            }
+            std::lock_guard lock(state->mutex);
+            auto& freeList = state->free[releasedClass];
+            if (freeList.size() < MaxBuffersPerClass && state->retainedBytes + owned->capacity() <= MaxRetainedBytes)
+            {
+                state->retainedBytes += owned->capacity();
+                freeList.push_back(std::move(owned));
+            }
+        }};
+    }
+
+private:
+    // Size classes go from 4 KiB up to 64 MiB, larger requests are plain allocations.
+    static constexpr std::size_t MinClassBits = 12;
+    static constexpr std::size_t ClassCount = 15;
+    static constexpr std::size_t MaxBuffersPerClass = 16;
+
+    struct State {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Buffer>> free[ClassCount];
+        std::size_t retainedBytes = 0;
+    };
+
+    static std::size_t classOf(std::size_t size) {
+        const std::size_t rounded = std::bit_ceil(size < (std::size_t{1} << MinClassBits) ? std::size_t{1} << MinClassBits : size);
+        return static_cast<std::size_t>(std::countr_zero(rounded)) - MinClassBits;
+    }
+
+    std::shared_ptr<State> state = std::make_shared<State>();
+};
+
+#endif //BUFFERPOOL_H
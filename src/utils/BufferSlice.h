@@ -0,0 +1,100 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef BUFFERSLICE_H
+#define BUFFERSLICE_H
+#include <any>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+/**
+ * @file BufferSlice.h
+ * @brief A reference counted, read-only view over bytes owned by someone else.
+ *
+ * Actions pass their output to the next action through `ActionResult::data`. Large payloads
+ * (memory mapped files, pooled read buffers, bundle entries...) must not be copied along the
+ * way, so they travel as a `BufferSlice`: a pointer/size pair plus a shared owner that keeps the
+ * backing storage alive for as long as any slice refers to it. Copying a slice only bumps the
+ * reference count.
+ */
+
+ /**
+    * @struct BufferSlice
+    * @brief A cheap to copy, ref-counted window into an immutable byte buffer.
+    *
+    * @var BufferSlice::owner
+    * Keeps the backing storage (mapping, pooled vector, string...) alive. May be null for slices
+    * over static storage.
+    *
+    * @var BufferSlice::bytes
+    * First byte of the slice.
+    *
+    * @var BufferSlice::length
+    * Number of bytes in the slice.
+    */
+struct BufferSlice {
+    std::shared_ptr<const void> owner;
+    const unsigned char* bytes = nullptr;
+    std::size_t length = 0;
+
+    BufferSlice() = default;
+
+    BufferSlice(std::shared_ptr<const void> owner, const void* bytes, std::size_t length)
+        : owner(std::move(owner)), bytes(static_cast<const unsigned char*>(bytes)), length(length) {}
+
+    const unsigned char* data() const {
+        return bytes;
+    }
+
+    std::size_t size() const {
+        return length;
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    const unsigned char* begin() const {
+        return bytes;
+    }
+
+    const unsigned char* end() const {
+        return bytes + length;
+    }
+
+    std::string_view view() const {
+        return {reinterpret_cast<const char*>(bytes), length};
+    }
+
+    /**
+     * @brief Returns a sub range of this slice sharing the same owner.
+     *
+     * @param offset Offset of the first byte, clamped to the slice size.
+     * @param count Maximum number of bytes of the sub range.
+     */
+    BufferSlice subslice(std::size_t offset, std::size_t count = static_cast<std::size_t>(-1)) const {
+        if (offset > length)
+        {
+            offset = length;
+        }
+        if (count > length - offset)
+        {
+            count = length - offset;
+        }
+        return {owner, bytes + offset, count};
+    }
+
+    /**
+     * @brief Extracts a slice from an action result payload.
+     *
+     * @param data The `ActionResult::data` of a previous action.
+     * @return A pointer to the slice, or nullptr when the payload is not a `BufferSlice`.
+     */
+    static const BufferSlice* fromAny(const std::any& data) {
+        return std::any_cast<BufferSlice>(&data);
+    }
+};
+
+#endif //BUFFERSLICE_H
@@ -0,0 +1,273 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CHECKSUM_X86_DISPATCH 1
+#endif
+
+/**
+ * @struct Checksum
+ * @brief CRC-32 (gzip, ISO 3309) and Adler-32 (zlib) checksums, vectorized when the CPU allows it.
+ *
+ * Both are computed incrementally like their zlib counterparts: start from `Crc32Initial` or
+ * `Adler32Initial` and pass the running value along with each piece of data.
+ *
+ * The CRC-32 kernel folds 64 bytes per step with carry-less multiplications (PCLMULQDQ) and
+ * reduces the remainder with a Barrett reduction, after Gopal et al. ("Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction"). The Adler-32 kernel sums 32 bytes per step
+ * with AVX2, weighting them with multiply-adds, and takes the modulo once per 5536 bytes. The
+ * scalar fallbacks are slicing-by-8 and an eight bytes wide sum. Implementations are chosen once,
+ * at run time, so the build needs no instruction set flags.
+ */
+struct Checksum {
+
+    static constexpr std::uint32_t Crc32Initial = 0;
+    static constexpr std::uint32_t Adler32Initial = 1;
+
+    /**
+     * @brief Extends the CRC-32 `crc` of the preceding data with `size` bytes.
+     */
+    static std::uint32_t crc32(std::uint32_t crc, const unsigned char* data, std::size_t size) {
+        static const auto implementation = selectCrc32();
+        return implementation(crc, data, size);
+    }
+
+    /**
+     * @brief Extends the Adler-32 `adler` of the preceding data with `size` bytes.
+     */
+    static std::uint32_t adler32(std::uint32_t adler, const unsigned char* data, std::size_t size) {
+        static const auto implementation = selectAdler32();
+        return implementation(adler, data, size);
+    }
+
+    /**
+     * @brief Computes a CRC-32 eight bytes per step, see `crc32`.
+     */
+    static std::uint32_t crc32Scalar(std::uint32_t crc, const unsigned char* data, std::size_t size) {
+        const Crc32Tables& Tables = crc32Tables();
+
+        std::uint32_t c = ~crc;
+        for (; size >= 8; data += 8, size -= 8)
+        {
+            const std::uint32_t low = c ^ (data[0] | data[1] << 8 | data[2] << 16 | static_cast<std::uint32_t>(data[3]) << 24);
+            const std::uint32_t high = data[4] | data[5] << 8 | data[6] << 16 | static_cast<std::uint32_t>(data[7]) << 24;
+            c = Tables[7][low & 0xff] ^ Tables[6][low >> 8 & 0xff] ^ Tables[5][low >> 16 & 0xff] ^ Tables[4][low >> 24] ^
+                Tables[3][high & 0xff] ^ Tables[2][high >> 8 & 0xff] ^ Tables[1][high >> 16 & 0xff] ^ Tables[0][high >> 24];
+        }
+        for (; size != 0; ++data, --size)
+        {
+            c = Tables[0][(c ^ *data) & 0xff] ^ c >> 8;
+        }
+        return ~c;
+    }
+
+    /**
+     * @brief Computes an Adler-32 eight bytes per step, see `adler32`.
+     */
+    static std::uint32_t adler32Scalar(std::uint32_t adler, const unsigned char* data, std::size_t size) {
+        std::uint32_t a = adler & 0xffff;
+        std::uint32_t b = adler >> 16;
+        while (size != 0)
+        {
+            const std::size_t length = std::min(size, AdlerMaxRun);
+            size -= length;
+            std::size_t i = 0;
+            for (; i + 8 <= length; i += 8)
+            {
+                // Eight bytes at once: b gains eight times a plus the bytes weighted by 8 down to 1.
+                const unsigned char* bytes = data + i;
+                b += 8 * a + 8 * bytes[0] + 7 * bytes[1] + 6 * bytes[2] + 5 * bytes[3] + 4 * bytes[4] +
+                     3 * bytes[5] + 2 * bytes[6] + bytes[7];
+                a += bytes[0] + bytes[1] + bytes[2] + bytes[3] + bytes[4] + bytes[5] + bytes[6] + bytes[7];
+            }
+            for (; i < length; ++i)
+            {
+                a += data[i];
+                b += a;
+            }
+            data += length;
+            a %= AdlerBase;
+            b %= AdlerBase;
+        }
+        return b << 16 | a;
+    }
+
+#if defined(CHECKSUM_X86_DISPATCH)
+    /**
+     * @brief Computes a CRC-32 64 bytes per step, see `crc32`. Requires PCLMULQDQ and SSE4.1.
+     */
+    __attribute__((target("pclmul,sse4.1")))
+    static std::uint32_t crc32Pclmul(std::uint32_t crc, const unsigned char* data, std::size_t size) {
+        if (size < 64)
+        {
+            return crc32Scalar(crc, data, size);
+        }
+        // Folding constants x^(4*128+32), x^(4*128-32), x^(128+32), x^(128-32) and x^64 modulo the
+        // reflected polynomial, then the polynomial itself and its Barrett constant.
+        const __m128i fold4 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+        const __m128i fold1 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+        const __m128i fold64 = _mm_set_epi64x(0, 0x0163cd6124);
+        const __m128i barrett = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+        const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+        auto load = [](const unsigned char* bytes) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+        };
+
+        __m128i x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(static_cast<int>(~crc)));
+        __m128i x2 = load(data + 16);
+        __m128i x3 = load(data + 32);
+        __m128i x4 = load(data + 48);
+        data += 64;
+        size -= 64;
+        for (; size >= 64; data += 64, size -= 64)
+        {
+            x1 = crc32Fold(x1, fold4, load(data));
+            x2 = crc32Fold(x2, fold4, load(data + 16));
+            x3 = crc32Fold(x3, fold4, load(data + 32));
+            x4 = crc32Fold(x4, fold4, load(data + 48));
+        }
+
+        x1 = crc32Fold(x1, fold1, x2);
+        x1 = crc32Fold(x1, fold1, x3);
+        x1 = crc32Fold(x1, fold1, x4);
+        for (; size >= 16; data += 16, size -= 16)
+        {
+            x1 = crc32Fold(x1, fold1, load(data));
+        }
+
+        // 128 bits to 64, then the Barrett reduction to 32.
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, fold1, 0x10));
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 4), _mm_clmulepi64_si128(_mm_and_si128(x1, low32), fold64, 0x00));
+        __m128i quotient = _mm_clmulepi64_si128(_mm_and_si128(x1, low32), barrett, 0x10);
+        quotient = _mm_clmulepi64_si128(_mm_and_si128(quotient, low32), barrett, 0x00);
+        x1 = _mm_xor_si128(x1, quotient);
+
+        const std::uint32_t folded = ~static_cast<std::uint32_t>(_mm_extract_epi32(x1, 1));
+        return crc32Scalar(folded, data, size);
+    }
+
+    /**
+     * @brief Computes an Adler-32 32 bytes per step, see `adler32`. Requires AVX2.
+     */
+    __attribute__((target("avx2")))
+    static std::uint32_t adler32Avx2(std::uint32_t adler, const unsigned char* data, std::size_t size) {
+        const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                                 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+        const __m256i ones = _mm256_set1_epi16(1);
+        const __m256i zero = _mm256_setzero_si256();
+        std::uint32_t a = adler & 0xffff;
+        std::uint32_t b = adler >> 16;
+        while (size >= 32)
+        {
+            std::size_t blocks = std::min(size, AdlerMaxRun) / 32;
+            size -= blocks * 32;
+            // `a` grows by each block sum, `b` by 32 times `a` before the block plus the weighted bytes.
+            __m256i sumA = _mm256_setr_epi32(static_cast<int>(a), 0, 0, 0, 0, 0, 0, 0);
+            __m256i sumB = _mm256_setr_epi32(static_cast<int>(b), 0, 0, 0, 0, 0, 0, 0);
+            __m256i previousA = zero;
+            do
+            {
+                const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+                previousA = _mm256_add_epi32(previousA, sumA);
+                sumA = _mm256_add_epi32(sumA, _mm256_sad_epu8(bytes, zero));
+                sumB = _mm256_add_epi32(sumB, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+                data += 32;
+            }
+            while (--blocks != 0);
+            sumB = _mm256_add_epi32(sumB, _mm256_slli_epi32(previousA, 5));
+            a = adler32Sum(sumA) % AdlerBase;
+            b = adler32Sum(sumB) % AdlerBase;
+        }
+        return adler32Scalar(b << 16 | a, data, size);
+    }
+#endif
+
+private:
+    using Function = std::uint32_t (*)(std::uint32_t, const unsigned char*, std::size_t);
+
+    static constexpr std::uint32_t AdlerBase = 65521;
+
+    // Bytes summed before `b` may overflow 32 bits (zlib's NMAX), rounded down to the vector step.
+    static constexpr std::size_t AdlerMaxRun = 5552 / 32 * 32;
+
+    static Function selectCrc32() {
+#if defined(CHECKSUM_X86_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+        {
+            return crc32Pclmul;
+        }
+#endif
+        return crc32Scalar;
+    }
+
+    static Function selectAdler32() {
+#if defined(CHECKSUM_X86_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return adler32Avx2;
+        }
+#endif
+        return adler32Scalar;
+    }
+
+#if defined(CHECKSUM_X86_DISPATCH)
+    // Multiplies both halves of `value` by their folding constant and adds the next 16 bytes.
+    __attribute__((target("pclmul,sse4.1")))
+    static __m128i crc32Fold(__m128i value, __m128i constants, __m128i next) {
+        const __m128i low = _mm_clmulepi64_si128(value, constants, 0x00);
+        const __m128i high = _mm_clmulepi64_si128(value, constants, 0x11);
+        return _mm_xor_si128(_mm_xor_si128(high, low), next);
+    }
+
+    __attribute__((target("avx2")))
+    static std::uint32_t adler32Sum(const __m256i& lanes) {
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(lanes), _mm256_extracti128_si256(lanes, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+        return static_cast<std::uint32_t>(_mm_cvtsi128_si32(half));
+    }
+#endif
+
+    using Crc32Tables = std::array<std::array<std::uint32_t, 256>, 8>;
+
+    // Entry n of table t is the CRC of byte n followed by t zero bytes.
+    static constexpr Crc32Tables makeCrc32Tables() {
+        Crc32Tables tables{};
+        for (std::uint32_t n = 0; n < 256; ++n)
+        {
+            std::uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) != 0 ? 0xedb88320u ^ c >> 1 : c >> 1;
+            }
+            tables[0][n] = c;
+        }
+        for (std::size_t t = 1; t < 8; ++t)
+        {
+            for (std::size_t n = 0; n < 256; ++n)
+            {
+                tables[t][n] = tables[t - 1][n] >> 8 ^ tables[0][tables[t - 1][n] & 0xff];
+            }
+        }
+        return tables;
+    }
+
+    static const Crc32Tables& crc32Tables() {
+        static constexpr Crc32Tables Tables = makeCrc32Tables();
+        return Tables;
+    }
+};
+
+#endif //CHECKSUM_H
@@ -0,0 +1,58 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef CHUNKSTREAM_H
+#define CHUNKSTREAM_H
+#include <any>
+#include <cstddef>
+#include <memory>
+
+#include "BufferSlice.h"
+
+/**
+ * @class ChunkStream
+ * @brief A payload delivered as a sequence of slices instead of one contiguous buffer.
+ *
+ * Payloads too large to be held at once travel through `ActionResult::data` as a
+ * `std::shared_ptr<ChunkStream>`. The consumer pulls chunks one at a time and can start working on
+ * the first one while the rest is still being read, releasing each chunk as soon as it is done with
+ * it keeps the memory footprint bounded.
+ */
+class ChunkStream {
+public:
+    virtual ~ChunkStream() = default;
+
+    /**
+     * @brief Produces the next chunk of the payload.
+     *
+     * @param chunk Output parameter receiving the chunk.
+     * @return true if a chunk was produced, false once the payload is exhausted.
+     *
+     * @throws std::system_error If the underlying source fails.
+     */
+    virtual bool next(BufferSlice& chunk) = 0;
+
+    /**
+     * @brief Returns the total payload size in bytes, or zero when it is not known up front.
+     */
+    virtual std::size_t sizeHint() const {
+        return 0;
+    }
+
+    /**
+     * @brief Extracts a stream from an action result payload.
+     *
+     * @param data The `ActionResult::data` of a previous action.
+     * @return The stream, or nullptr when the payload is not a `ChunkStream`.
+     */
+    static std::shared_ptr<ChunkStream> fromAny(const std::any& data) {
+        if (const auto* stream = std::any_cast<std::shared_ptr<ChunkStream>>(&data))
+        {
+            return *stream;
+        }
+        return nullptr;
+    }
+};
+
+#endif //CHUNKSTREAM_H
@@ -0,0 +1,59 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef CONTENTTYPE_H
+#define CONTENTTYPE_H
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+/**
+ * @file ContentType.h
+ * @brief Guesses which action should process a loaded payload by looking at its first bytes.
+ */
+
+ /**
+    * @brief Returns the metadata type of the action able to process `bytes`.
+    *
+    * - "decompress" for gzip, zlib, zstd, xz and lz4 framed data.
+    * - "image" for PNG, JPEG, GIF, WebP and BMP.
+    * - "json" when the first non blank character opens an object or an array.
+    *
+    * @param bytes First bytes of the payload.
+    * @param size Number of available bytes.
+    * @return std::string The metadata type, empty when the content is not recognized.
+    */
+inline std::string sniffContentType(const unsigned char* bytes, std::size_t size) {
+    auto startsWith = [&](const char* magic, std::size_t length, std::size_t offset = 0) {
+        return size >= offset + length && std::memcmp(bytes + offset, magic, length) == 0;
+    };
+
+    if (startsWith("\x1f\x8b", 2) || startsWith("\x28\xb5\x2f\xfd", 4) ||
+        startsWith("\xfd\x37\x7a\x58\x5a\x00", 6) || startsWith("\x04\x22\x4d\x18", 4) ||
+        (size >= 2 && (bytes[0] & 0x0f) == 8 && ((bytes[0] << 8) | bytes[1]) % 31 == 0))
+    {
+        return "decompress";
+    }
+    if (startsWith("\x89PNG\r\n\x1a\n", 8) || startsWith("\xff\xd8\xff", 3) || startsWith("GIF8", 4) ||
+        (startsWith("RIFF", 4) && startsWith("WEBP", 4, 8)) || startsWith("BM", 2))
+    {
+        return "image";
+    }
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        const unsigned char c = bytes[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            continue;
+        }
+        if (c == '{' || c == '[')
+        {
+            return "json";
+        }
+        break;
+    }
+    return {};
+}
+
+#endif //CONTENTTYPE_H
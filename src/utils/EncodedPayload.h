@@ -0,0 +1,58 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef ENCODEDPAYLOAD_H
+#define ENCODEDPAYLOAD_H
+#include <any>
+#include <cstddef>
+#include <cstdint>
+
+#include "BufferSlice.h"
+
+/**
+ * @brief Compression formats known to the pipeline.
+ *
+ * The values are persisted in bundles (see `BundleFormat.h`), they must never change.
+ */
+enum class Codec : std::uint8_t {
+    Raw = 0,
+    Deflate = 1,
+    Brotli = 2,
+    Lzma = 3,
+    Zstd = 4,
+    Lz4 = 5
+};
+
+/**
+ * @struct EncodedPayload
+ * @brief Compressed bytes whose format and decoded size are known up front.
+ *
+ * Some sources record how their content was encoded (bundle entries for instance). They hand the
+ * bytes to `DataDecompressor` as an `EncodedPayload`, so it neither has to guess the format nor
+ * grow its output buffer: `decodedSize` bytes can be allocated at once.
+ *
+ * @var EncodedPayload::encoded
+ * The compressed bytes.
+ *
+ * @var EncodedPayload::codec
+ * Format of `encoded`, a zlib stream for `Codec::Deflate`, an xz stream for `Codec::Lzma` and an lz4
+ * frame for `Codec::Lz4`.
+ *
+ * @var EncodedPayload::decodedSize
+ * Size of the content once decoded.
+ */
+struct EncodedPayload {
+    BufferSlice encoded;
+    Codec codec = Codec::Raw;
+    std::size_t decodedSize = 0;
+
+    /**
+     * @brief Returns the payload held by an action result data, or null when it holds something else.
+     */
+    static const EncodedPayload* fromAny(const std::any& data) {
+        return std::any_cast<EncodedPayload>(&data);
+    }
+};
+
+#endif //ENCODEDPAYLOAD_H
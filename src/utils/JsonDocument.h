@@ -0,0 +1,845 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef JSONDOCUMENT_H
+#define JSONDOCUMENT_H
+#include <algorithm>
+#include <any>
+#include <array>
+#include <cfloat>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "BufferSlice.h"
+#include "JsonIndex.h"
+
+/**
+ * @class JsonDocument
+ * @brief A parsed JSON document (RFC 8259), stored as a tape.
+ *
+ * `parse` runs in two stages. `JsonIndex` first finds the structural characters with vector
+ * kernels, then a single pass over that index checks the grammar and appends every value to the
+ * tape: one 64-bit word per value holding its type and payload, a second word for numbers.
+ * Objects and arrays are delimited by a start and an end word, the start word recording where the
+ * end is, so skipping a container costs one read whatever its size. Strings without escapes are
+ * referenced in place in the text, the others are unescaped into a separate buffer.
+ *
+ * Values are read through `Value`, a lightweight cursor into the tape. The text must be valid
+ * UTF-8, which the index checks; its sequences are then copied as they are.
+ */
+class JsonDocument {
+public:
+
+    /**
+     * @brief Type of a JSON value. Integers are `Int64`, or `Uint64` past the range of `int64_t`,
+     *        other numbers `Double`.
+     */
+    enum class Type : std::uint8_t {
+        Null,
+        True,
+        False,
+        Int64,
+        Uint64,
+        Double,
+        String,
+        Array,
+        Object
+    };
+
+    /**
+     * @brief Containers nested deeper than this are rejected.
+     */
+    static constexpr std::size_t MaxDepth = 1024;
+
+    /**
+     * @class Value
+     * @brief A value of the document, valid as long as the document is.
+     *
+     * Accessors of another type than the value's throw `std::invalid_argument`.
+     */
+    class Value {
+    public:
+        Type type() const {
+            return static_cast<Type>(word() >> 56);
+        }
+
+        bool boolean() const {
+            require(type() == Type::True || type() == Type::False, "a boolean");
+            return type() == Type::True;
+        }
+
+        std::int64_t int64() const {
+            require(type() == Type::Int64, "an int64");
+            return static_cast<std::int64_t>(document->storage->tape[index + 1]);
+        }
+
+        std::uint64_t uint64() const {
+            require(type() == Type::Uint64 || (type() == Type::Int64 && int64() >= 0), "an uint64");
+            return document->storage->tape[index + 1];
+        }
+
+        /**
+         * @brief The value of any number, rounded when it is an integer `double` cannot hold.
+         */
+        double number() const {
+            switch (type())
+            {
+            case Type::Int64:
+                return static_cast<double>(int64());
+            case Type::Uint64:
+                return static_cast<double>(uint64());
+            case Type::Double:
+            {
+                double value;
+                std::memcpy(&value, &document->storage->tape[index + 1], sizeof(value));
+                return value;
+            }
+            default:
+                require(false, "a number");
+                return 0;
+            }
+        }
+
+        std::string_view string() const {
+            require(type() == Type::String, "a string");
+            return document->stringAt(word() & PayloadMask);
+        }
+
+        /**
+         * @brief Number of members of an object or elements of an array.
+         */
+        std::size_t size() const {
+            require(type() == Type::Array || type() == Type::Object, "a container");
+            return (word() & PayloadMask) >> 32;
+        }
+
+        /**
+         * @brief Calls `visit(Value)` for every element of an array, in order.
+         */
+        template <class Visitor>
+        void forEachElement(Visitor&& visit) const {
+            require(type() == Type::Array, "an array");
+            for (std::size_t at = index + 1, end = endIndex(); at < end; at = Value{document, at}.next())
+            {
+                visit(Value{document, at});
+            }
+        }
+
+        /**
+         * @brief Calls `visit(std::string_view key, Value)` for every member of an object, in order.
+         */
+        template <class Visitor>
+        void forEachMember(Visitor&& visit) const {
+            require(type() == Type::Object, "an object");
+            for (std::size_t at = index + 1, end = endIndex(); at < end;)
+            {
+                const Value value{document, at + 1};
+                visit(Value{document, at}.string(), value);
+                at = value.next();
+            }
+        }
+
+        /**
+         * @brief Looks up the first member named `key` of an object.
+         *
+         * @return true if the object has such a member, `member` then receives it.
+         */
+        bool find(std::string_view key, Value& member) const {
+            require(type() == Type::Object, "an object");
+            for (std::size_t at = index + 1, end = endIndex(); at < end;)
+            {
+                const Value value{document, at + 1};
+                if (Value{document, at}.string() == key)
+                {
+                    member = value;
+                    return true;
+                }
+                at = value.next();
+            }
+            return false;
+        }
+
+    private:
+        friend class JsonDocument;
+
+        Value(const JsonDocument* document, std::size_t index) : document(document), index(index) {}
+
+        std::uint64_t word() const {
+            return document->storage->tape[index];
+        }
+
+        std::size_t endIndex() const {
+            return static_cast<std::uint32_t>(word());
+        }
+
+        // Index of the value following this one.
+        std::size_t next() const {
+            switch (type())
+            {
+            case Type::Int64:
+            case Type::Uint64:
+            case Type::Double:
+                return index + 2;
+            case Type::Array:
+            case Type::Object:
+                return endIndex() + 1;
+            default:
+                return index + 1;
+            }
+        }
+
+        static void require(bool condition, const char* what) {
+            if (!condition)
+            {
+                throw std::invalid_argument(std::string("json value is not ") + what);
+            }
+        }
+
+        const JsonDocument* document;
+        std::size_t index;
+    };
+
+    /**
+     * @brief Parses `text` into a document holding on to it.
+     *
+     * @throws std::invalid_argument If `text` is not a single valid JSON value, with the offset of
+     *         the error.
+     */
+    static JsonDocument parse(BufferSlice text) {
+        JsonDocument document;
+        document.source = std::move(text);
+        auto storage = std::make_shared<Storage>();
+        Parser parser{*storage, document.source.data(), document.source.size()};
+        parser.run();
+        document.storage = std::move(storage);
+        return document;
+    }
+
+    /**
+     * @brief The root value.
+     */
+    Value root() const {
+        return {this, 0};
+    }
+
+    /**
+     * @brief The parsed text.
+     */
+    const BufferSlice& text() const {
+        return source;
+    }
+
+    /**
+     * @brief Extracts a document from an action result payload.
+     *
+     * @param data The `ActionResult::data` of a previous action.
+     * @return A pointer to the document, or nullptr when the payload is not a `JsonDocument`.
+     */
+    static const JsonDocument* fromAny(const std::any& data) {
+        return std::any_cast<JsonDocument>(&data);
+    }
+
+private:
+    // The tape and the unescaped strings, shared by the copies of a document.
+    struct Storage {
+        std::unique_ptr<std::uint64_t[]> tape;
+        std::string strings;
+    };
+
+    JsonDocument() = default;
+
+    static constexpr std::uint64_t PayloadMask = (std::uint64_t{1} << 56) - 1;
+
+    // String words: the offset of the characters in the text in the low 32 bits and their length
+    // above, or with `Unescaped` set, the offset of the length-prefixed string in `strings`.
+    static constexpr std::uint64_t Unescaped = std::uint64_t{1} << 55;
+    static constexpr std::size_t MaxInPlaceLength = (std::size_t{1} << 23) - 1;
+
+    // Tape tags closing containers, after those of `Type`.
+    static constexpr std::uint64_t ArrayEnd = 9;
+    static constexpr std::uint64_t ObjectEnd = 10;
+
+    static std::uint64_t tag(Type type) {
+        return static_cast<std::uint64_t>(type) << 56;
+    }
+
+    std::string_view stringAt(std::uint64_t payload) const {
+        if ((payload & Unescaped) == 0)
+        {
+            return {reinterpret_cast<const char*>(source.data()) + static_cast<std::uint32_t>(payload),
+                    static_cast<std::size_t>(payload >> 32)};
+        }
+        const std::size_t offset = payload & ~Unescaped;
+        std::uint32_t length;
+        const char* string = storage->strings.data() + offset;
+        std::memcpy(&length, string, sizeof(length));
+        return {string + sizeof(length), length};
+    }
+
+    struct Parser {
+        Storage& storage;
+        const unsigned char* json;
+        std::size_t size;
+        const JsonIndex* structurals = nullptr;
+        // The tape is allocated once for the whole document, `out` is where the next word goes.
+        std::uint64_t* tape = nullptr;
+        std::uint64_t* out = nullptr;
+
+        // An open container: where its start word is and how many values it holds so far.
+        struct Open {
+            std::size_t start;
+            std::uint64_t values;
+            bool object;
+        };
+
+        [[noreturn]] void fail(const char* what, std::size_t offset) const {
+            throw std::invalid_argument(std::string(what) + " at offset " + std::to_string(offset) + " of json document");
+        }
+
+        // The structural index is scratch space, each thread keeps its storage from document to document.
+        static JsonIndex& index() {
+            thread_local JsonIndex index;
+            return index;
+        }
+
+        // The cursor in the index and the open containers are locals: words are written through
+        // `std::uint64_t` pointers, which may alias any member of the same type.
+        void run() {
+            JsonIndex& built = index();
+            if (!built.build(json, size))
+            {
+                failIndex();
+            }
+            structurals = &built;
+            const std::uint32_t* next = built.positions();
+            const std::uint32_t* const end = next + built.size();
+
+            // A number takes two words, but unless it ends a container or the document a comma, which
+            // takes none, follows it. The tape holds at most a word per structural character, plus one
+            // per container, made of two of them, plus one.
+            storage.tape = std::make_unique_for_overwrite<std::uint64_t[]>(built.size() + built.size() / 2 + 2);
+            tape = storage.tape.get();
+            out = tape;
+
+            std::array<Open, MaxDepth> open;
+            std::size_t depth = 0;
+            enum class Expect { Value, Key, After } expect = Expect::Value;
+            for (;;)
+            {
+                if (expect == Expect::After)
+                {
+                    if (depth == 0)
+                    {
+                        if (next != end)
+                        {
+                            fail("unexpected content after json document", *next);
+                        }
+                        return;
+                    }
+                    if (next == end)
+                    {
+                        fail("unexpected end", size);
+                    }
+                    const char c = static_cast<char>(json[*next]);
+                    const Open& container = open[depth - 1];
+                    if (c == ',')
+                    {
+                        ++next;
+                        expect = container.object ? Expect::Key : Expect::Value;
+                        continue;
+                    }
+                    if (c != (container.object ? '}' : ']'))
+                    {
+                        fail(container.object ? "expected ',' or '}'" : "expected ',' or ']'", *next);
+                    }
+                    ++next;
+                    close(container);
+                    --depth;
+                    continue;
+                }
+
+                if (expect == Expect::Key)
+                {
+                    if (next == end)
+                    {
+                        fail("unexpected end", size);
+                    }
+                    if (json[*next] != '"')
+                    {
+                        fail("expected member name", *next);
+                    }
+                    const std::size_t key = *next++;
+                    string(key, next != end ? *next : size);
+                    if (next == end)
+                    {
+                        fail("unexpected end", size);
+                    }
+                    if (json[*next] != ':')
+                    {
+                        fail("expected ':'", *next);
+                    }
+                    ++next;
+                }
+
+                if (next == end)
+                {
+                    fail("unexpected end", size);
+                }
+                const std::size_t offset = *next++;
+                const char c = static_cast<char>(json[offset]);
+                if (depth != 0)
+                {
+                    ++open[depth - 1].values;
+                }
+                if (c == '{' || c == '[')
+                {
+                    if (depth == MaxDepth)
+                    {
+                        fail("nesting too deep", offset);
+                    }
+                    const bool object = c == '{';
+                    open[depth++] = {static_cast<std::size_t>(out - tape), 0, object};
+                    ++out;
+                    if (next == end)
+                    {
+                        fail("unexpected end", size);
+                    }
+                    if (json[*next] == (object ? '}' : ']'))
+                    {
+                        ++next;
+                        close(open[--depth]);
+                        expect = Expect::After;
+                        continue;
+                    }
+                    expect = object ? Expect::Key : Expect::Value;
+                    continue;
+                }
+                if (c == '"')
+                {
+                    string(offset, next != end ? *next : size);
+                }
+                else
+                {
+                    scalar(offset);
+                }
+                expect = Expect::After;
+            }
+        }
+
+        // Reports why the index could not be built.
+        [[noreturn]] void failIndex() const {
+            if (size > JsonIndex::MaxDocumentSize)
+            {
+                fail("document too large", 0);
+            }
+            const std::size_t invalid = JsonIndex::invalidUtf8(json, size);
+            bool inString = false;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                if (i >= invalid)
+                {
+                    fail("invalid utf-8", invalid);
+                }
+                if (inString && json[i] < 0x20)
+                {
+                    fail("control character in string", i);
+                }
+                if (inString && json[i] == '\\')
+                {
+                    ++i;
+                }
+                else if (json[i] == '"')
+                {
+                    inString = !inString;
+                }
+            }
+            if (invalid < size)
+            {
+                fail("invalid utf-8", invalid);
+            }
+            fail("unterminated string", size);
+        }
+
+        void close(const Open& container) {
+            const std::uint64_t values = std::min<std::uint64_t>(container.values, (std::uint64_t{1} << 24) - 1);
+            const auto end = static_cast<std::uint64_t>(out - tape);
+            tape[container.start] = tag(container.object ? Type::Object : Type::Array) | values << 32 | end;
+            *out++ = (container.object ? ObjectEnd : ArrayEnd) << 56 | container.start;
+        }
+
+        // Appends the string opening at `offset` to the tape. The index guarantees it is terminated
+        // and free of control characters, and that only blanks separate its closing quote from
+        // `following`, the next structural character or the end of the document. Only the strings
+        // in blocks the index saw a backslash in are searched for one.
+        void string(std::size_t offset, std::size_t following) {
+            std::size_t end = following;
+            while (json[--end] != '"')
+            {
+            }
+            const std::size_t first = offset + 1;
+            const void* backslash =
+                structurals->backslashIn(first, end) ? std::memchr(json + first, '\\', end - first) : nullptr;
+            if (backslash == nullptr && end - first <= MaxInPlaceLength)
+            {
+                *out++ = tag(Type::String) | static_cast<std::uint64_t>(end - first) << 32 | first;
+                return;
+            }
+
+            // Unescaping never lengthens a string, the buffer is sized for the escaped one.
+            std::string& strings = storage.strings;
+            const std::size_t start = strings.size();
+            *out++ = tag(Type::String) | Unescaped | start;
+            strings.resize(start + sizeof(std::uint32_t) + (end - first));
+            char* const begin = strings.data() + start + sizeof(std::uint32_t);
+            char* out = begin;
+            std::size_t position = first;
+            while (backslash != nullptr)
+            {
+                const std::size_t escaped = static_cast<const unsigned char*>(backslash) - json;
+                std::memcpy(out, json + position, escaped - position);
+                out += escaped - position;
+                position = escape(escaped + 1, out);
+                backslash = position < end ? std::memchr(json + position, '\\', end - position) : nullptr;
+            }
+            std::memcpy(out, json + position, end - position);
+            out += end - position;
+
+            const auto length = static_cast<std::uint32_t>(out - begin);
+            std::memcpy(begin - sizeof(length), &length, sizeof(length));
+            strings.resize(start + sizeof(length) + length);
+        }
+
+        // Writes the character escaped at `position`, just past a backslash, and returns the position after it.
+        std::size_t escape(std::size_t position, char*& out) const {
+            switch (json[position++])
+            {
+            case '"': *out++ = '"'; return position;
+            case '\\': *out++ = '\\'; return position;
+            case '/': *out++ = '/'; return position;
+            case 'b': *out++ = '\b'; return position;
+            case 'f': *out++ = '\f'; return position;
+            case 'n': *out++ = '\n'; return position;
+            case 'r': *out++ = '\r'; return position;
+            case 't': *out++ = '\t'; return position;
+            case 'u': break;
+            default: fail("invalid escape", position - 2);
+            }
+            std::uint32_t code = hex4(position);
+            position += 4;
+            // A high surrogate not followed by a low one is kept as it is, like a lone low surrogate.
+            if (code >= 0xd800 && code < 0xdc00 && size - position >= 6 && json[position] == '\\' &&
+                json[position + 1] == 'u')
+            {
+                const std::uint32_t low = hex4(position + 2);
+                if (low >= 0xdc00 && low < 0xe000)
+                {
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    position += 6;
+                }
+            }
+            writeUtf8(out, code);
+            return position;
+        }
+
+        std::uint32_t hex4(std::size_t position) const {
+            // The value of each hexadecimal digit, 0xff for the other characters.
+            static constexpr auto Digits = [] {
+                std::array<std::uint8_t, 256> digits{};
+                digits.fill(0xff);
+                for (std::uint8_t i = 0; i < 10; ++i)
+                {
+                    digits['0' + i] = i;
+                }
+                for (std::uint8_t i = 0; i < 6; ++i)
+                {
+                    digits['a' + i] = digits['A' + i] = 10 + i;
+                }
+                return digits;
+            }();
+            std::uint32_t code = 0;
+            std::uint32_t invalid = 0;
+            for (std::size_t i = 0; i < 4 && position + i < size; ++i)
+            {
+                const std::uint8_t digit = Digits[json[position + i]];
+                invalid |= digit;
+                code = code << 4 | digit;
+            }
+            if (size - position < 4 || (invalid & 0xf0) != 0)
+            {
+                fail("invalid unicode escape", position);
+            }
+            return code;
+        }
+
+        static void writeUtf8(char*& out, std::uint32_t code) {
+            if (code < 0x80)
+            {
+                *out++ = static_cast<char>(code);
+            }
+            else if (code < 0x800)
+            {
+                *out++ = static_cast<char>(0xc0 | code >> 6);
+                *out++ = static_cast<char>(0x80 | (code & 0x3f));
+            }
+            else if (code < 0x10000)
+            {
+                *out++ = static_cast<char>(0xe0 | code >> 12);
+                *out++ = static_cast<char>(0x80 | (code >> 6 & 0x3f));
+                *out++ = static_cast<char>(0x80 | (code & 0x3f));
+            }
+            else
+            {
+                *out++ = static_cast<char>(0xf0 | code >> 18);
+                *out++ = static_cast<char>(0x80 | (code >> 12 & 0x3f));
+                *out++ = static_cast<char>(0x80 | (code >> 6 & 0x3f));
+                *out++ = static_cast<char>(0x80 | (code & 0x3f));
+            }
+        }
+
+        static bool digit(unsigned char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        // Reads the digits at `at` into `magnitude`, which is exact up to 19 digits, and returns
+        // their number. Eight bytes are checked and converted at once while the text lasts.
+        std::size_t integerDigits(std::size_t& at, std::uint64_t& magnitude) const {
+            static constexpr std::uint64_t Powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+            constexpr std::uint64_t Zeros = 0x3030303030303030;
+            constexpr std::uint64_t HighNibbles = 0xf0f0f0f0f0f0f0f0;
+            const std::size_t start = at;
+            while (size - at >= sizeof(std::uint64_t))
+            {
+                std::uint64_t chunk;
+                std::memcpy(&chunk, json + at, sizeof(chunk));
+                // Non-zero bytes mark the characters out of '0'..'9'.
+                const std::uint64_t others = ((chunk & HighNibbles) ^ Zeros) |
+                                             (((chunk + 0x0606060606060606) & HighNibbles) ^ Zeros);
+                const std::size_t count = others == 0 ? 8 : static_cast<std::size_t>(__builtin_ctzll(others)) / 8;
+                if (count == 0)
+                {
+                    return at - start;
+                }
+                if (count < 8)
+                {
+                    // Shift the digits to the end, behind leading zeros.
+                    chunk = chunk << (64 - 8 * count) | Zeros >> (8 * count);
+                }
+                magnitude = magnitude * Powers[count] + eightDigits(chunk);
+                at += count;
+                if (count < 8)
+                {
+                    return at - start;
+                }
+            }
+            while (at < size && digit(json[at]))
+            {
+                magnitude = magnitude * 10 + (json[at++] - '0');
+            }
+            return at - start;
+        }
+
+        // The value of eight ASCII digits, the first in the lowest byte.
+        static std::uint32_t eightDigits(std::uint64_t chunk) {
+            chunk = (chunk & 0x0f0f0f0f0f0f0f0f) * 2561 >> 8;
+            chunk = (chunk & 0x00ff00ff00ff00ff) * 6553601 >> 16;
+            return static_cast<std::uint32_t>((chunk & 0x0000ffff0000ffff) * 42949672960001 >> 32);
+        }
+
+        // Whether `c` may follow a literal or a number: a blank, an operator or a quote.
+        static bool delimiter(unsigned char c) {
+            static constexpr auto delimiters = [] {
+                std::array<bool, 256> table{};
+                for (const char d : std::string_view(" \t\r\n{}[]:,\""))
+                {
+                    table[static_cast<unsigned char>(d)] = true;
+                }
+                return table;
+            }();
+            return delimiters[c];
+        }
+
+        void scalar(std::size_t offset) {
+            if (json[offset] == '-' || digit(json[offset]))
+            {
+                number(offset);
+            }
+            else
+            {
+                literal(offset);
+            }
+        }
+
+        // The first character selects the only literal the value may be, whose bytes are then
+        // compared at once, so documents mixing literals do not mispredict a branch per literal.
+        void literal(std::size_t offset) {
+            struct Literal {
+                std::uint64_t text;
+                std::uint64_t mask;
+                std::size_t length;
+                Type type;
+            };
+            // Indexed by bits 3 and 4 of the first character, 0 for 'f', 1 for 'n' and 2 for 't'. The
+            // last entry matches none of the characters selecting it.
+            static constexpr Literal Literals[] = {{0x65736c6166, 0xffffffffff, 5, Type::False},
+                                                   {0x6c6c756e, 0xffffffff, 4, Type::Null},
+                                                   {0x65757274, 0xffffffff, 4, Type::True},
+                                                   {0, 0xff, 1, Type::Null}};
+            const Literal& literal = Literals[json[offset] >> 3 & 3];
+            std::uint64_t word = 0;
+            if (size - offset >= sizeof(word))
+            {
+                std::memcpy(&word, json + offset, sizeof(word));
+            }
+            else
+            {
+                for (std::size_t i = 0; i < size - offset; ++i)
+                {
+                    word |= std::uint64_t{json[offset + i]} << 8 * i;
+                }
+            }
+            const std::size_t end = offset + literal.length;
+            if ((word & literal.mask) != literal.text || (end < size && !delimiter(json[end])))
+            {
+                fail("invalid value", offset);
+            }
+            *out++ = tag(literal.type);
+        }
+
+        // Parses -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?, the significands of up to 19 digits
+        // being converted while they are checked. Integers and the other numbers exact in a double
+        // (Clinger's fast path) are stored from there, only the others go through `from_chars`.
+        void number(std::size_t offset) {
+            std::size_t at = offset;
+            const bool negative = json[at] == '-';
+            if (negative)
+            {
+                ++at;
+            }
+            if (at == size || !digit(json[at]) || (json[at] == '0' && at + 1 < size && digit(json[at + 1])))
+            {
+                fail("invalid value", offset);
+            }
+            std::uint64_t magnitude = 0;
+            const std::size_t digits = integerDigits(at, magnitude);
+
+            // The fraction digits continue the significand.
+            std::size_t significandDigits = digits;
+            std::int64_t exponent = 0;
+            bool integer = true;
+            if (at < size && json[at] == '.')
+            {
+                integer = false;
+                if (++at == size || !digit(json[at]))
+                {
+                    fail("invalid number", offset);
+                }
+                const std::size_t fractionDigits = integerDigits(at, magnitude);
+                significandDigits += fractionDigits;
+                exponent = -static_cast<std::int64_t>(fractionDigits);
+            }
+            if (at < size && (json[at] == 'e' || json[at] == 'E'))
+            {
+                integer = false;
+                bool negativeExponent = false;
+                if (++at < size && (json[at] == '+' || json[at] == '-'))
+                {
+                    negativeExponent = json[at++] == '-';
+                }
+                if (at == size || !digit(json[at]))
+                {
+                    fail("invalid number", offset);
+                }
+                std::int64_t value = 0;
+                while (at < size && digit(json[at]))
+                {
+                    // Saturated: with 19 significand digits at most, the fast path is out of reach long before.
+                    value = std::min<std::int64_t>(value * 10 + (json[at++] - '0'), 1000000);
+                }
+                exponent += negativeExponent ? -value : value;
+            }
+            if (at < size && !delimiter(json[at]))
+            {
+                fail("invalid number", offset);
+            }
+
+            constexpr std::uint64_t Int64Limit = std::uint64_t{1} << 63;
+            if (integer && digits <= 19 && magnitude < Int64Limit + negative)
+            {
+                *out++ = tag(Type::Int64);
+                *out++ = negative ? 0 - magnitude : magnitude;
+                return;
+            }
+            if (integer && digits <= 19 && !negative)
+            {
+                *out++ = tag(Type::Uint64);
+                *out++ = magnitude;
+                return;
+            }
+
+            // A significand and a power of ten both exact in a double give a correctly rounded
+            // product or quotient, when the arithmetic is not carried out in a wider format.
+            if (FLT_EVAL_METHOD == 0 && significandDigits <= 19 && magnitude <= MaxExactSignificand &&
+                exponent >= -MaxExactPower && exponent <= MaxExactPower)
+            {
+                double value = static_cast<double>(magnitude);
+                value = exponent < 0 ? value / exactPower(-exponent) : value * exactPower(exponent);
+                store(negative ? -value : value);
+                return;
+            }
+
+            const std::string_view token(reinterpret_cast<const char*>(json + offset), at - offset);
+            const char* first = token.data();
+            const char* last = first + token.size();
+            // Integers of 20 digits may still fit an `uint64_t`.
+            if (std::uint64_t value; integer && !negative && std::from_chars(first, last, value).ec == std::errc())
+            {
+                *out++ = tag(Type::Uint64);
+                *out++ = value;
+                return;
+            }
+            double value;
+            if (std::from_chars(first, last, value).ec != std::errc())
+            {
+                // Out of range: numbers too small round to zero, too large are rejected.
+                value = std::strtod(std::string(token).c_str(), nullptr);
+                if (std::isinf(value))
+                {
+                    fail("number out of range", offset);
+                }
+            }
+            store(value);
+        }
+
+        static constexpr std::uint64_t MaxExactSignificand = std::uint64_t{1} << 53;
+        static constexpr std::int64_t MaxExactPower = 22;
+
+        // Powers of ten up to 10^22 are exact in a double.
+        static double exactPower(std::int64_t exponent) {
+            static constexpr double Powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                                1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                                1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+            return Powers[exponent];
+        }
+
+        void store(double value) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            *out++ = tag(Type::Double);
+            *out++ = bits;
+        }
+    };
+
+    BufferSlice source;
+    std::shared_ptr<const Storage> storage;
+};
+
+#endif //JSONDOCUMENT_H
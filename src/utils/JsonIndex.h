@@ -0,0 +1,672 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef JSONINDEX_H
+#define JSONINDEX_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define JSONINDEX_X86_DISPATCH 1
+#endif
+
+/**
+ * @class JsonIndex
+ * @brief The structural index of a JSON document, the first stage of `JsonDocument::parse`.
+ *
+ * Lists in document order the offsets of the brackets, braces, colons and commas outside of
+ * strings, of the opening quote of every string and of the first character of every other scalar
+ * (numbers, `true`, `false`, `null`). The second stage then walks the index instead of the bytes.
+ *
+ * Documents are classified 64 bytes at a time, after Langdale and Lemire ("Parsing Gigabytes of
+ * JSON per Second"): the vector kernels turn the quotes, backslashes, whitespace and operators of
+ * a block into 64-bit masks (byte compares and nibble-indexed shuffles), then the same bitwise
+ * steps for every kernel find the escaped characters, the string interiors (a prefix XOR of the
+ * quotes) and the scalar starts, carrying their state from block to block. The AVX2 kernel
+ * classifies 32 bytes per instruction, the SSE4.2 one 16 bytes, and the scalar fallback one byte
+ * per table lookup. The implementation is chosen once, at run time, so the build needs no
+ * instruction set flags.
+ *
+ * The kernels validate the document as UTF-8 on the way. A block of ASCII characters costs one
+ * test, the others are checked by the vector kernels with the nibble lookups of Keiser and Lemire
+ * ("Validating UTF-8 In Less Than One Instruction Per Byte"), and one byte at a time by the scalar
+ * fallback.
+ *
+ * Control characters 0x0C and 0x1A are classified as operators, like the `,` and `:` they share
+ * a nibble lookup with, by every kernel. Both are invalid outside strings, where the second stage
+ * rejects them.
+ */
+class JsonIndex {
+public:
+
+    /**
+     * @brief Largest document indexed, offsets are 32 bits wide.
+     */
+    static constexpr std::size_t MaxDocumentSize = std::numeric_limits<std::uint32_t>::max() - 64;
+
+    /**
+     * @brief Indexes `size` bytes of `json` with the fastest kernel supported by the CPU.
+     *
+     * The index is kept for the next build, which reuses its storage.
+     *
+     * @return false if a string is not terminated or holds an unescaped control character, if the
+     *         document is not valid UTF-8 or if it is larger than `MaxDocumentSize`. The index is
+     *         incomplete then.
+     */
+    bool build(const unsigned char* json, std::size_t size) {
+        static const auto implementation = select();
+        return implementation(*this, json, size);
+    }
+
+    /**
+     * @brief Offsets of the structural characters, in document order.
+     */
+    const std::uint32_t* positions() const {
+        return entries.get();
+    }
+
+    /**
+     * @brief Number of structural characters.
+     */
+    std::size_t size() const {
+        return count;
+    }
+
+    /**
+     * @brief Whether a backslash lies in the bytes `[first, last)` of the document.
+     */
+    bool backslashIn(std::size_t first, std::size_t last) const {
+        if (first >= last)
+        {
+            return false;
+        }
+        const std::size_t lastBlock = (last - 1) / 64;
+        std::size_t block = first / 64;
+        std::uint64_t found = backslashes[block] & ~std::uint64_t{0} << first % 64;
+        for (; block != lastBlock; found = backslashes[++block])
+        {
+            if (found != 0)
+            {
+                return true;
+            }
+        }
+        return (found & ~std::uint64_t{0} >> (63 - (last - 1) % 64)) != 0;
+    }
+
+    /**
+     * @brief Offset of the first invalid UTF-8 sequence of `size` bytes at `bytes`, `size` if there is none.
+     */
+    static std::size_t invalidUtf8(const unsigned char* bytes, std::size_t size) {
+        Utf8Scalar utf8;
+        std::size_t sequence = 0;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            if (utf8.needed == 0)
+            {
+                sequence = i;
+            }
+            if (!utf8.feed(bytes[i]))
+            {
+                return sequence;
+            }
+        }
+        return utf8.needed == 0 ? size : sequence;
+    }
+
+    /**
+     * @brief Indexes `json` one byte at a time, see `build`.
+     */
+    static bool buildScalar(JsonIndex& index, const unsigned char* json, std::size_t size) {
+        if (!index.reserve(size))
+        {
+            return false;
+        }
+        State state;
+        Utf8Scalar utf8;
+        std::size_t offset = 0;
+        for (; offset + 64 <= size; offset += 64)
+        {
+            index.append(classifyScalar(json + offset), state, offset);
+            utf8.check(json + offset, 64);
+        }
+        if (offset < size)
+        {
+            index.append(classifyScalar(padded(json + offset, size - offset).data()), state, offset);
+            utf8.check(json + offset, size - offset);
+        }
+        return index.finish(state) && utf8.valid();
+    }
+
+#if defined(JSONINDEX_X86_DISPATCH)
+    /**
+     * @brief Indexes `json` classifying 16 bytes per instruction, see `build`.
+     */
+    __attribute__((target("sse4.2")))
+    static bool buildSse42(JsonIndex& index, const unsigned char* json, std::size_t size) {
+        if (!index.reserve(size))
+        {
+            return false;
+        }
+        State state;
+        Utf8Sse42 utf8{};
+        std::size_t offset = 0;
+        for (; offset + 64 <= size; offset += 64)
+        {
+            index.append(classifySse42(json + offset), state, offset);
+            checkUtf8Sse42(json + offset, utf8);
+        }
+        if (offset < size)
+        {
+            const std::array<unsigned char, 64> last = padded(json + offset, size - offset);
+            index.append(classifySse42(last.data()), state, offset);
+            checkUtf8Sse42(last.data(), utf8);
+        }
+        return index.finish(state) && validUtf8Sse42(utf8);
+    }
+
+    /**
+     * @brief Indexes `json` classifying 32 bytes per instruction, see `build`.
+     */
+    __attribute__((target("avx2")))
+    static bool buildAvx2(JsonIndex& index, const unsigned char* json, std::size_t size) {
+        if (!index.reserve(size))
+        {
+            return false;
+        }
+        State state;
+        Utf8Avx2 utf8{};
+        std::size_t offset = 0;
+        for (; offset + 64 <= size; offset += 64)
+        {
+            index.append(classifyAvx2(json + offset), state, offset);
+            checkUtf8Avx2(json + offset, utf8);
+        }
+        if (offset < size)
+        {
+            const std::array<unsigned char, 64> last = padded(json + offset, size - offset);
+            index.append(classifyAvx2(last.data()), state, offset);
+            checkUtf8Avx2(last.data(), utf8);
+        }
+        return index.finish(state) && validUtf8Avx2(utf8);
+    }
+#endif
+
+private:
+    using Builder = bool (*)(JsonIndex&, const unsigned char*, std::size_t);
+
+    // One bit per byte of a 64 bytes block, for each class of character.
+    struct Block {
+        std::uint64_t quotes;
+        std::uint64_t backslashes;
+        std::uint64_t whitespace;
+        std::uint64_t operators;
+        std::uint64_t controls;
+    };
+
+    // What a block leaves to the next one.
+    struct State {
+        std::uint64_t escapeCarry = 0;  // 1 when the block ended with an odd run of backslashes.
+        std::uint64_t inString = 0;     // All ones when the block ended inside a string.
+        std::uint64_t scalarCarry = 0;  // 1 when the block ended inside a scalar.
+        std::uint64_t errors = 0;       // Control characters met inside strings.
+    };
+
+    enum Class : std::uint8_t {
+        Quote = 1,
+        Backslash = 2,
+        Whitespace = 4,
+        Operator = 8,
+        Control = 16
+    };
+
+    // Validates UTF-8 one byte at a time: `needed` continuation bytes are still expected, the next
+    // one within `[low, high]`, which rules out overlong forms, surrogates and code points past U+10FFFF.
+    struct Utf8Scalar {
+        std::uint8_t needed = 0;
+        std::uint8_t low = 0x80;
+        std::uint8_t high = 0xbf;
+        bool error = false;
+
+        bool feed(unsigned char c) {
+            if (needed != 0)
+            {
+                if (c < low || c > high)
+                {
+                    return false;
+                }
+                low = 0x80;
+                high = 0xbf;
+                --needed;
+                return true;
+            }
+            if (c < 0x80)
+            {
+                return true;
+            }
+            if (c >= 0xc2 && c <= 0xdf)
+            {
+                needed = 1;
+            }
+            else if (c >= 0xe0 && c <= 0xef)
+            {
+                needed = 2;
+                low = c == 0xe0 ? 0xa0 : 0x80;
+                high = c == 0xed ? 0x9f : 0xbf;
+            }
+            else if (c >= 0xf0 && c <= 0xf4)
+            {
+                needed = 3;
+                low = c == 0xf0 ? 0x90 : 0x80;
+                high = c == 0xf4 ? 0x8f : 0xbf;
+            }
+            else
+            {
+                return false;
+            }
+            return true;
+        }
+
+        void check(const unsigned char* bytes, std::size_t size) {
+            std::size_t i = 0;
+            while (i < size && !error)
+            {
+                std::uint64_t word;
+                if (needed == 0 && i + 8 <= size &&
+                    (std::memcpy(&word, bytes + i, 8), (word & 0x8080808080808080) == 0))
+                {
+                    i += 8;
+                    continue;
+                }
+                error = !feed(bytes[i++]);
+            }
+        }
+
+        bool valid() const {
+            return !error && needed == 0;
+        }
+    };
+
+#if defined(JSONINDEX_X86_DISPATCH)
+    // What the UTF-8 check of a vector kernel leaves to the next block: its last vector, the
+    // sequences it leaves unfinished and the errors met so far.
+    struct Utf8Sse42 {
+        __m128i previous;
+        __m128i incomplete;
+        __m128i errors;
+    };
+
+    struct Utf8Avx2 {
+        __m256i previous;
+        __m256i incomplete;
+        __m256i errors;
+    };
+
+    // Bits of the nibble lookups, set for the errors each nibble allows. A pair of bytes is invalid
+    // when a bit is set in the three lookups, except TwoContinuations, which is expected after the
+    // lead byte of a three or four bytes sequence, and only there.
+    enum Utf8Error : std::uint8_t {
+        TooShort = 1 << 0,
+        TooLong = 1 << 1,
+        Overlong3 = 1 << 2,
+        TooLarge = 1 << 3,
+        Surrogate = 1 << 4,
+        Overlong2 = 1 << 5,
+        TooLarge1000 = 1 << 6,
+        Overlong4 = 1 << 6,
+        TwoContinuations = 1 << 7,
+        Carry = TooShort | TooLong | TwoContinuations
+    };
+
+    // Indexed by the high nibble of the first byte of a pair.
+    static constexpr std::uint8_t Utf8FirstHigh[16] = {
+        TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+        TwoContinuations, TwoContinuations, TwoContinuations, TwoContinuations,
+        TooShort | Overlong2,
+        TooShort,
+        TooShort | Overlong3 | Surrogate,
+        TooShort | TooLarge | TooLarge1000 | Overlong4};
+
+    // Indexed by the low nibble of the first byte of a pair.
+    static constexpr std::uint8_t Utf8FirstLow[16] = {
+        Carry | Overlong3 | Overlong2 | Overlong4,
+        Carry | Overlong2,
+        Carry,
+        Carry,
+        Carry | TooLarge,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000 | Surrogate,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000};
+
+    // Indexed by the high nibble of the second byte of a pair.
+    static constexpr std::uint8_t Utf8SecondHigh[16] = {
+        TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+        TooLong | Overlong2 | TwoContinuations | Overlong3 | TooLarge1000 | Overlong4,
+        TooLong | Overlong2 | TwoContinuations | Overlong3 | TooLarge,
+        TooLong | Overlong2 | TwoContinuations | Surrogate | TooLarge,
+        TooLong | Overlong2 | TwoContinuations | Surrogate | TooLarge,
+        TooShort, TooShort, TooShort, TooShort};
+
+    // Subtracted with saturation from the last vector of a block, non-zero where a sequence is
+    // still missing bytes: a lead byte of four bytes among the last three, of three among the last
+    // two, of two in last place.
+    static constexpr std::uint8_t Utf8IncompleteLimits[32] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1};
+#endif
+
+    static Builder select() {
+#if defined(JSONINDEX_X86_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return buildAvx2;
+        }
+        if (__builtin_cpu_supports("sse4.2"))
+        {
+            return buildSse42;
+        }
+#endif
+        return buildScalar;
+    }
+
+    static constexpr std::array<std::uint8_t, 256> makeClasses() {
+        std::array<std::uint8_t, 256> classes{};
+        for (std::size_t c = 0; c < 0x20; ++c)
+        {
+            classes[c] = Control;
+        }
+        classes['"'] = Quote;
+        classes['\\'] = Backslash;
+        classes[' '] = Whitespace;
+        classes['\t'] = Whitespace | Control;
+        classes['\n'] = Whitespace | Control;
+        classes['\r'] = Whitespace | Control;
+        for (const unsigned char c : {'{', '}', '[', ']', ':', ','})
+        {
+            classes[c] = Operator;
+        }
+        classes[0x0c] = Operator | Control;
+        classes[0x1a] = Operator | Control;
+        return classes;
+    }
+
+    // The last bytes of a document, padded with blanks to a whole block.
+    static std::array<unsigned char, 64> padded(const unsigned char* bytes, std::size_t size) {
+        std::array<unsigned char, 64> block;
+        block.fill(' ');
+        std::memcpy(block.data(), bytes, size);
+        return block;
+    }
+
+    static Block classifyScalar(const unsigned char* bytes) {
+        static constexpr std::array<std::uint8_t, 256> Classes = makeClasses();
+        Block block{};
+        for (std::size_t i = 0; i < 64; ++i)
+        {
+            const std::uint64_t c = Classes[bytes[i]];
+            block.quotes |= (c & Quote) << i;
+            block.backslashes |= (c >> 1 & 1) << i;
+            block.whitespace |= (c >> 2 & 1) << i;
+            block.operators |= (c >> 3 & 1) << i;
+            block.controls |= (c >> 4 & 1) << i;
+        }
+        return block;
+    }
+
+#if defined(JSONINDEX_X86_DISPATCH)
+    __attribute__((target("sse4.2")))
+    static Block classifySse42(const unsigned char* bytes) {
+        // Indexed by the low nibble, each entry equals the only character of its class with that nibble.
+        const __m128i whitespaceTable = _mm_setr_epi8(' ', 0, 0, 0, 0, 0, 0, 0, 0, '\t', '\n', 0, 0, '\r', 0, 0);
+        // Looked up with bit 5 set, which maps `[` and `]` to `{` and `}`.
+        const __m128i operatorTable = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0);
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i caseBit = _mm_set1_epi8(0x20);
+        const __m128i lastControl = _mm_set1_epi8(0x1f);
+
+        Block block{};
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i * 16));
+            const __m128i folded = _mm_or_si128(c, caseBit);
+            const std::size_t shift = i * 16;
+            block.quotes |= mask16(_mm_cmpeq_epi8(c, quote)) << shift;
+            block.backslashes |= mask16(_mm_cmpeq_epi8(c, backslash)) << shift;
+            block.whitespace |= mask16(_mm_cmpeq_epi8(_mm_shuffle_epi8(whitespaceTable, c), c)) << shift;
+            block.operators |= mask16(_mm_cmpeq_epi8(_mm_shuffle_epi8(operatorTable, folded), folded)) << shift;
+            block.controls |= mask16(_mm_cmpeq_epi8(_mm_min_epu8(c, lastControl), c)) << shift;
+        }
+        return block;
+    }
+
+    __attribute__((target("avx2")))
+    static Block classifyAvx2(const unsigned char* bytes) {
+        const __m256i whitespaceTable = _mm256_setr_epi8(' ', 0, 0, 0, 0, 0, 0, 0, 0, '\t', '\n', 0, 0, '\r', 0, 0,
+                                                         ' ', 0, 0, 0, 0, 0, 0, 0, 0, '\t', '\n', 0, 0, '\r', 0, 0);
+        const __m256i operatorTable = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0,
+                                                       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0);
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i caseBit = _mm256_set1_epi8(0x20);
+        const __m256i lastControl = _mm256_set1_epi8(0x1f);
+
+        Block block{};
+        for (std::size_t i = 0; i < 2; ++i)
+        {
+            const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + i * 32));
+            const __m256i folded = _mm256_or_si256(c, caseBit);
+            const std::size_t shift = i * 32;
+            block.quotes |= mask32(_mm256_cmpeq_epi8(c, quote)) << shift;
+            block.backslashes |= mask32(_mm256_cmpeq_epi8(c, backslash)) << shift;
+            block.whitespace |= mask32(_mm256_cmpeq_epi8(_mm256_shuffle_epi8(whitespaceTable, c), c)) << shift;
+            block.operators |= mask32(_mm256_cmpeq_epi8(_mm256_shuffle_epi8(operatorTable, folded), folded)) << shift;
+            block.controls |= mask32(_mm256_cmpeq_epi8(_mm256_min_epu8(c, lastControl), c)) << shift;
+        }
+        return block;
+    }
+
+    // The errors of the 16 bytes `input`, which follow `previous`.
+    __attribute__((target("sse4.2")))
+    static __m128i utf8ErrorsSse42(__m128i input, __m128i previous) {
+        const __m128i lowNibbles = _mm_set1_epi8(0x0f);
+        const __m128i prev1 = _mm_alignr_epi8(input, previous, 15);
+        const __m128i prev2 = _mm_alignr_epi8(input, previous, 14);
+        const __m128i prev3 = _mm_alignr_epi8(input, previous, 13);
+        const __m128i firstHigh = _mm_shuffle_epi8(table16(Utf8FirstHigh), _mm_and_si128(_mm_srli_epi16(prev1, 4), lowNibbles));
+        const __m128i firstLow = _mm_shuffle_epi8(table16(Utf8FirstLow), _mm_and_si128(prev1, lowNibbles));
+        const __m128i secondHigh = _mm_shuffle_epi8(table16(Utf8SecondHigh), _mm_and_si128(_mm_srli_epi16(input, 4), lowNibbles));
+        const __m128i special = _mm_and_si128(_mm_and_si128(firstHigh, firstLow), secondHigh);
+        // The high bit is set in the bytes two places after a lead byte of three or four bytes, or three after one of four.
+        const __m128i continuations = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+                                                   _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80)));
+        return _mm_xor_si128(_mm_and_si128(continuations, _mm_set1_epi8(TwoContinuationsByte)), special);
+    }
+
+    __attribute__((target("sse4.2")))
+    static void checkUtf8Sse42(const unsigned char* bytes, Utf8Sse42& utf8) {
+        __m128i chunks[4];
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            chunks[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i * 16));
+        }
+        const __m128i any = _mm_or_si128(_mm_or_si128(chunks[0], chunks[1]), _mm_or_si128(chunks[2], chunks[3]));
+        if (_mm_movemask_epi8(any) == 0)
+        {
+            // ASCII only: valid, unless the previous block left a sequence unfinished.
+            utf8.errors = _mm_or_si128(utf8.errors, utf8.incomplete);
+            return;
+        }
+        __m128i errors = utf8ErrorsSse42(chunks[0], utf8.previous);
+        for (std::size_t i = 1; i < 4; ++i)
+        {
+            errors = _mm_or_si128(errors, utf8ErrorsSse42(chunks[i], chunks[i - 1]));
+        }
+        utf8.errors = _mm_or_si128(utf8.errors, errors);
+        utf8.incomplete = _mm_subs_epu8(chunks[3], _mm_loadu_si128(reinterpret_cast<const __m128i*>(Utf8IncompleteLimits + 16)));
+        utf8.previous = chunks[3];
+    }
+
+    __attribute__((target("sse4.2")))
+    static bool validUtf8Sse42(const Utf8Sse42& utf8) {
+        const __m128i errors = _mm_or_si128(utf8.errors, utf8.incomplete);
+        return _mm_testz_si128(errors, errors) != 0;
+    }
+
+    // The errors of the 32 bytes `input`, which follow `previous`, see `utf8ErrorsSse42`.
+    __attribute__((target("avx2")))
+    static __m256i utf8ErrorsAvx2(__m256i input, __m256i previous) {
+        const __m256i lowNibbles = _mm256_set1_epi8(0x0f);
+        // The previous high lane and the current low lane, shifted into the current vector by alignr.
+        const __m256i carried = _mm256_permute2x128_si256(previous, input, 0x21);
+        const __m256i prev1 = _mm256_alignr_epi8(input, carried, 15);
+        const __m256i prev2 = _mm256_alignr_epi8(input, carried, 14);
+        const __m256i prev3 = _mm256_alignr_epi8(input, carried, 13);
+        const __m256i firstHigh = _mm256_shuffle_epi8(table32(Utf8FirstHigh), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibbles));
+        const __m256i firstLow = _mm256_shuffle_epi8(table32(Utf8FirstLow), _mm256_and_si256(prev1, lowNibbles));
+        const __m256i secondHigh = _mm256_shuffle_epi8(table32(Utf8SecondHigh), _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibbles));
+        const __m256i special = _mm256_and_si256(_mm256_and_si256(firstHigh, firstLow), secondHigh);
+        const __m256i continuations = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80)),
+                                                      _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80)));
+        return _mm256_xor_si256(_mm256_and_si256(continuations, _mm256_set1_epi8(TwoContinuationsByte)), special);
+    }
+
+    __attribute__((target("avx2")))
+    static void checkUtf8Avx2(const unsigned char* bytes, Utf8Avx2& utf8) {
+        const __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes));
+        const __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(first, second)) == 0)
+        {
+            utf8.errors = _mm256_or_si256(utf8.errors, utf8.incomplete);
+            return;
+        }
+        const __m256i errors = _mm256_or_si256(utf8ErrorsAvx2(first, utf8.previous), utf8ErrorsAvx2(second, first));
+        utf8.errors = _mm256_or_si256(utf8.errors, errors);
+        utf8.incomplete = _mm256_subs_epu8(second, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Utf8IncompleteLimits)));
+        utf8.previous = second;
+    }
+
+    __attribute__((target("avx2")))
+    static bool validUtf8Avx2(const Utf8Avx2& utf8) {
+        const __m256i errors = _mm256_or_si256(utf8.errors, utf8.incomplete);
+        return _mm256_testz_si256(errors, errors) != 0;
+    }
+
+    static constexpr char TwoContinuationsByte = static_cast<char>(TwoContinuations);
+
+    __attribute__((target("sse4.2")))
+    static __m128i table16(const std::uint8_t (&table)[16]) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(table));
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i table32(const std::uint8_t (&table)[16]) {
+        return _mm256_broadcastsi128_si256(table16(table));
+    }
+
+    // Lambdas do not inherit the target of their enclosing function, the helpers carry their own.
+    __attribute__((target("sse4.2")))
+    static std::uint64_t mask16(__m128i matches) {
+        return static_cast<std::uint16_t>(_mm_movemask_epi8(matches));
+    }
+
+    __attribute__((target("avx2")))
+    static std::uint64_t mask32(__m256i matches) {
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(matches));
+    }
+#endif
+
+    bool reserve(std::size_t size) {
+        if (size > MaxDocumentSize)
+        {
+            return false;
+        }
+        // At most one entry per byte, the storage is not initialized.
+        if (capacity < size + 64)
+        {
+            capacity = size + 64;
+            entries = std::make_unique_for_overwrite<std::uint32_t[]>(capacity);
+            backslashes = std::make_unique_for_overwrite<std::uint64_t[]>(capacity / 64);
+        }
+        count = 0;
+        return true;
+    }
+
+    static std::uint64_t prefixXor(std::uint64_t bits) {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+    // Characters preceded by an odd number of backslashes, after simdjson.
+    static std::uint64_t escaped(std::uint64_t backslashes, std::uint64_t& carry) {
+        constexpr std::uint64_t EvenBits = 0x5555555555555555ull;
+        constexpr std::uint64_t OddBits = ~EvenBits;
+        const std::uint64_t starts = backslashes & ~(backslashes << 1);
+        // A run continued from the previous block starts one position earlier.
+        const std::uint64_t evenStartMask = EvenBits ^ carry;
+        const std::uint64_t evenStarts = starts & evenStartMask;
+        const std::uint64_t oddStarts = starts & ~evenStartMask;
+        const std::uint64_t evenCarries = backslashes + evenStarts;
+        std::uint64_t oddCarries;
+        const bool endsOdd = __builtin_add_overflow(backslashes, oddStarts, &oddCarries);
+        oddCarries |= carry;
+        carry = endsOdd ? 1 : 0;
+        const std::uint64_t evenCarryEnds = evenCarries & ~backslashes;
+        const std::uint64_t oddCarryEnds = oddCarries & ~backslashes;
+        return (evenCarryEnds & OddBits) | (oddCarryEnds & EvenBits);
+    }
+
+    void append(const Block& block, State& state, std::size_t offset) {
+        const std::uint64_t quotes = block.quotes & ~escaped(block.backslashes, state.escapeCarry);
+        // Set from an opening quote, included, to its closing quote, excluded.
+        const std::uint64_t inString = prefixXor(quotes) ^ state.inString;
+        state.inString = static_cast<std::uint64_t>(static_cast<std::int64_t>(inString) >> 63);
+        state.errors |= block.controls & inString;
+
+        const std::uint64_t scalars = ~(block.operators | block.whitespace | quotes | inString);
+        const std::uint64_t scalarStarts = scalars & ~(scalars << 1 | state.scalarCarry);
+        state.scalarCarry = scalars >> 63;
+
+        std::uint64_t structurals = (block.operators & ~inString) | (quotes & inString) | scalarStarts;
+        std::uint32_t* out = entries.get() + count;
+        const auto base = static_cast<std::uint32_t>(offset);
+        while (structurals != 0)
+        {
+            *out++ = base + static_cast<std::uint32_t>(__builtin_ctzll(structurals));
+            structurals &= structurals - 1;
+        }
+        count = out - entries.get();
+        backslashes[offset / 64] = block.backslashes;
+    }
+
+    bool finish(const State& state) const {
+        return state.inString == 0 && state.errors == 0;
+    }
+
+    std::unique_ptr<std::uint32_t[]> entries;
+    // The backslashes of every block.
+    std::unique_ptr<std::uint64_t[]> backslashes;
+    std::size_t capacity = 0;
+    std::size_t count = 0;
+};
+
+#endif //JSONINDEX_H
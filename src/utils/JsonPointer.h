@@ -0,0 +1,164 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef JSONPOINTER_H
+#define JSONPOINTER_H
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "JsonDocument.h"
+
+/**
+ * @struct JsonPointer
+ * @brief A JSON pointer (RFC 6901) designating values of a JSON document.
+ *
+ * As an extension, a `*` reference token matches every member of an object and every element of
+ * an array: the tokens `assets`, `*` and `uri` designate the `uri` member of every asset.
+ */
+struct JsonPointer {
+    /**
+     * @brief The unescaped reference tokens, `*` being the wildcard.
+     */
+    std::vector<std::string> tokens;
+
+    /**
+     * @brief Maximum number of pointers `collect` matches in a single pass.
+     */
+    static constexpr std::size_t MaxPointers = 64;
+
+    /**
+     * @brief Parses the textual form of a pointer, `~1` and `~0` escaping `/` and `~`.
+     *
+     * @throws std::invalid_argument If `text` is neither empty nor starts with `/`.
+     */
+    static JsonPointer parse(std::string_view text) {
+        JsonPointer pointer;
+        if (text.empty())
+        {
+            return pointer;
+        }
+        if (text[0] != '/')
+        {
+            throw std::invalid_argument("json pointer must start with '/': " + std::string(text));
+        }
+        while (!text.empty())
+        {
+            text.remove_prefix(1);
+            const std::size_t end = std::min(text.find('/'), text.size());
+            std::string token;
+            for (std::size_t i = 0; i < end; ++i)
+            {
+                if (text[i] == '~' && i + 1 < end && (text[i + 1] == '0' || text[i + 1] == '1'))
+                {
+                    token += text[++i] == '0' ? '~' : '/';
+                }
+                else
+                {
+                    token += text[i];
+                }
+            }
+            pointer.tokens.push_back(std::move(token));
+            text.remove_prefix(end);
+        }
+        return pointer;
+    }
+
+    /**
+     * @brief Appends the strings of `document` designated by any of `pointers` to `values`, in document order.
+     *
+     * The tape is walked once. Containers no pointer can lead into are skipped in one step, and
+     * designated values that are not strings are ignored.
+     *
+     * @param document The parsed JSON document.
+     * @param pointers At most `MaxPointers` pointers.
+     * @param values Receives the unescaped strings.
+     *
+     * @throws std::invalid_argument If there are too many pointers.
+     */
+    static void collect(const JsonDocument& document, const std::vector<JsonPointer>& pointers,
+                        std::vector<std::string>& values) {
+        if (pointers.size() > MaxPointers)
+        {
+            throw std::invalid_argument("too many json pointers");
+        }
+        const Mask all = pointers.size() == MaxPointers ? ~Mask{0} : (Mask{1} << pointers.size()) - 1;
+        Walker{pointers, values}.value(document.root(), 0, all);
+    }
+
+private:
+    // One bit per pointer still matching the current value.
+    using Mask = std::uint64_t;
+
+    struct Walker {
+        const std::vector<JsonPointer>& pointers;
+        std::vector<std::string>& values;
+
+        // Pointers of `candidates` whose token at `depth` designates the child `token`.
+        Mask descend(Mask candidates, std::size_t depth, std::string_view token) const {
+            Mask matching = 0;
+            for (Mask rest = candidates; rest != 0; rest &= rest - 1)
+            {
+                const std::size_t i = static_cast<std::size_t>(__builtin_ctzll(rest));
+                const std::vector<std::string>& tokens = pointers[i].tokens;
+                if (tokens.size() > depth && (tokens[depth] == "*" || tokens[depth] == token))
+                {
+                    matching |= Mask{1} << i;
+                }
+            }
+            return matching;
+        }
+
+        bool designates(Mask candidates, std::size_t depth) const {
+            for (Mask rest = candidates; rest != 0; rest &= rest - 1)
+            {
+                if (pointers[static_cast<std::size_t>(__builtin_ctzll(rest))].tokens.size() == depth)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void value(const JsonDocument::Value& value, std::size_t depth, Mask candidates) {
+            if (candidates == 0)
+            {
+                return;
+            }
+            switch (value.type())
+            {
+            case JsonDocument::Type::Object:
+                value.forEachMember([&](std::string_view key, const JsonDocument::Value& member) {
+                    this->value(member, depth + 1, descend(candidates, depth, key));
+                });
+                break;
+            case JsonDocument::Type::Array:
+            {
+                char index[24];
+                std::size_t i = 0;
+                value.forEachElement([&](const JsonDocument::Value& element) {
+                    const auto printed = std::to_chars(index, index + sizeof(index), i++);
+                    this->value(element, depth + 1, descend(candidates, depth, std::string_view(index, printed.ptr - index)));
+                });
+                break;
+            }
+            case JsonDocument::Type::String:
+                if (designates(candidates, depth))
+                {
+                    values.emplace_back(value.string());
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    };
+};
+
+#endif //JSONPOINTER_H
@@ -0,0 +1,150 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief A fixed set of worker threads executing queued tasks.
+ *
+ * Besides fire and forget tasks, the pool offers `parallelFor`, in which the calling thread takes
+ * part in the work. Because the caller never waits for a task that has not started yet,
+ * `parallelFor` can safely be nested from inside pool tasks.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(std::size_t threads = 0) {
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        workers.reserve(threads);
+        for (std::size_t i = 0; i < threads; ++i)
+        {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    /**
+     * @brief Returns a pool sized to the hardware concurrency, shared by the whole process.
+     */
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    std::size_t size() const {
+        return workers.size();
+    }
+
+    /**
+     * @brief Queues `task` for execution on one of the workers.
+     *
+     * @param task The callable to run. It must not throw.
+     */
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wakeUp.notify_one();
+    }
+
+    /**
+     * @brief Calls `body(i)` for every `i` in `[0, count)` and returns once all calls finished.
+     *
+     * @param count Number of iterations.
+     * @param body The callable invoked for each index. It must not throw.
+     */
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)>& body) {
+        if (count == 0)
+        {
+            return;
+        }
+
+        struct Progress {
+            std::atomic<std::size_t> next{0};
+            std::atomic<std::size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto progress = std::make_shared<Progress>();
+
+        // Helpers may start after the loop is over, they only touch the shared progress then.
+        auto run = [progress, count, &body]() {
+            for (std::size_t i = progress->next.fetch_add(1); i < count; i = progress->next.fetch_add(1))
+            {
+                body(i);
+                if (progress->done.fetch_add(1) + 1 == count)
+                {
+                    std::lock_guard lock(progress->mutex);
+                    progress->finished.notify_all();
+                }
+            }
+        };
+
+        const std::size_t helpers = std::min(count - 1, workers.size());
+        for (std::size_t i = 0; i < helpers; ++i)
+        {
+            submit(run);
+        }
+        run();
+
+        std::unique_lock lock(progress->mutex);
+        progress->finished.wait(lock, [&]() { return progress->done.load() == count; });
+    }
+
+private:
+    void work() {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                wakeUp.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+};
+
+#endif //THREADPOOL_H
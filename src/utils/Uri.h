@@ -0,0 +1,236 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#ifndef URI_H
+#define URI_H
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief URI schemes known to the pipeline, interned so that dispatching on them is an integer switch.
+ *
+ * `None` designates plain paths, `Other` any other syntactically valid scheme.
+ */
+enum class UriScheme : std::uint8_t {
+    None,
+    File,
+    Http,
+    Https,
+    Bundle,
+    Data,
+    Memory,
+    Other
+};
+
+/**
+ * @struct Uri
+ * @brief The components of a URI (RFC 3986), viewed in place.
+ *
+ * Parsing never allocates nor decodes: every component is a view into the parsed text, which
+ * must outlive the `Uri`. Components are still percent-encoded, `decode` is only worth calling on
+ * the ones `needsDecoding` reports.
+ *
+ * Text without a scheme is a plain path: it is kept whole in `path`, `?` and `#` included.
+ * Single letter schemes are not recognised either, so that `C:/dir` stays a path.
+ */
+struct Uri {
+    std::string_view scheme;
+    std::string_view authority;
+    std::string_view path;
+    std::string_view query;
+    std::string_view fragment;
+    UriScheme schemeId = UriScheme::None;
+    bool hasAuthority = false;
+    bool hasQuery = false;
+    bool hasFragment = false;
+
+    /**
+     * @brief Splits `text` into its components.
+     */
+    static Uri parse(std::string_view text) noexcept {
+        Uri uri;
+        const std::size_t schemeSize = schemeLength(text);
+        if (schemeSize == 0)
+        {
+            uri.path = text;
+            return uri;
+        }
+        uri.scheme = text.substr(0, schemeSize);
+        uri.schemeId = intern(uri.scheme);
+        text.remove_prefix(schemeSize + 1);
+
+        if (const std::size_t hash = text.find('#'); hash != std::string_view::npos)
+        {
+            uri.fragment = text.substr(hash + 1);
+            uri.hasFragment = true;
+            text = text.substr(0, hash);
+        }
+        if (const std::size_t question = text.find('?'); question != std::string_view::npos)
+        {
+            uri.query = text.substr(question + 1);
+            uri.hasQuery = true;
+            text = text.substr(0, question);
+        }
+        if (text.starts_with("//"))
+        {
+            text.remove_prefix(2);
+            const std::size_t slash = text.find('/');
+            uri.authority = text.substr(0, slash);
+            uri.hasAuthority = true;
+            text = slash == std::string_view::npos ? std::string_view() : text.substr(slash);
+        }
+        uri.path = text;
+        return uri;
+    }
+
+    /**
+     * @brief Returns the scheme of `text` without parsing the rest of it.
+     */
+    static UriScheme schemeOf(std::string_view text) noexcept {
+        const std::size_t schemeSize = schemeLength(text);
+        return schemeSize == 0 ? UriScheme::None : intern(text.substr(0, schemeSize));
+    }
+
+    /**
+     * @brief Maps a scheme, compared case-insensitively, to its identifier.
+     */
+    static UriScheme intern(std::string_view scheme) noexcept {
+        // Scheme characters are letters, digits, '+', '-' and '.': setting bit 5 lowercases the
+        // letters and leaves the others unchanged.
+        auto is = [scheme](std::string_view lower) {
+            for (std::size_t i = 0; i < lower.size(); ++i)
+            {
+                if ((scheme[i] | 0x20) != lower[i])
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+        switch (scheme.size())
+        {
+        case 4:
+            return is("file")   ? UriScheme::File
+                   : is("http") ? UriScheme::Http
+                   : is("data") ? UriScheme::Data
+                                : UriScheme::Other;
+        case 5:
+            return is("https") ? UriScheme::Https : UriScheme::Other;
+        case 6:
+            return is("bundle") ? UriScheme::Bundle : is("memory") ? UriScheme::Memory : UriScheme::Other;
+        default:
+            return UriScheme::Other;
+        }
+    }
+
+    /**
+     * @brief Whether `component` contains percent-encoded octets.
+     */
+    static bool needsDecoding(std::string_view component) noexcept {
+        return std::memchr(component.data(), '%', component.size()) != nullptr;
+    }
+
+    /**
+     * @brief Percent-decodes `component` into `out`.
+     *
+     * Runs without escapes are copied 16 bytes at a time. Malformed escapes are copied as they are.
+     *
+     * @param component The encoded text.
+     * @param out Receives at most `component.size()` bytes, may be `component.data()` to decode in place.
+     * @return std::size_t The number of bytes written.
+     */
+    static std::size_t decode(std::string_view component, char* out) noexcept {
+        const char* in = component.data();
+        const std::size_t size = component.size();
+        std::size_t read = 0;
+        std::size_t written = 0;
+        while (read < size)
+        {
+#if defined(__SSE2__)
+            if (size - read >= 16)
+            {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + read));
+                const auto escapes = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('%'))));
+                if (escapes == 0)
+                {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + written), block);
+                    read += 16;
+                    written += 16;
+                    continue;
+                }
+                const auto run = static_cast<std::size_t>(std::countr_zero(escapes));
+                std::memmove(out + written, in + read, run);
+                read += run;
+                written += run;
+            }
+#endif
+            if (in[read] == '%' && size - read >= 3)
+            {
+                const int high = hexValue(in[read + 1]);
+                const int low = hexValue(in[read + 2]);
+                if (high >= 0 && low >= 0)
+                {
+                    out[written++] = static_cast<char>(high << 4 | low);
+                    read += 3;
+                    continue;
+                }
+            }
+            out[written++] = in[read++];
+        }
+        return written;
+    }
+
+    /**
+     * @brief Percent-decodes `component` into `out`, replacing its content.
+     */
+    static void decode(std::string_view component, std::string& out) {
+        out.resize(component.size());
+        out.resize(decode(component, out.data()));
+    }
+
+private:
+    // Length of the scheme ending at the first ':', or 0 when `text` has no scheme.
+    static std::size_t schemeLength(std::string_view text) noexcept {
+        if (text.empty() || !isAlpha(text[0]))
+        {
+            return 0;
+        }
+        for (std::size_t i = 1; i < text.size(); ++i)
+        {
+            const char c = text[i];
+            if (c == ':')
+            {
+                return i > 1 ? i : 0;
+            }
+            if (!isAlpha(c) && !(c >= '0' && c <= '9') && c != '+' && c != '-' && c != '.')
+            {
+                return 0;
+            }
+        }
+        return 0;
+    }
+
+    static bool isAlpha(char c) noexcept {
+        return (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+    }
+
+    static int hexValue(char c) noexcept {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        c = static_cast<char>(c | 0x20);
+        return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+    }
+};
+
+#endif //URI_H
@@ -0,0 +1,132 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/utils/Base64.h"
+
+namespace {
+
+    std::string encode(const std::vector<unsigned char>& bytes)
+    {
+        static constexpr char Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string text;
+        text.reserve((bytes.size() + 2) / 3 * 4);
+        std::size_t i = 0;
+        for (; i + 3 <= bytes.size(); i += 3)
+        {
+            const std::uint32_t bits = bytes[i] << 16 | bytes[i + 1] << 8 | bytes[i + 2];
+            text += Alphabet[bits >> 18];
+            text += Alphabet[bits >> 12 & 63];
+            text += Alphabet[bits >> 6 & 63];
+            text += Alphabet[bits & 63];
+        }
+        if (i < bytes.size())
+        {
+            const std::uint32_t bits = bytes[i] << 16 | (i + 1 < bytes.size() ? bytes[i + 1] << 8 : 0);
+            text += Alphabet[bits >> 18];
+            text += Alphabet[bits >> 12 & 63];
+            text += i + 1 < bytes.size() ? Alphabet[bits >> 6 & 63] : '=';
+            text += '=';
+        }
+        return text;
+    }
+
+    using Decoder = bool (*)(std::string_view, unsigned char*, std::size_t&);
+
+    // Decodes `text` for about `seconds` and returns the throughput in encoded bytes per second.
+    double measure(Decoder decoder, const std::string& text, const std::vector<unsigned char>& expected, double seconds)
+    {
+        std::vector<unsigned char> out(Base64::decodedCapacity(text.size()));
+        std::size_t written = 0;
+        if (!decoder(text, out.data(), written) || written != expected.size() ||
+            std::memcmp(out.data(), expected.data(), written) != 0)
+        {
+            return -1;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+        std::size_t rounds = 0;
+        double elapsed = 0;
+        do
+        {
+            decoder(text, out.data(), written);
+            ++rounds;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        while (elapsed < seconds);
+        return static_cast<double>(rounds * text.size()) / elapsed;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::size_t> sizes = {64, 1024, 64 * 1024, 4 * 1024 * 1024};
+    if (argc > 1)
+    {
+        sizes.clear();
+        for (int i = 1; i < argc; ++i)
+        {
+            sizes.push_back(std::stoul(argv[i]));
+        }
+    }
+
+    struct Candidate {
+        const char* name;
+        Decoder decoder;
+        bool supported;
+    };
+#if defined(BASE64_X86_DISPATCH)
+    __builtin_cpu_init();
+#endif
+    const Candidate candidates[] = {
+        {"scalar", Base64::decodeScalar, true},
+#if defined(BASE64_X86_DISPATCH)
+        {"ssse3", Base64::decodeSsse3, __builtin_cpu_supports("ssse3") != 0},
+        {"avx2", Base64::decodeAvx2, __builtin_cpu_supports("avx2") != 0},
+#endif
+    };
+
+    std::mt19937 random(42);
+    std::cout << std::fixed << std::setprecision(2);
+    for (const std::size_t size : sizes)
+    {
+        std::vector<unsigned char> bytes(size);
+        for (auto& byte : bytes)
+        {
+            byte = static_cast<unsigned char>(random());
+        }
+        const std::string text = encode(bytes);
+
+        std::cout << "decoded size " << size << " bytes:\n";
+        double scalar = 0;
+        for (const Candidate& candidate : candidates)
+        {
+            if (!candidate.supported)
+            {
+                continue;
+            }
+            const double throughput = measure(candidate.decoder, text, bytes, 0.5);
+            if (throughput < 0)
+            {
+                std::cerr << candidate.name << " decoded a wrong result" << std::endl;
+                return 1;
+            }
+            if (scalar == 0)
+            {
+                scalar = throughput;
+            }
+            std::cout << "  " << std::setw(7) << candidate.name << " " << std::setw(8) << throughput / 1e9
+                      << " GB/s  x" << throughput / scalar << "\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,406 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <brotli/encode.h>
+#include <lzma.h>
+#include <zlib.h>
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include "../src/actions/Load/BundleWriter.h"
+#include "../src/utils/ThreadPool.h"
+
+namespace {
+
+    namespace fs = std::filesystem;
+
+    // Bounds the memory held by the contents compressed ahead of being written.
+    constexpr std::size_t WindowBytes = std::size_t{256} << 20;
+    constexpr std::size_t WindowFilesPerThread = 8;
+
+    struct Settings {
+        fs::path directory;
+        std::string output;
+        std::string tracePath;
+        std::size_t jobs = 0;
+        bool fast = false;
+        unsigned minSavingPercent = 5;
+        std::string dictionaryPath;
+    };
+
+    struct Packed {
+        std::vector<unsigned char> stored;
+        std::size_t originalSize = 0;
+        Codec codec = Codec::Raw;
+    };
+
+    void printUsage(const char* program)
+    {
+        std::cerr << "usage: " << program << " [--trace FILE] [--jobs N] [--fast] [--min-saving PERCENT] DIRECTORY OUTPUT\n"
+                  << "  --trace FILE  order entries by first access in FILE, one name or bundle:// URI per line\n"
+                  << "  --jobs N      number of compression threads (default: hardware threads)\n"
+                  << "  --fast        favour packing speed over compression ratio\n"
+                  << "  --min-saving PERCENT  store entries raw unless compression saves this much (default: 5)\n"
+                  << "  --zstd-dictionary FILE  also try zstd with this dictionary, for bundles of small entries"
+                  << std::endl;
+    }
+
+    std::vector<unsigned char> readFile(const fs::path& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<unsigned char> content(fs::file_size(path));
+        in.read(reinterpret_cast<char*>(content.data()), static_cast<std::streamsize>(content.size()));
+        if (!in)
+        {
+            throw std::runtime_error("unable to read " + path.string());
+        }
+        return content;
+    }
+
+    bool deflate(const std::vector<unsigned char>& input, int level, std::vector<unsigned char>& output)
+    {
+        uLongf size = compressBound(static_cast<uLong>(input.size()));
+        output.resize(size);
+        if (compress2(output.data(), &size, input.data(), static_cast<uLong>(input.size()), level) != Z_OK)
+        {
+            return false;
+        }
+        output.resize(size);
+        return true;
+    }
+
+    bool brotli(const std::vector<unsigned char>& input, int quality, std::vector<unsigned char>& output)
+    {
+        std::size_t size = BrotliEncoderMaxCompressedSize(input.size());
+        if (size == 0)
+        {
+            return false;
+        }
+        output.resize(size);
+        if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC, input.size(), input.data(),
+                                   &size, output.data()))
+        {
+            return false;
+        }
+        output.resize(size);
+        return true;
+    }
+
+    bool xz(const std::vector<unsigned char>& input, std::uint32_t preset, std::vector<unsigned char>& output)
+    {
+        output.resize(lzma_stream_buffer_bound(input.size()));
+        std::size_t size = 0;
+        if (lzma_easy_buffer_encode(preset, LZMA_CHECK_CRC32, nullptr, input.data(), input.size(), output.data(),
+                                    &size, output.size()) != LZMA_OK)
+        {
+            return false;
+        }
+        output.resize(size);
+        return true;
+    }
+
+#if defined(HAVE_ZSTD)
+    /**
+     * The dictionary given with `--zstd-dictionary`, digested once for every compression thread.
+     */
+    struct ZstdDictionary {
+        ZSTD_CDict* digested = nullptr;
+
+        ZstdDictionary() = default;
+        ZstdDictionary(const ZstdDictionary&) = delete;
+        ZstdDictionary& operator=(const ZstdDictionary&) = delete;
+
+        ~ZstdDictionary() {
+            ::ZSTD_freeCDict(digested);
+        }
+    };
+
+    ZstdDictionary zstdDictionary;
+
+    bool zstd(const std::vector<unsigned char>& input, std::vector<unsigned char>& output)
+    {
+        thread_local const std::unique_ptr<ZSTD_CCtx, std::size_t (*)(ZSTD_CCtx*)> context(::ZSTD_createCCtx(),
+                                                                                        ::ZSTD_freeCCtx);
+        output.resize(::ZSTD_compressBound(input.size()));
+        const std::size_t size = ::ZSTD_compress_usingCDict(context.get(), output.data(), output.size(), input.data(),
+                                                            input.size(), zstdDictionary.digested);
+        if (::ZSTD_isError(size))
+        {
+            return false;
+        }
+        output.resize(size);
+        return true;
+    }
+#endif
+
+    /**
+     * Compresses `input` with every codec and keeps the smallest result, or the input itself when
+     * no codec saves at least `minSavingPercent`.
+     */
+    Packed pack(std::vector<unsigned char>&& input, const Settings& settings)
+    {
+        Packed packed;
+        packed.originalSize = input.size();
+        const std::size_t worthIt = input.size() - input.size() * settings.minSavingPercent / 100;
+
+        std::vector<unsigned char> candidate;
+        auto consider = [&](bool compressed, Codec codec) {
+            if (compressed && candidate.size() < worthIt &&
+                (packed.codec == Codec::Raw || candidate.size() < packed.stored.size()))
+            {
+                packed.stored.swap(candidate);
+                packed.codec = codec;
+            }
+        };
+        consider(deflate(input, settings.fast ? 6 : 9, candidate), Codec::Deflate);
+        consider(brotli(input, settings.fast ? 5 : BROTLI_MAX_QUALITY, candidate), Codec::Brotli);
+        consider(xz(input, settings.fast ? 2 : (9 | LZMA_PRESET_EXTREME), candidate), Codec::Lzma);
+#if defined(HAVE_ZSTD)
+        if (zstdDictionary.digested != nullptr)
+        {
+            consider(zstd(input, candidate), Codec::Zstd);
+        }
+#endif
+
+        if (packed.codec == Codec::Raw)
+        {
+            packed.stored = std::move(input);
+        }
+        return packed;
+    }
+
+    /**
+     * Puts the entries met in the trace first, in the order of their first access, so assets used
+     * together are stored next to each other. The others follow in name order.
+     *
+     * Returns the number of traced entries.
+     */
+    std::size_t orderByTrace(std::vector<std::string>& names, const std::string& tracePath)
+    {
+        std::ifstream trace(tracePath);
+        if (!trace)
+        {
+            throw std::runtime_error("unable to open trace file: " + tracePath);
+        }
+        std::unordered_map<std::string, std::size_t> firstAccess;
+        std::string line;
+        while (std::getline(trace, line))
+        {
+            std::string_view name = line;
+            if (name.starts_with("bundle://"))
+            {
+                name.remove_prefix(9);
+            }
+            firstAccess.emplace(std::string(name), firstAccess.size());
+        }
+        std::stable_sort(names.begin(), names.end(), [&firstAccess](const std::string& left, const std::string& right) {
+            const auto leftRank = firstAccess.find(left);
+            const auto rightRank = firstAccess.find(right);
+            if (leftRank == firstAccess.end() || rightRank == firstAccess.end())
+            {
+                return leftRank != firstAccess.end() && rightRank == firstAccess.end();
+            }
+            return leftRank->second < rightRank->second;
+        });
+        return static_cast<std::size_t>(std::count_if(names.begin(), names.end(), [&firstAccess](const std::string& name) {
+            return firstAccess.contains(name);
+        }));
+    }
+
+    const char* codecName(Codec codec)
+    {
+        switch (codec)
+        {
+        case Codec::Deflate:
+            return "deflate";
+        case Codec::Brotli:
+            return "brotli";
+        case Codec::Lzma:
+            return "lzma";
+        case Codec::Zstd:
+            return "zstd";
+        default:
+            return "raw";
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (argument == "--trace" && hasValue)
+        {
+            settings.tracePath = argv[++i];
+        }
+        else if (argument == "--jobs" && hasValue)
+        {
+            settings.jobs = std::stoul(argv[++i]);
+        }
+        else if (argument == "--fast")
+        {
+            settings.fast = true;
+        }
+        else if (argument == "--min-saving" && hasValue)
+        {
+            settings.minSavingPercent = std::min(100ul, std::stoul(argv[++i]));
+        }
+        else if (argument == "--zstd-dictionary" && hasValue)
+        {
+            settings.dictionaryPath = argv[++i];
+        }
+        else if (!argument.starts_with("--"))
+        {
+            positional.push_back(argument);
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (positional.size() != 2)
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+    settings.directory = positional[0];
+    settings.output = positional[1];
+#if !defined(HAVE_ZSTD)
+    if (!settings.dictionaryPath.empty())
+    {
+        std::cerr << "--zstd-dictionary: zstd support is not compiled in" << std::endl;
+        return 2;
+    }
+#endif
+
+    try
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+#if defined(HAVE_ZSTD)
+        if (!settings.dictionaryPath.empty())
+        {
+            // Entries record the dictionary ID in their frame header, readers only need it loaded.
+            const std::vector<unsigned char> dictionary = readFile(settings.dictionaryPath);
+            zstdDictionary.digested = ::ZSTD_createCDict(dictionary.data(), dictionary.size(),
+                                                         settings.fast ? 3 : ::ZSTD_maxCLevel());
+            if (zstdDictionary.digested == nullptr)
+            {
+                throw std::runtime_error("invalid zstd dictionary: " + settings.dictionaryPath);
+            }
+        }
+#endif
+
+        std::vector<std::string> names;
+        for (const auto& file : fs::recursive_directory_iterator(settings.directory))
+        {
+            if (file.is_regular_file())
+            {
+                names.push_back(file.path().lexically_relative(settings.directory).generic_string());
+            }
+        }
+        std::sort(names.begin(), names.end());
+        std::size_t hotCount = 0;
+        if (!settings.tracePath.empty())
+        {
+            hotCount = orderByTrace(names, settings.tracePath);
+        }
+
+        BundleWriter writer(settings.output, names);
+        ThreadPool pool(settings.jobs);
+        const std::size_t windowFiles = std::max<std::size_t>(1, pool.size() * WindowFilesPerThread);
+
+        std::size_t originalBytes = 0;
+        std::size_t storedBytes = 0;
+        std::size_t codecCounts[5] = {};
+        std::vector<Packed> window;
+        std::vector<std::exception_ptr> errors;
+        for (std::size_t first = 0; first < names.size();)
+        {
+            // Files are compressed a window at a time and written in order, the window stops early
+            // once it holds enough bytes.
+            std::size_t last = first;
+            std::size_t bytes = 0;
+            while (last < names.size() && last - first < windowFiles && bytes < WindowBytes)
+            {
+                bytes += fs::file_size(settings.directory / names[last]);
+                ++last;
+            }
+
+            // The parallelFor body must not throw: failures are kept per file and the first one
+            // rethrown once the window is done.
+            window.assign(last - first, Packed{});
+            errors.assign(last - first, nullptr);
+            pool.parallelFor(last - first, [&](std::size_t k) {
+                try
+                {
+                    window[k] = pack(readFile(settings.directory / names[first + k]), settings);
+                }
+                catch (...)
+                {
+                    errors[k] = std::current_exception();
+                }
+            });
+            for (const std::exception_ptr& error : errors)
+            {
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+            }
+            for (std::size_t k = 0; k < window.size(); ++k)
+            {
+                const Packed& packed = window[k];
+                writer.add(first + k, packed.stored.data(), packed.stored.size(), packed.originalSize, packed.codec,
+                           first + k < hotCount ? BundleFormat::HotEntry : 0);
+                originalBytes += packed.originalSize;
+                storedBytes += packed.stored.size();
+                ++codecCounts[static_cast<std::size_t>(packed.codec)];
+            }
+            first = last;
+        }
+        writer.finish();
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::fixed << std::setprecision(2)
+                  << "entries:    " << names.size() << "\n"
+                  << "hot:        " << hotCount << "\n"
+                  << "original:   " << originalBytes << " bytes\n"
+                  << "stored:     " << storedBytes << " bytes ("
+                  << (originalBytes > 0 ? 100.0 * static_cast<double>(storedBytes) / static_cast<double>(originalBytes) : 100.0)
+                  << "%)\n"
+                  << "codecs:    ";
+        for (std::size_t codec = 0; codec < 5; ++codec)
+        {
+            std::cout << " " << codecName(static_cast<Codec>(codec)) << " " << codecCounts[codec];
+        }
+        std::cout << "\nwall time:  " << seconds << " s" << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Unable to pack " << settings.directory << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
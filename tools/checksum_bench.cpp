@@ -0,0 +1,135 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "../src/utils/Checksum.h"
+
+namespace {
+
+    using Function = std::uint32_t (*)(std::uint32_t, const unsigned char*, std::size_t);
+
+    std::uint32_t zlibCrc32(std::uint32_t crc, const unsigned char* data, std::size_t size)
+    {
+        return static_cast<std::uint32_t>(::crc32_z(crc, data, size));
+    }
+
+    std::uint32_t zlibAdler32(std::uint32_t adler, const unsigned char* data, std::size_t size)
+    {
+        return static_cast<std::uint32_t>(::adler32_z(adler, data, size));
+    }
+
+    // Checksums `bytes` for about `seconds` and returns the throughput in bytes per second.
+    double measure(Function function, std::uint32_t initial, const std::vector<unsigned char>& bytes,
+                   std::uint32_t expected, double seconds)
+    {
+        if (function(initial, bytes.data(), bytes.size()) != expected)
+        {
+            return -1;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+        std::size_t rounds = 0;
+        double elapsed = 0;
+        volatile std::uint32_t sink = 0;
+        do
+        {
+            sink = function(initial, bytes.data(), bytes.size());
+            ++rounds;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        while (elapsed < seconds);
+        static_cast<void>(sink);
+        return static_cast<double>(rounds * bytes.size()) / elapsed;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::size_t> sizes = {64, 1024, 64 * 1024, 4 * 1024 * 1024};
+    if (argc > 1)
+    {
+        sizes.clear();
+        for (int i = 1; i < argc; ++i)
+        {
+            sizes.push_back(std::stoul(argv[i]));
+        }
+    }
+
+    struct Candidate {
+        const char* name;
+        Function function;
+        bool supported;
+    };
+#if defined(CHECKSUM_X86_DISPATCH)
+    __builtin_cpu_init();
+#endif
+    const Candidate crc32Candidates[] = {
+        {"scalar", Checksum::crc32Scalar, true},
+        {"zlib", zlibCrc32, true},
+#if defined(CHECKSUM_X86_DISPATCH)
+        {"pclmul", Checksum::crc32Pclmul,
+         __builtin_cpu_supports("pclmul") != 0 && __builtin_cpu_supports("sse4.1") != 0},
+#endif
+    };
+    const Candidate adler32Candidates[] = {
+        {"scalar", Checksum::adler32Scalar, true},
+        {"zlib", zlibAdler32, true},
+#if defined(CHECKSUM_X86_DISPATCH)
+        {"avx2", Checksum::adler32Avx2, __builtin_cpu_supports("avx2") != 0},
+#endif
+    };
+
+    std::mt19937 random(42);
+    std::cout << std::fixed << std::setprecision(2);
+    for (const std::size_t size : sizes)
+    {
+        std::vector<unsigned char> bytes(size);
+        for (auto& byte : bytes)
+        {
+            byte = static_cast<unsigned char>(random());
+        }
+
+        auto run = [&](const char* checksum, const auto& candidates, std::uint32_t initial) {
+            const std::uint32_t expected = candidates[0].function(initial, bytes.data(), bytes.size());
+            std::cout << checksum << " of " << size << " bytes:\n";
+            double scalar = 0;
+            for (const Candidate& candidate : candidates)
+            {
+                if (!candidate.supported)
+                {
+                    continue;
+                }
+                const double throughput = measure(candidate.function, initial, bytes, expected, 0.5);
+                if (throughput < 0)
+                {
+                    std::cerr << candidate.name << " computed a wrong " << checksum << std::endl;
+                    return false;
+                }
+                if (scalar == 0)
+                {
+                    scalar = throughput;
+                }
+                std::cout << "  " << std::setw(7) << candidate.name << " " << std::setw(8) << throughput / 1e9
+                          << " GB/s  x" << throughput / scalar << "\n";
+            }
+            return true;
+        };
+        if (!run("crc32", crc32Candidates, Checksum::Crc32Initial) ||
+            !run("adler32", adler32Candidates, Checksum::Adler32Initial))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
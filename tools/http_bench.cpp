@@ -0,0 +1,858 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <csignal>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/net/HttpClient.h"
+#include "../src/net/HttpEventLoop.h"
+#include "../src/net/RangedDownload.h"
+#include "../src/net/Url.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct ServerOptions {
+        std::size_t bodySize = 1024;
+        // Added to every response.
+        std::chrono::milliseconds delay{0};
+        // Share of the responses delayed by `slowDelay` on top of `delay`.
+        double slowShare = 0;
+        std::chrono::milliseconds slowDelay{1000};
+        // Whether `Range: bytes=first-last` requests are honoured with partial content.
+        bool ranges = false;
+    };
+
+    // Byte at `offset` of the bodies served, a pattern that makes misplaced ranges visible.
+    char bodyByte(std::size_t offset)
+    {
+        return static_cast<char>('a' + offset % 251 % 26);
+    }
+
+    // Parses the `Range: bytes=first-last` header of `head`, false when absent or of another form.
+    bool parseRange(const std::string& head, std::size_t& first, std::size_t& last)
+    {
+        const std::size_t at = head.find("\r\nRange: bytes=");
+        if (at == std::string::npos)
+        {
+            return false;
+        }
+        char* end = nullptr;
+        first = std::strtoull(head.c_str() + at + 15, &end, 10);
+        if (*end != '-')
+        {
+            return false;
+        }
+        const char* lastStart = end + 1;
+        last = std::strtoull(lastStart, &end, 10);
+        return end != lastStart && first <= last;
+    }
+
+    [[noreturn]] void throwErrno(const char* what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // Lets a process keep as many descriptors open as its hard limit allows.
+    void raiseDescriptorLimit()
+    {
+        rlimit limit{};
+        if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            ::setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    /**
+     * HTTP/1.1 keep-alive server on the loopback interface, driven by a single epoll thread. It runs
+     * in a child process, so the client and the server each get the whole descriptor limit.
+     *
+     * Every request is answered with a body of `ServerOptions::bodySize` bytes after the configured
+     * delay, or with the requested part of it when ranges are enabled, except `/stats`, which reports
+     * the connections accepted, the requests answered, the range requests among them and the most
+     * connections open at once.
+     */
+    class LoopbackServer {
+    public:
+        explicit LoopbackServer(const ServerOptions& options) {
+            const int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listener < 0)
+            {
+                throwErrno("socket");
+            }
+            const int on = 1;
+            ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+                ::listen(listener, SOMAXCONN) != 0 ||
+                ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+            {
+                const int error = errno;
+                ::close(listener);
+                errno = error;
+                throwErrno("listen");
+            }
+            listenPort = ntohs(address.sin_port);
+
+            child = ::fork();
+            if (child < 0)
+            {
+                const int error = errno;
+                ::close(listener);
+                errno = error;
+                throwErrno("fork");
+            }
+            if (child == 0)
+            {
+                ::signal(SIGPIPE, SIG_IGN);
+                raiseDescriptorLimit();
+                try
+                {
+                    serve(listener, options);
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << "loopback server: " << e.what() << std::endl;
+                }
+                ::_exit(1);
+            }
+            ::close(listener);
+        }
+
+        LoopbackServer(const LoopbackServer&) = delete;
+        LoopbackServer& operator=(const LoopbackServer&) = delete;
+
+        ~LoopbackServer() {
+            ::kill(child, SIGKILL);
+            ::waitpid(child, nullptr, 0);
+        }
+
+        std::string url(const std::string& target) const {
+            return "http://127.0.0.1:" + std::to_string(listenPort) + target;
+        }
+
+        /**
+         * Counters of the server, queried over a connection of its own: `connections` counts the
+         * connection of the query as well.
+         */
+        std::map<std::string, std::size_t> stats() const {
+            HttpClient client;
+            const HttpResponse response = client.get(url("/stats"));
+            std::map<std::string, std::size_t> values;
+            std::string text(reinterpret_cast<const char*>(response.body.data()), response.body.size());
+            for (std::size_t at = 0; at < text.size();)
+            {
+                const std::size_t equal = text.find('=', at);
+                const std::size_t end = std::min(text.find(' ', at), text.size());
+                if (equal == std::string::npos || equal > end)
+                {
+                    break;
+                }
+                values[text.substr(at, equal - at)] = std::stoull(text.substr(equal + 1, end - equal - 1));
+                at = end + 1;
+            }
+            return values;
+        }
+
+    private:
+        struct Connection {
+            std::uint64_t id = 0;
+            std::string input;
+            std::string output;
+            std::string response;
+            std::size_t written = 0;
+            bool answering = false;
+        };
+
+        struct Due {
+            Clock::time_point at;
+            int fd;
+            std::uint64_t id;
+
+            bool operator>(const Due& other) const {
+                return at > other.at;
+            }
+        };
+
+        [[noreturn]] static void serve(int listener, const ServerOptions& options) {
+            const int poller = ::epoll_create1(EPOLL_CLOEXEC);
+            if (poller < 0)
+            {
+                throwErrno("epoll_create1");
+            }
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = listener;
+            ::epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+
+            std::string body(options.bodySize, '\0');
+            for (std::size_t i = 0; i < body.size(); ++i)
+            {
+                body[i] = bodyByte(i);
+            }
+            const std::string acceptRanges = options.ranges ? "Accept-Ranges: bytes\r\n" : "";
+            const std::string head = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n" + acceptRanges +
+                                     "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+            std::mt19937_64 random(42);
+            std::bernoulli_distribution slow(std::clamp(options.slowShare, 0.0, 1.0));
+
+            std::unordered_map<int, Connection> connections;
+            std::priority_queue<Due, std::vector<Due>, std::greater<>> due;
+            std::uint64_t nextId = 0;
+            std::size_t accepted = 0;
+            std::size_t answered = 0;
+            std::size_t ranged = 0;
+            std::size_t peak = 0;
+
+            auto closeConnection = [&](int fd) {
+                ::close(fd);
+                connections.erase(fd);
+            };
+
+            // Sends what is left of the response, waiting for EPOLLOUT when the socket is full. False once
+            // the connection is closed.
+            auto flush = [&](int fd, Connection& connection) {
+                while (connection.written < connection.output.size())
+                {
+                    const ssize_t count = ::send(fd, connection.output.data() + connection.written,
+                                                 connection.output.size() - connection.written, MSG_NOSIGNAL);
+                    if (count < 0)
+                    {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        {
+                            closeConnection(fd);
+                            return false;
+                        }
+                        epoll_event writable{};
+                        writable.events = EPOLLIN | EPOLLOUT;
+                        writable.data.fd = fd;
+                        ::epoll_ctl(poller, EPOLL_CTL_MOD, fd, &writable);
+                        return true;
+                    }
+                    connection.written += static_cast<std::size_t>(count);
+                }
+                connection.output.clear();
+                connection.written = 0;
+                connection.answering = false;
+                epoll_event readable{};
+                readable.events = EPOLLIN;
+                readable.data.fd = fd;
+                ::epoll_ctl(poller, EPOLL_CTL_MOD, fd, &readable);
+                return true;
+            };
+
+            auto nextRequest = [&](int fd, Connection& connection) {
+                if (connection.answering)
+                {
+                    return;
+                }
+                const std::size_t end = connection.input.find("\r\n\r\n");
+                if (end == std::string::npos)
+                {
+                    return;
+                }
+                const std::size_t targetStart = connection.input.find(' ') + 1;
+                const std::string target =
+                    connection.input.substr(targetStart, connection.input.find(' ', targetStart) - targetStart);
+                const std::string request = connection.input.substr(0, end + 2);
+                connection.input.erase(0, end + 4);
+                connection.answering = true;
+                if (target == "/stats")
+                {
+                    const std::string text = "connections=" + std::to_string(accepted) + " requests=" +
+                                             std::to_string(answered) + " ranged=" + std::to_string(ranged) +
+                                             " peak=" + std::to_string(peak);
+                    connection.output = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(text.size()) +
+                                        "\r\n\r\n" + text;
+                    flush(fd, connection);
+                    return;
+                }
+                std::size_t first = 0;
+                std::size_t last = 0;
+                if (options.ranges && parseRange(request, first, last) && first < body.size())
+                {
+                    ++ranged;
+                    last = std::min(last, body.size() - 1);
+                    connection.response = "HTTP/1.1 206 Partial Content\r\n" + acceptRanges + "Content-Range: bytes " +
+                                          std::to_string(first) + "-" + std::to_string(last) + "/" +
+                                          std::to_string(body.size()) + "\r\nContent-Length: " +
+                                          std::to_string(last - first + 1) + "\r\n\r\n";
+                    connection.response.append(body, first, last - first + 1);
+                }
+                else
+                {
+                    connection.response = head + body;
+                }
+                Clock::duration delay = options.delay;
+                if (slow(random))
+                {
+                    delay += options.slowDelay;
+                }
+                due.push({Clock::now() + delay, fd, connection.id});
+            };
+
+            std::vector<epoll_event> events(1024);
+            for (;;)
+            {
+                int timeout = -1;
+                if (!due.empty())
+                {
+                    const auto wait = std::chrono::ceil<std::chrono::milliseconds>(due.top().at - Clock::now());
+                    timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, wait.count()));
+                }
+                const int count = ::epoll_wait(poller, events.data(), static_cast<int>(events.size()), timeout);
+                if (count < 0 && errno != EINTR)
+                {
+                    throwErrno("epoll_wait");
+                }
+                for (int i = 0; i < count; ++i)
+                {
+                    const int fd = events[i].data.fd;
+                    if (fd == listener)
+                    {
+                        for (int client; (client = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0;)
+                        {
+                            const int on = 1;
+                            ::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                            epoll_event readable{};
+                            readable.events = EPOLLIN;
+                            readable.data.fd = client;
+                            ::epoll_ctl(poller, EPOLL_CTL_ADD, client, &readable);
+                            connections[client].id = ++nextId;
+                            ++accepted;
+                            peak = std::max(peak, connections.size());
+                        }
+                        continue;
+                    }
+                    const auto found = connections.find(fd);
+                    if (found == connections.end())
+                    {
+                        continue;
+                    }
+                    Connection& connection = found->second;
+                    if ((events[i].events & EPOLLOUT) != 0 && !flush(fd, connection))
+                    {
+                        continue;
+                    }
+                    if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0)
+                    {
+                        char buffer[16 * 1024];
+                        ssize_t received;
+                        while ((received = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+                        {
+                            connection.input.append(buffer, static_cast<std::size_t>(received));
+                        }
+                        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                        {
+                            closeConnection(fd);
+                            continue;
+                        }
+                    }
+                    nextRequest(fd, connection);
+                }
+
+                for (const auto now = Clock::now(); !due.empty() && due.top().at <= now;)
+                {
+                    const Due next = due.top();
+                    due.pop();
+                    const auto found = connections.find(next.fd);
+                    if (found == connections.end() || found->second.id != next.id)
+                    {
+                        continue;
+                    }
+                    ++answered;
+                    found->second.output = std::move(found->second.response);
+                    if (flush(next.fd, found->second))
+                    {
+                        nextRequest(next.fd, found->second);
+                    }
+                }
+            }
+        }
+
+        pid_t child = -1;
+        std::uint16_t listenPort = 0;
+    };
+
+    struct Settings {
+        std::string scenario;
+        std::size_t requests = 0;
+        std::size_t threads = 16;
+        double budget = 0.05;
+        std::size_t largeBody = 64u << 20;
+        std::size_t downloads = 4;
+        ServerOptions server;
+    };
+
+    // Threads of this process, as the kernel counts them.
+    std::size_t threadCount()
+    {
+        std::ifstream status("/proc/self/status");
+        for (std::string line; std::getline(status, line);)
+        {
+            if (line.rfind("Threads:", 0) == 0)
+            {
+                return std::stoul(line.substr(8));
+            }
+        }
+        return 0;
+    }
+
+    double percentile(std::vector<double> values, double rank)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+        std::sort(values.begin(), values.end());
+        return values[std::min(values.size() - 1, static_cast<std::size_t>(rank * static_cast<double>(values.size())))];
+    }
+
+    void printLatencies(const std::vector<double>& milliseconds)
+    {
+        std::cout << "  latency p50 " << percentile(milliseconds, 0.50) << " ms, p95 " << percentile(milliseconds, 0.95)
+                  << " ms, p99 " << percentile(milliseconds, 0.99) << " ms\n";
+    }
+
+    // Sequential requests through one client, then through a new client (and connection) per request.
+    bool keepAlive(const Settings& settings)
+    {
+        const LoopbackServer server(settings.server);
+        const std::string url = server.url("/asset");
+        bool passed = true;
+        for (const bool reuse : {true, false})
+        {
+            const std::size_t connectionsBefore = server.stats()["connections"];
+            HttpClient shared;
+            std::vector<double> latencies;
+            latencies.reserve(settings.requests);
+            const auto start = Clock::now();
+            for (std::size_t i = 0; i < settings.requests; ++i)
+            {
+                const auto sent = Clock::now();
+                if (reuse)
+                {
+                    shared.get(url);
+                }
+                else
+                {
+                    HttpClient().get(url);
+                }
+                latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - sent).count());
+            }
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            const std::size_t connections = server.stats()["connections"] - connectionsBefore - 1;
+            std::cout << (reuse ? "keep-alive" : "connection per request") << ": " << settings.requests
+                      << " requests over " << connections << " connections, "
+                      << static_cast<double>(settings.requests) / seconds << " requests/s\n";
+            printLatencies(latencies);
+            if (reuse)
+            {
+                passed = connections == 1 && shared.connectionsReused() + 1 == settings.requests;
+            }
+        }
+        return passed;
+    }
+
+    // Every request queued at once on an event loop with a single I/O thread, each on its own connection.
+    bool concurrency(const Settings& settings)
+    {
+        raiseDescriptorLimit();
+        const LoopbackServer server(settings.server);
+        const Url url = Url::parse(server.url("/asset"));
+
+        const std::size_t threadsBefore = threadCount();
+        HttpEventLoop::Options options;
+        options.ioThreads = 1;
+        options.maxConnectionsPerOrigin = settings.requests;
+        options.maxIdlePerOrigin = settings.requests;
+        HttpEventLoop loop(options);
+
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::size_t pending = settings.requests;
+        std::size_t failed = 0;
+        std::string firstError;
+        std::vector<double> latencies;
+        latencies.reserve(settings.requests);
+
+        const auto start = Clock::now();
+        for (std::size_t i = 0; i < settings.requests; ++i)
+        {
+            const auto sent = Clock::now();
+            loop.fetch(url, HttpRequest{}, [&, sent](HttpResponse&& response, std::exception_ptr error) {
+                const double latency = std::chrono::duration<double, std::milli>(Clock::now() - sent).count();
+                std::string message;
+                if (error)
+                {
+                    try
+                    {
+                        std::rethrow_exception(error);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        message = e.what();
+                    }
+                }
+                else if (response.status != 200 || response.body.size() != settings.server.bodySize)
+                {
+                    message = "unexpected response, status " + std::to_string(response.status);
+                }
+                const std::lock_guard lock(mutex);
+                if (!message.empty() && failed++ == 0)
+                {
+                    firstError = message;
+                }
+                latencies.push_back(latency);
+                if (--pending == 0)
+                {
+                    finished.notify_one();
+                }
+            });
+        }
+        const std::size_t threadsDuring = threadCount();
+        {
+            std::unique_lock lock(mutex);
+            finished.wait(lock, [&] { return pending == 0; });
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        const std::size_t peak = server.stats()["peak"];
+
+        std::cout << "event loop: " << settings.requests << " concurrent requests in " << seconds * 1000
+                  << " ms, " << failed << " failed, " << peak << " connections open at once on the server, "
+                  << threadsDuring - threadsBefore << " threads added to the process\n";
+        printLatencies(latencies);
+        if (failed != 0)
+        {
+            std::cout << "  first error: " << firstError << "\n";
+        }
+        // The /stats connection may be open on top of the requests.
+        return failed == 0 && peak >= settings.requests && threadsDuring - threadsBefore <= options.ioThreads;
+    }
+
+    // Runs `requests` requests spread over `threads` threads through `client` and returns their latencies.
+    std::vector<double> sendAll(HttpClient& client, const std::string& url, std::size_t requests, std::size_t threads)
+    {
+        std::vector<double> latencies(requests);
+        std::atomic<std::size_t> next{0};
+        std::atomic<std::size_t> failed{0};
+        auto run = [&]() {
+            for (std::size_t i = next.fetch_add(1); i < requests; i = next.fetch_add(1))
+            {
+                const auto sent = Clock::now();
+                try
+                {
+                    client.get(url);
+                }
+                catch (const std::exception&)
+                {
+                    failed.fetch_add(1);
+                }
+                latencies[i] = std::chrono::duration<double, std::milli>(Clock::now() - sent).count();
+            }
+        };
+        std::vector<std::thread> workers;
+        for (std::size_t i = 1; i < threads; ++i)
+        {
+            workers.emplace_back(run);
+        }
+        run();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        if (failed != 0)
+        {
+            throw std::runtime_error(std::to_string(failed.load()) + " requests failed");
+        }
+        return latencies;
+    }
+
+    // Sequential requests to a server answering a share of them late, without and with hedging, then
+    // concurrent requests on one hedged client, whose hedges must stay within the budget.
+    bool hedging(const Settings& settings)
+    {
+        const LoopbackServer server(settings.server);
+        const std::string url = server.url("/asset");
+        bool passed = true;
+        double plainTail = 0;
+        // The budget is below the slow share, hedging can only be expected to shorten the tail up to p95.
+
+        struct Run {
+            const char* name;
+            bool hedge;
+            std::size_t threads;
+        };
+        for (const Run& run : {Run{"no hedging", false, 1}, Run{"hedging", true, 1},
+                               Run{"hedging, concurrent", true, settings.threads}})
+        {
+            HttpClient::Options options;
+            options.hedge = run.hedge;
+            options.hedgeBudget = settings.budget;
+            options.concurrentRequests = run.threads;
+            HttpClient client(options);
+            const std::vector<double> latencies = sendAll(client, url, settings.requests, run.threads);
+            const double tail = percentile(latencies, 0.95);
+            const double allowed = settings.budget * static_cast<double>(settings.requests);
+
+            std::cout << run.name << ": " << settings.requests << " requests on " << run.threads << " threads";
+            if (run.hedge)
+            {
+                std::cout << ", " << client.hedgesIssued() << " hedges for a budget of " << allowed;
+            }
+            std::cout << "\n";
+            printLatencies(latencies);
+
+            if (!run.hedge)
+            {
+                plainTail = tail;
+                continue;
+            }
+            if (static_cast<double>(client.hedgesIssued()) > allowed)
+            {
+                std::cout << "  hedges exceed the budget\n";
+                passed = false;
+            }
+            if (run.threads == 1 && tail >= plainTail)
+            {
+                std::cout << "  hedging did not shorten the tail\n";
+                passed = false;
+            }
+        }
+        return passed;
+    }
+
+    // Checks that `response` holds the whole body of `size` bytes the loopback server sends.
+    bool completeBody(const HttpResponse& response, std::size_t size)
+    {
+        if (response.status != 200 || response.body.size() != size)
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            if (response.body.data()[i] != static_cast<unsigned char>(bodyByte(i)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Ranged downloads of small bodies, which must take one plain request each, then of a large body,
+    // which must be split into chunks, timed against plain downloads of the same body.
+    bool ranges(const Settings& settings)
+    {
+        RangedDownload::Options options;
+        options.chunkSize = 1u << 20;
+        options.parallelism = 4;
+        bool passed = true;
+        bool intact = true;
+
+        {
+            ServerOptions serverOptions = settings.server;
+            serverOptions.ranges = true;
+            const LoopbackServer server(serverOptions);
+            const Url url = Url::parse(server.url("/asset"));
+            HttpClient client;
+            const auto start = Clock::now();
+            for (std::size_t i = 0; i < settings.requests; ++i)
+            {
+                intact = completeBody(RangedDownload::get(client, url, options), serverOptions.bodySize) && intact;
+            }
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            auto stats = server.stats();
+            std::cout << "small bodies: " << settings.requests << " downloads of " << serverOptions.bodySize
+                      << " bytes, " << stats["requests"] << " requests, " << stats["ranged"]
+                      << " ranged, "
+                      << static_cast<double>(settings.requests) / seconds << " downloads/s\n";
+            if (stats["ranged"] != 0 || stats["requests"] != settings.requests)
+            {
+                std::cout << "  small bodies were not downloaded with one plain request\n";
+                passed = false;
+            }
+        }
+
+        ServerOptions serverOptions = settings.server;
+        serverOptions.ranges = true;
+        serverOptions.bodySize = settings.largeBody;
+        const LoopbackServer server(serverOptions);
+        const Url url = Url::parse(server.url("/asset"));
+        const std::size_t chunks = (serverOptions.bodySize + options.chunkSize - 1) / options.chunkSize;
+        for (const bool split : {false, true})
+        {
+            HttpClient client;
+            const std::size_t rangedBefore = server.stats()["ranged"];
+            std::vector<double> latencies;
+            for (std::size_t i = 0; i < settings.downloads; ++i)
+            {
+                const auto sent = Clock::now();
+                const HttpResponse response = split ? RangedDownload::get(client, url, options) : client.send(url, HttpRequest{});
+                latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - sent).count());
+                intact = completeBody(response, serverOptions.bodySize) && intact;
+            }
+            const std::size_t rangedRequests = server.stats()["ranged"] - rangedBefore;
+            const double megabytes = static_cast<double>(serverOptions.bodySize) / (1 << 20);
+            std::cout << (split ? "ranged" : "plain") << ": " << settings.downloads << " downloads of " << megabytes
+                      << " MiB, " << rangedRequests << " range requests, "
+                      << megabytes * 1000 / percentile(latencies, 0.5) << " MiB/s at the median\n";
+            printLatencies(latencies);
+            if (rangedRequests != (split && chunks > 1 ? chunks * settings.downloads : 0))
+            {
+                std::cout << "  expected " << chunks << " range requests per ranged download\n";
+                passed = false;
+            }
+        }
+        if (!intact)
+        {
+            std::cout << "  a body was not received intact\n";
+        }
+        return passed && intact;
+    }
+
+    void printUsage(const char* program)
+    {
+        std::cerr << "usage: " << program << " keepalive|concurrency|hedge|ranges [--requests N] [--body BYTES] [--delay MS]\n"
+                  << "       [--slow-share FRACTION] [--slow-delay MS] [--budget FRACTION] [--threads N]\n"
+                  << "  Runs a scenario against a loopback server answering after --delay milliseconds with bodies\n"
+                  << "  of --body bytes, and --slow-share of the responses --slow-delay milliseconds later. Exits\n"
+                  << "  with 1 when the expected behaviour is not observed.\n"
+                  << "  keepalive    N sequential requests reuse one connection (default N: 2000)\n"
+                  << "  concurrency  N requests in flight at once on one event loop thread (default N: 10000)\n"
+                  << "  hedge        N requests without and with hedging within --budget, sequential then on\n"
+                  << "               --threads threads (default N: 400, slow share 0.08, budget 0.05)\n"
+                  << "  ranges       N ranged downloads of --body bytes, which must not be split, then 4 of a 64 MiB\n"
+                  << "               body split into 1 MiB ranges, timed against plain downloads (default N: 200)"
+                  << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    try
+    {
+        if (argc < 2)
+        {
+            throw std::invalid_argument("missing scenario");
+        }
+        settings.scenario = argv[1];
+        for (int i = 2; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (argument == "--requests" && hasValue)
+            {
+                settings.requests = std::stoul(argv[++i]);
+            }
+            else if (argument == "--body" && hasValue)
+            {
+                settings.server.bodySize = std::stoul(argv[++i]);
+            }
+            else if (argument == "--delay" && hasValue)
+            {
+                settings.server.delay = std::chrono::milliseconds(std::stoul(argv[++i]));
+            }
+            else if (argument == "--slow-share" && hasValue)
+            {
+                settings.server.slowShare = std::stod(argv[++i]);
+            }
+            else if (argument == "--slow-delay" && hasValue)
+            {
+                settings.server.slowDelay = std::chrono::milliseconds(std::stoul(argv[++i]));
+            }
+            else if (argument == "--budget" && hasValue)
+            {
+                settings.budget = std::stod(argv[++i]);
+            }
+            else if (argument == "--threads" && hasValue)
+            {
+                settings.threads = std::max<std::size_t>(1, std::stoul(argv[++i]));
+            }
+            else
+            {
+                throw std::invalid_argument("unknown argument " + argument);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    std::cout << std::fixed << std::setprecision(2);
+    try
+    {
+        bool passed;
+        if (settings.scenario == "keepalive")
+        {
+            settings.requests = settings.requests != 0 ? settings.requests : 2000;
+            passed = keepAlive(settings);
+        }
+        else if (settings.scenario == "concurrency")
+        {
+            settings.requests = settings.requests != 0 ? settings.requests : 10000;
+            passed = concurrency(settings);
+        }
+        else if (settings.scenario == "hedge")
+        {
+            settings.requests = settings.requests != 0 ? settings.requests : 400;
+            settings.server.slowShare = settings.server.slowShare != 0 ? settings.server.slowShare : 0.08;
+            passed = hedging(settings);
+        }
+        else if (settings.scenario == "ranges")
+        {
+            settings.requests = settings.requests != 0 ? settings.requests : 200;
+            passed = ranges(settings);
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 2;
+        }
+        std::cout << (passed ? "passed" : "FAILED") << std::endl;
+        return passed ? 0 : 1;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,176 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/utils/JsonDocument.h"
+#include "../src/utils/JsonIndex.h"
+
+namespace {
+
+    // A manifest-like document of about `size` bytes: objects of strings, numbers and literals.
+    std::string generate(std::size_t size, std::mt19937& random)
+    {
+        std::string json = "{\"assets\":[";
+        for (std::size_t i = 0; json.size() < size; ++i)
+        {
+            if (i != 0)
+            {
+                json += ',';
+            }
+            json += "\n  {\"uri\": \"file:///assets/textures/tile_" + std::to_string(random() % 100000) +
+                    ".png\", \"size\": " + std::to_string(random() % 10000000) + ", \"scale\": " +
+                    std::to_string(static_cast<double>(random() % 1000) / 7.0) +
+                    ", \"tags\": [\"diffuse\", \"srgb\\u00e9\"], \"mipmaps\": " + (random() % 2 ? "true" : "false") +
+                    ", \"parent\": null}";
+        }
+        json += "\n]}";
+        return json;
+    }
+
+    std::string readFile(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (!in && !in.eof())
+        {
+            throw std::runtime_error("unable to read " + path);
+        }
+        return content;
+    }
+
+    // Runs `round` for about `seconds` and returns the throughput in bytes of `size` per second.
+    template <class Round>
+    double measure(std::size_t size, double seconds, Round&& round)
+    {
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+        std::size_t rounds = 0;
+        double elapsed = 0;
+        do
+        {
+            round();
+            ++rounds;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        while (elapsed < seconds);
+        return static_cast<double>(rounds * size) / elapsed;
+    }
+
+    using Builder = bool (*)(JsonIndex&, const unsigned char*, std::size_t);
+}
+
+int main(int argc, char** argv)
+{
+    // Numbers are sizes of generated documents, other arguments files to parse.
+    std::vector<std::pair<std::string, std::string>> documents;
+    std::mt19937 random(42);
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            if (argument.find_first_not_of("0123456789") == std::string::npos)
+            {
+                documents.emplace_back("generated " + argument + " bytes", generate(std::stoul(argument), random));
+            }
+            else
+            {
+                documents.emplace_back(argument, readFile(argument));
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+    if (documents.empty())
+    {
+        for (const std::size_t size : {1024, 64 * 1024, 4 * 1024 * 1024})
+        {
+            documents.emplace_back("generated " + std::to_string(size) + " bytes", generate(size, random));
+        }
+    }
+
+    struct Candidate {
+        const char* name;
+        Builder builder;
+        bool supported;
+    };
+#if defined(JSONINDEX_X86_DISPATCH)
+    __builtin_cpu_init();
+#endif
+    const Candidate candidates[] = {
+        {"scalar", JsonIndex::buildScalar, true},
+#if defined(JSONINDEX_X86_DISPATCH)
+        {"sse4.2", JsonIndex::buildSse42, __builtin_cpu_supports("sse4.2") != 0},
+        {"avx2", JsonIndex::buildAvx2, __builtin_cpu_supports("avx2") != 0},
+#endif
+    };
+
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto& [name, text] : documents)
+    {
+        const auto* bytes = reinterpret_cast<const unsigned char*>(text.data());
+        std::cout << name << ":\n";
+
+        // Every kernel must find the same structurals as the scalar one.
+        JsonIndex reference;
+        if (!JsonIndex::buildScalar(reference, bytes, text.size()))
+        {
+            std::cerr << "  not a valid json document" << std::endl;
+            return 1;
+        }
+        double scalar = 0;
+        for (const Candidate& candidate : candidates)
+        {
+            if (!candidate.supported)
+            {
+                continue;
+            }
+            JsonIndex index;
+            if (!candidate.builder(index, bytes, text.size()) || index.size() != reference.size() ||
+                std::memcmp(index.positions(), reference.positions(), index.size() * sizeof(std::uint32_t)) != 0)
+            {
+                std::cerr << candidate.name << " found wrong structurals" << std::endl;
+                return 1;
+            }
+            const double throughput = measure(text.size(), 0.5, [&] {
+                candidate.builder(index, bytes, text.size());
+            });
+            if (scalar == 0)
+            {
+                scalar = throughput;
+            }
+            std::cout << "  index " << std::setw(7) << candidate.name << " " << std::setw(8) << throughput / 1e9
+                      << " GB/s  x" << throughput / scalar << "\n";
+        }
+
+        const auto owner = std::make_shared<const std::string>(text);
+        const BufferSlice slice(owner, owner->data(), owner->size());
+        try
+        {
+            const double throughput = measure(text.size(), 0.5, [&] {
+                JsonDocument::parse(slice);
+            });
+            std::cout << "  parse " << std::setw(16) << throughput / 1e9 << " GB/s, "
+                      << reference.size() << " structurals\n";
+        }
+        catch (const std::invalid_argument& e)
+        {
+            std::cerr << "  " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+﻿//
+// Created by juanp on 4/16/2025.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <zdict.h>
+#include <zstd.h>
+
+#include "../src/actions/Decompress/ZstdDecoder.h"
+
+namespace {
+
+    namespace fs = std::filesystem;
+
+    struct Settings {
+        std::string output;
+        std::vector<fs::path> samples;
+        std::size_t dictionarySize = 112640;
+        std::size_t maxSampleSize = 128 * 1024;
+        int level = 19;
+    };
+
+    struct Totals {
+        std::size_t compressed = 0;
+        double decodeSeconds = 0;
+    };
+
+    void printUsage(const char* program)
+    {
+        std::cerr << "usage: " << program << " [--size BYTES] [--max-sample BYTES] [--level N] OUTPUT SAMPLE...\n"
+                  << "  --size BYTES        maximum dictionary size (default: 112640)\n"
+                  << "  --max-sample BYTES  skip samples larger than this, they gain little from a dictionary\n"
+                  << "                      (default: 131072)\n"
+                  << "  --level N           compression level of the comparison (default: 19)\n"
+                  << "  SAMPLE              a sample file, or a directory whose files are all samples"
+                  << std::endl;
+    }
+
+    std::string readFile(const fs::path& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string content(fs::file_size(path), '\0');
+        in.read(content.data(), static_cast<std::streamsize>(content.size()));
+        if (!in)
+        {
+            throw std::runtime_error("unable to read " + path.string());
+        }
+        return content;
+    }
+
+    void collect(const fs::path& path, const Settings& settings, std::vector<std::string>& samples)
+    {
+        auto add = [&](const fs::path& file) {
+            if (fs::file_size(file) != 0 && fs::file_size(file) <= settings.maxSampleSize)
+            {
+                samples.push_back(readFile(file));
+            }
+        };
+        if (!fs::is_directory(path))
+        {
+            add(path);
+            return;
+        }
+        for (const auto& file : fs::recursive_directory_iterator(path))
+        {
+            if (file.is_regular_file())
+            {
+                add(file.path());
+            }
+        }
+    }
+
+    /**
+     * Compresses every sample on its own, with `dictionary` when given, then decodes them all back
+     * through `ZstdDecoder`, the way the pipeline decodes them.
+     */
+    Totals measure(const std::vector<std::string>& samples, int level, const ZSTD_CDict* dictionary)
+    {
+        ZSTD_CCtx* context = ::ZSTD_createCCtx();
+        std::vector<std::vector<unsigned char>> frames(samples.size());
+        Totals totals;
+        for (std::size_t i = 0; i < samples.size(); ++i)
+        {
+            std::vector<unsigned char>& frame = frames[i];
+            frame.resize(::ZSTD_compressBound(samples[i].size()));
+            const std::size_t size =
+                dictionary != nullptr
+                    ? ::ZSTD_compress_usingCDict(context, frame.data(), frame.size(), samples[i].data(),
+                                                 samples[i].size(), dictionary)
+                    : ::ZSTD_compressCCtx(context, frame.data(), frame.size(), samples[i].data(), samples[i].size(),
+                                          level);
+            if (::ZSTD_isError(size))
+            {
+                ::ZSTD_freeCCtx(context);
+                throw std::runtime_error(std::string("compression failed: ") + ::ZSTD_getErrorName(size));
+            }
+            frame.resize(size);
+            totals.compressed += size;
+        }
+        ::ZSTD_freeCCtx(context);
+
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < frames.size(); ++i)
+        {
+            BufferSlice decoded;
+            if (!ZstdDecoder::decodeFrame(frames[i].data(), frames[i].size(), decoded) ||
+                decoded.size() != samples[i].size() ||
+                !std::equal(samples[i].begin(), samples[i].end(), decoded.data()))
+            {
+                throw std::runtime_error("sample " + std::to_string(i) + " does not decode back");
+            }
+        }
+        totals.decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return totals;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (argument == "--size" && hasValue)
+        {
+            settings.dictionarySize = std::stoull(argv[++i]);
+        }
+        else if (argument == "--max-sample" && hasValue)
+        {
+            settings.maxSampleSize = std::stoull(argv[++i]);
+        }
+        else if (argument == "--level" && hasValue)
+        {
+            settings.level = std::clamp(std::stoi(argv[++i]), 1, ::ZSTD_maxCLevel());
+        }
+        else if (!argument.starts_with("--"))
+        {
+            positional.push_back(argument);
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (positional.size() < 2)
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+    settings.output = positional[0];
+    settings.samples.assign(positional.begin() + 1, positional.end());
+
+    try
+    {
+        std::vector<std::string> samples;
+        for (const fs::path& path : settings.samples)
+        {
+            collect(path, settings, samples);
+        }
+        std::string concatenated;
+        std::vector<std::size_t> sampleSizes;
+        for (const std::string& sample : samples)
+        {
+            concatenated += sample;
+            sampleSizes.push_back(sample.size());
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<unsigned char> dictionary(settings.dictionarySize);
+        const std::size_t size = ::ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), concatenated.data(),
+                                                         sampleSizes.data(), static_cast<unsigned>(sampleSizes.size()));
+        if (::ZDICT_isError(size))
+        {
+            throw std::runtime_error(std::string("training failed on ") + std::to_string(samples.size()) +
+                                     " samples: " + ::ZDICT_getErrorName(size));
+        }
+        dictionary.resize(size);
+        const double trainSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::ofstream out(settings.output, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(dictionary.data()), static_cast<std::streamsize>(dictionary.size()));
+        out.close();
+        if (!out)
+        {
+            throw std::runtime_error("unable to write " + settings.output);
+        }
+
+        // Compare the samples compressed alone and with the dictionary, decoded as the pipeline does.
+        const std::uint32_t id = ZstdDecoder::loadDictionary(settings.output);
+        ZSTD_CDict* digested = ::ZSTD_createCDict(dictionary.data(), dictionary.size(), settings.level);
+        const Totals alone = measure(samples, settings.level, nullptr);
+        const Totals shared = measure(samples, settings.level, digested);
+        ::ZSTD_freeCDict(digested);
+
+        auto percent = [&](std::size_t bytes) {
+            return concatenated.empty() ? 100.0 : 100.0 * static_cast<double>(bytes) / static_cast<double>(concatenated.size());
+        };
+        auto perSample = [&](double seconds) {
+            return samples.empty() ? 0.0 : seconds * 1e6 / static_cast<double>(samples.size());
+        };
+        std::cout << std::fixed << std::setprecision(2)
+                  << "dictionary: " << settings.output << ", id " << id << ", " << dictionary.size() << " bytes\n"
+                  << "samples:    " << samples.size() << ", " << concatenated.size() << " bytes\n"
+                  << "alone:      " << alone.compressed << " bytes (" << percent(alone.compressed) << "%), decode "
+                  << perSample(alone.decodeSeconds) << " us/sample\n"
+                  << "dictionary: " << shared.compressed << " bytes (" << percent(shared.compressed) << "%), decode "
+                  << perSample(shared.decodeSeconds) << " us/sample\n"
+                  << "train time: " << trainSeconds << " s" << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Unable to train a dictionary: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}